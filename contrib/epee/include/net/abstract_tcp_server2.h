@@ -45,6 +45,7 @@
 #include <boost/interprocess/detail/atomic.hpp>
 #include <boost/thread/thread.hpp>
 #include "net_utils_base.h"
+#include "bandwidth_limiter.h"
 #include "syncobj.h"
 
 
@@ -76,7 +77,7 @@ namespace net_utils
     typedef typename t_protocol_handler::connection_context t_connection_context;
     /// Construct a connection with the given io_service.
     explicit connection(boost::asio::io_service& io_service,
-      typename t_protocol_handler::config_type& config, volatile uint32_t& sock_count, i_connection_filter * &pfilter);
+      typename t_protocol_handler::config_type& config, volatile uint32_t& sock_count, i_connection_filter * &pfilter, bandwidth_limiter& limiter);
 
     virtual ~connection();
     /// Get the socket associated with the connection.
@@ -93,6 +94,8 @@ namespace net_utils
   private:
     //----------------- i_service_endpoint ---------------------
     virtual bool do_send(const void* ptr, size_t cb);
+    virtual bool do_send_shared(const void* head_ptr, size_t head_cb, const shared_send_buffer& body, send_priority priority);
+    virtual size_t get_send_queue_size();
     virtual bool close();
     virtual bool call_run_once_service_io();
     virtual bool request_callback();
@@ -102,6 +105,11 @@ namespace net_utils
     //------------------------------------------------------
     boost::shared_ptr<connection<t_protocol_handler> > safe_shared_from_this();
     bool shutdown();
+    bool enqueue_send(const void* head_ptr, size_t head_cb, const shared_send_buffer& body, send_priority priority);
+    void start_write_que_front(const boost::shared_ptr<connection<t_protocol_handler> >& self);
+    void start_read(const boost::shared_ptr<connection<t_protocol_handler> >& self);
+    void handle_send_timer(const boost::system::error_code& e);
+    void handle_recv_timer(const boost::system::error_code& e);
     /// Handle completion of a read operation.
     void handle_read(const boost::system::error_code& e,
       std::size_t bytes_transferred);
@@ -121,8 +129,22 @@ namespace net_utils
     t_connection_context context;
     volatile uint32_t m_want_close_connection;
     std::atomic<bool> m_was_shutdown;
+    /// Send queue item: owned head (or whole small message) plus optional body shared with other connections.
+    struct send_que_entry
+    {
+      std::string head;
+      shared_send_buffer body;
+      send_priority priority;
+    };
     critical_section m_send_que_lock;
-    std::list<std::string> m_send_que;
+    std::list<send_que_entry> m_send_que;
+    /// Bytes of the front entry already written, front entry goes out in chunks when upload is limited.
+    size_t m_send_que_front_offset;
+    bandwidth_limiter& m_limiter;
+    token_bucket m_peer_up;   //guarded by m_send_que_lock
+    token_bucket m_peer_down; //touched only from read handlers
+    boost::asio::deadline_timer m_send_timer;
+    boost::asio::deadline_timer m_recv_timer;
     volatile uint32_t& m_ref_sockets_count;
     i_connection_filter* &m_pfilter;
     volatile bool m_is_multithreaded;
@@ -167,6 +189,13 @@ namespace net_utils
 
     void set_threads_prefix(const std::string& prefix_name);
 
+    /// Give each worker thread its own io_service and spread connections among them round-robin,
+    /// so a connection is always served by the same thread. Call before init_server().
+    /// Acceptor, idle handlers and async_call() stay on the main io_service, connections never go there.
+    void set_io_service_per_thread(size_t threads_count);
+
+    size_t get_io_services_count(){return m_thread_io_services.size() + 1;}
+
     bool deinit_server(){return true;}
 
     size_t get_threads_count(){return m_threads_count;}
@@ -181,6 +210,8 @@ namespace net_utils
 
     int get_binded_port(){return m_port;}
 
+    bandwidth_limiter& get_bandwidth_limiter(){return m_limiter;}
+
     boost::asio::io_service& get_io_service(){return io_service_;}
 
     struct idle_callback_conext_base
@@ -257,9 +288,19 @@ namespace net_utils
 
     bool is_thread_worker();
 
+    boost::asio::io_service& get_io_service_for_thread(size_t thread_index);
+    boost::asio::io_service& pick_io_service_for_connection();
+
     /// The io_service used to perform asynchronous operations.
     std::unique_ptr<boost::asio::io_service> m_io_service_local_instance;
     boost::asio::io_service& io_service_;    
+    /// Extra io_services of io_service per thread mode, io_service_ serves as the first one.
+    /// Declared before anything holding sockets, so they are destroyed last.
+    std::vector<std::unique_ptr<boost::asio::io_service> > m_thread_io_services;
+    std::vector<std::unique_ptr<boost::asio::io_service::work> > m_thread_io_works;
+    std::atomic<uint32_t> m_next_io_service;
+    /// Referenced by every connection, so constructed before any of them.
+    bandwidth_limiter m_limiter;
 
     /// Acceptor used to listen for incoming connections.
     boost::asio::ip::tcp::acceptor acceptor_;
@@ -49,16 +49,23 @@ DISABLE_VS_WARNINGS(4355)
 
   template<class t_protocol_handler>
   connection<t_protocol_handler>::connection(boost::asio::io_service& io_service,
-    typename t_protocol_handler::config_type& config, volatile uint32_t& sock_count, i_connection_filter* &pfilter)
+    typename t_protocol_handler::config_type& config, volatile uint32_t& sock_count, i_connection_filter* &pfilter, bandwidth_limiter& limiter)
                           : strand_(io_service),
                             socket_(io_service),
                             m_protocol_handler(this, config, context), 
                             m_want_close_connection(0), 
                             m_was_shutdown(0), 
+                            m_send_que_front_offset(0),
+                            m_limiter(limiter),
+                            m_send_timer(io_service),
+                            m_recv_timer(io_service),
                             m_ref_sockets_count(sock_count), 
                             m_pfilter(pfilter)
   {
     boost::interprocess::ipcdetail::atomic_inc32(&m_ref_sockets_count);
+    uint64_t now = misc_utils::get_tick_count();
+    m_peer_up.set_rate(limiter.get_peer_up_rate(), now);
+    m_peer_down.set_rate(limiter.get_peer_down_rate(), now);
   }
 DISABLE_VS_WARNINGS(4355)
   //---------------------------------------------------------------------------------
@@ -140,11 +147,7 @@ DISABLE_VS_WARNINGS(4355)
 
     m_protocol_handler.after_init_connection();
 
-    socket_.async_read_some(boost::asio::buffer(buffer_),
-      strand_.wrap(
-        boost::bind(&connection<t_protocol_handler>::handle_read, self,
-          boost::asio::placeholders::error,
-          boost::asio::placeholders::bytes_transferred)));
+    start_read(self);
 
 
     return true;
@@ -244,12 +247,19 @@ DISABLE_VS_WARNINGS(4355)
           shutdown();
       }else
       {
-        socket_.async_read_some(boost::asio::buffer(buffer_),
-          strand_.wrap(
-            boost::bind(&connection<t_protocol_handler>::handle_read, connection<t_protocol_handler>::shared_from_this(),
-              boost::asio::placeholders::error,
-              boost::asio::placeholders::bytes_transferred)));
-        LOG_PRINT_L4("[sock " << socket_.native_handle() << "]Assync read requested.");
+        uint64_t wait_ms = m_limiter.account_download(m_peer_down, bytes_transferred, misc_utils::get_tick_count());
+        if(wait_ms)
+        {
+          //download limit hit: stop reading for a while and let tcp flow control slow down the peer
+          LOG_PRINT_L4("[sock " << socket_.native_handle() << "] Read paused for " << wait_ms << "ms");
+          m_recv_timer.expires_from_now(boost::posix_time::milliseconds(wait_ms));
+          m_recv_timer.async_wait(strand_.wrap(
+            boost::bind(&connection<t_protocol_handler>::handle_recv_timer, connection<t_protocol_handler>::shared_from_this(), 
+              boost::asio::placeholders::error)));
+        }else
+        {
+          start_read(connection<t_protocol_handler>::shared_from_this());
+        }
       }
     }else
     {
@@ -268,6 +278,27 @@ DISABLE_VS_WARNINGS(4355)
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
+  void connection<t_protocol_handler>::start_read(const boost::shared_ptr<connection<t_protocol_handler> >& self)
+  {
+    socket_.async_read_some(boost::asio::buffer(buffer_),
+      strand_.wrap(
+        boost::bind(&connection<t_protocol_handler>::handle_read, self,
+          boost::asio::placeholders::error,
+          boost::asio::placeholders::bytes_transferred)));
+    LOG_PRINT_L4("[sock " << socket_.native_handle() << "]Assync read requested.");
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void connection<t_protocol_handler>::handle_recv_timer(const boost::system::error_code& e)
+  {
+    TRY_ENTRY();
+    if(e || m_was_shutdown)
+      return;
+    start_read(connection<t_protocol_handler>::shared_from_this());
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::handle_recv_timer", void());
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
   bool connection<t_protocol_handler>::call_run_once_service_io()
   {
     TRY_ENTRY();
@@ -295,6 +326,28 @@ DISABLE_VS_WARNINGS(4355)
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
   bool connection<t_protocol_handler>::do_send(const void* ptr, size_t cb)
+  {
+    return enqueue_send(ptr, cb, shared_send_buffer(), send_priority_normal);
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::do_send_shared(const void* head_ptr, size_t head_cb, const shared_send_buffer& body, send_priority priority)
+  {
+    return enqueue_send(head_ptr, head_cb, body, priority);
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  size_t connection<t_protocol_handler>::get_send_queue_size()
+  {
+    //queue of a shut down connection is never written, nothing to wait for
+    if(m_was_shutdown)
+      return 0;
+    CRITICAL_REGION_LOCAL(m_send_que_lock);
+    return m_send_que.size();
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  bool connection<t_protocol_handler>::enqueue_send(const void* head_ptr, size_t head_cb, const shared_send_buffer& body, send_priority priority)
   {
     TRY_ENTRY();
     // Use safe_shared_from_this, because of this is public method and it can be called on the object being deleted
@@ -304,6 +357,7 @@ DISABLE_VS_WARNINGS(4355)
     if(m_was_shutdown)
       return false;
 
+    size_t cb = head_cb + (body ? body->size() : 0);
     LOG_PRINT("[sock " << socket_.native_handle() << "] SEND " << cb, LOG_LEVEL_4);
     context.m_last_send = time(NULL);
     context.m_send_cnt += cb;
@@ -319,8 +373,18 @@ DISABLE_VS_WARNINGS(4355)
       return false;
     }
 
-    m_send_que.resize(m_send_que.size()+1);
-    m_send_que.back().assign((const char*)ptr, cb);
+    // body is queued by reference, only the head is copied;
+    // the front entry may be partially written already, so new one goes behind it,
+    // but ahead of queued entries of lower priority
+    auto it = m_send_que.begin();
+    if(it != m_send_que.end())
+      ++it;
+    while(it != m_send_que.end() && it->priority <= priority)
+      ++it;
+    it = m_send_que.insert(it, send_que_entry());
+    it->head.assign((const char*)head_ptr, head_cb);
+    it->body = body;
+    it->priority = priority;
     
     if(m_send_que.size() > 1)
     {
@@ -334,18 +398,55 @@ DISABLE_VS_WARNINGS(4355)
         return false;
       }
 
-      boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front().data(), m_send_que.front().size()),
-        //strand_.wrap(
-        boost::bind(&connection<t_protocol_handler>::handle_write, self, _1, _2)
-        //)
-        );
-
-      LOG_PRINT_L4("[sock " << socket_.native_handle() << "] Assync send requested " << m_send_que.front().size());
+      start_write_que_front(self);
+      LOG_PRINT_L4("[sock " << socket_.native_handle() << "] Assync send requested " << cb);
     }
 
     return true;
 
-    CATCH_ENTRY_L0("connection<t_protocol_handler>::do_send", false);
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::enqueue_send", false);
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void connection<t_protocol_handler>::start_write_que_front(const boost::shared_ptr<connection<t_protocol_handler> >& self)
+  {
+    //should be called under m_send_que_lock; head and body go out in one gather write
+    const send_que_entry& e = m_send_que.front();
+    size_t body_size = e.body ? e.body->size() : 0;
+    size_t left = e.head.size() + body_size - m_send_que_front_offset;
+    size_t to_write = left;
+    if(m_peer_up.is_limited() || m_limiter.is_upload_limited())
+    {
+      uint64_t wait_ms = 0;
+      to_write = static_cast<size_t>(m_limiter.grant_upload(m_peer_up, std::min<size_t>(left, BANDWIDTH_LIMITER_MAX_WRITE_CHUNK), 
+        std::min<size_t>(left, BANDWIDTH_LIMITER_MIN_WRITE_CHUNK), e.priority, misc_utils::get_tick_count(), wait_ms));
+      if(!to_write)
+      {
+        //upload limit hit, the entry stays at the front until the timer fires
+        m_send_timer.expires_from_now(boost::posix_time::milliseconds(wait_ms));
+        m_send_timer.async_wait(boost::bind(&connection<t_protocol_handler>::handle_send_timer, self, boost::asio::placeholders::error));
+        return;
+      }
+    }
+
+    std::vector<boost::asio::const_buffer> buffers;
+    buffers.reserve(2);
+    size_t offset = m_send_que_front_offset;
+    if(offset < e.head.size())
+    {
+      size_t n = std::min(e.head.size() - offset, to_write);
+      buffers.push_back(boost::asio::buffer(e.head.data() + offset, n));
+      to_write -= n;
+      offset = e.head.size();
+    }
+    if(to_write && body_size)
+      buffers.push_back(boost::asio::buffer(e.body->data() + (offset - e.head.size()), to_write));
+
+    boost::asio::async_write(socket_, buffers,
+      //strand_.wrap(
+      boost::bind(&connection<t_protocol_handler>::handle_write, self, _1, _2)
+      //)
+      );
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
@@ -405,6 +506,14 @@ DISABLE_VS_WARNINGS(4355)
       return;
     }
 
+    m_send_que_front_offset += cb;
+    if(m_send_que_front_offset < m_send_que.front().head.size() + (m_send_que.front().body ? m_send_que.front().body->size() : 0))
+    {
+      //rest of the shaped entry
+      start_write_que_front(connection<t_protocol_handler>::shared_from_this());
+      return;
+    }
+    m_send_que_front_offset = 0;
     m_send_que.pop_front();
     if(m_send_que.empty())
     {
@@ -415,10 +524,7 @@ DISABLE_VS_WARNINGS(4355)
     }else
     {
       //have more data to send
-      boost::asio::async_write(socket_, boost::asio::buffer(m_send_que.front().data(), m_send_que.front().size()),
-        //strand_.wrap(
-          boost::bind(&connection<t_protocol_handler>::handle_write, connection<t_protocol_handler>::shared_from_this(), _1, _2));
-        //);
+      start_write_que_front(connection<t_protocol_handler>::shared_from_this());
     }
     CRITICAL_REGION_END();
 
@@ -428,6 +534,18 @@ DISABLE_VS_WARNINGS(4355)
     }
     CATCH_ENTRY_L0("connection<t_protocol_handler>::handle_write", void());
   }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  void connection<t_protocol_handler>::handle_send_timer(const boost::system::error_code& e)
+  {
+    TRY_ENTRY();
+    if(e || m_was_shutdown)
+      return;
+    CRITICAL_REGION_LOCAL(m_send_que_lock);
+    if(!m_send_que.empty())
+      start_write_que_front(connection<t_protocol_handler>::shared_from_this());
+    CATCH_ENTRY_L0("connection<t_protocol_handler>::handle_send_timer", void());
+  }
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
@@ -435,8 +553,8 @@ DISABLE_VS_WARNINGS(4355)
   boosted_tcp_server<t_protocol_handler>::boosted_tcp_server():
     m_io_service_local_instance(new boost::asio::io_service()),
     io_service_(*m_io_service_local_instance.get()),
+    m_next_io_service(0),
     acceptor_(io_service_),
-    new_connection_(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter)), 
     m_stop_signal_sent(false), m_port(0), m_sockets_count(0), m_threads_count(0), m_pfilter(NULL), m_thread_index(0)
   {
     m_thread_name_prefix = "NET";
@@ -445,8 +563,8 @@ DISABLE_VS_WARNINGS(4355)
   template<class t_protocol_handler>
   boosted_tcp_server<t_protocol_handler>::boosted_tcp_server(boost::asio::io_service& extarnal_io_service):
     io_service_(extarnal_io_service),
+    m_next_io_service(0),
     acceptor_(io_service_),
-    new_connection_(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter)), 
     m_stop_signal_sent(false), m_port(0), m_sockets_count(0), m_threads_count(0), m_pfilter(NULL), m_thread_index(0)
   {
     m_thread_name_prefix = "NET";
@@ -476,6 +594,8 @@ DISABLE_VS_WARNINGS(4355)
     acceptor_.listen();
     boost::asio::ip::tcp::endpoint binded_endpoint = acceptor_.local_endpoint();
     m_port = binded_endpoint.port();
+    //created here, not in constructor: limiter, filter and sockets counter are set up by now
+    new_connection_.reset(new connection<t_protocol_handler>(pick_io_service_for_connection(), m_config, m_sockets_count, m_pfilter, m_limiter));
     acceptor_.async_accept(new_connection_->socket(),
       boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
       boost::asio::placeholders::error));
@@ -507,11 +627,12 @@ POP_WARNINGS
     std::string thread_name = std::string("[") + m_thread_name_prefix;
     thread_name += boost::to_string(local_thr_index) + "]";
     log_space::log_singletone::set_thread_log_prefix(thread_name);
+    boost::asio::io_service& thread_io_service = get_io_service_for_thread(local_thr_index);
     while(!m_stop_signal_sent)
     {
       try
       {
-        io_service_.run();
+        thread_io_service.run();
       }
       catch(const std::exception& ex)
       {
@@ -534,6 +655,31 @@ POP_WARNINGS
   }
   //---------------------------------------------------------------------------------
   template<class t_protocol_handler>
+  void boosted_tcp_server<t_protocol_handler>::set_io_service_per_thread(size_t threads_count)
+  {
+    m_thread_io_services.clear();
+    for (size_t i = 1; i < threads_count; ++i)
+      m_thread_io_services.emplace_back(new boost::asio::io_service());
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  boost::asio::io_service& boosted_tcp_server<t_protocol_handler>::get_io_service_for_thread(size_t thread_index)
+  {
+    size_t i = thread_index % get_io_services_count();
+    return i ? *m_thread_io_services[i - 1] : io_service_;
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
+  boost::asio::io_service& boosted_tcp_server<t_protocol_handler>::pick_io_service_for_connection()
+  {
+    if (m_thread_io_services.empty())
+      return io_service_;
+    //main io_service's thread runs idle handlers, which make sync connects and handshakes,
+    //a connection served by that thread would wait for itself
+    return *m_thread_io_services[m_next_io_service++ % m_thread_io_services.size()];
+  }
+  //---------------------------------------------------------------------------------
+  template<class t_protocol_handler>
   void boosted_tcp_server<t_protocol_handler>::set_connection_filter(i_connection_filter* pfilter)
   {
     m_pfilter = pfilter;
@@ -546,8 +692,20 @@ POP_WARNINGS
     m_threads_count = threads_count;
     m_main_thread_id = boost::this_thread::get_id();
     log_space::log_singletone::set_thread_log_prefix("[SRV_MAIN]");
+    CHECK_AND_ASSERT_MES(m_thread_io_services.size() < threads_count || !threads_count, false,
+      "Threads count " << threads_count << " is less than io_services count " << get_io_services_count());
     while(!m_stop_signal_sent)
     {
+      // thread index picks the io_service, so every io_service gets its thread again after restart
+      m_thread_index = 0;
+      // unlike io_service_ with its acceptor, per thread io_services may have nothing to do for a while
+      m_thread_io_works.clear();
+      for (auto& ios : m_thread_io_services)
+      {
+        ios->reset();
+        m_thread_io_works.emplace_back(new boost::asio::io_service::work(*ios));
+      }
+
 
       // Create a pool of threads to run all of the io_services.
       CRITICAL_REGION_BEGIN(m_threads_lock);
@@ -633,6 +791,9 @@ POP_WARNINGS
 //       c->cancel();
 //     }
 //     connections_mutex.unlock();
+    m_thread_io_works.clear();
+    for (auto& ios : m_thread_io_services)
+      ios->stop();
     io_service_.stop();
     CATCH_ENTRY_L0("boosted_tcp_server<t_protocol_handler>::send_stop_signal()", void());
   }
@@ -651,7 +812,7 @@ POP_WARNINGS
     {
       connection_ptr conn(std::move(new_connection_));
 
-      new_connection_.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter));
+      new_connection_.reset(new connection<t_protocol_handler>(pick_io_service_for_connection(), m_config, m_sockets_count, m_pfilter, m_limiter));
       acceptor_.async_accept(new_connection_->socket(),
         boost::bind(&boosted_tcp_server<t_protocol_handler>::handle_accept, this,
         boost::asio::placeholders::error));
@@ -669,7 +830,7 @@ POP_WARNINGS
   {
     TRY_ENTRY();
 
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter) );
+    connection_ptr new_connection_l(new connection<t_protocol_handler>(pick_io_service_for_connection(), m_config, m_sockets_count, m_pfilter, m_limiter) );
 //     connections_mutex.lock();
 //     connections_.push_back(new_connection_l);
 //     LOG_PRINT_L2("connections_ size now " << connections_.size());
@@ -757,7 +918,7 @@ POP_WARNINGS
     if (r)
     {
       new_connection_l->get_context(conn_context);
-      //new_connection_l.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter));
+      //new_connection_l.reset(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter, m_limiter));
     }
 
     return r;
@@ -769,7 +930,8 @@ POP_WARNINGS
   bool boosted_tcp_server<t_protocol_handler>::connect_async(const std::string& adr, const std::string& port, uint32_t conn_timeout, t_callback cb, const std::string& bind_ip)
   {
     TRY_ENTRY();    
-    connection_ptr new_connection_l(new connection<t_protocol_handler>(io_service_, m_config, m_sockets_count, m_pfilter) );
+    boost::asio::io_service& connection_io_service = pick_io_service_for_connection();
+    connection_ptr new_connection_l(new connection<t_protocol_handler>(connection_io_service, m_config, m_sockets_count, m_pfilter, m_limiter) );
     boost::asio::ip::tcp::socket&  sock_ = new_connection_l->socket();
 //     connections_mutex.lock();
 //     connections_.push_back(new_connection_l);
@@ -795,7 +957,7 @@ POP_WARNINGS
       sock_.bind(local_endpoint);
     }
     
-    boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(io_service_));
+    boost::shared_ptr<boost::asio::deadline_timer> sh_deadline(new boost::asio::deadline_timer(connection_io_service));
     //start deadline
     sh_deadline->expires_from_now(boost::posix_time::milliseconds(conn_timeout));
     sh_deadline->async_wait([=](const boost::system::error_code& error)
@@ -0,0 +1,196 @@
+// Copyright (c) 2006-2013, Andrey N. Sabelnikov, www.sabelnikov.net
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// * Neither the name of the Andrey N. Sabelnikov nor the
+// names of its contributors may be used to endorse or promote products
+// derived from this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER  BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+#include "syncobj.h"
+#include "net_utils_base.h"
+
+#define BANDWIDTH_LIMITER_MIN_BURST        16384
+#define BANDWIDTH_LIMITER_MAX_WRITE_CHUNK  16384
+#define BANDWIDTH_LIMITER_MIN_WRITE_CHUNK  1024
+#define BANDWIDTH_LIMITER_MAX_WAIT_MS      1000
+
+namespace epee
+{
+namespace net_utils
+{
+  /************************************************************************/
+  /* Token bucket, not thread safe: owner protects it                     */
+  /************************************************************************/
+  class token_bucket
+  {
+  public:
+    token_bucket():m_rate(0), m_burst(0), m_tokens(0), m_last_refill(0)
+    {}
+
+    //bytes_per_second == 0 means unlimited
+    void set_rate(uint64_t bytes_per_second, uint64_t now_ms)
+    {
+      m_rate = bytes_per_second;
+      m_burst = std::max<uint64_t>(bytes_per_second, BANDWIDTH_LIMITER_MIN_BURST);
+      m_tokens = static_cast<int64_t>(m_burst);
+      m_last_refill = now_ms;
+    }
+
+    uint64_t get_rate() const { return m_rate; }
+    bool is_limited() const { return m_rate != 0; }
+
+    //how many bytes (not more than wanted) the class may send right now without consuming them;
+    //returns 0 and sets wait_ms if less than min_grant is available
+    uint64_t peek(uint64_t wanted, uint64_t min_grant, send_priority priority, uint64_t now_ms, uint64_t& wait_ms)
+    {
+      if (!is_limited())
+        return wanted;
+      refill(now_ms);
+      int64_t available = m_tokens - get_reserve(priority);
+      if (available >= static_cast<int64_t>(min_grant))
+        return std::min<uint64_t>(wanted, static_cast<uint64_t>(available));
+
+      uint64_t missing = static_cast<uint64_t>(static_cast<int64_t>(min_grant) - available);
+      wait_ms = std::min<uint64_t>(missing * 1000 / m_rate + 1, BANDWIDTH_LIMITER_MAX_WAIT_MS);
+      return 0;
+    }
+
+    //bucket may go into debt here (download is accounted after the fact)
+    void consume(uint64_t cb, uint64_t now_ms)
+    {
+      if (!is_limited())
+        return;
+      refill(now_ms);
+      m_tokens -= static_cast<int64_t>(cb);
+    }
+
+    //time until the bucket gets out of debt
+    uint64_t get_debt_wait_ms(uint64_t now_ms)
+    {
+      if (!is_limited())
+        return 0;
+      refill(now_ms);
+      if (m_tokens > 0)
+        return 0;
+      return std::min<uint64_t>(static_cast<uint64_t>(-m_tokens) * 1000 / m_rate + 1, BANDWIDTH_LIMITER_MAX_WAIT_MS);
+    }
+
+  private:
+    void refill(uint64_t now_ms)
+    {
+      if (now_ms <= m_last_refill)
+        return;
+      uint64_t added = (now_ms - m_last_refill) * m_rate / 1000;
+      if (!added)
+        return; //keep fractions until they make a whole byte
+      m_tokens = std::min<int64_t>(m_tokens + static_cast<int64_t>(added), static_cast<int64_t>(m_burst));
+      m_last_refill = now_ms;
+    }
+
+    //lower classes leave part of the bucket to higher ones
+    int64_t get_reserve(send_priority priority) const
+    {
+      switch (priority)
+      {
+      case send_priority_high:   return 0;
+      case send_priority_normal: return static_cast<int64_t>(m_burst / 8);
+      default:                   return static_cast<int64_t>(m_burst / 4);
+      }
+    }
+
+    uint64_t m_rate;
+    uint64_t m_burst;
+    int64_t m_tokens;
+    uint64_t m_last_refill;
+  };
+
+  /************************************************************************/
+  /* Server wide limits, shared by all connections of the server          */
+  /************************************************************************/
+  class bandwidth_limiter
+  {
+  public:
+    bandwidth_limiter():m_peer_up_rate(0), m_peer_down_rate(0), m_up_limited(false)
+    {}
+
+    //all rates are bytes per second, 0 - unlimited; peer rates apply to connections created after the call
+    void set_limits(uint64_t up, uint64_t down, uint64_t peer_up, uint64_t peer_down, uint64_t now_ms)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      m_up.set_rate(up, now_ms);
+      m_down.set_rate(down, now_ms);
+      m_peer_up_rate = peer_up;
+      m_peer_down_rate = peer_down;
+      m_up_limited = up != 0;
+    }
+
+    //lock-free check for the unshaped fast path
+    bool is_upload_limited() const { return m_up_limited; }
+
+    uint64_t get_up_rate(){ CRITICAL_REGION_LOCAL(m_lock); return m_up.get_rate(); }
+    uint64_t get_down_rate(){ CRITICAL_REGION_LOCAL(m_lock); return m_down.get_rate(); }
+    uint64_t get_peer_up_rate(){ CRITICAL_REGION_LOCAL(m_lock); return m_peer_up_rate; }
+    uint64_t get_peer_down_rate(){ CRITICAL_REGION_LOCAL(m_lock); return m_peer_down_rate; }
+
+    //takes upload allowance from both peer and global buckets; 0 means wait wait_ms and retry
+    uint64_t grant_upload(token_bucket& peer, uint64_t wanted, uint64_t min_grant, send_priority priority, uint64_t now_ms, uint64_t& wait_ms)
+    {
+      uint64_t granted = peer.peek(wanted, min_grant, priority, now_ms, wait_ms);
+      if (!granted)
+        return 0;
+      CRITICAL_REGION_LOCAL(m_lock);
+      granted = m_up.peek(granted, std::min(min_grant, granted), priority, now_ms, wait_ms);
+      if (!granted)
+        return 0;
+      m_up.consume(granted, now_ms);
+      peer.consume(granted, now_ms);
+      return granted;
+    }
+
+    //accounts received bytes, returns how long reading should be paused
+    uint64_t account_download(token_bucket& peer, uint64_t cb, uint64_t now_ms)
+    {
+      peer.consume(cb, now_ms);
+      uint64_t wait_ms = peer.get_debt_wait_ms(now_ms);
+      CRITICAL_REGION_LOCAL(m_lock);
+      m_down.consume(cb, now_ms);
+      return std::max(wait_ms, m_down.get_debt_wait_ms(now_ms));
+    }
+
+  private:
+    critical_section m_lock;
+    token_bucket m_up;
+    token_bucket m_down;
+    uint64_t m_peer_up_rate;
+    uint64_t m_peer_down_rate;
+    std::atomic<bool> m_up_limited;
+  };
+}
+}
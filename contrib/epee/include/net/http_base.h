@@ -27,6 +27,7 @@
 
 
 #pragma once
+#include <functional>
 #include <boost/lexical_cast.hpp>
 #include <boost/regex.hpp>
 
@@ -156,18 +157,38 @@ namespace net_utils
 
 			void clear()
 			{
-				this->~http_request_info();
-				new(this) http_request_info();
+				//field by field, so that buffers are reused by the next request on the connection
+				m_http_method = http_method_unknown;
+				m_URI.clear();
+				m_http_method_str.clear();
+				m_full_request_str.clear();
+				m_replace_html.clear();
+				m_request_head.clear();
+				m_http_ver_hi = 0;
+				m_http_ver_lo = 0;
+				m_have_to_block = false;
+				m_header_info.clear();
+				m_uri_content.m_path.clear();
+				m_uri_content.m_query.clear();
+				m_uri_content.m_fragment.clear();
+				m_uri_content.m_query_params.clear();
+				m_full_request_buf_size = 0;
+				m_body.clear();
 			}
 		};
 
 
+		//takes next piece of body (may take its contents), returns false if it can't be sent
+		typedef std::function<bool(std::string& chunk)> body_chunk_sink;
+		typedef std::function<bool(const body_chunk_sink& sink)> body_stream_writer;
+
 		struct http_response_info 
 		{
 			int					m_response_code;
 			std::string			m_response_comment;
 			fields_list	        m_additional_fields;
 			std::string			m_body;
+			body_stream_writer  m_body_writer; //if set, used instead of m_body, body goes with chunked transfer encoding
 			std::string			m_mime_tipe;
 			http_header_info    m_header_info;
 			int                 m_http_ver_hi;// OUT paramter only
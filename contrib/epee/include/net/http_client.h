@@ -48,6 +48,9 @@
 #include "to_nonconst_iterator.h"
 #include "net_parse_helpers.h"
 
+//body is read directly in steps of this size, so Content-Length alone can't make client allocate much
+#define HTTP_CLIENT_BODY_READ_STEP     (4 * 1024 * 1024)
+
 //#include "shlwapi.h"
 
 //#pragma comment(lib, "shlwapi.lib")
@@ -168,7 +171,9 @@ namespace epee
       class http_simple_client : public i_target_handler
       {
       public:
-
+        http_simple_client():m_timeout(0), m_state(reciev_machine_state_header), m_chunked_state(http_chunked_state_undefined),
+          m_response_started(false), m_body_read_directly(false), m_len_in_summary(0), m_len_in_remain(0)
+        {}
 
       private:
         enum reciev_machine_state
@@ -202,6 +207,8 @@ namespace epee
         reciev_machine_state m_state;
         chunked_state m_chunked_state;
         std::string m_chunked_cache;
+        bool m_response_started;
+        bool m_body_read_directly;
         critical_section m_lock;
       protected:
         uint64_t m_len_in_summary;
@@ -214,6 +221,15 @@ namespace epee
           m_host_buff = name;
         }
 
+        //server to connect to on the first invoke
+        void set_server(const std::string& host, const std::string& port, unsigned int timeout)
+        {
+          CRITICAL_REGION_LOCAL(m_lock);
+          m_host_buff = host;
+          m_port = port;
+          m_timeout = timeout;
+        }
+
         boost::asio::ip::tcp::socket& get_socket()
         {
           return m_net_client.get_socket();
@@ -246,10 +262,19 @@ namespace epee
           return m_net_client.is_connected();
         }
         //---------------------------------------------------------------------------
+        bool is_alive()
+        {
+          CRITICAL_REGION_LOCAL(m_lock);
+          return m_net_client.is_alive();
+        }
+        //---------------------------------------------------------------------------
         virtual bool handle_target_data(std::string& piece_of_transfer)
         {
           CRITICAL_REGION_LOCAL(m_lock);
-          m_response_info.m_body += piece_of_transfer;
+          if (m_response_info.m_body.empty() && m_response_info.m_body.capacity() < piece_of_transfer.size())
+            m_response_info.m_body.swap(piece_of_transfer);
+          else
+            m_response_info.m_body += piece_of_transfer;
           piece_of_transfer.clear();
           return true;
         }
@@ -265,17 +290,63 @@ namespace epee
         inline bool invoke(const std::string& uri, const std::string& method, const std::string& body, const http_response_info** ppresponse_info = NULL, const fields_list& additional_params = fields_list())
         {
           CRITICAL_REGION_LOCAL(m_lock);
-          if (!is_connected())
+          if (ppresponse_info)
+            *ppresponse_info = &m_response_info;
+
+          std::string req_buff;
+          add_request_to_buff(req_buff, uri, method, body, additional_params);
+          for (bool retried = false;; retried = true)
           {
-            LOG_PRINT("Reconnecting...", LOG_LEVEL_3);
-            if (!connect(m_host_buff, m_port, m_timeout))
+            bool reused = false;
+            if (!connect_if_needed(reused))
+              return false;
+            m_response_info.clear();
+            bool res = m_net_client.send(req_buff);
+            if (res && handle_reciev())
+              return true;
+            //server may close idle keep-alive connection just before our request got there
+            if (!reused || m_response_started || retried)
             {
-              LOG_PRINT("Failed to connect to " << m_host_buff << ":" << m_port, LOG_LEVEL_3);
+              LOG_PRINT_L1("HTTP_CLIENT: Failed to " << (res ? "receive response" : "send request") << " " << uri);
               return false;
             }
+            LOG_PRINT_L3("HTTP_CLIENT: Keep-alive connection to " << m_host_buff << ":" << m_port << " was closed, resending " << uri);
+            disconnect();
           }
-          m_response_info.clear();
-          std::string req_buff = method + " ";
+        }
+        //---------------------------------------------------------------------------
+        inline bool invoke_post(const std::string& uri, const std::string& body, const http_response_info** ppresponse_info = NULL, const fields_list& additional_params = fields_list())
+        {
+          CRITICAL_REGION_LOCAL(m_lock);
+          return invoke(uri, "POST", body, ppresponse_info, additional_params);
+        }
+      protected:
+        //response body goes to m_response_info.m_body and may be read there directly
+        virtual bool is_body_buffered()
+        {
+          return true;
+        }
+      private:
+        //---------------------------------------------------------------------------
+        inline bool connect_if_needed(bool& reused)
+        {
+          reused = is_connected();
+          if (reused)
+            return true;
+          LOG_PRINT("Reconnecting...", LOG_LEVEL_3);
+          if (!connect(m_host_buff, m_port, m_timeout))
+          {
+            LOG_PRINT("Failed to connect to " << m_host_buff << ":" << m_port, LOG_LEVEL_3);
+            return false;
+          }
+          return true;
+        }
+        //---------------------------------------------------------------------------
+        inline void add_request_to_buff(std::string& req_buff, const std::string& uri, const std::string& method, const std::string& body, const fields_list& additional_params)
+        {
+          //header and body go in one write
+          req_buff.reserve(req_buff.size() + uri.size() + body.size() + 256);
+          req_buff += method + " ";
           req_buff += uri + " HTTP/1.1\r\n" +
             "Host: " + m_host_buff + "\r\n" + "Content-Length: " + boost::lexical_cast<std::string>(body.size()) + "\r\n";
 
@@ -289,26 +360,8 @@ namespace epee
             req_buff += it->first + ": " + it->second + "\r\n";
           req_buff += "\r\n";
           //--
-
-          bool res = m_net_client.send(req_buff);
-          CHECK_AND_ASSERT_MES(res, false, "HTTP_CLIENT: Failed to SEND");
-          if (body.size())
-            res = m_net_client.send(body);
-          CHECK_AND_ASSERT_MES(res, false, "HTTP_CLIENT: Failed to SEND");
-
-          if (ppresponse_info)
-            *ppresponse_info = &m_response_info;
-
-          m_state = reciev_machine_state_header;
-          return handle_reciev();
+          req_buff += body;
         }
-        //---------------------------------------------------------------------------
-        inline bool invoke_post(const std::string& uri, const std::string& body, const http_response_info** ppresponse_info = NULL, const fields_list& additional_params = fields_list())
-        {
-          CRITICAL_REGION_LOCAL(m_lock);
-          return invoke(uri, "POST", body, ppresponse_info, additional_params);
-        }
-      private:
         //---------------------------------------------------------------------------
         inline bool handle_reciev()
         {
@@ -316,6 +369,8 @@ namespace epee
           bool keep_handling = true;
           bool need_more_data = true;
           std::string recv_buffer;
+          m_response_started = false;
+          m_state = reciev_machine_state_header;
           while (keep_handling)
           {
             if (need_more_data)
@@ -325,6 +380,8 @@ namespace epee
                 LOG_PRINT("Unexpected reciec fail", LOG_LEVEL_3);
                 m_state = reciev_machine_state_error;
               }
+              if (recv_buffer.size())
+                m_response_started = true;
               if (!recv_buffer.size())
               {
                 //connection is going to be closed
@@ -363,12 +420,20 @@ namespace epee
           {
             if (m_response_info.m_header_info.m_connection.size() && !string_tools::compare_no_case("close", m_response_info.m_header_info.m_connection))
               disconnect();
+            else if (recv_buffer.size())
+            {
+              //bytes after the end of response, connection can't be reused
+              LOG_PRINT_L1("HTTP_CLIENT: " << recv_buffer.size() << " unexpected bytes after response, disconnecting");
+              disconnect();
+            }
 
             return true;
           }
           else
           {
             LOG_PRINT_L3("Returning false because of wrong state machine. state: " << m_state);
+            //position in the stream is unknown, connection can't be reused
+            disconnect();
             return false;
           }
         }
@@ -396,7 +461,7 @@ namespace epee
               analize_cached_header_and_invoke_state();
               m_header_cache.clear();
               if (!recv_buff.size() && (m_state != reciev_machine_state_error && m_state != reciev_machine_state_done))
-                need_more_data = true;
+                need_more_data = !(m_state == reciev_machine_state_body_content_len && m_body_read_directly);
 
               return true;
             }
@@ -409,21 +474,44 @@ namespace epee
           bool handle_body_content_len(std::string& recv_buff, bool& need_more_data)
         {
             CRITICAL_REGION_LOCAL(m_lock);
-            if (!recv_buff.size())
+            if (!recv_buff.size() && !m_body_read_directly)
             {
               LOG_PRINT("Warning: Content-Len mode, but connection unexpectedly closed", LOG_LEVEL_3);
               m_state = reciev_machine_state_done;
               return true;
             }
-            CHECK_AND_ASSERT_MES(m_len_in_remain >= recv_buff.size(), false, "m_len_in_remain >= recv_buff.size()");
+            //anything past content length belongs to the next response
+            std::string next_response_part;
+            if (recv_buff.size() > m_len_in_remain)
+            {
+              next_response_part.assign(recv_buff, static_cast<size_t>(m_len_in_remain), std::string::npos);
+              recv_buff.resize(static_cast<size_t>(m_len_in_remain));
+            }
             m_len_in_remain -= recv_buff.size();
             bool r = m_pcontent_encoding_handler->update_in(recv_buff);
+            recv_buff.swap(next_response_part);
             if (!r)
             {
               m_state = reciev_machine_state_error;
               return false;
             }
 
+            //the rest of the body is read right into its place, no intermediate buffers
+            while (m_len_in_remain && m_body_read_directly)
+            {
+              std::string& body = m_response_info.m_body;
+              size_t offset = body.size();
+              size_t step = static_cast<size_t>((std::min)(m_len_in_remain, static_cast<uint64_t>(HTTP_CLIENT_BODY_READ_STEP - offset % HTTP_CLIENT_BODY_READ_STEP)));
+              body.resize(offset + step);
+              if (!m_net_client.recv_n(&body[offset], step))
+              {
+                LOG_PRINT("Content-Len mode, failed to read " << m_len_in_remain << " bytes of body", LOG_LEVEL_3);
+                m_state = reciev_machine_state_error;
+                return false;
+              }
+              m_len_in_remain -= step;
+            }
+
             if (m_len_in_remain == 0)
               m_state = reciev_machine_state_done;
             else
@@ -581,6 +669,8 @@ namespace epee
                   if (m_len_in_remain == 0)
                   {//last chunk, let stop the stream and fix the chunk queue.
                     m_state = reciev_machine_state_done;
+                    recv_buff.swap(m_chunked_cache);
+                    m_chunked_cache.clear();
                     return true;
                   }
                   m_chunked_state = http_chunked_state_chunk_body;
@@ -715,6 +805,7 @@ namespace epee
         {
             STATIC_REGEXP_EXPR_1(rexp_match_gzip, "^.*?((gzip)|(deflate))", boost::regex::icase | boost::regex::normal);
             boost::smatch result;						//   12      3
+            m_body_read_directly = false;
             if (boost::regex_search(m_response_info.m_header_info.m_content_encoding, result, rexp_match_gzip, boost::match_default) && result[0].matched)
             {
 #ifdef HTTP_ENABLE_GZIP
@@ -728,6 +819,7 @@ namespace epee
             else
             {
               m_pcontent_encoding_handler.reset(new do_nothing_sub_handler(this));
+              m_body_read_directly = is_body_buffered();
             }
 
             return true;
@@ -769,6 +861,7 @@ namespace epee
               }
               m_state = reciev_machine_state_body_chunked;
               m_chunked_state = http_chunked_state_chunk_head;
+              m_chunked_cache.clear();
               return true;
             }
             else if (!m_response_info.m_header_info.m_content_length.empty())
@@ -789,6 +882,8 @@ namespace epee
               {
                 m_len_in_remain = m_len_in_summary;
                 m_state = reciev_machine_state_body_content_len;
+                if (m_body_read_directly)
+                  m_response_info.m_body.reserve(static_cast<size_t>((std::min)(m_len_in_summary, static_cast<uint64_t>(HTTP_CLIENT_BODY_READ_STEP))));
                 return true;
               }
             }
@@ -905,6 +1000,11 @@ namespace epee
           return r;
         }
 
+        virtual bool is_body_buffered()
+        {
+          return false;
+        }
+
       public:
         template<typename callback_t>
         bool invoke_cb(callback_t cb, const std::string& url, uint64_t timeout, const std::string& method = "GET", const std::string& body = std::string(), const fields_list& additional_params = fields_list())
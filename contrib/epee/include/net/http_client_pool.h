@@ -0,0 +1,167 @@
+// Copyright (c) 2006-2013, Andrey N. Sabelnikov, www.sabelnikov.net
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// * Neither the name of the Andrey N. Sabelnikov nor the
+// names of its contributors may be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER  BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "http_client.h"
+
+#define HTTP_CLIENT_POOL_DEFAULT_MAX_IDLE  4
+
+namespace epee
+{
+namespace net_utils
+{
+namespace http
+{
+  /************************************************************************/
+  /* Keep-alive clients of one server shared between threads: each call  */
+  /* takes an idle connected client or makes a new one, the lease gives   */
+  /* it back when the call is done.                                       */
+  /************************************************************************/
+  template<class t_client = http_simple_client>
+  class http_client_pool
+  {
+  public:
+    class lease
+    {
+    public:
+      lease(http_client_pool& pool, std::unique_ptr<t_client>&& client, uint64_t generation):
+        m_pool(pool), m_client(std::move(client)), m_generation(generation)
+      {}
+
+      lease(lease&& other):m_pool(other.m_pool), m_client(std::move(other.m_client)), m_generation(other.m_generation)
+      {}
+
+      ~lease()
+      {
+        if (m_client)
+          m_pool.release(std::move(m_client), m_generation);
+      }
+
+      t_client& operator*()
+      {
+        return *m_client;
+      }
+
+      t_client* operator->()
+      {
+        return m_client.get();
+      }
+
+    private:
+      lease(const lease&);
+      lease& operator=(const lease&);
+
+      http_client_pool& m_pool;
+      std::unique_ptr<t_client> m_client;
+      uint64_t m_generation;
+    };
+
+    http_client_pool(size_t max_idle = HTTP_CLIENT_POOL_DEFAULT_MAX_IDLE):m_max_idle(max_idle), m_timeout(0), m_generation(0)
+    {}
+
+    //clients of the previous server are dropped, the ones in use - when given back
+    void set_server(const std::string& host, const std::string& port, unsigned int timeout)
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_host = host;
+      m_port = port;
+      m_timeout = timeout;
+      ++m_generation;
+      m_idle.clear();
+    }
+
+    lease acquire()
+    {
+      std::unique_lock<std::mutex> guard(m_lock);
+      uint64_t generation = m_generation;
+      if (!m_idle.empty())
+      {
+        //most recently used one is the least likely to be closed by server as idle
+        std::unique_ptr<t_client> client = std::move(m_idle.back());
+        m_idle.pop_back();
+        return lease(*this, std::move(client), generation);
+      }
+      std::string host = m_host;
+      std::string port = m_port;
+      unsigned int timeout = m_timeout;
+      guard.unlock();
+
+      std::unique_ptr<t_client> client(new t_client());
+      client->set_server(host, port, timeout);
+      return lease(*this, std::move(client), generation);
+    }
+
+    //idle clients closed by server are dropped, true if any is left or a new one connects
+    bool check_connection()
+    {
+      std::unique_lock<std::mutex> guard(m_lock);
+      m_idle.erase(std::remove_if(m_idle.begin(), m_idle.end(), [](const std::unique_ptr<t_client>& client) { return !client->is_alive(); }), m_idle.end());
+      if (!m_idle.empty())
+        return true;
+      std::string host = m_host;
+      std::string port = m_port;
+      unsigned int timeout = m_timeout;
+      guard.unlock();
+
+      lease client = acquire();
+      return client->connect(host, port, timeout);
+    }
+
+    size_t get_idle_count()
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      return m_idle.size();
+    }
+
+  private:
+    void release(std::unique_ptr<t_client>&& client, uint64_t generation)
+    {
+      if (!client->is_connected())
+        return;
+      std::lock_guard<std::mutex> guard(m_lock);
+      if (generation == m_generation && m_idle.size() < m_max_idle)
+        m_idle.push_back(std::move(client));
+    }
+
+    size_t m_max_idle;
+    std::string m_host;
+    std::string m_port;
+    unsigned int m_timeout;
+    uint64_t m_generation;
+    std::vector<std::unique_ptr<t_client> > m_idle;
+    std::mutex m_lock;
+  };
+}
+}
+}
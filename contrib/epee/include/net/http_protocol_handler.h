@@ -34,6 +34,7 @@
 #include "net_utils_base.h"
 #include "to_nonconst_iterator.h"
 #include "http_base.h"
+#include "http_worker_pool.h"
 
 namespace epee
 {
@@ -86,6 +87,10 @@ namespace net_utils
 			}
 			virtual bool handle_recv(const void* ptr, size_t cb);
 			virtual bool handle_request(const http::http_request_info& query_info, http_response_info& response);
+			//response of request taken by handle_request_async(), may be called from any thread
+			void on_async_response(http_response_info& response);
+			//sends async response and goes on with pipelined requests, called on connection's strand
+			void handle_qued_callback();
     
       
       //temporary here
@@ -109,14 +114,11 @@ namespace net_utils
 				http_body_transfer_undefined
 			};
 
-			bool handle_buff_in(std::string& buf);
+			bool handle_buff_in();
 
 			bool analize_cached_request_header_and_invoke_state(size_t pos);
 
-			bool handle_invoke_query_line();
-			bool parse_cached_header(http_header_info& body_info, const std::string& m_cache_to_process, size_t pos);
-			std::string::size_type match_end_of_header(const std::string& buf);
-			bool get_len_from_content_lenght(const std::string& str, size_t& len);
+			bool handle_invoke_query_line(size_t line_len);
 			bool handle_retriving_query_body();
 			bool handle_query_measure();
 			bool set_ready_state();
@@ -126,12 +128,17 @@ namespace net_utils
 
 			//major function 
 			inline bool handle_request_and_send_response(const http::http_request_info& query_info);
+			inline bool send_response(const http::http_request_info& query_info, http_response_info& response);
+			inline bool send_streamed_response(http_response_info& response);
+			inline bool wait_send_queue_drained();
 
 
 			std::string get_not_found_response_body(const std::string& URI);
 
 			std::string m_root_path;
 			std::string m_cache;
+			size_t m_cache_pos; //data before it is already handled, dropped once per handle_recv
+			std::string m_send_buff; //responses to requests of current handle_recv
 			machine_state m_state;
 			body_transfer_type m_body_transfer_type;
 			bool m_is_stop_handling;
@@ -139,15 +146,29 @@ namespace net_utils
 			size_t m_len_summary, m_len_remain;
 			config_type& m_config;
 			bool m_want_close;
+			bool m_async_pending; //request is handled out of io thread, next pipelined ones wait in m_cache
+			critical_section m_async_lock;
+			bool m_async_response_ready;
+			http_response_info m_async_response;
 		protected:
+			//true if request is taken to be answered later by on_async_response()
+			virtual bool handle_request_async(const http::http_request_info& query_info)
+			{
+				return false;
+			}
+
+			http::http_request_info m_async_query_info; //copy of request being handled asynchronously
 			i_service_endpoint* m_psnd_hndlr; 
 		};
 
+
     template<class t_connection_context>
 		struct i_http_server_handler
 		{
 			virtual ~i_http_server_handler(){}
 			virtual bool handle_http_request(const http_request_info& query_info, http_response_info& response, t_connection_context& m_conn_context)=0;
+			//pool to call handle_http_request() on instead of io thread, NULL to handle request in place
+			virtual worker_pool* get_request_worker_pool(const http_request_info& query_info){return NULL;}
       virtual bool init_server_thread(){return true;}
 			virtual bool deinit_server_thread(){return true;}
 		};
@@ -192,13 +213,52 @@ namespace net_utils
 			{
 				return m_config.m_phandler->deinit_server_thread();
 			}
-      void handle_qued_callback()   
-      {}
 			bool after_init_connection()
 			{
 				return true;
 			}
 
+		protected:
+			virtual bool handle_request_async(const http_request_info& query_info)
+			{
+				CHECK_AND_ASSERT_MES(m_config.m_phandler, false, "m_config.m_phandler is NULL!!!!");
+				worker_pool* ppool = m_config.m_phandler->get_request_worker_pool(query_info);
+				if(!ppool)
+					return false;
+				//released by on_async_response(), connection has to outlive the job
+				if(!this->m_psnd_hndlr->add_ref())
+					return false;
+				this->m_async_query_info = query_info;
+				if(!ppool->post([this]()
+					{
+						http_response_info response;
+						try
+						{
+							handle_request(this->m_async_query_info, response);
+						}
+						catch(...)
+						{
+							//connection waits for this response, it has to come anyway
+							LOG_ERROR("Exception while handling " << this->m_async_query_info.m_URI);
+							response.clear();
+							response.m_response_code = 500;
+							response.m_response_comment = "Internal Server Error";
+						}
+						this->on_async_response(response);
+					}))
+				{
+					//queue is full: refuse instead of blocking io thread
+					LOG_PRINT_L1("Request " << query_info.m_URI << " refused, worker queue is full");
+					http_response_info response;
+					response.m_response_code = 503;
+					response.m_response_comment = "Service Unavailable";
+					response.m_mime_tipe = "text/plain";
+					response.m_body = "Server is busy";
+					this->on_async_response(response);
+				}
+				return true;
+			}
+
 		private:
 			//simple_http_connection_handler::config_type m_stub_config;
 			config_type& m_config;
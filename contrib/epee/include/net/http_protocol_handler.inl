@@ -27,6 +27,7 @@
 
 #include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/make_shared.hpp>
 #include "http_protocol_handler.h"
 #include "reg_exp_definer.h"
 #include "string_tools.h"
@@ -35,6 +36,14 @@
 
 #define HTTP_MAX_URI_LEN		 9000 
 #define HTTP_MAX_HEADER_LEN		 100000
+#define HTTP_MAX_PREALLOCATED_BODY_LEN 1048576
+#define HTTP_MAX_COALESCED_BODY_LEN 65536
+//data a client may send ahead while its request is handled asynchronously: one more request of reasonable size
+#define HTTP_MAX_PENDING_CACHE_LEN (HTTP_MAX_HEADER_LEN + HTTP_MAX_PREALLOCATED_BODY_LEN)
+//next chunk of streamed body is produced only when send queue is drained below this many entries
+#define HTTP_STREAMED_RESPONSE_SEND_QUE_WATERMARK 8
+//client that takes no chunk of streamed body for that long is dropped
+#define HTTP_STREAMED_RESPONSE_SEND_TIMEOUT 60000
 
 namespace epee
 {
@@ -193,6 +202,7 @@ namespace net_utils
 		//--------------------------------------------------------------------------------------------
 		template<class t_connection_context>
 		simple_http_connection_handler<t_connection_context>::simple_http_connection_handler(i_service_endpoint* psnd_hndlr, config_type& config):
+		m_cache_pos(0),
 		m_state(http_state_retriving_comand_line),
 		m_body_transfer_type(http_body_transfer_undefined),
         m_is_stop_handling(false),
@@ -200,6 +210,8 @@ namespace net_utils
 		m_len_remain(0),
 		m_config(config), 
 		m_want_close(false),
+		m_async_pending(false),
+		m_async_response_ready(false),
         m_psnd_hndlr(psnd_hndlr)
 	{
 
@@ -219,158 +231,135 @@ namespace net_utils
   template<class t_connection_context>
 	bool simple_http_connection_handler<t_connection_context>::handle_recv(const void* ptr, size_t cb)
 	{
-		std::string buf((const char*)ptr, cb);
-		//LOG_PRINT_L0("HTTP_RECV: " << ptr << "\r\n" << buf);
-		//file_io_utils::save_string_to_file(string_tools::get_current_module_folder() + "/" + boost::lexical_cast<std::string>(ptr), std::string((const char*)ptr, cb));
-
-		bool res = handle_buff_in(buf);
+		//LOG_PRINT_L0("HTTP_RECV: " << ptr << "\r\n" << std::string((const char*)ptr, cb));
+		if(m_async_pending && m_cache.size() + cb > HTTP_MAX_PENDING_CACHE_LEN)
+		{
+			//nothing is parsed until the async response is sent, so the cache would grow without limit
+			LOG_ERROR("simple_http_connection_handler::handle_recv: " << m_cache.size() + cb << " bytes sent ahead while request is handled asynchronously, closing connection");
+			m_want_close = true;
+			return false;
+		}
+		m_cache.append((const char*)ptr, cb);
+		bool res = handle_buff_in();
+		if(m_send_buff.size())
+		{
+			m_psnd_hndlr->do_send(m_send_buff.data(), m_send_buff.size());
+			m_send_buff.clear();
+		}
 		if(m_want_close/*m_state == http_state_connection_close || m_state == http_state_error*/)
 			return false;
 		return res;
 	}
 	//--------------------------------------------------------------------------------------------
   template<class t_connection_context>
-	bool simple_http_connection_handler<t_connection_context>::handle_buff_in(std::string& buf)
+	bool simple_http_connection_handler<t_connection_context>::handle_buff_in()
 	{
-
-		if(m_cache.size())
-			m_cache += buf;
-		else
-			m_cache.swap(buf);
-
+		bool res = true;
 		m_is_stop_handling = false;
-		while(!m_is_stop_handling)
+		//pipelined requests are handled one by one until data ends or connection is to be closed,
+		//while one of them is handled asynchronously the rest stay in m_cache to keep responses in order
+		while(!m_is_stop_handling && !m_want_close && !m_async_pending && res)
 		{
+			const char* begin = m_cache.data() + m_cache_pos;
+			size_t avail = m_cache.size() - m_cache_pos;
 			switch(m_state)
 			{
 			case http_state_retriving_comand_line:
-				//The HTTP protocol does not place any a priori limit on the length of a URI.  (c)RFC2616
-				//but we forebly restirct it len to HTTP_MAX_URI_LEN to make it more safely
-				if(!m_cache.size())
-					break;
-
-				//check_and_handle_fake_response();
-				if((m_cache[0] == '\r' || m_cache[0] == '\n'))
 				{
-          //some times it could be that before query line cold be few line breaks
-          //so we have to be calm without panic with assers
-					m_cache.erase(0, 1);
-					break;
-				}
+					//The HTTP protocol does not place any a priori limit on the length of a URI.  (c)RFC2616
+					//but we forebly restirct it len to HTTP_MAX_URI_LEN to make it more safely
+					if(!avail)
+						break;
 
-				if(std::string::npos != m_cache.find('\n', 0))
-					handle_invoke_query_line();
-				else
-				{
+					if(*begin == '\r' || *begin == '\n')
+					{
+						//some times it could be that before query line cold be few line breaks
+						//so we have to be calm without panic with assers
+						++m_cache_pos;
+						break;
+					}
+
+					const char* line_end = static_cast<const char*>(memchr(begin, '\n', avail));
+					if(line_end)
+					{
+						res = handle_invoke_query_line(line_end - begin + 1);
+						break;
+					}
 					m_is_stop_handling = true;
-					if(m_cache.size() > HTTP_MAX_URI_LEN)
+					if(avail > HTTP_MAX_URI_LEN)
 					{
 						LOG_ERROR("simple_http_connection_handler::handle_buff_out: Too long URI line");
 						m_state = http_state_error;
-						return false;
+						res = false;
 					}
+					break;
 				}
-				break;
 			case http_state_retriving_header:
 				{
-					std::string::size_type pos = match_end_of_header(m_cache);
-					if(std::string::npos == pos)
+					size_t pos = match_end_of_http_header(begin, begin + avail);
+					if(!pos)
 					{
 						m_is_stop_handling = true;
-						if(m_cache.size() > HTTP_MAX_HEADER_LEN)
+						if(avail > HTTP_MAX_HEADER_LEN)
 						{
 							LOG_ERROR("simple_http_connection_handler::handle_buff_in: Too long header area");
 							m_state = http_state_error;
-							return false;
-						}	
+							res = false;
+						}
 						break;
 					}
-					analize_cached_request_header_and_invoke_state(pos);
+					res = analize_cached_request_header_and_invoke_state(pos);
 					break;
 				}
 			case http_state_retriving_body:
-				return handle_retriving_query_body();
+				res = handle_retriving_query_body();
+				break;
 			case http_state_connection_close:
-				return false;
+				res = false;
+				break;
 			default:
 				LOG_ERROR("simple_http_connection_handler::handle_char_out: Wrong state: " << m_state);
-				return false;
+				res = false;
+				break;
 			case http_state_error:
 				LOG_ERROR("simple_http_connection_handler::handle_char_out: Error state!!!");
-				return false;
+				res = false;
+				break;
 			}
 
-			if(!m_cache.size())
+			if(m_cache_pos == m_cache.size())
 				m_is_stop_handling = true;
 		}
 
-		return true;
-	}
-	//--------------------------------------------------------------------------------------------
-	inline bool analize_http_method(const boost::smatch& result, http::http_method& method, int& http_ver_major, int& http_ver_minor)
-	{
-		CHECK_AND_ASSERT_MES(result[0].matched, false, "simple_http_connection_handler::analize_http_method() assert failed...");
-		http_ver_major = boost::lexical_cast<int>(result[11]);
-		http_ver_minor = boost::lexical_cast<int>(result[12]);
-		if(result[4].matched)
-			method = http::http_method_get;
-		else if(result[5].matched)
-			method = http::http_method_head;
-		else if(result[6].matched)
-			method = http::http_method_post;
-		else if(result[7].matched)
-			method = http::http_method_put;
-		else 
-			method = http::http_method_etc;
-
-		return true;
+		//drop handled data once, not after every request, buffer capacity is kept
+		if(m_cache_pos == m_cache.size())
+			m_cache.clear();
+		else if(m_cache_pos)
+			m_cache.erase(0, m_cache_pos);
+		m_cache_pos = 0;
+		return res;
 	}
-
   //--------------------------------------------------------------------------------------------
   template<class t_connection_context>
-	bool simple_http_connection_handler<t_connection_context>::handle_invoke_query_line()
+	bool simple_http_connection_handler<t_connection_context>::handle_invoke_query_line(size_t line_len)
 	{ 
 		LOG_FRAME("simple_http_connection_handler<t_connection_context>::handle_recognize_protocol_out(*)", LOG_LEVEL_3);
 
-		STATIC_REGEXP_EXPR_1(rexp_match_command_line, "^(((OPTIONS)|(GET)|(HEAD)|(POST)|(PUT)|(DELETE)|(TRACE)) (\\S+) HTTP/(\\d+).(\\d+))\r?\n", boost::regex::icase | boost::regex::normal);
-		//											    123         4     5      6      7     8        9        10          11     12    
-		//size_t match_len = 0;
-		boost::smatch result;	
-		if(boost::regex_search(m_cache, result, rexp_match_command_line, boost::match_default) && result[0].matched)
-		{
-			analize_http_method(result, m_query_info.m_http_method, m_query_info.m_http_ver_hi, m_query_info.m_http_ver_hi);
-			m_query_info.m_URI = result[10];
-      parse_uri(m_query_info.m_URI, m_query_info.m_uri_content);
-			m_query_info.m_http_method_str = result[2];
-			m_query_info.m_full_request_str = result[0];
-
-			m_cache.erase(m_cache.begin(),  to_nonsonst_iterator(m_cache, result[0].second));
-
-			m_state = http_state_retriving_header;
-
-			return true;
-		}else
+		const char* begin = m_cache.data() + m_cache_pos;
+		const char* end = begin + line_len - 1;
+		if(end != begin && *(end - 1) == '\r')
+			--end;
+		if(!parse_http_request_line(begin, end, m_query_info))
 		{
 			m_state = http_state_error;
-			LOG_ERROR("simple_http_connection_handler<t_connection_context>::handle_invoke_query_line(): Failed to match first line: " << m_cache);
+			LOG_ERROR("simple_http_connection_handler<t_connection_context>::handle_invoke_query_line(): Failed to match first line: " << std::string(begin, end));
 			return false;
 		}
-
-		return false;
-	}
-	//--------------------------------------------------------------------------------------------
-  template<class t_connection_context>
-	std::string::size_type simple_http_connection_handler<t_connection_context>::match_end_of_header(const std::string& buf)
-	{
-
-    //Here we returning head size, including terminating sequence (\r\n\r\n or \n\n)
-		std::string::size_type res = buf.find("\r\n\r\n");
-		if(std::string::npos != res)
-			return res+4;
-		res = buf.find("\n\n");
-		if(std::string::npos != res)
-			return res+2;
-		return res;
+		parse_uri(m_query_info.m_URI, m_query_info.m_uri_content);
+		m_query_info.m_full_request_str.assign(begin, line_len);
+		m_cache_pos += line_len;
+		m_state = http_state_retriving_header;
+		return true;
 	}
 	//--------------------------------------------------------------------------------------------
   template<class t_connection_context>
@@ -380,27 +369,28 @@ namespace net_utils
 
 		LOG_FRAME("simple_http_connection_handler<t_connection_context>::analize_cached_request_header_and_invoke_state(*)", LOG_LEVEL_3);
 
+		const char* begin = m_cache.data() + m_cache_pos;
 		m_query_info.m_full_request_buf_size = pos;
-    m_query_info.m_request_head.assign(m_cache.begin(), m_cache.begin()+pos); 
+    m_query_info.m_request_head.assign(begin, pos); 
 
-		if(!parse_cached_header(m_query_info.m_header_info, m_cache, pos))
+		if(!parse_http_header_fields(begin, begin + pos, m_query_info.m_header_info))
 		{
-			LOG_ERROR("simple_http_connection_handler<t_connection_context>::analize_cached_request_header_and_invoke_state(): failed to anilize request header: " << m_cache);
+			LOG_ERROR("simple_http_connection_handler<t_connection_context>::analize_cached_request_header_and_invoke_state(): failed to anilize request header: " << m_query_info.m_request_head);
 			m_state = http_state_error;
+			return false;
 		}
 
-		m_cache.erase(0, pos);
+		m_cache_pos += pos;
 
-		std::string req_command_str = m_query_info.m_full_request_str;
     //if we have POST or PUT command, it is very possible tha we will get body
     //but now, we suppose than we have body only in case of we have "ContentLength" 
 		if(m_query_info.m_header_info.m_content_length.size())
 		{
 			m_state = http_state_retriving_body;
 			m_body_transfer_type = http_body_transfer_measure;
-			if(!get_len_from_content_lenght(m_query_info.m_header_info.m_content_length, m_len_summary))
+			if(!parse_content_length(m_query_info.m_header_info.m_content_length, m_len_summary))
 			{
-				LOG_ERROR("simple_http_connection_handler<t_connection_context>::analize_cached_request_header_and_invoke_state(): Failed to get_len_from_content_lenght();, m_query_info.m_content_length="<<m_query_info.m_header_info.m_content_length);
+				LOG_ERROR("simple_http_connection_handler<t_connection_context>::analize_cached_request_header_and_invoke_state(): Failed to parse_content_length();, m_query_info.m_content_length="<<m_query_info.m_header_info.m_content_length);
 				m_state = http_state_error;
 				return false;
 			}
@@ -412,6 +402,7 @@ namespace net_utils
 					m_state = http_state_error;
 			}
 			m_len_remain = m_len_summary;
+			m_query_info.m_body.reserve((std::min)(m_len_summary, static_cast<size_t>(HTTP_MAX_PREALLOCATED_BODY_LEN)));
 		}else
 		{//current query finished, next will be next query
 			handle_request_and_send_response(m_query_info);
@@ -445,17 +436,10 @@ namespace net_utils
 	bool simple_http_connection_handler<t_connection_context>::handle_query_measure()
 	{
 
-		if(m_len_remain >= m_cache.size())
-		{
-			m_len_remain -= m_cache.size();
-			m_query_info.m_body += m_cache;
-			m_cache.clear();
-		}else
-		{
-			m_query_info.m_body.append(m_cache.begin(), m_cache.begin() + m_len_remain);
-			m_cache.erase(0, m_len_remain);
-			m_len_remain = 0;
-		}
+		size_t len = (std::min)(m_len_remain, m_cache.size() - m_cache_pos);
+		m_query_info.m_body.append(m_cache, m_cache_pos, len);
+		m_cache_pos += len;
+		m_len_remain -= len;
 
 		if(!m_len_remain)
 		{
@@ -468,87 +452,164 @@ namespace net_utils
 	}
 	//--------------------------------------------------------------------------------------------
   template<class t_connection_context>
-	bool simple_http_connection_handler<t_connection_context>::parse_cached_header(http_header_info& body_info, const std::string& m_cache_to_process, size_t pos)
-	{ 
-		LOG_FRAME("http_stream_filter::parse_cached_header(*)", LOG_LEVEL_3);
-
-		STATIC_REGEXP_EXPR_1(rexp_mach_field, 
-			"\n?((Connection)|(Referer)|(Content-Length)|(Content-Type)|(Transfer-Encoding)|(Content-Encoding)|(Host)|(Cookie)"
-			//  12            3         4                5              6                   7                  8      9    
-			"|([\\w-]+?)) ?: ?((.*?)(\r?\n))[^\t ]",	
-			//10             1112   13 
-			boost::regex::icase | boost::regex::normal);
-
-		boost::smatch		result;
-		std::string::const_iterator it_current_bound = m_cache_to_process.begin();
-		std::string::const_iterator it_end_bound = m_cache_to_process.begin()+pos;
-
-		body_info.clear();
+	bool simple_http_connection_handler<t_connection_context>::handle_request_and_send_response(const http::http_request_info& query_info)
+	{
+		//async response is sent from handle_qued_callback(), it can't run before this handle_recv
+		//is over, so responses collected in m_send_buff still go first
+		if(handle_request_async(query_info))
+		{
+			m_async_pending = true;
+			return true;
+		}
 
-		//lookup all fields and fill well-known fields
-		while( boost::regex_search( it_current_bound, it_end_bound, result, rexp_mach_field, boost::match_default) && result[0].matched) 
+		http_response_info response;
+		bool res = handle_request(query_info, response);
+		//CHECK_AND_ASSERT_MES(res, res, "handle_request(query_info, response) returned false" );
+		return send_response(query_info, response) && res;
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::send_response(const http::http_request_info& query_info, http_response_info& response)
+	{
+		if(response.m_body_writer)
 		{
-			const size_t field_val = 12;
-			const size_t field_etc_name = 10;
-
-			int i = 2; //start position = 2
-			if(result[i++].matched)//"Connection"
-				body_info.m_connection = result[field_val];
-			else if(result[i++].matched)//"Referer"
-				body_info.m_referer = result[field_val];
-			else if(result[i++].matched)//"Content-Length"
-				body_info.m_content_length = result[field_val];
-			else if(result[i++].matched)//"Content-Type"
-				body_info.m_content_type = result[field_val];
-			else if(result[i++].matched)//"Transfer-Encoding"
-				body_info.m_transfer_encoding = result[field_val];
-			else if(result[i++].matched)//"Content-Encoding"
-				body_info.m_content_encoding = result[field_val];
-			else if(result[i++].matched)//"Host"
-				body_info.m_host = result[field_val];
-			else if(result[i++].matched)//"Cookie"
-				body_info.m_cookie = result[field_val];
-			else if(result[i++].matched)//e.t.c (HAVE TO BE MATCHED!)
-				body_info.m_etc_fields.push_back(std::pair<std::string, std::string>(result[field_etc_name], result[field_val]));
-			else
+			//HTTP/1.0 clients don't know chunked encoding, they get the body collected
+			if(query_info.m_http_ver_hi == 1 && query_info.m_http_ver_lo == 0)
+			{
+				http::body_stream_writer writer;
+				writer.swap(response.m_body_writer);
+				std::string& body = response.m_body;
+				if(!writer([&body](std::string& chunk) { body += chunk; return true; }))
+				{
+					LOG_ERROR("Failed to produce response body for " << query_info.m_URI);
+					response.m_body.clear();
+					response.m_response_code = 500;
+					response.m_response_comment = "Internal Server Error";
+				}
+			}else
 			{
-				LOG_ERROR("simple_http_connection_handler<t_connection_context>::parse_cached_header() not matched last entry in:"<<m_cache_to_process);
+				return send_streamed_response(response);
 			}
+		}
 
-			it_current_bound = result[(int)result.size()-1]. first;
+		std::string response_data = get_response_header(response);
+		
+		//LOG_PRINT_L0("HTTP_SEND: << \r\n" << response_data + response.m_body);
+    LOG_PRINT_L3("HTTP_RESPONSE_HEAD: << \r\n" << response_data);
+		
+		//responses are collected and sent once per handle_recv, head and body written apart make
+		//Nagle wait for delayed ack on every keep-alive or pipelined request
+		m_send_buff += response_data;
+		if(response.m_body.size() > HTTP_MAX_COALESCED_BODY_LEN)
+		{
+			//big body goes by reference, without copying it into the buffer
+			m_psnd_hndlr->do_send_shared(m_send_buff.data(), m_send_buff.size(), boost::make_shared<const std::string>(std::move(response.m_body)), send_priority_normal);
+			m_send_buff.clear();
+		}else
+		{
+			m_send_buff += response.m_body;
 		}
-		return  true;
+		return true;
 	}
 	//-----------------------------------------------------------------------------------
   template<class t_connection_context>
-	bool simple_http_connection_handler<t_connection_context>::get_len_from_content_lenght(const std::string& str, size_t& OUT len)
+	void simple_http_connection_handler<t_connection_context>::on_async_response(http_response_info& response)
 	{
-		STATIC_REGEXP_EXPR_1(rexp_mach_field, "\\d+", boost::regex::normal);
-		std::string res;
-		boost::smatch result;
-		if(!(boost::regex_search( str, result, rexp_mach_field, boost::match_default) && result[0].matched))
-			return false;
-
-		len = boost::lexical_cast<size_t>(result[0]);
-		return true;
+		{
+			CRITICAL_REGION_LOCAL(m_async_lock);
+			m_async_response = std::move(response);
+			m_async_response_ready = true;
+		}
+		//the rest is done on connection's strand, the reference taken at dispatch keeps connection alive till then
+		m_psnd_hndlr->request_callback();
+		m_psnd_hndlr->release();
 	}
 	//-----------------------------------------------------------------------------------
   template<class t_connection_context>
-	bool simple_http_connection_handler<t_connection_context>::handle_request_and_send_response(const http::http_request_info& query_info)
+	void simple_http_connection_handler<t_connection_context>::handle_qued_callback()
 	{
 		http_response_info response;
-		bool res = handle_request(query_info, response);
-		//CHECK_AND_ASSERT_MES(res, res, "handle_request(query_info, response) returned false" );
+		{
+			CRITICAL_REGION_LOCAL(m_async_lock);
+			if(!m_async_response_ready)
+				return;
+			m_async_response_ready = false;
+			response = std::move(m_async_response);
+			m_async_response.clear();
+		}
 
-		std::string response_data = get_response_header(response);
-		
-		//LOG_PRINT_L0("HTTP_SEND: << \r\n" << response_data + response.m_body);
-    LOG_PRINT_L3("HTTP_RESPONSE_HEAD: << \r\n" << response_data);
-		
-		m_psnd_hndlr->do_send((void*)response_data.data(), response_data.size());
-		if(response.m_body.size())
-			m_psnd_hndlr->do_send((void*)response.m_body.data(), response.m_body.size());
-		return res;
+		//nothing of the next request is parsed yet, so headers of the async one decide on keep-alive
+		m_query_info = std::move(m_async_query_info);
+		m_async_query_info.clear();
+		m_async_pending = false;
+		bool res = send_response(m_query_info, response);
+		set_ready_state();
+		if(res)
+			res = handle_buff_in();
+		if(m_send_buff.size())
+		{
+			m_psnd_hndlr->do_send(m_send_buff.data(), m_send_buff.size());
+			m_send_buff.clear();
+		}
+		if(!res || m_want_close)
+			m_psnd_hndlr->close();
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::wait_send_queue_drained()
+	{
+		//a slow client holds the producer instead of piling the whole body up in the send queue;
+		//no read is pending on the connection while its request is handled, so the io runs other connections meanwhile
+		size_t que_size = m_psnd_hndlr->get_send_queue_size();
+		uint64_t progress_time = misc_utils::get_tick_count();
+		while(que_size > HTTP_STREAMED_RESPONSE_SEND_QUE_WATERMARK)
+		{
+			if(misc_utils::get_tick_count() - progress_time > HTTP_STREAMED_RESPONSE_SEND_TIMEOUT)
+			{
+				LOG_ERROR("Streamed response for " << m_query_info.m_URI << " isn't taken by client for " << HTTP_STREAMED_RESPONSE_SEND_TIMEOUT << "ms");
+				return false;
+			}
+			if(!m_psnd_hndlr->call_run_once_service_io())
+				return false;
+			size_t new_size = m_psnd_hndlr->get_send_queue_size();
+			if(new_size < que_size)
+				progress_time = misc_utils::get_tick_count();
+			que_size = new_size;
+		}
+		return true;
+	}
+	//-----------------------------------------------------------------------------------
+  template<class t_connection_context>
+	bool simple_http_connection_handler<t_connection_context>::send_streamed_response(http_response_info& response)
+	{
+		//body is sent chunk by chunk while it's being produced, the head goes with the first chunk
+		m_send_buff += get_response_header(response);
+		LOG_PRINT_L3("HTTP_RESPONSE_HEAD: << \r\n" << m_send_buff);
+		bool r = response.m_body_writer([this](std::string& chunk) -> bool
+		{
+			if(!chunk.size())
+				return true;
+			if(!wait_send_queue_drained())
+				return false;
+			std::stringstream chunk_head;
+			chunk_head << std::hex << chunk.size() << "\r\n";
+			m_send_buff += chunk_head.str();
+			chunk += "\r\n";
+			bool send_res = m_psnd_hndlr->do_send_shared(m_send_buff.data(), m_send_buff.size(), boost::make_shared<const std::string>(std::move(chunk)), send_priority_normal);
+			m_send_buff.clear();
+			return send_res;
+		});
+		if(!r)
+		{
+			//head is already sent, nothing to do but drop the connection
+			LOG_ERROR("Failed to send streamed response for " << m_query_info.m_URI << ", closing connection");
+			m_send_buff.clear();
+			m_want_close = true;
+			m_state = http_state_connection_close;
+			return false;
+		}
+		m_send_buff += "0\r\n\r\n";
+		return true;
 	}
 	//-----------------------------------------------------------------------------------
   template<class t_connection_context>
@@ -587,9 +648,11 @@ namespace net_utils
 	{
 		std::string buf = "HTTP/1.1 ";
 		buf += boost::lexical_cast<std::string>(response.m_response_code) + " " + response.m_response_comment + "\r\n" +
-			"Server: Epee-based\r\n"
-			"Content-Length: ";
-		buf += boost::lexical_cast<std::string>(response.m_body.size()) + "\r\n";
+			"Server: Epee-based\r\n";
+		if(response.m_body_writer)
+			buf += "Transfer-Encoding: chunked\r\n";
+		else
+			buf += "Content-Length: " + boost::lexical_cast<std::string>(response.m_body.size()) + "\r\n";
 		buf += "Content-Type: ";
 		buf += response.m_mime_tipe + "\r\n";
 
@@ -601,15 +664,18 @@ namespace net_utils
 		//Wed, 01 Dec 2010 03:27:41 GMT"
 
 		string_tools::trim(m_query_info.m_header_info.m_connection);
-		if(m_query_info.m_header_info.m_connection.size())
+		//HTTP/1.1 keeps connection alive unless asked to close, HTTP/1.0 closes unless asked to keep it
+		bool keep_alive_asked = !string_tools::compare_no_case("keep-alive", m_query_info.m_header_info.m_connection);
+		if(!string_tools::compare_no_case("close", m_query_info.m_header_info.m_connection) ||
+			(m_query_info.m_http_ver_hi == 1 && m_query_info.m_http_ver_lo == 0 && !keep_alive_asked))
 		{
-			if(!string_tools::compare_no_case("close", m_query_info.m_header_info.m_connection))
-			{
-        //closing connection after sending
-				buf += "Connection: close\r\n";
-				m_state = http_state_connection_close;
-				m_want_close = true;
-			}
+			//closing connection after sending
+			buf += "Connection: close\r\n";
+			m_state = http_state_connection_close;
+			m_want_close = true;
+		}else if(keep_alive_asked)
+		{
+			buf += "Connection: keep-alive\r\n";
 		}
 		//add additional fields, if it is
 		for(fields_list::const_iterator it = response.m_additional_fields.begin(); it!=response.m_additional_fields.end(); it++)
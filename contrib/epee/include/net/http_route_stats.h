@@ -0,0 +1,335 @@
+// Copyright (c) 2006-2013, Andrey N. Sabelnikov, www.sabelnikov.net
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// * Neither the name of the Andrey N. Sabelnikov nor the
+// names of its contributors may be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER  BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <set>
+
+#include "misc_log_ex.h"
+#include "serialization/keyvalue_serialization.h"
+
+#define HTTP_ROUTE_STATS_SLOW_CALL_PARAMS_MAX_LEN  1024
+
+namespace epee
+{
+namespace net_utils
+{
+namespace http
+{
+  /************************************************************************/
+  /* Log-linear latency histogram (HDR-like): values below 16us are exact,*/
+  /* above that every power of two is split into 16 buckets, so reported  */
+  /* percentiles are within 1/16 of the real value. Lock-free.            */
+  /************************************************************************/
+  class latency_histogram
+  {
+  public:
+    enum { sub_bucket_bits = 4, sub_buckets_count = 1 << sub_bucket_bits, max_value_bits = 36 };
+    enum { buckets_count = (max_value_bits - sub_bucket_bits + 1) * sub_buckets_count };
+
+    latency_histogram()
+    {
+      clear();
+    }
+
+    void clear()
+    {
+      for (size_t i = 0; i != buckets_count; ++i)
+        m_buckets[i] = 0;
+    }
+
+    void record(uint64_t value)
+    {
+      m_buckets[get_bucket_index(value)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    //value under which `percentile` of recorded values fall, bucket upper bound
+    uint64_t get_percentile(double percentile, uint64_t count) const
+    {
+      if (!count)
+        return 0;
+      uint64_t rank = static_cast<uint64_t>(percentile / 100 * count + 0.5);
+      if (!rank)
+        rank = 1;
+      uint64_t seen = 0;
+      for (size_t i = 0; i != buckets_count; ++i)
+      {
+        seen += m_buckets[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+          return get_bucket_upper_bound(i);
+      }
+      return get_bucket_upper_bound(buckets_count - 1);
+    }
+
+    static size_t get_bucket_index(uint64_t value)
+    {
+      if (value < sub_buckets_count)
+        return static_cast<size_t>(value);
+      size_t msb = 0;
+      for (uint64_t v = value; v >>= 1;)
+        ++msb;
+      if (msb >= max_value_bits)
+        return buckets_count - 1;
+      size_t shift = msb - sub_bucket_bits;
+      return (msb - sub_bucket_bits + 1) * sub_buckets_count + static_cast<size_t>((value >> shift) & (sub_buckets_count - 1));
+    }
+
+    static uint64_t get_bucket_upper_bound(size_t index)
+    {
+      if (index < sub_buckets_count)
+        return index;
+      size_t msb = index / sub_buckets_count + sub_bucket_bits - 1;
+      size_t shift = msb - sub_bucket_bits;
+      uint64_t low = (uint64_t(1) << msb) + (uint64_t(index % sub_buckets_count) << shift);
+      return low + (uint64_t(1) << shift) - 1;
+    }
+
+  private:
+    std::atomic<uint64_t> m_buckets[buckets_count];
+  };
+
+  struct route_stat
+  {
+    std::string name;
+    uint64_t calls;
+    uint64_t errors;
+    uint64_t total_time_us;
+    uint64_t max_time_us;
+    uint64_t p50_us;
+    uint64_t p90_us;
+    uint64_t p99_us;
+    uint64_t p999_us;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(name)
+      KV_SERIALIZE(calls)
+      KV_SERIALIZE(errors)
+      KV_SERIALIZE(total_time_us)
+      KV_SERIALIZE(max_time_us)
+      KV_SERIALIZE(p50_us)
+      KV_SERIALIZE(p90_us)
+      KV_SERIALIZE(p99_us)
+      KV_SERIALIZE(p999_us)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  /************************************************************************/
+  /* Per-route call counters and latency histograms of one http server.  */
+  /* Routes are named by string literals from the uri map.               */
+  /************************************************************************/
+  class route_stats
+  {
+  public:
+    enum { slots_count = 64 };
+
+    route_stats():m_slow_call_threshold_ms(0), m_log_slow_call_params(false)
+    {
+      for (size_t i = 0; i != slots_count + 1; ++i)
+        init_slot(m_slots[i]);
+    }
+
+    //calls taking longer are logged with their parameters, 0 - don't log
+    void set_slow_call_threshold_ms(uint64_t ms)
+    {
+      m_slow_call_threshold_ms = ms;
+    }
+
+    uint64_t get_slow_call_threshold_ms() const
+    {
+      return m_slow_call_threshold_ms;
+    }
+
+    //params may carry secret keys, by default slow calls are logged with params size only
+    void set_log_slow_call_params(bool log_params)
+    {
+      m_log_slow_call_params = log_params;
+    }
+
+    //params of this route are never logged
+    void hide_params(const std::string& name)
+    {
+      std::lock_guard<std::mutex> guard(m_hidden_params_lock);
+      m_hidden_params_routes.insert(name);
+    }
+
+    bool is_params_logged(const char* name)
+    {
+      if (!m_log_slow_call_params)
+        return false;
+      std::lock_guard<std::mutex> guard(m_hidden_params_lock);
+      return !m_hidden_params_routes.count(name);
+    }
+
+    void on_call(const char* name, uint64_t time_us, bool success)
+    {
+      slot& s = get_slot(name);
+      s.calls.fetch_add(1, std::memory_order_relaxed);
+      if (!success)
+        s.errors.fetch_add(1, std::memory_order_relaxed);
+      s.total_time_us.fetch_add(time_us, std::memory_order_relaxed);
+      uint64_t max_time = s.max_time_us.load(std::memory_order_relaxed);
+      while (max_time < time_us && !s.max_time_us.compare_exchange_weak(max_time, time_us, std::memory_order_relaxed));
+      s.histogram.record(time_us);
+    }
+
+    //routes that didn't fit into the table are reported as "other"
+    void get_stats(std::list<route_stat>& stats) const
+    {
+      for (size_t i = 0; i != slots_count + 1; ++i)
+      {
+        const slot& s = m_slots[i];
+        const char* name = s.name.load(std::memory_order_acquire);
+        uint64_t calls = s.calls.load(std::memory_order_relaxed);
+        if (!calls || (i != slots_count && !name))
+          continue;
+        route_stat st = AUTO_VAL_INIT(st);
+        st.name = i == slots_count ? "other" : name;
+        st.calls = calls;
+        st.errors = s.errors.load(std::memory_order_relaxed);
+        st.total_time_us = s.total_time_us.load(std::memory_order_relaxed);
+        st.max_time_us = s.max_time_us.load(std::memory_order_relaxed);
+        st.p50_us = (std::min)(s.histogram.get_percentile(50, calls), st.max_time_us);
+        st.p90_us = (std::min)(s.histogram.get_percentile(90, calls), st.max_time_us);
+        st.p99_us = (std::min)(s.histogram.get_percentile(99, calls), st.max_time_us);
+        st.p999_us = (std::min)(s.histogram.get_percentile(99.9, calls), st.max_time_us);
+        stats.push_back(st);
+      }
+    }
+
+  private:
+    struct slot
+    {
+      std::atomic<const char*> name;
+      std::atomic<uint64_t> calls;
+      std::atomic<uint64_t> errors;
+      std::atomic<uint64_t> total_time_us;
+      std::atomic<uint64_t> max_time_us;
+      latency_histogram histogram;
+    };
+
+    static void init_slot(slot& s)
+    {
+      s.name = nullptr;
+      s.calls = s.errors = s.total_time_us = s.max_time_us = 0;
+    }
+
+    static bool is_same_name(const char* a, const char* b)
+    {
+      return a == b || !strcmp(a, b);
+    }
+
+    //same open addressing as levin::traffic_stats, a slot is taken by the first route that hashes to it
+    slot& get_slot(const char* name)
+    {
+      size_t h = 0;
+      for (const char* p = name; *p; ++p)
+        h = h * 31 + static_cast<unsigned char>(*p);
+      size_t i = h % slots_count;
+      for (size_t n = 0; n != slots_count; ++n, i = (i + 1) % slots_count)
+      {
+        const char* current = m_slots[i].name.load(std::memory_order_acquire);
+        if (current && is_same_name(current, name))
+          return m_slots[i];
+        if (!current)
+        {
+          const char* expected = nullptr;
+          if (m_slots[i].name.compare_exchange_strong(expected, name, std::memory_order_acq_rel) || is_same_name(expected, name))
+            return m_slots[i];
+        }
+      }
+      return m_slots[slots_count];
+    }
+
+    std::atomic<uint64_t> m_slow_call_threshold_ms;
+    std::atomic<bool> m_log_slow_call_params;
+    std::mutex m_hidden_params_lock;
+    std::set<std::string> m_hidden_params_routes;
+    slot m_slots[slots_count + 1];
+  };
+
+  /************************************************************************/
+  /* Times one call of a route from the uri map, the call is counted as  */
+  /* failed unless set_ok() is reached.                                   */
+  /************************************************************************/
+  class route_call_timer
+  {
+  public:
+    route_call_timer(route_stats& stats, const char* name, const std::string& params):
+      m_stats(stats), m_name(name), m_params(params), m_ok(false), m_start(std::chrono::steady_clock::now())
+    {}
+
+    ~route_call_timer()
+    {
+      uint64_t time_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count();
+      m_stats.on_call(m_name, time_us, m_ok);
+      uint64_t threshold_ms = m_stats.get_slow_call_threshold_ms();
+      if (threshold_ms && time_us >= threshold_ms * 1000)
+      {
+        if (m_stats.is_params_logged(m_name))
+        {
+          LOG_PRINT_YELLOW("Slow rpc call " << m_name << (m_ok ? "" : " (failed)") << ": " << time_us / 1000 << "ms, params: " << get_printable_params(), LOG_LEVEL_0);
+        }
+        else
+        {
+          LOG_PRINT_YELLOW("Slow rpc call " << m_name << (m_ok ? "" : " (failed)") << ": " << time_us / 1000 << "ms, params: " << m_params.size() << " bytes", LOG_LEVEL_0);
+        }
+      }
+    }
+
+    void set_ok()
+    {
+      m_ok = true;
+    }
+
+  private:
+    std::string get_printable_params() const
+    {
+      for (char c : m_params)
+      {
+        if (static_cast<unsigned char>(c) < 0x20 && c != '\r' && c != '\n' && c != '\t')
+          return "<" + std::to_string(m_params.size()) + " bytes of binary data>";
+      }
+      if (m_params.size() <= HTTP_ROUTE_STATS_SLOW_CALL_PARAMS_MAX_LEN)
+        return m_params;
+      return m_params.substr(0, HTTP_ROUTE_STATS_SLOW_CALL_PARAMS_MAX_LEN) + "...(" + std::to_string(m_params.size()) + " bytes)";
+    }
+
+    route_stats& m_stats;
+    const char* m_name;
+    const std::string& m_params;
+    bool m_ok;
+    std::chrono::steady_clock::time_point m_start;
+  };
+}
+}
+}
@@ -26,9 +26,13 @@
 
 
 #pragma once 
+#include <atomic>
+#include <memory>
+#include <boost/thread/thread.hpp>
 #include "serialization/keyvalue_serialization.h"
 #include "storages/portable_storage_template_helper.h"
 #include "http_base.h"
+#include "http_route_stats.h"
 
 
 #define CHAIN_HTTP_TO_MAP2(context_type) bool handle_http_request(const epee::net_utils::http::http_request_info& query_info, \
@@ -44,7 +48,13 @@
 }
 
 
-#define BEGIN_URI_MAP2()   template<class t_context> bool handle_http_request_map(const epee::net_utils::http::http_request_info& query_info, \
+//every route of the map is timed into get_http_route_stats(), see epee::net_utils::http::route_stats
+#define BEGIN_URI_MAP2()   static epee::net_utils::http::route_stats& get_http_route_stats() \
+  { \
+    static epee::net_utils::http::route_stats stats; \
+    return stats; \
+  } \
+  template<class t_context> bool handle_http_request_map(const epee::net_utils::http::http_request_info& query_info, \
   epee::net_utils::http::http_response_info& response_info, \
   t_context& m_conn_context) { \
   LOG_PRINT_L1("[HTTP][" << query_info.m_URI << "]"); \
@@ -52,7 +62,14 @@
   bool handled = false; \
   if(false) return true; //just a stub to have "else if"
 
-#define MAP_URI2(pattern, callback)  else if(std::string::npos != query_info.m_URI.find(pattern)) return callback(query_info, response_info, m_conn_context);
+#define MAP_URI2(pattern, callback)  else if(std::string::npos != query_info.m_URI.find(pattern)) \
+    { \
+      epee::net_utils::http::route_call_timer route_timer(get_http_route_stats(), pattern, query_info.m_body); \
+      if(!callback(query_info, response_info, m_conn_context)) \
+        return false; \
+      route_timer.set_ok(); \
+      return true; \
+    }
 
 #define MAP_URI_AUTO_XML2(s_pattern, callback_f, command_type) //TODO: don't think i ever again will use xml - ambiguous and "overtagged" format
 
@@ -60,6 +77,7 @@
     else if((query_info.m_URI == s_pattern) && (cond)) \
     { \
       handled = true; \
+      epee::net_utils::http::route_call_timer route_timer(get_http_route_stats(), s_pattern, query_info.m_body); \
       uint64_t ticks = misc_utils::get_tick_count(); \
       boost::value_initialized<command_type::request> req; \
       bool parse_res = epee::serialization::load_t_from_json(static_cast<command_type::request&>(req), query_info.m_body); \
@@ -79,14 +97,49 @@
       response_info.m_mime_tipe = "application/json"; \
       response_info.m_header_info.m_content_type = " application/json"; \
       LOG_PRINT( s_pattern << " processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms", LOG_LEVEL_2); \
+      route_timer.set_ok(); \
     }
 
 #define MAP_URI_AUTO_JON2(s_pattern, callback_f, command_type) MAP_URI_AUTO_JON2_IF(s_pattern, callback_f, command_type, true)
 
+//handler class should have get_cached_response(key, body, epoch) and
+//store_cacheable_response(key, epoch, req, resp, body, indent), the latter always fills body
+#define MAP_URI_AUTO_JON2_CACHED(s_pattern, callback_f, command_type) \
+    else if(query_info.m_URI == s_pattern) \
+    { \
+      handled = true; \
+      epee::net_utils::http::route_call_timer route_timer(get_http_route_stats(), s_pattern, query_info.m_body); \
+      uint64_t ticks = misc_utils::get_tick_count(); \
+      boost::value_initialized<command_type::request> req; \
+      bool parse_res = epee::serialization::load_t_from_json(static_cast<command_type::request&>(req), query_info.m_body); \
+      CHECK_AND_ASSERT_MES(parse_res, false, "Failed to parse json: \r\n" << query_info.m_body); \
+      uint64_t ticks1 = epee::misc_utils::get_tick_count(); \
+      std::string cache_key = std::string("uri:") + s_pattern + ":" + epee::serialization::store_t_to_json(static_cast<command_type::request&>(req)); \
+      uint64_t cache_epoch = 0; \
+      if(!get_cached_response(cache_key, response_info.m_body, cache_epoch)) \
+      { \
+        boost::value_initialized<command_type::response> resp;\
+        if(!callback_f(static_cast<command_type::request&>(req), static_cast<command_type::response&>(resp), m_conn_context)) \
+        { \
+          LOG_ERROR("Failed to " << #callback_f << "()"); \
+          response_info.m_response_code = 500; \
+          response_info.m_response_comment = "Internal Server Error"; \
+          return true; \
+        } \
+        store_cacheable_response(cache_key, cache_epoch, static_cast<command_type::request&>(req), static_cast<command_type::response&>(resp), response_info.m_body, 0); \
+      } \
+      uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
+      response_info.m_mime_tipe = "application/json"; \
+      response_info.m_header_info.m_content_type = " application/json"; \
+      LOG_PRINT( s_pattern << " processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms", LOG_LEVEL_2); \
+      route_timer.set_ok(); \
+    }
+
 #define MAP_URI_AUTO_BIN2(s_pattern, callback_f, command_type) \
     else if(query_info.m_URI == s_pattern) \
     { \
       handled = true; \
+      epee::net_utils::http::route_call_timer route_timer(get_http_route_stats(), s_pattern, query_info.m_body); \
       uint64_t ticks = misc_utils::get_tick_count(); \
       boost::value_initialized<command_type::request> req; \
       bool parse_res = epee::serialization::load_t_from_binary(static_cast<command_type::request&>(req), query_info.m_body); \
@@ -106,6 +159,34 @@
       response_info.m_mime_tipe = " application/octet-stream"; \
       response_info.m_header_info.m_content_type = " application/octet-stream"; \
       LOG_PRINT( s_pattern << "() processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms", LOG_LEVEL_2); \
+      route_timer.set_ok(); \
+    }
+
+//response is serialized straight to connection by chunks after handler returns, see http_response_info::m_body_writer
+#define MAP_URI_AUTO_BIN2_STREAMED(s_pattern, callback_f, command_type) \
+    else if(query_info.m_URI == s_pattern) \
+    { \
+      handled = true; \
+      epee::net_utils::http::route_call_timer route_timer(get_http_route_stats(), s_pattern, query_info.m_body); \
+      uint64_t ticks = misc_utils::get_tick_count(); \
+      boost::value_initialized<command_type::request> req; \
+      bool parse_res = epee::serialization::load_t_from_binary(static_cast<command_type::request&>(req), query_info.m_body); \
+      CHECK_AND_ASSERT_MES(parse_res, false, "Failed to parse bin body data, body size=" << query_info.m_body.size()); \
+      uint64_t ticks1 = misc_utils::get_tick_count(); \
+      std::shared_ptr<command_type::response> presp = std::make_shared<command_type::response>(); \
+      if(!callback_f(static_cast<command_type::request&>(req), *presp, m_conn_context)) \
+      { \
+        LOG_ERROR("Failed to " << #callback_f << "()"); \
+        response_info.m_response_code = 500; \
+        response_info.m_response_comment = "Internal Server Error"; \
+        return true; \
+      } \
+      uint64_t ticks2 = misc_utils::get_tick_count(); \
+      response_info.m_body_writer = [presp](const epee::net_utils::http::body_chunk_sink& sink) { return epee::serialization::store_t_to_binary_stream(*presp, sink); }; \
+      response_info.m_mime_tipe = " application/octet-stream"; \
+      response_info.m_header_info.m_content_type = " application/octet-stream"; \
+      LOG_PRINT( s_pattern << "() processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms, streaming response", LOG_LEVEL_2); \
+      route_timer.set_ok(); \
     }
 
 #define CHAIN_URI_MAP2(callback) else {callback(query_info, response_info, m_conn_context);handled = true;}
@@ -199,6 +280,265 @@ namespace epee
     };
 
     typedef response<dummy_result, error> error_response;
+
+    //builds the same text as store_t_to_json() of response<t_param, dummy_error> from
+    //already serialized result (dumped with indent 1)
+    inline void make_response_json(const epee::serialization::storage_entry& id, const std::string& result_json, std::string& body)
+    {
+      std::stringstream ss;
+      epee::serialization::dump_as_json(ss, id, 1);
+      body.clear();
+      body.reserve(result_json.size() + 64);
+      body += "{\r\n  \"id\": ";
+      body += ss.str();
+      body += ",\r\n  \"jsonrpc\": \"2.0\",\r\n  \"result\": ";
+      body += result_json;
+      body += "\r\n}";
+    }
+
+#define JSON_RPC_BATCH_DEFAULT_MAX_SIZE   100
+
+    struct batch_config
+    {
+      batch_config():max_size(JSON_RPC_BATCH_DEFAULT_MAX_SIZE), threads(1)
+      {}
+
+      size_t max_size; //calls in one batch, 0 - batches are not accepted
+      size_t threads;  //batch is spread over that many threads when all its calls are read only, 1 - calls are always run one by one (for handlers that aren't thread safe)
+      std::function<bool(const std::string& method)> is_read_only;
+    };
+
+    inline bool is_batch_request(const std::string& body)
+    {
+      for(char c : body)
+      {
+        if(!isspace(static_cast<unsigned char>(c)))
+          return c == '[';
+      }
+      return false;
+    }
+
+    //takes value of first "method" key without parsing the call, good enough to route request;
+    //the call itself is parsed and validated by the map as usual
+    inline bool peek_method_name(const std::string& body, std::string& method)
+    {
+      static const std::string key = "\"method\"";
+      size_t pos = body.find(key);
+      if(pos == std::string::npos)
+        return false;
+      pos += key.size();
+      while(pos < body.size() && isspace(static_cast<unsigned char>(body[pos])))
+        ++pos;
+      if(pos == body.size() || body[pos] != ':')
+        return false;
+      ++pos;
+      while(pos < body.size() && isspace(static_cast<unsigned char>(body[pos])))
+        ++pos;
+      if(pos == body.size() || body[pos] != '"')
+        return false;
+      size_t end = body.find('"', ++pos);
+      if(end == std::string::npos)
+        return false;
+      method.assign(body, pos, end - pos);
+      return true;
+    }
+
+    //splits top level json array into texts of its elements, elements themselves are not validated
+    inline bool split_json_array(const std::string& body, std::vector<std::string>& items)
+    {
+      items.clear();
+      size_t pos = body.find('[');
+      if(pos == std::string::npos)
+        return false;
+      ++pos;
+      size_t depth = 0;
+      size_t item_start = std::string::npos;
+      for(; pos != body.size(); ++pos)
+      {
+        char c = body[pos];
+        if(c == '"')
+        {
+          if(item_start == std::string::npos)
+            item_start = pos;
+          for(++pos; pos != body.size() && body[pos] != '"'; ++pos)
+          {
+            if(body[pos] == '\\')
+              ++pos;
+          }
+          if(pos >= body.size())
+            return false;
+        }
+        else if(c == '{' || c == '[')
+        {
+          if(item_start == std::string::npos)
+            item_start = pos;
+          ++depth;
+        }
+        else if((c == '}' || c == ']') && depth)
+        {
+          --depth;
+        }
+        else if(!depth && (c == ',' || c == ']'))
+        {
+          if(item_start == std::string::npos)
+            return c == ']' && items.empty();
+          size_t item_end = pos;
+          while(isspace(static_cast<unsigned char>(body[item_end - 1])))
+            --item_end;
+          items.push_back(body.substr(item_start, item_end - item_start));
+          item_start = std::string::npos;
+          if(c == ']')
+            return true;
+        }
+        else if(c == '}')
+        {
+          return false;
+        }
+        else if(item_start == std::string::npos && !isspace(static_cast<unsigned char>(c)))
+        {
+          item_start = pos;
+        }
+      }
+      return false;
+    }
+
+    inline void make_error_json(int64_t code, const std::string& message, std::string& body)
+    {
+      error_response rsp = AUTO_VAL_INIT(rsp);
+      rsp.jsonrpc = "2.0";
+      rsp.id = epee::serialization::storage_entry(std::string());
+      rsp.error.code = code;
+      rsp.error.message = message;
+      epee::serialization::store_t_to_json(rsp, body);
+    }
+
+    //runs every call of batch through t_single_call(query, response) and joins responses into array,
+    //calls are run in parallel only if all of them are read only, otherwise one by one in given order;
+    //notifications (calls without id) are run too, but get no entry in the array
+    template<class t_single_call>
+    bool handle_batch(const net_utils::http::http_request_info& query_info, net_utils::http::http_response_info& response_info,
+      const batch_config& config, t_single_call single_call)
+    {
+      response_info.m_mime_tipe = "application/json";
+      response_info.m_header_info.m_content_type = " application/json";
+      std::vector<std::string> calls;
+      if(!split_json_array(query_info.m_body, calls))
+      {
+        make_error_json(-32700, "Parse error", response_info.m_body);
+        return true;
+      }
+      if(calls.empty())
+      {
+        make_error_json(-32600, "Invalid Request", response_info.m_body);
+        return true;
+      }
+      if(calls.size() > config.max_size)
+      {
+        LOG_PRINT_L1("json_rpc batch of " << calls.size() << " calls rejected, limit is " << config.max_size);
+        make_error_json(-32600, "Invalid Request: batch is too big, max " + std::to_string(config.max_size) + " calls allowed", response_info.m_body);
+        return true;
+      }
+
+      bool parallel = config.threads > 1 && calls.size() > 1 && config.is_read_only;
+      std::vector<bool> notifications(calls.size());
+      for(size_t i = 0; i != calls.size(); ++i)
+      {
+        epee::serialization::portable_storage ps;
+        if(!ps.load_from_json(calls[i]))
+        {
+          //answered with parse error by the map
+          parallel = false;
+          continue;
+        }
+        epee::serialization::storage_entry id;
+        notifications[i] = !ps.get_value("id", id, nullptr);
+        std::string method;
+        parallel = parallel && ps.get_value("method", method, nullptr) && config.is_read_only(method);
+      }
+
+      std::vector<std::string> results(calls.size());
+      auto run_call = [&](size_t i)
+      {
+        net_utils::http::http_request_info call_query;
+        call_query.m_http_method = query_info.m_http_method;
+        call_query.m_URI = query_info.m_URI;
+        call_query.m_body.swap(calls[i]);
+        net_utils::http::http_response_info call_response;
+        call_response.m_response_code = 200;
+        if(call_query.m_body.empty() || call_query.m_body[0] != '{')
+        {
+          make_error_json(-32600, "Invalid Request", results[i]);
+          return;
+        }
+        single_call(call_query, call_response);
+        if(call_response.m_body_writer)
+        {
+          call_response.m_body.clear();
+          call_response.m_body_writer([&](std::string& chunk) { call_response.m_body += chunk; return true; });
+        }
+        if(call_response.m_body.empty())
+          make_error_json(-32603, "Internal error", results[i]);
+        else
+          results[i].swap(call_response.m_body);
+      };
+
+      uint64_t ticks = misc_utils::get_tick_count();
+      if(parallel)
+      {
+        std::atomic<size_t> next_call(0);
+        auto worker = [&]()
+        {
+          for(size_t i = next_call++; i < calls.size(); i = next_call++)
+            run_call(i);
+        };
+        boost::thread_group workers;
+        size_t threads = (std::min)(config.threads, calls.size());
+        for(size_t i = 1; i < threads; ++i)
+          workers.create_thread(worker);
+        worker();
+        workers.join_all();
+      }
+      else
+      {
+        for(size_t i = 0; i != calls.size(); ++i)
+          run_call(i);
+      }
+
+      size_t total_size = 2;
+      size_t responses = 0;
+      for(size_t i = 0; i != results.size(); ++i)
+      {
+        if(notifications[i])
+          continue;
+        total_size += results[i].size() + 1;
+        ++responses;
+      }
+      std::string& body = response_info.m_body;
+      body.clear();
+      if(!responses)
+      {
+        //batch of notifications only, nothing to answer
+        response_info.m_response_code = 204;
+        response_info.m_response_comment = "No Content";
+        response_info.m_mime_tipe.clear();
+        response_info.m_header_info.m_content_type.clear();
+        LOG_PRINT(query_info.m_URI << " batch of " << calls.size() << " notifications processed with " << misc_utils::get_tick_count() - ticks << "ms", LOG_LEVEL_2);
+        return true;
+      }
+      body.reserve(total_size);
+      body += '[';
+      for(size_t i = 0; i != results.size(); ++i)
+      {
+        if(notifications[i])
+          continue;
+        if(body.size() > 1)
+          body += ',';
+        body += results[i];
+      }
+      body += ']';
+      LOG_PRINT(query_info.m_URI << " batch of " << calls.size() << " calls processed " << (parallel ? "in parallel " : "") << "with " << misc_utils::get_tick_count() - ticks << "ms", LOG_LEVEL_2);
+      return true;
+    }
   }
 }
 
@@ -234,6 +574,26 @@ namespace epee
     if(false) return true; //just a stub to have "else if"
 
 
+//same as BEGIN_JSON_RPC_MAP, but also takes JSON-RPC 2.0 batches (arrays of calls), each call is
+//dispatched through the same map, see epee::json_rpc::handle_batch
+#define BEGIN_JSON_RPC_MAP_WITH_BATCH(uri, config) else if(query_info.m_URI == uri && epee::json_rpc::is_batch_request(query_info.m_body)) \
+    { \
+      handled = true; \
+      epee::net_utils::http::route_call_timer route_timer(get_http_route_stats(), uri "[batch]", query_info.m_body); \
+      if(!epee::json_rpc::handle_batch(query_info, response_info, config, \
+        [&](const epee::net_utils::http::http_request_info& call_query, epee::net_utils::http::http_response_info& call_response) \
+        { \
+          /*calls of a batch may run on several threads, each gets own copy of connection context*/ \
+          typename std::decay<decltype(m_conn_context)>::type call_context(m_conn_context); \
+          return handle_http_request_map(call_query, call_response, call_context); \
+        })) \
+        return false; \
+      route_timer.set_ok(); \
+      return true; \
+    } \
+    BEGIN_JSON_RPC_MAP(uri)
+
+
 #define PREPARE_OBJECTS_FROM_JSON(command_type) \
   handled = true; \
   boost::value_initialized<epee::json_rpc::request<command_type::request> > req_; \
@@ -260,11 +620,13 @@ namespace epee
   uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
   response_info.m_mime_tipe = "application/json"; \
   response_info.m_header_info.m_content_type = " application/json"; \
-  LOG_PRINT( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms", LOG_LEVEL_2);
+  LOG_PRINT( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms", LOG_LEVEL_2); \
+  route_timer.set_ok();
 
 #define MAP_JON_RPC_WE_IF(method_name, callback_f, command_type, cond) \
     else if((callback_name == method_name) && (cond)) \
 { \
+  epee::net_utils::http::route_call_timer route_timer(get_http_route_stats(), method_name, query_info.m_body); \
   PREPARE_OBJECTS_FROM_JSON(command_type) \
   epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
   fail_resp.jsonrpc = "2.0"; \
@@ -280,9 +642,66 @@ namespace epee
 
 #define MAP_JON_RPC_WE(method_name, callback_f, command_type) MAP_JON_RPC_WE_IF(method_name, callback_f, command_type, true)
 
+//same as MAP_JON_RPC_WE, but serialized result is looked up in/stored to handler's cache, see MAP_URI_AUTO_JON2_CACHED
+#define MAP_JON_RPC_WE_CACHED(method_name, callback_f, command_type) \
+    else if(callback_name == method_name) \
+{ \
+  epee::net_utils::http::route_call_timer route_timer(get_http_route_stats(), method_name, query_info.m_body); \
+  PREPARE_OBJECTS_FROM_JSON(command_type) \
+  std::string cache_key = std::string("json_rpc:") + method_name + ":" + epee::serialization::store_t_to_json(req.params); \
+  std::string result_json; \
+  uint64_t cache_epoch = 0; \
+  if(!get_cached_response(cache_key, result_json, cache_epoch)) \
+  { \
+    epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
+    fail_resp.jsonrpc = "2.0"; \
+    fail_resp.id = req.id; \
+    if(!callback_f(req.params, resp.result, fail_resp.error, m_conn_context)) \
+    { \
+      epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
+      return true; \
+    } \
+    store_cacheable_response(cache_key, cache_epoch, req.params, resp.result, result_json, 1); \
+  } \
+  uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
+  epee::json_rpc::make_response_json(req.id, result_json, response_info.m_body); \
+  uint64_t ticks3 = epee::misc_utils::get_tick_count(); \
+  response_info.m_mime_tipe = "application/json"; \
+  response_info.m_header_info.m_content_type = " application/json"; \
+  LOG_PRINT( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "/" << ticks3-ticks2 << "ms", LOG_LEVEL_2); \
+  route_timer.set_ok(); \
+  return true;\
+}
+
+//same as MAP_JON_RPC_WE, but successful response is serialized straight to connection, see MAP_URI_AUTO_BIN2_STREAMED
+#define MAP_JON_RPC_WE_STREAMED(method_name, callback_f, command_type) \
+    else if(callback_name == method_name) \
+{ \
+  epee::net_utils::http::route_call_timer route_timer(get_http_route_stats(), method_name, query_info.m_body); \
+  PREPARE_OBJECTS_FROM_JSON(command_type) \
+  epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
+  fail_resp.jsonrpc = "2.0"; \
+  fail_resp.id = req.id; \
+  if(!callback_f(req.params, resp.result, fail_resp.error, m_conn_context)) \
+  { \
+    epee::serialization::store_t_to_json(static_cast<epee::json_rpc::error_response&>(fail_resp), response_info.m_body); \
+    return true; \
+  } \
+  uint64_t ticks2 = epee::misc_utils::get_tick_count(); \
+  typedef epee::json_rpc::response<command_type::response, epee::json_rpc::dummy_error> streamed_response_type; \
+  std::shared_ptr<streamed_response_type> presp = std::make_shared<streamed_response_type>(std::move(resp)); \
+  response_info.m_body_writer = [presp](const epee::net_utils::http::body_chunk_sink& sink) { return epee::serialization::store_t_to_json_stream(*presp, sink); }; \
+  response_info.m_mime_tipe = "application/json"; \
+  response_info.m_header_info.m_content_type = " application/json"; \
+  LOG_PRINT( query_info.m_URI << "[" << method_name << "] processed with " << ticks1-ticks << "/"<< ticks2-ticks1 << "ms, streaming response", LOG_LEVEL_2); \
+  route_timer.set_ok(); \
+  return true;\
+}
+
 #define MAP_JON_RPC_WERI(method_name, callback_f, command_type) \
     else if(callback_name == method_name) \
 { \
+  epee::net_utils::http::route_call_timer route_timer(get_http_route_stats(), method_name, query_info.m_body); \
   PREPARE_OBJECTS_FROM_JSON(command_type) \
   epee::json_rpc::error_response fail_resp = AUTO_VAL_INIT(fail_resp); \
   fail_resp.jsonrpc = "2.0"; \
@@ -299,6 +718,7 @@ namespace epee
 #define MAP_JON_RPC_IF(method_name, callback_f, command_type, cond) \
     else if((callback_name == method_name) && (cond)) \
 { \
+  epee::net_utils::http::route_call_timer route_timer(get_http_route_stats(), method_name, query_info.m_body); \
   PREPARE_OBJECTS_FROM_JSON(command_type) \
   if(!callback_f(req.params, resp.result, m_conn_context)) \
   { \
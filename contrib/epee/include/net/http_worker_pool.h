@@ -0,0 +1,168 @@
+// Copyright (c) 2006-2013, Andrey N. Sabelnikov, www.sabelnikov.net
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// * Neither the name of the Andrey N. Sabelnikov nor the
+// names of its contributors may be used to endorse or promote products
+// derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER  BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <boost/thread/thread.hpp>
+
+#include "misc_log_ex.h"
+
+namespace epee
+{
+namespace net_utils
+{
+namespace http
+{
+  /************************************************************************/
+  /* Fixed set of threads fed from a bounded queue. post() never blocks:  */
+  /* when the queue is full it fails and the caller has to refuse work.   */
+  /************************************************************************/
+  class worker_pool
+  {
+  public:
+    typedef std::function<void()> job;
+
+    worker_pool():m_threads_count(0), m_max_queue_size(0), m_running(false), m_busy_count(0)
+    {}
+
+    ~worker_pool()
+    {
+      stop();
+    }
+
+    bool init(size_t threads_count, size_t max_queue_size, const std::string& name)
+    {
+      CHECK_AND_ASSERT_MES(!m_running, false, "worker_pool " << name << " is already running");
+      if(!threads_count)
+        return true;
+      m_name = name;
+      m_threads_count = threads_count;
+      m_max_queue_size = max_queue_size;
+      m_running = true;
+      for(size_t i = 0; i != threads_count; i++)
+        m_threads.create_thread(std::bind(&worker_pool::worker, this));
+      LOG_PRINT_L0("Worker pool " << m_name << " started: " << threads_count << " threads, queue limit " << m_max_queue_size);
+      return true;
+    }
+
+    //jobs already queued are still done, new ones are refused
+    void stop()
+    {
+      {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if(!m_running)
+          return;
+        m_running = false;
+      }
+      m_job_cv.notify_all();
+      m_threads.join_all();
+    }
+
+    //stays the same after stop(), zero if pool was never started
+    size_t get_threads_count() const
+    {
+      return m_threads_count;
+    }
+
+    bool is_running()
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      return m_running;
+    }
+
+    bool post(job&& j)
+    {
+      {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if(!m_running || m_queue.size() >= m_max_queue_size)
+          return false;
+        m_queue.push_back(std::move(j));
+      }
+      m_job_cv.notify_one();
+      return true;
+    }
+
+    size_t get_queue_size()
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      return m_queue.size();
+    }
+
+    size_t get_busy_count()
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      return m_busy_count;
+    }
+
+  private:
+    void worker()
+    {
+      std::unique_lock<std::mutex> guard(m_lock);
+      while(true)
+      {
+        m_job_cv.wait(guard, [this](){ return !m_running || !m_queue.empty(); });
+        if(m_queue.empty())
+          return;
+        job j = std::move(m_queue.front());
+        m_queue.pop_front();
+        ++m_busy_count;
+        guard.unlock();
+        try
+        {
+          j();
+        }
+        catch(const std::exception& e)
+        {
+          LOG_ERROR("Worker pool " << m_name << ": exception in job: " << e.what());
+        }
+        catch(...)
+        {
+          LOG_ERROR("Worker pool " << m_name << ": unknown exception in job");
+        }
+        guard.lock();
+        --m_busy_count;
+      }
+    }
+
+    std::string m_name;
+    size_t m_threads_count;
+    size_t m_max_queue_size;
+    bool m_running;
+    size_t m_busy_count;
+    std::deque<job> m_queue;
+    std::mutex m_lock;
+    std::condition_variable m_job_cv;
+    boost::thread_group m_threads;
+  };
+}
+}
+}
@@ -27,12 +27,14 @@
 #pragma once
 #include <atomic>
 #include <unordered_map>
+#include <map>
 
 #include <boost/uuid/uuid_generators.hpp>
 #include <boost/interprocess/detail/atomic.hpp>
 #include <boost/smart_ptr/make_shared.hpp>
 
 #include "levin_base.h"
+#include "levin_traffic_stats.h"
 #include "misc_language.h"
 #include "profile_tools.h"
 
@@ -69,6 +71,15 @@ public:
   levin_commands_handler<t_connection_context>* m_pcommands_handler;
   uint64_t m_max_packet_size; 
   uint64_t m_invoke_timeout;
+  traffic_stats m_traffic_stats;
+  //filled before the server starts, read-only afterwards
+  std::map<int, net_utils::send_priority> m_send_priorities;
+
+  net_utils::send_priority get_send_priority(int command) const
+  {
+    auto it = m_send_priorities.find(command);
+    return it == m_send_priorities.end() ? net_utils::send_priority_normal : it->second;
+  }
 
   void on_send_stop_signal();
   int invoke(int command, const std::string& in_buff, std::string& buff_out, boost::uuids::uuid connection_id);
@@ -76,6 +87,9 @@ public:
   int invoke_async(int command, const std::string& in_buff, boost::uuids::uuid connection_id, callback_t cb, size_t timeout = LEVIN_DEFAULT_TIMEOUT_PRECONFIGURED);
 
   int notify(int command, const std::string& in_buff, boost::uuids::uuid connection_id);
+  int notify(int command, const net_utils::shared_send_buffer& in_buff, boost::uuids::uuid connection_id);
+  //sends to each connection from the io_service serving it, returns count of connections found
+  size_t notify_to_list(int command, const net_utils::shared_send_buffer& in_buff, const std::list<boost::uuids::uuid>& connections);
   bool close(boost::uuids::uuid connection_id);
   bool update_connection_context(const t_connection_context& contxt);
   bool request_callback(boost::uuids::uuid connection_id);
@@ -123,6 +137,7 @@ public:
   critical_section m_call_lock;
 
   volatile uint32_t m_wait_count;
+  std::atomic<int> m_invoke_command;
   volatile uint32_t m_close_called;
   bucket_head2 m_current_head;
   net_utils::i_service_endpoint* m_pservice_endpoint; 
@@ -141,6 +156,7 @@ public:
     virtual bool is_timer_started() const=0;
     virtual void cancel()=0;
     virtual bool cancel_timer()=0;
+    virtual int get_command() const=0;
   };
   template <class callback_t>
   struct invoke_handler: invoke_response_handler_base
@@ -205,6 +221,10 @@ public:
       }
       return m_timer_cancelled;
     }
+    virtual int get_command() const
+    {
+      return m_command;
+    }
   };
   critical_section m_invoke_response_handlers_lock;
   std::list<boost::shared_ptr<invoke_response_handler_base> > m_invoke_response_handlers;
@@ -232,6 +252,7 @@ public:
     m_deletion_initiated = false;
     m_protocol_released = false;
     m_wait_count = 0;
+    m_invoke_command = traffic_stats::other_command;
     m_oponent_protocol_ver = 0;
     m_connection_initialized = false;
   }
@@ -370,6 +391,8 @@ public:
           }
 
           bool is_response = (m_oponent_protocol_ver == LEVIN_PROTOCOL_VER_1 && m_current_head.m_flags&LEVIN_PACKET_RESPONSE);
+          uint64_t recv_bytes = sizeof(bucket_head2) + m_current_head.m_cb;
+          m_connection_context.m_recv_msgs.fetch_add(1, std::memory_order_relaxed);
 
           LOG_PRINT_CC_L4(m_connection_context, "LEVIN_PACKET_RECIEVED. [len=" << m_current_head.m_cb 
             << ", flags" << m_current_head.m_flags 
@@ -384,6 +407,8 @@ public:
             if(!m_invoke_response_handlers.empty())
             {//async call scenario
               boost::shared_ptr<invoke_response_handler_base> response_handler = m_invoke_response_handlers.front();
+              //responses are counted under the command we sent, not the one peer put into the header
+              m_config.m_traffic_stats.on_recv(response_handler->get_command(), recv_bytes);
               bool timer_cancelled = response_handler->cancel_timer();
               
               if(timer_cancelled)
@@ -399,10 +424,12 @@ public:
               //use sync call scenario
               if(!boost::interprocess::ipcdetail::atomic_read32(&m_wait_count) && !boost::interprocess::ipcdetail::atomic_read32(&m_close_called))
               {
+                m_config.m_traffic_stats.on_recv(traffic_stats::other_command, recv_bytes);
                 LOG_ERROR_CC(m_connection_context, "no active invoke when response came, wtf?");
                 return false;
               }else
               {
+                m_config.m_traffic_stats.on_recv(m_invoke_command.load(std::memory_order_relaxed), recv_bytes);
                 CRITICAL_REGION_BEGIN(m_local_inv_buff_lock);
                 buff_to_invoke.swap(m_local_inv_buff);
                 buff_to_invoke.clear();
@@ -416,13 +443,18 @@ public:
             if(m_current_head.m_have_to_return_data)
             {
               std::string return_buff;
-              TIME_MEASURE_START_MS(invoke_handle_time);
+              TIME_MEASURE_START(invoke_handle_time_us);
               m_current_head.m_return_code = m_config.m_pcommands_handler->invoke(
                                                                   m_current_head.m_command, 
                                                                   buff_to_invoke, 
                                                                   return_buff, 
                                                                   m_connection_context);
-              TIME_MEASURE_FINISH_MS(invoke_handle_time);
+              TIME_MEASURE_FINISH(invoke_handle_time_us);
+              //ids nobody handles go to one bucket, otherwise peer could take all slots of the table
+              int stat_command = m_current_head.m_return_code == LEVIN_ERROR_CONNECTION_HANDLER_NOT_DEFINED ? static_cast<int>(traffic_stats::other_command) : m_current_head.m_command;
+              m_config.m_traffic_stats.on_recv(stat_command, recv_bytes);
+              on_handled(stat_command, invoke_handle_time_us);
+              uint64_t invoke_handle_time = invoke_handle_time_us / 1000;
               LOG_PRINT_CC_L3(m_connection_context, "INVOKE HANDLER: " << invoke_handle_time << "ms, command: " << m_current_head.m_command);
               if (invoke_handle_time > m_config.m_invoke_timeout / 2)
               {
@@ -436,9 +468,10 @@ public:
               std::string send_buff((const char*)&m_current_head, sizeof(m_current_head));
               send_buff += return_buff;
               CRITICAL_REGION_BEGIN(m_send_lock);
-              if(!m_pservice_endpoint->do_send(send_buff.data(), send_buff.size()))
+              if(!m_pservice_endpoint->do_send_shared(send_buff.data(), send_buff.size(), net_utils::shared_send_buffer(), m_config.get_send_priority(m_current_head.m_command)))
                 return false;
               CRITICAL_REGION_END();
+              on_sent(stat_command, return_buff.size());
               LOG_PRINT_CC_L4(m_connection_context, "LEVIN_PACKET_SENT. [len=" << m_current_head.m_cb 
                 << ", flags" << m_current_head.m_flags 
                 << ", r?=" << m_current_head.m_have_to_return_data 
@@ -448,9 +481,13 @@ public:
             else
             {
               
-              TIME_MEASURE_START_MS(notify_handle_time);
-              m_config.m_pcommands_handler->notify(m_current_head.m_command, buff_to_invoke, m_connection_context);
-              TIME_MEASURE_FINISH_MS(notify_handle_time);
+              TIME_MEASURE_START(notify_handle_time_us);
+              int notify_res = m_config.m_pcommands_handler->notify(m_current_head.m_command, buff_to_invoke, m_connection_context);
+              TIME_MEASURE_FINISH(notify_handle_time_us);
+              int stat_command = notify_res == LEVIN_ERROR_CONNECTION_HANDLER_NOT_DEFINED ? static_cast<int>(traffic_stats::other_command) : m_current_head.m_command;
+              m_config.m_traffic_stats.on_recv(stat_command, recv_bytes);
+              on_handled(stat_command, notify_handle_time_us);
+              uint64_t notify_handle_time = notify_handle_time_us / 1000;
               LOG_PRINT_CC_L3(m_connection_context, "NOTIFY HANDLER: " << notify_handle_time << "ms, command: " << m_current_head.m_command);
               if (notify_handle_time > m_config.m_invoke_timeout / 2)
               {
@@ -553,15 +590,9 @@ public:
       boost::interprocess::ipcdetail::atomic_write32(&m_invoke_buf_ready, 0);
       CRITICAL_REGION_BEGIN(m_send_lock);
       CRITICAL_REGION_LOCAL1(m_invoke_response_handlers_lock);
-      if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
-      {
-        LOG_PRINT_CC_RED(m_connection_context, "Failed to do_send", LOG_LEVEL_2);
-        err_code = LEVIN_ERROR_CONNECTION;
-        break;
-      }
 
-      //add response handler before do_send of the last 
-      //part of packet, in case if it somehow lead to situation when response 
+      //add response handler before do_send of the packet, 
+      //in case if it somehow lead to situation when response 
       //comes before it return control and response could be handled 
       //by protocol state machine without proper invoke_response_handler
       if (!add_invoke_response_handler(cb, timeout, *this, command))
@@ -570,12 +601,19 @@ public:
         break;
       }
 
-      if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
+      //head and body are queued as one unit, so priority reordering can't split them
+      if(!m_pservice_endpoint->do_send_shared(&head, sizeof(head), boost::make_shared<const std::string>(in_buff), m_config.get_send_priority(command)))
       {
         LOG_PRINT_CC_RED(m_connection_context, "Failed to do_send", LOG_LEVEL_2);
-        err_code = LEVIN_ERROR_CONNECTION;
+        //take the response handler back, unless its timer already fired and reported the failure
+        if (m_invoke_response_handlers.back()->cancel_timer())
+        {
+          m_invoke_response_handlers.pop_back();
+          err_code = LEVIN_ERROR_CONNECTION;
+        }
         break;
       }
+      on_sent(command, in_buff.size());
 
 
       CRITICAL_REGION_END();
@@ -615,19 +653,15 @@ public:
     head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
 
     boost::interprocess::ipcdetail::atomic_write32(&m_invoke_buf_ready, 0);
+    m_invoke_command.store(command, std::memory_order_relaxed);
     CRITICAL_REGION_BEGIN(m_send_lock);
-    if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
-    {
-      LOG_ERROR_CC(m_connection_context, "Failed to do_send");
-      return LEVIN_ERROR_CONNECTION;
-    }
-
-    if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
+    if(!m_pservice_endpoint->do_send_shared(&head, sizeof(head), boost::make_shared<const std::string>(in_buff), m_config.get_send_priority(command)))
     {
       LOG_ERROR_CC(m_connection_context, "Failed to do_send");
       return LEVIN_ERROR_CONNECTION;
     }
     CRITICAL_REGION_END();
+    on_sent(command, in_buff.size());
 
     LOG_PRINT_CC_L4(m_connection_context, "LEVIN_PACKET_SENT. [len=" << head.m_cb 
                             << ", f=" << head.m_flags 
@@ -661,6 +695,11 @@ public:
   }
 
   int notify(int command, const std::string& in_buff)
+  {
+    return notify(command, boost::make_shared<const std::string>(in_buff));
+  }
+  //------------------------------------------------------------------------------------------
+  int notify(int command, const net_utils::shared_send_buffer& in_buff)
   {
     misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler(
                           boost::bind(&async_protocol_handler::finish_outer_call, this));
@@ -676,24 +715,19 @@ public:
     bucket_head2 head = {0};
     head.m_signature = LEVIN_SIGNATURE;
     head.m_have_to_return_data = false;
-    head.m_cb = in_buff.size();
+    head.m_cb = in_buff->size();
 
     head.m_command = command;
     head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
     head.m_flags = LEVIN_PACKET_REQUEST;
     CRITICAL_REGION_BEGIN(m_send_lock);
-    if(!m_pservice_endpoint->do_send(&head, sizeof(head)))
+    if(!m_pservice_endpoint->do_send_shared(&head, sizeof(head), in_buff, m_config.get_send_priority(command)))
     {
-      LOG_PRINT_CC_RED(m_connection_context, "Failed to do_send()", LOG_LEVEL_2);
-      return -1;
-    }
-
-    if(!m_pservice_endpoint->do_send(in_buff.data(), (int)in_buff.size()))
-    {
-      LOG_PRINT_CC_RED(m_connection_context, "Failed to do_send()", LOG_LEVEL_2);
+      LOG_PRINT_CC_RED(m_connection_context, "Failed to do_send_shared()", LOG_LEVEL_2);
       return -1;
     }
     CRITICAL_REGION_END();
+    on_sent(command, in_buff->size());
     LOG_PRINT_CC_L4(m_connection_context, "LEVIN_PACKET_SENT. [len=" << head.m_cb << 
       ", f=" << head.m_flags << 
       ", r?=" << head.m_have_to_return_data <<
@@ -703,6 +737,18 @@ public:
     return 1;
   }
   //------------------------------------------------------------------------------------------
+  void on_sent(int command, size_t body_size)
+  {
+    m_config.m_traffic_stats.on_send(command, sizeof(bucket_head2) + body_size);
+    m_connection_context.m_send_msgs.fetch_add(1, std::memory_order_relaxed);
+  }
+  //------------------------------------------------------------------------------------------
+  void on_handled(int command, uint64_t time_us)
+  {
+    m_config.m_traffic_stats.on_handled(command, time_us);
+    m_connection_context.m_handler_time_us.fetch_add(time_us, std::memory_order_relaxed);
+  }
+  //------------------------------------------------------------------------------------------
   boost::uuids::uuid get_connection_id() {return m_connection_context.m_connection_id;}
   //------------------------------------------------------------------------------------------
   t_connection_context& get_context_ref() {return m_connection_context;}
@@ -822,6 +868,55 @@ int async_protocol_handler_config<t_connection_context>::notify(int command, con
 }
 //------------------------------------------------------------------------------------------
 template<class t_connection_context>
+int async_protocol_handler_config<t_connection_context>::notify(int command, const net_utils::shared_send_buffer& in_buff, boost::uuids::uuid connection_id)
+{
+  async_protocol_handler<t_connection_context>* aph;
+  int r = find_and_lock_connection(connection_id, aph);
+  return LEVIN_OK == r ? aph->notify(command, in_buff) : r;
+}
+//------------------------------------------------------------------------------------------
+template<class t_connection_context>
+size_t async_protocol_handler_config<t_connection_context>::notify_to_list(int command, const net_utils::shared_send_buffer& in_buff, const std::list<boost::uuids::uuid>& connections)
+{
+  typedef std::list<boost::uuids::uuid> ids_list;
+  std::map<boost::asio::io_service*, boost::shared_ptr<ids_list> > by_io_service;
+  size_t count = 0;
+  CRITICAL_REGION_BEGIN(m_connects_lock);
+  for (const auto& id : connections)
+  {
+    async_protocol_handler<t_connection_context>* aph = find_connection(id);
+    if (!aph)
+      continue;
+    boost::shared_ptr<ids_list>& ids = by_io_service[&aph->m_pservice_endpoint->get_io_service()];
+    if (!ids)
+      ids.reset(new ids_list());
+    ids->push_back(id);
+    ++count;
+  }
+  CRITICAL_REGION_END();
+
+  if (by_io_service.size() == 1)
+  {
+    //all connections share one io_service, nothing to gain from posting
+    for (const auto& id : *by_io_service.begin()->second)
+      notify(command, in_buff, id);
+    return count;
+  }
+  //with io_service per thread each thread queues sends of its own connections,
+  //instead of this one taking every connection's locks in turn
+  for (auto& g : by_io_service)
+  {
+    boost::shared_ptr<ids_list> ids = g.second;
+    g.first->post([this, command, in_buff, ids]()
+    {
+      for (const auto& id : *ids)
+        notify(command, in_buff, id);
+    });
+  }
+  return count;
+}
+//------------------------------------------------------------------------------------------
+template<class t_connection_context>
 bool async_protocol_handler_config<t_connection_context>::close(boost::uuids::uuid connection_id)
 {
   CRITICAL_REGION_LOCAL(m_connects_lock);
@@ -0,0 +1,144 @@
+// Copyright (c) 2006-2013, Andrey N. Sabelnikov, www.sabelnikov.net
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+// * Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// * Redistributions in binary form must reproduce the above copyright
+// notice, this list of conditions and the following disclaimer in the
+// documentation and/or other materials provided with the distribution.
+// * Neither the name of the Andrey N. Sabelnikov nor the
+// names of its contributors may be used to endorse or promote products
+// derived from this software without specific prior written permission.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER  BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+// 
+
+
+
+
+#pragma once
+
+#include <atomic>
+#include <list>
+
+namespace epee
+{
+namespace levin
+{
+  /************************************************************************/
+  /* Per-command traffic counters, updated lock-free from any thread      */
+  /************************************************************************/
+  struct command_traffic_stat
+  {
+    int command;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t messages_in;
+    uint64_t messages_out;
+    uint64_t handler_time_us;
+  };
+
+  class traffic_stats
+  {
+  public:
+    enum { slots_count = 128 };
+    //bucket for table overflow, callers also use it for commands that have no handler so peers can't fill the table
+    enum { other_command = 0 };
+
+    traffic_stats()
+    {
+      for (size_t i = 0; i != slots_count + 1; ++i)
+        init_slot(m_slots[i]);
+    }
+
+    void on_recv(int command, uint64_t bytes)
+    {
+      slot& s = get_slot(command);
+      s.bytes_in.fetch_add(bytes, std::memory_order_relaxed);
+      s.messages_in.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void on_send(int command, uint64_t bytes)
+    {
+      slot& s = get_slot(command);
+      s.bytes_out.fetch_add(bytes, std::memory_order_relaxed);
+      s.messages_out.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void on_handled(int command, uint64_t time_us)
+    {
+      get_slot(command).handler_time_us.fetch_add(time_us, std::memory_order_relaxed);
+    }
+
+    //commands that didn't fit into the table are reported with command == other_command
+    void get_stats(std::list<command_traffic_stat>& stats) const
+    {
+      for (size_t i = 0; i != slots_count + 1; ++i)
+      {
+        const slot& s = m_slots[i];
+        int command = s.command.load(std::memory_order_acquire);
+        if (i != slots_count && !command)
+          continue;
+        command_traffic_stat st = {i == slots_count ? static_cast<int>(other_command) : command,
+                                   s.bytes_in.load(std::memory_order_relaxed),
+                                   s.bytes_out.load(std::memory_order_relaxed),
+                                   s.messages_in.load(std::memory_order_relaxed),
+                                   s.messages_out.load(std::memory_order_relaxed),
+                                   s.handler_time_us.load(std::memory_order_relaxed)};
+        if (i == slots_count && !st.messages_in && !st.messages_out)
+          continue;
+        stats.push_back(st);
+      }
+    }
+
+  private:
+    struct slot
+    {
+      std::atomic<int> command;
+      std::atomic<uint64_t> bytes_in;
+      std::atomic<uint64_t> bytes_out;
+      std::atomic<uint64_t> messages_in;
+      std::atomic<uint64_t> messages_out;
+      std::atomic<uint64_t> handler_time_us;
+    };
+
+    static void init_slot(slot& s)
+    {
+      s.command = 0;
+      s.bytes_in = s.bytes_out = s.messages_in = s.messages_out = s.handler_time_us = 0;
+    }
+
+    //open addressing over a fixed table, a slot is taken by the first command that hashes to it and never released
+    slot& get_slot(int command)
+    {
+      size_t i = static_cast<size_t>(static_cast<unsigned int>(command)) % slots_count;
+      for (size_t n = 0; n != slots_count && command != other_command; ++n, i = (i + 1) % slots_count)
+      {
+        int current = m_slots[i].command.load(std::memory_order_acquire);
+        if (current == command)
+          return m_slots[i];
+        if (!current)
+        {
+          int expected = 0;
+          if (m_slots[i].command.compare_exchange_strong(expected, command, std::memory_order_acq_rel) || expected == command)
+            return m_slots[i];
+        }
+      }
+      return m_slots[slots_count];
+    }
+
+    slot m_slots[slots_count + 1];
+  };
+}
+}
@@ -177,6 +177,9 @@ namespace net_utils
 				{
 					m_connected = true;
 					m_deadline.expires_at(boost::posix_time::pos_infin);
+					//request-response traffic, don't let Nagle hold small writes till delayed ack
+					boost::system::error_code ignored_ec;
+					m_socket.set_option(boost::asio::ip::tcp::no_delay(true), ignored_ec);
 					return true;
 				}else
 				{
@@ -346,6 +349,25 @@ namespace net_utils
 			//CATCH_ENTRY_L0("is_connected", false)
 		}
 
+		//idle connection is alive if peer neither closed it nor sent anything unasked
+		bool is_alive()
+		{
+			if(!is_connected())
+				return false;
+			char c = 0;
+			boost::system::error_code ec;
+			m_socket.non_blocking(true, ec);
+			size_t peeked = m_socket.receive(boost::asio::buffer(&c, 1), boost::asio::ip::tcp::socket::message_peek, ec);
+			bool alive = ec == boost::asio::error::would_block;
+			m_socket.non_blocking(false, ec);
+			if(!alive)
+			{
+				LOG_PRINT("Idle connection is " << (peeked ? "out of sync" : "closed"), LOG_LEVEL_3);
+				disconnect();
+			}
+			return alive;
+		}
+
 		inline 
 		bool recv(std::string& buff)
 		{
@@ -430,6 +452,13 @@ namespace net_utils
 		}
 
 		inline bool recv_n(std::string& buff, int64_t sz)
+		{
+			buff.resize(static_cast<size_t>(sz));
+			return recv_n(&buff[0], buff.size());
+		}
+
+		//reads exactly sz bytes right into the caller's memory
+		inline bool recv_n(char* buff, size_t sz)
 		{
 
 			try
@@ -451,7 +480,6 @@ namespace net_utils
 				// operation completes. The blocking_udp_client.cpp example shows how you
 				// can use boost::bind rather than boost::lambda.
 
-				buff.resize(static_cast<size_t>(sz));
 				boost::system::error_code ec = boost::asio::error::would_block;
 				size_t bytes_transfered = 0;
 
@@ -459,7 +487,7 @@ namespace net_utils
 				handler_obj hndlr(ec, bytes_transfered);
 
 				//char local_buff[10000] = {0};
-				boost::asio::async_read(m_socket, boost::asio::buffer((char*)buff.data(), buff.size()), boost::asio::transfer_at_least(buff.size()), hndlr);
+				boost::asio::async_read(m_socket, boost::asio::buffer(buff, sz), boost::asio::transfer_at_least(sz), hndlr);
 
 				// Block until the asynchronous operation has completed.
 				while (ec == boost::asio::error::would_block && !boost::interprocess::ipcdetail::atomic_read32(&m_shutdowned))
@@ -477,9 +505,9 @@ namespace net_utils
 					m_deadline.expires_at(boost::posix_time::pos_infin);
 				}
 
-				if(bytes_transfered != buff.size())
+				if(bytes_transfered != sz)
 				{
-					LOG_ERROR("Transferred missmatch with transfer_at_least value: m_bytes_transferred=" << bytes_transfered << " at_least value=" << buff.size());
+					LOG_ERROR("Transferred missmatch with transfer_at_least value: m_bytes_transferred=" << bytes_transfered << " at_least value=" << sz);
 					return false;
 				}
 
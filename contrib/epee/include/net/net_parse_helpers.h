@@ -28,6 +28,9 @@
 
 
 #pragma once 
+#include <string.h>
+#include <ctype.h>
+#include <limits>
 #include "http_base.h"
 #include "reg_exp_definer.h"
 
@@ -95,38 +98,214 @@ namespace net_utils
   inline 
     bool parse_uri(const std::string uri, http::uri_content& content)
   {
-
-    ///iframe_test.html?api_url=http://api.vk.com/api.php&api_id=3289090&api_settings=1&viewer_id=562964060&viewer_type=0&sid=0aad8d1c5713130f9ca0076f2b7b47e532877424961367d81e7fa92455f069be7e21bc3193cbd0be11895&secret=368ebbc0ef&access_token=668bc03f43981d883f73876ffff4aa8564254b359cc745dfa1b3cde7bdab2e94105d8f6d8250717569c0a7&user_id=0&group_id=0&is_app_user=1&auth_key=d2f7a895ca5ff3fdb2a2a8ae23fe679a&language=0&parent_language=0&ad_info=ElsdCQBaQlxiAQRdFUVUXiN2AVBzBx5pU1BXIgZUJlIEAWcgAUoLQg==&referrer=unknown&lc_name=9834b6a3&hash=
+    //path[?query][#fragment], split by hand as it is done for every http request
     content.m_query_params.clear();
-    STATIC_REGEXP_EXPR_1(rexp_match_uri, "^([^?#]*)(\\?([^#]*))?(#(.*))?", boost::regex::icase | boost::regex::normal);
+    std::string::size_type fragment_pos = uri.find('#');
+    std::string::size_type query_pos = uri.find('?');
+    if(query_pos > fragment_pos)
+      query_pos = std::string::npos;
 
-    boost::smatch result;	
-    if(!boost::regex_search(uri, result, rexp_match_uri, boost::match_default) && result[0].matched)
+    content.m_path = uri.substr(0, (std::min)(query_pos, fragment_pos));
+    if(std::string::npos != query_pos)
+      content.m_query = uri.substr(query_pos + 1, std::string::npos == fragment_pos ? std::string::npos : fragment_pos - query_pos - 1);
+    if(std::string::npos != fragment_pos)
+      content.m_fragment = uri.substr(fragment_pos + 1);
+    if(content.m_query.size())
     {
-      LOG_PRINT_L0("[PARSE URI] regex not matched for uri: " << uri);
-      content.m_path = uri;
-      return true;
+      parse_uri_query(content.m_query, content.m_query_params);
     }
-    if(result[1].matched)
+    return true;
+  }
+  //----------------------------------------------------------------------------
+  // Hand-written http request line and header parsers, used by the http server
+  // instead of regexps. They work over [begin, end) of the receive cache.
+  //----------------------------------------------------------------------------
+  inline bool is_equal_no_case(const char* begin, const char* end, const char* lit)
+  {
+    for(; begin != end; ++begin, ++lit)
     {
-      content.m_path = result[1];
+      if(!*lit || ::tolower(static_cast<unsigned char>(*begin)) != ::tolower(static_cast<unsigned char>(*lit)))
+        return false;
     }
-    if(result[3].matched)
+    return !*lit;
+  }
+  //----------------------------------------------------------------------------
+  inline bool is_http_space(char c)
+  {
+    return c == ' ' || c == '\t';
+  }
+  //----------------------------------------------------------------------------
+  inline bool parse_small_uint(const char*& it, const char* end, int& val)
+  {
+    const char* start = it;
+    val = 0;
+    for(; it != end && *it >= '0' && *it <= '9' && it - start < 4; ++it)
+      val = val * 10 + (*it - '0');
+    return it != start;
+  }
+  //----------------------------------------------------------------------------
+  // request line without terminating \r\n: "METHOD URI HTTP/x.y"
+  inline bool parse_http_request_line(const char* begin, const char* end, http::http_request_info& info)
+  {
+    const char* it = begin;
+    while(it != end && !is_http_space(*it))
+      ++it;
+    if(is_equal_no_case(begin, it, "GET"))
+      info.m_http_method = http::http_method_get;
+    else if(is_equal_no_case(begin, it, "POST"))
+      info.m_http_method = http::http_method_post;
+    else if(is_equal_no_case(begin, it, "HEAD"))
+      info.m_http_method = http::http_method_head;
+    else if(is_equal_no_case(begin, it, "PUT"))
+      info.m_http_method = http::http_method_put;
+    else if(is_equal_no_case(begin, it, "OPTIONS") || is_equal_no_case(begin, it, "DELETE") || is_equal_no_case(begin, it, "TRACE"))
+      info.m_http_method = http::http_method_etc;
+    else
+      return false;
+    info.m_http_method_str.assign(begin, it);
+
+    while(it != end && is_http_space(*it))
+      ++it;
+    const char* uri_begin = it;
+    while(it != end && !is_http_space(*it))
+      ++it;
+    if(uri_begin == it)
+      return false;
+    info.m_URI.assign(uri_begin, it);
+
+    while(it != end && is_http_space(*it))
+      ++it;
+    if(end - it < 5 || !is_equal_no_case(it, it + 5, "HTTP/"))
+      return false;
+    it += 5;
+    if(!parse_small_uint(it, end, info.m_http_ver_hi) || it == end || *it != '.')
+      return false;
+    ++it;
+    if(!parse_small_uint(it, end, info.m_http_ver_lo))
+      return false;
+    while(it != end && is_http_space(*it))
+      ++it;
+    return it == end;
+  }
+  //----------------------------------------------------------------------------
+  // header area after request line, lines are "name: value" ended by \r\n or \n,
+  // lines starting with space or tab continue previous value
+  inline bool parse_http_header_fields(const char* begin, const char* end, http::http_header_info& info)
+  {
+    info.clear();
+    std::string* last_value = NULL;
+    const char* it = begin;
+    while(it != end)
     {
-      content.m_query = result[3];
+      const char* line_end = static_cast<const char*>(memchr(it, '\n', end - it));
+      if(!line_end)
+        line_end = end;
+      const char* next_line = line_end == end ? end : line_end + 1;
+      if(line_end != it && *(line_end - 1) == '\r')
+        --line_end;
+
+      if(it == line_end)
+      {
+        it = next_line;
+        continue;
+      }
+
+      if(is_http_space(*it))
+      {
+        while(it != line_end && is_http_space(*it))
+          ++it;
+        if(last_value && it != line_end)
+        {
+          last_value->push_back(' ');
+          last_value->append(it, line_end);
+        }
+        it = next_line;
+        continue;
+      }
+
+      const char* colon = static_cast<const char*>(memchr(it, ':', line_end - it));
+      if(!colon)
+      {
+        last_value = NULL;
+        it = next_line;
+        continue;
+      }
+      const char* name_end = colon;
+      while(name_end != it && is_http_space(*(name_end - 1)))
+        --name_end;
+      const char* val_begin = colon + 1;
+      while(val_begin != line_end && is_http_space(*val_begin))
+        ++val_begin;
+      const char* val_end = line_end;
+      while(val_end != val_begin && is_http_space(*(val_end - 1)))
+        --val_end;
+
+      if(is_equal_no_case(it, name_end, "Connection"))
+        last_value = &info.m_connection;
+      else if(is_equal_no_case(it, name_end, "Referer"))
+        last_value = &info.m_referer;
+      else if(is_equal_no_case(it, name_end, "Content-Length"))
+        last_value = &info.m_content_length;
+      else if(is_equal_no_case(it, name_end, "Content-Type"))
+        last_value = &info.m_content_type;
+      else if(is_equal_no_case(it, name_end, "Transfer-Encoding"))
+        last_value = &info.m_transfer_encoding;
+      else if(is_equal_no_case(it, name_end, "Content-Encoding"))
+        last_value = &info.m_content_encoding;
+      else if(is_equal_no_case(it, name_end, "Host"))
+        last_value = &info.m_host;
+      else if(is_equal_no_case(it, name_end, "Cookie"))
+        last_value = &info.m_cookie;
+      else
+      {
+        info.m_etc_fields.push_back(std::pair<std::string, std::string>(std::string(it, name_end), std::string()));
+        last_value = &info.m_etc_fields.back().second;
+      }
+      last_value->assign(val_begin, val_end);
+      it = next_line;
     }
-    if(result[5].matched)
+    return true;
+  }
+  //----------------------------------------------------------------------------
+  inline bool parse_content_length(const std::string& str, size_t& len)
+  {
+    std::string::const_iterator it = str.begin();
+    while(it != str.end() && is_http_space(*it))
+      ++it;
+    if(it == str.end())
+      return false;
+    len = 0;
+    for(; it != str.end() && *it >= '0' && *it <= '9'; ++it)
     {
-      content.m_fragment = result[5];
+      if(len > (std::numeric_limits<size_t>::max() - 9) / 10)
+        return false;
+      len = len * 10 + (*it - '0');
     }
-    if(content.m_query.size())
+    while(it != str.end() && is_http_space(*it))
+      ++it;
+    return it == str.end();
+  }
+  //----------------------------------------------------------------------------
+  // returns size of header area including terminating empty line, 0 if it is not complete yet
+  inline size_t match_end_of_http_header(const char* begin, const char* end)
+  {
+    if(begin != end && *begin == '\n')
+      return 1;
+    if(end - begin >= 2 && begin[0] == '\r' && begin[1] == '\n')
+      return 2;
+    for(const char* it = begin; it != end; ++it)
     {
-      parse_uri_query(content.m_query, content.m_query_params);
+      it = static_cast<const char*>(memchr(it, '\n', end - it));
+      if(!it)
+        return 0;
+      if(it + 1 != end && it[1] == '\n')
+        return it + 2 - begin;
+      if(end - it >= 3 && it[1] == '\r' && it[2] == '\n')
+        return it + 3 - begin;
     }
-    return true;
+    return 0;
   }
 
-
   inline 
     bool parse_url(const std::string url_str, http::url_content& content)
   {
@@ -29,7 +29,9 @@
 #ifndef _NET_UTILS_BASE_H_
 #define _NET_UTILS_BASE_H_
 
+#include <atomic>
 #include <boost/uuid/uuid.hpp>
+#include <boost/shared_ptr.hpp>
 #include "string_tools.h"
 
 #ifndef MAKE_IP
@@ -55,6 +57,11 @@ namespace net_utils
     time_t   m_last_send;
     uint64_t m_recv_cnt;
     uint64_t m_send_cnt;
+    //levin messages and time spent in command handlers, maintained by levin protocol handler,
+    //read by stats from other threads
+    std::atomic<uint64_t> m_recv_msgs;
+    std::atomic<uint64_t> m_send_msgs;
+    std::atomic<uint64_t> m_handler_time_us;
 
     connection_context_base(boost::uuids::uuid connection_id, long remote_ip, int remote_port, bool is_income, time_t last_recv = 0, time_t last_send = 0, uint64_t recv_cnt = 0, uint64_t send_cnt = 0):
                                             m_connection_id(connection_id),
@@ -65,6 +72,9 @@ namespace net_utils
                                             m_last_send(last_send),
                                             m_recv_cnt(recv_cnt),
                                             m_send_cnt(send_cnt),
+                                            m_recv_msgs(0),
+                                            m_send_msgs(0),
+                                            m_handler_time_us(0),
                                             m_started(time(NULL))
     {}
 
@@ -76,9 +86,26 @@ namespace net_utils
                                m_last_send(0),
                                m_recv_cnt(0),
                                m_send_cnt(0),
+                               m_recv_msgs(0),
+                               m_send_msgs(0),
+                               m_handler_time_us(0),
                                m_started(time(NULL))
     {}
 
+    connection_context_base(const connection_context_base& a): m_connection_id(a.m_connection_id),
+                                                               m_remote_ip(a.m_remote_ip),
+                                                               m_remote_port(a.m_remote_port),
+                                                               m_is_income(a.m_is_income),
+                                                               m_last_recv(a.m_last_recv),
+                                                               m_last_send(a.m_last_send),
+                                                               m_recv_cnt(a.m_recv_cnt),
+                                                               m_send_cnt(a.m_send_cnt),
+                                                               m_recv_msgs(a.m_recv_msgs.load(std::memory_order_relaxed)),
+                                                               m_send_msgs(a.m_send_msgs.load(std::memory_order_relaxed)),
+                                                               m_handler_time_us(a.m_handler_time_us.load(std::memory_order_relaxed)),
+                                                               m_started(a.m_started)
+    {}
+
     connection_context_base& operator=(const connection_context_base& a)
     {
       set_details(a.m_connection_id, a.m_remote_ip, a.m_remote_port, a.m_is_income);
@@ -96,12 +123,33 @@ namespace net_utils
 
 	};
 
+  //immutable payload shared between send queues of several connections (broadcasts)
+  typedef boost::shared_ptr<const std::string> shared_send_buffer;
+
+  //traffic classes of outgoing messages, lower value goes out first
+  enum send_priority
+  {
+    send_priority_high = 0,     //block relay
+    send_priority_normal = 1,   //tx relay and control commands
+    send_priority_bulk = 2      //sync responses
+  };
+
 	/************************************************************************/
 	/*                                                                      */
 	/************************************************************************/
 	struct i_service_endpoint
 	{
 		virtual bool do_send(const void* ptr, size_t cb)=0;
+    //sends small head followed by optional shared body as one unit, endpoints that can't queue body by reference
+    //or don't shape traffic just copy it and ignore priority
+    virtual bool do_send_shared(const void* head_ptr, size_t head_cb, const shared_send_buffer& body, send_priority priority)
+    {
+      if (!do_send(head_ptr, head_cb))
+        return false;
+      return !body || do_send(body->data(), body->size());
+    }
+    //entries waiting in send queue, endpoints that send right away (or are shut down) report 0
+    virtual size_t get_send_queue_size(){return 0;}
     virtual bool close()=0;
     virtual bool call_run_once_service_io()=0;
     virtual bool request_callback()=0;
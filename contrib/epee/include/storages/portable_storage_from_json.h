@@ -25,6 +25,8 @@
 // 
 
 #pragma once
+#include <cstdlib>
+#include <limits>
 #include "parserse_base_utils.h"
 #include "file_io_utils.h"
 
@@ -35,296 +37,369 @@ namespace epee
   {
     namespace json
     {
-#define CHECK_ISSPACE()  if(!isspace(*it)){ ASSERT_MES_AND_THROW("Wrong JSON character at: " << std::string(it, buf_end));}
+#define JSON_ERROR_CONTEXT_SIZE 64
 
-      /*inline void parse_error()
-      {
-        ASSERT_MES_AND_THROW("json parse error");
-      }*/
+      /************************************************************************/
+      /* Single pass recursive descent parser, walks raw buffer once and     */
+      /* feeds values to storage as soon as they are matched. Unescaped      */
+      /* strings and names are copied by whole runs, numbers are converted   */
+      /* in place without intermediate strings.                              */
+      /************************************************************************/
       template<class t_storage>
-      inline void run_handler(typename t_storage::hsection current_section, std::string::const_iterator& sec_buf_begin, std::string::const_iterator buf_end, t_storage& stg)
+      class json_parser
       {
+      public:
+        json_parser(const char* begin, const char* end, t_storage& stg)
+          : m_begin(begin), m_it(begin), m_end(end), m_stg(stg)
+        {}
 
-        std::string::const_iterator sub_element_start;
-        std::string name;        
-        typename t_storage::harray h_array = nullptr;
-        enum match_state
+        void parse()
         {
-          match_state_lookup_for_section_start, 
-          match_state_lookup_for_name, 
-          match_state_waiting_separator, 
-          match_state_wonder_after_separator, 
-          match_state_wonder_after_value, 
-          match_state_wonder_array, 
-          match_state_array_after_value,
-          match_state_array_waiting_value, 
-          match_state_error
-        };
+          skip_spaces();
+          //empty document gives empty storage, as before
+          if(m_it == m_end)
+            return;
+          CHECK_AND_ASSERT_THROW_MES(*m_it == '{', "Wrong JSON character at: " << context());
+          parse_section(nullptr);
+          //anything after root section is ignored
+        }
 
-        enum array_mode
+      private:
+        struct number
         {
-          array_mode_undifined = 0,
-          array_mode_sections, 
-          array_mode_string, 
-          array_mode_numbers,
-          array_mode_booleans
+          bool is_float;
+          bool is_signed;
+          uint64_t u;
+          int64_t i;
+          double d;
         };
 
-        match_state state = match_state_lookup_for_section_start;
-        array_mode array_md = array_mode_undifined;
-        std::string::const_iterator it = sec_buf_begin;
-        for(;it != buf_end;it++)
+        std::string context() const
         {
-          switch (state)
+          const char* end = m_end - m_it > JSON_ERROR_CONTEXT_SIZE ? m_it + JSON_ERROR_CONTEXT_SIZE : m_end;
+          return "offset " + std::to_string(m_it - m_begin) + ": " + std::string(m_it, end);
+        }
+
+        //same set as isspace() in "C" locale, without the locale lookup
+        static bool is_space(char c)
+        {
+          return c == ' ' || (c >= '\t' && c <= '\r');
+        }
+
+        static bool is_digit(char c)
+        {
+          return c >= '0' && c <= '9';
+        }
+
+        void skip_spaces()
+        {
+          while(m_it != m_end && is_space(*m_it))
+            ++m_it;
+        }
+
+        //returns next meaningful character without consuming it
+        char next_char()
+        {
+          skip_spaces();
+          CHECK_AND_ASSERT_THROW_MES(m_it != m_end, "Unexpected end of JSON at offset " << m_it - m_begin);
+          return *m_it;
+        }
+
+        void expect(char c)
+        {
+          CHECK_AND_ASSERT_THROW_MES(next_char() == c, "Wrong JSON character, expected '" << c << "' at: " << context());
+          ++m_it;
+        }
+
+        //m_it points to '{', on return points right after matching '}'
+        void parse_section(typename t_storage::hsection current_section)
+        {
+          ++m_it;
+          std::string name;
+          char c = next_char();
+          while(c != '}')
           {
-          case match_state_lookup_for_section_start:
-            if(*it == '{')
-              state = match_state_lookup_for_name;
-            else CHECK_ISSPACE();
-            break;
-          case match_state_lookup_for_name:
-            switch(*it)
+            CHECK_AND_ASSERT_THROW_MES(c == '"', "Wrong JSON character, expected name at: " << context());
+            parse_string(name);
+            expect(':');
+            parse_value(name, current_section);
+            c = next_char();
+            if(c == ',')
             {
-            case '"':
-              match_string2(it, buf_end, name);
-              state = match_state_waiting_separator;
-              break;
-            case '}':
-              //this is it! section ends here.
-              //seems that it is empty section
-              sec_buf_begin = it;
-              return;
-            default:
-              CHECK_ISSPACE();
+              ++m_it;
+              //trailing comma before '}' is tolerated
+              c = next_char();
             }
-            break;
-          case match_state_waiting_separator:
-            if(*it == ':')
-              state = match_state_wonder_after_separator;
-            else CHECK_ISSPACE();
-            break;
-          case match_state_wonder_after_separator:
-            if(*it == '"')
-            {//just a named string value started
-              std::string val;
-              match_string2(it, buf_end, val);
-              //insert text value 
-              stg.set_value(name, val, current_section);              
-              state = match_state_wonder_after_value;
-            }else if (isdigit(*it) || *it == '-')
-            {//just a named number value started
-              std::string val;
-              bool is_v_float = false;bool is_signed = false;
-              match_number2(it, buf_end, val, is_v_float, is_signed);
-              if(!is_v_float)
-              {
-                if(is_signed)
-                {
-                  int64_t nval = boost::lexical_cast<int64_t>(val);
-                  stg.set_value(name, nval, current_section);              
-                }else
-                {
-                  uint64_t nval = boost::lexical_cast<uint64_t >(val);
-                  stg.set_value(name, nval, current_section);              
-                }
-              }else
-              {
-                double nval = boost::lexical_cast<double>(val);
-                stg.set_value(name, nval, current_section);              
-              }
-              state = match_state_wonder_after_value;
-            }else if(isalpha(*it) )
-            {// could be null, true or false
-              std::string word;
-              match_word2(it, buf_end, word);
-              if(boost::iequals(word, "null"))
-              {
-                state = match_state_wonder_after_value;
-                //just skip this, 
-              }else if(boost::iequals(word, "true"))
-              {
-                stg.set_value(name, true, current_section);              
-                state = match_state_wonder_after_value;
-              }else if(boost::iequals(word, "false"))
-              {
-                stg.set_value(name, false, current_section);              
-                state = match_state_wonder_after_value;
-              }else ASSERT_MES_AND_THROW("Unknown value keyword " << word);
-            }else if(*it == '{')
+            else
             {
-              //sub section here
-              typename t_storage::hsection new_sec = stg.open_section(name, current_section, true);
-              CHECK_AND_ASSERT_THROW_MES(new_sec, "Failed to insert new section in json: " << std::string(it, buf_end));
-              run_handler(new_sec, it, buf_end, stg);
-              state = match_state_wonder_after_value;
-            }else if(*it == '[')
-            {//array of something
-              state = match_state_wonder_array;
-            }else CHECK_ISSPACE();
-            break;
-          case match_state_wonder_after_value:
-            if(*it == ',')
-              state = match_state_lookup_for_name;
-            else if(*it == '}')
+              CHECK_AND_ASSERT_THROW_MES(c == '}', "Wrong JSON character, expected ',' or '}' at: " << context());
+            }
+          }
+          ++m_it;
+        }
+
+        void parse_value(const std::string& name, typename t_storage::hsection current_section)
+        {
+          char c = next_char();
+          if(c == '"')
+          {
+            parse_string(m_value);
+            m_stg.set_value(name, m_value, current_section);
+          }
+          else if(is_digit(c) || c == '-')
+          {
+            number n;
+            parse_number(n);
+            if(n.is_float)
+              m_stg.set_value(name, n.d, current_section);
+            else if(n.is_signed)
+              m_stg.set_value(name, n.i, current_section);
+            else
+              m_stg.set_value(name, n.u, current_section);
+          }
+          else if(c == '{')
+          {
+            typename t_storage::hsection new_sec = m_stg.open_section(name, current_section, true);
+            CHECK_AND_ASSERT_THROW_MES(new_sec, "Failed to insert new section in json: " << context());
+            parse_section(new_sec);
+          }
+          else if(c == '[')
+          {
+            parse_array(name, current_section);
+          }
+          else
+          {
+            //null is just skipped
+            bool v = false;
+            if(parse_keyword(v))
+              m_stg.set_value(name, v, current_section);
+          }
+        }
+
+        //array type is defined by its first element, the rest must be of the same kind
+        void parse_array(const std::string& name, typename t_storage::hsection current_section)
+        {
+          ++m_it;
+          char c = next_char();
+          if(c == ']')
+          {
+            //empty array, nothing to store
+            ++m_it;
+            return;
+          }
+
+          typename t_storage::harray h_array = nullptr;
+          if(c == '{')
+          {
+            typename t_storage::hsection new_sec = nullptr;
+            h_array = m_stg.insert_first_section(name, new_sec, current_section);
+            CHECK_AND_ASSERT_THROW_MES(h_array && new_sec, "failed to create new section");
+            parse_section(new_sec);
+            while(next_array_item())
             {
-              //this is it! section ends here.
-              sec_buf_begin = it;
-              return;
-            }else CHECK_ISSPACE();
-            break;
-          case match_state_wonder_array:
-            if(*it == '[')
+              CHECK_AND_ASSERT_THROW_MES(next_char() == '{', "Wrong JSON character, expected section in array at: " << context());
+              new_sec = nullptr;
+              bool r = m_stg.insert_next_section(h_array, new_sec);
+              CHECK_AND_ASSERT_THROW_MES(r && new_sec, "failed to insert next section");
+              parse_section(new_sec);
+            }
+          }
+          else if(c == '"')
+          {
+            parse_string(m_value);
+            h_array = m_stg.insert_first_value(name, m_value, current_section);
+            CHECK_AND_ASSERT_THROW_MES(h_array, " failed to insert values entry");
+            while(next_array_item())
             {
-              ASSERT_MES_AND_THROW("array of array not suppoerted yet :( sorry"); 
-              //mean array of array
+              CHECK_AND_ASSERT_THROW_MES(next_char() == '"', "Wrong JSON character, expected string in array at: " << context());
+              parse_string(m_value);
+              bool r = m_stg.insert_next_value(h_array, m_value);
+              CHECK_AND_ASSERT_THROW_MES(r, "failed to insert values");
             }
-            if(*it == '{')
+          }
+          else if(is_digit(c) || c == '-')
+          {
+            number n;
+            parse_number(n);
+            //integers in arrays are always kept as signed, as before
+            if(n.is_float)
+              h_array = m_stg.insert_first_value(name, n.d, current_section);
+            else
+              h_array = m_stg.insert_first_value(name, to_int64(n), current_section);
+            CHECK_AND_ASSERT_THROW_MES(h_array, " failed to insert values section entry");
+            while(next_array_item())
             {
-              //mean array of sections
-              typename t_storage::hsection new_sec = nullptr;
-              h_array = stg.insert_first_section(name, new_sec, current_section);
-              CHECK_AND_ASSERT_THROW_MES(h_array&&new_sec, "failed to create new section");
-              run_handler(new_sec, it, buf_end, stg);
-              state = match_state_array_after_value;
-              array_md = array_mode_sections;
-            }else if(*it == '"')
+              c = next_char();
+              CHECK_AND_ASSERT_THROW_MES(is_digit(c) || c == '-', "Wrong JSON character, expected number in array at: " << context());
+              parse_number(n);
+              bool r = n.is_float ? m_stg.insert_next_value(h_array, n.d) : m_stg.insert_next_value(h_array, to_int64(n));
+              CHECK_AND_ASSERT_THROW_MES(r, "Failed to insert next value");
+            }
+          }
+          else if(c == '[')
+          {
+            ASSERT_MES_AND_THROW("array of array not suppoerted yet :( sorry");
+          }
+          else
+          {
+            bool v = false;
+            CHECK_AND_ASSERT_THROW_MES(parse_keyword(v), "null is not allowed in array: " << context());
+            h_array = m_stg.insert_first_value(name, v, current_section);
+            CHECK_AND_ASSERT_THROW_MES(h_array, " failed to insert values section entry");
+            while(next_array_item())
             {
-              //mean array of strings
-              std::string val;
-              match_string2(it, buf_end, val);
-              h_array = stg.insert_first_value(name, val, current_section);
-              CHECK_AND_ASSERT_THROW_MES(h_array, " failed to insert values entry");
-              state = match_state_array_after_value;
-              array_md = array_mode_string;
-            }else if (isdigit(*it) || *it == '-')
-            {//array of numbers value started
-              std::string val;
-              bool is_v_float = false;bool is_signed_val = false;
-              match_number2(it, buf_end, val, is_v_float, is_signed_val);
-              if(!is_v_float)
-              {
-                int64_t nval = boost::lexical_cast<int64_t>(val);//bool res = string_tools::string_to_num_fast(val, nval);
-                h_array = stg.insert_first_value(name, nval, current_section);
-                CHECK_AND_ASSERT_THROW_MES(h_array, " failed to insert values section entry");
-              }else
-              {
-                double nval = boost::lexical_cast<double>(val);//bool res = string_tools::string_to_num_fast(val, nval);
-                h_array = stg.insert_first_value(name, nval, current_section);
-                CHECK_AND_ASSERT_THROW_MES(h_array, " failed to insert values section entry");
-              }
+              next_char();
+              CHECK_AND_ASSERT_THROW_MES(parse_keyword(v), "null is not allowed in array: " << context());
+              bool r = m_stg.insert_next_value(h_array, v);
+              CHECK_AND_ASSERT_THROW_MES(r, " failed to insert values section entry");
+            }
+          }
+        }
 
-              state = match_state_array_after_value;
-              array_md = array_mode_numbers;
-            }else if(*it == ']')//empty array
-            {
-              array_md = array_mode_undifined;
-              state = match_state_wonder_after_value;
-            }else if(isalpha(*it) )
-            {// array of booleans
-              std::string word;
-              match_word2(it, buf_end, word);
-              if(boost::iequals(word, "true"))
-              {
-                h_array = stg.insert_first_value(name, true, current_section);              
-                CHECK_AND_ASSERT_THROW_MES(h_array, " failed to insert values section entry");
-                state = match_state_array_after_value;
-                array_md = array_mode_booleans;
-              }else if(boost::iequals(word, "false"))
-              {
-                h_array = stg.insert_first_value(name, false, current_section);              
-                CHECK_AND_ASSERT_THROW_MES(h_array, " failed to insert values section entry");
-                state = match_state_array_after_value;
-                array_md = array_mode_booleans;
+        //consumes ',' and returns true, or consumes ']' and returns false
+        bool next_array_item()
+        {
+          char c = next_char();
+          ++m_it;
+          if(c == ',')
+            return true;
+          CHECK_AND_ASSERT_THROW_MES(c == ']', "Wrong JSON character, expected ',' or ']' at: " << context());
+          return false;
+        }
 
-              }else ASSERT_MES_AND_THROW("Unknown value keyword " << word)
-            }else CHECK_ISSPACE();
-            break;
-          case match_state_array_after_value:
-            if(*it == ',')
-              state = match_state_array_waiting_value;
-            else if(*it == ']')
+        //m_it points to opening quote, on return points right after closing one
+        void parse_string(std::string& val)
+        {
+          val.clear();
+          const char* run = ++m_it;
+          while(m_it != m_end)
+          {
+            char c = *m_it;
+            if(c == '"')
+            {
+              val.append(run, m_it);
+              ++m_it;
+              return;
+            }
+            if(c != '\\')
             {
-              h_array = nullptr;
-              array_md = array_mode_undifined;
-              state = match_state_wonder_after_value;
-            }else CHECK_ISSPACE();
-            break;
-          case match_state_array_waiting_value:
-            switch(array_md)
+              ++m_it;
+              continue;
+            }
+            val.append(run, m_it);
+            CHECK_AND_ASSERT_THROW_MES(++m_it != m_end, "Failed to match string in json entry: " << std::string(run - 1, m_end));
+            switch(*m_it)
             {
-            case array_mode_sections:
-              if(*it == '{')
-              {
-                typename t_storage::hsection new_sec = NULL;
-                bool res = stg.insert_next_section(h_array, new_sec);
-                CHECK_AND_ASSERT_THROW_MES(res&&new_sec, "failed to insert next section");
-                run_handler(new_sec, it, buf_end, stg);
-                state = match_state_array_after_value;
-              }else CHECK_ISSPACE();
-              break;
-            case array_mode_string:
-              if(*it == '"')
-              {
-                std::string val;
-                match_string2(it, buf_end, val);
-                bool res = stg.insert_next_value(h_array, val);
-                CHECK_AND_ASSERT_THROW_MES(res, "failed to insert values");
-                state = match_state_array_after_value;
-              }else CHECK_ISSPACE();
-              break;
-            case array_mode_numbers:
-              if (isdigit(*it) || *it == '-')
-              {//array of numbers value started
-                std::string val;
-                bool is_v_float = false;bool is_signed_val = false;
-                match_number2(it, buf_end, val, is_v_float, is_signed_val);
-                bool insert_res = false;
-                if(!is_v_float)
-                {
-                  int64_t nval = boost::lexical_cast<int64_t>(val);  //bool res = string_tools::string_to_num_fast(val, nval);
-                  insert_res = stg.insert_next_value(h_array, nval);
-                  
-                }else
-                {
-                  //TODO: optimize here if need
-                  double nval = boost::lexical_cast<double>(val); //string_tools::string_to_num_fast(val, nval);
-                  insert_res = stg.insert_next_value(h_array, nval);              
-                }
-                CHECK_AND_ASSERT_THROW_MES(insert_res, "Failed to insert next value");
-                state = match_state_array_after_value;
-                array_md = array_mode_numbers;
-              }else CHECK_ISSPACE();
-              break;
-            case array_mode_booleans:
-              if(isalpha(*it) )
-              {// array of booleans
-                std::string word;
-                match_word2(it, buf_end, word);
-                if(boost::iequals(word, "true"))
-                {
-                  bool r = stg.insert_next_value(h_array, true);              
-                  CHECK_AND_ASSERT_THROW_MES(r, " failed to insert values section entry");
-                  state = match_state_array_after_value;
-                }else if(boost::iequals(word, "false"))
-                {
-                  bool r = stg.insert_next_value(h_array, false);
-                  CHECK_AND_ASSERT_THROW_MES(r, " failed to insert values section entry");
-                  state = match_state_array_after_value;
-                }
-                else ASSERT_MES_AND_THROW("Unknown value keyword " << word);
-              }else CHECK_ISSPACE();
-              break;
-            case array_mode_undifined:
+            case 'b': val.push_back(0x08); break;
+            case 'f': val.push_back(0x0C); break;
+            case 'n': val.push_back('\n'); break;
+            case 'r': val.push_back('\r'); break;
+            case 't': val.push_back('\t'); break;
+            case 'v': val.push_back('\v'); break;
+            case '\'': val.push_back('\''); break;
+            case '"': val.push_back('"'); break;
+            case '\\': val.push_back('\\'); break;
+            case '/': val.push_back('/'); break;
             default:
-              ASSERT_MES_AND_THROW("Bad array state");
+              val.push_back(*m_it);
+              LOG_PRINT_L0("Unknown escape sequence :\"\\" << *m_it << "\"");
             }
-            break;
-          case match_state_error:
-          default:
-            ASSERT_MES_AND_THROW("WRONG JSON STATE");
+            run = ++m_it;
           }
+          ASSERT_MES_AND_THROW("Failed to match string in json entry: " << std::string(run, m_end));
         }
-      }
+
+        void parse_number(number& n)
+        {
+          const char* start = m_it;
+          n.is_float = false;
+          n.is_signed = false;
+          n.u = 0;
+          if(*m_it == '-')
+          {
+            n.is_signed = true;
+            ++m_it;
+          }
+          const char* digits = m_it;
+          bool overflow = false;
+          for(; m_it != m_end && is_digit(*m_it); ++m_it)
+          {
+            uint64_t d = *m_it - '0';
+            if(n.u > (std::numeric_limits<uint64_t>::max() - d) / 10)
+              overflow = true;
+            n.u = n.u * 10 + d;
+          }
+          CHECK_AND_ASSERT_THROW_MES(m_it != digits, "wrong number in json entry: " << context());
+          if(m_it != m_end && *m_it == '.')
+          {
+            n.is_float = true;
+            for(++m_it; m_it != m_end && is_digit(*m_it); ++m_it);
+          }
+          if(m_it != m_end && (*m_it == 'e' || *m_it == 'E'))
+          {
+            n.is_float = true;
+            ++m_it;
+            if(m_it != m_end && (*m_it == '-' || *m_it == '+'))
+              ++m_it;
+            for(; m_it != m_end && is_digit(*m_it); ++m_it);
+          }
+          CHECK_AND_ASSERT_THROW_MES(m_it != m_end, "wrong number in json entry: " << std::string(start, m_it));
+          CHECK_AND_ASSERT_THROW_MES(n.is_float || !overflow, "number is out of range in json entry: " << std::string(start, m_it));
+
+          if(n.is_float)
+          {
+            m_value.assign(start, m_it);
+            char* end = nullptr;
+            n.d = strtod(m_value.c_str(), &end);
+            CHECK_AND_ASSERT_THROW_MES(end == m_value.c_str() + m_value.size(), "wrong number in json entry: " << m_value);
+          }
+          else if(n.is_signed)
+          {
+            CHECK_AND_ASSERT_THROW_MES(n.u <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max()) + 1, "number is out of range in json entry: " << std::string(start, m_it));
+            n.i = static_cast<int64_t>(0 - n.u);
+          }
+        }
+
+        static int64_t to_int64(const number& n)
+        {
+          if(n.is_signed)
+            return n.i;
+          CHECK_AND_ASSERT_THROW_MES(n.u <= static_cast<uint64_t>(std::numeric_limits<int64_t>::max()), "number is out of range in json array: " << n.u);
+          return static_cast<int64_t>(n.u);
+        }
+
+        //matches true/false/null in any case, returns false for null
+        bool parse_keyword(bool& v)
+        {
+          const char* start = m_it;
+          while(m_it != m_end && isalpha(static_cast<unsigned char>(*m_it)))
+            ++m_it;
+          size_t len = m_it - start;
+          if(is_word(start, len, "true"))
+            v = true;
+          else if(is_word(start, len, "false"))
+            v = false;
+          else if(is_word(start, len, "null"))
+            return false;
+          else
+            ASSERT_MES_AND_THROW("Unknown value keyword " << std::string(start, m_it));
+          return true;
+        }
+
+        static bool is_word(const char* p, size_t len, const char* word)
+        {
+          for(size_t i = 0; i != len; ++i)
+            if(!word[i] || tolower(static_cast<unsigned char>(p[i])) != word[i])
+              return false;
+          return word[len] == 0;
+        }
+
+        const char* m_begin;
+        const char* m_it;
+        const char* m_end;
+        t_storage& m_stg;
+        std::string m_value; //reused for every string value
+      };
 /*
 {
     "firstName": "John",
@@ -357,10 +432,10 @@ namespace epee
       template<class t_storage>
       inline bool load_from_json(const std::string& buff_json, t_storage& stg)
       {
-        std::string::const_iterator sec_buf_begin  = buff_json.begin();
         try
         {
-          run_handler(nullptr, sec_buf_begin, buff_json.end(), stg);
+          json_parser<t_storage> parser(buff_json.data(), buff_json.data() + buff_json.size(), stg);
+          parser.parse();
           return true;
         }
         catch(const std::exception& ex)
@@ -376,4 +451,4 @@ namespace epee
       }
     }
   }
-}
\ No newline at end of file
+}
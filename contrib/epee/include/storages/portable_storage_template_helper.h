@@ -27,6 +27,7 @@
 #pragma once
 #include "parserse_base_utils.h"
 #include "portable_storage.h"
+#include "portable_storage_to_stream.h"
 #include "file_io_utils.h"
 
 namespace epee
@@ -81,6 +82,14 @@ namespace epee
     }
     //-----------------------------------------------------------------------------------------------------------
     template<class t_struct>
+    bool store_t_to_json_stream(const t_struct& str_in, const stream_sink& sink, size_t chunk_size = PORTABLE_STORAGE_STREAM_CHUNK_SIZE)
+    {
+      json_stream_storage st(sink, chunk_size);
+      str_in.store(st);
+      return st.finish();
+    }
+    //-----------------------------------------------------------------------------------------------------------
+    template<class t_struct>
     bool load_t_from_binary(t_struct& out, const std::string& binary_buff)
     {
       portable_storage ps;
@@ -119,5 +128,15 @@ POP_WARNINGS
       store_t_to_binary(str_in, binary_buff, indent);
       return binary_buff;
     }
+    //-----------------------------------------------------------------------------------------------------------
+    template<class t_struct>
+    bool store_t_to_binary_stream(const t_struct& str_in, const stream_sink& sink, size_t chunk_size = PORTABLE_STORAGE_STREAM_CHUNK_SIZE)
+    {
+      binary_stream_storage st(sink, chunk_size);
+      str_in.store(st);
+      st.start_writing();
+      str_in.store(st);
+      return st.finish();
+    }
   }
 }
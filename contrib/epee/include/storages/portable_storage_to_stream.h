@@ -0,0 +1,406 @@
+// Copyright (c) 2006-2013, Andrey N. Sabelnikov, www.sabelnikov.net
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//     * Redistributions of source code must retain the above copyright
+//     notice, this list of conditions and the following disclaimer.
+//     * Redistributions in binary form must reproduce the above copyright
+//     notice, this list of conditions and the following disclaimer in the
+//     documentation and/or other materials provided with the distribution.
+//     * Neither the name of the Andrey N. Sabelnikov nor the
+//     names of its contributors may be used to endorse or promote products
+//     derived from this software without specific prior written permission.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+// ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+// WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+// DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER  BE LIABLE FOR ANY
+// DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+// (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+// ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+// SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <limits>
+#include <sstream>
+#include "misc_language.h"
+#include "portable_storage_base.h"
+#include "portable_storage_to_bin.h"
+#include "portable_storage_to_json.h"
+
+#define PORTABLE_STORAGE_STREAM_CHUNK_SIZE  (64*1024)
+
+namespace epee
+{
+  namespace serialization
+  {
+    //receives next piece of output, may take its contents; returning false stops output
+    typedef std::function<bool(std::string& chunk)> stream_sink;
+
+    /************************************************************************/
+    /* Write-only storages with store() interface of portable_storage.      */
+    /* Values go straight to the output buffer, which is handed to sink     */
+    /* every PORTABLE_STORAGE_STREAM_CHUNK_SIZE bytes, so no tree and no    */
+    /* whole body is built. Entries keep declaration order (portable_storage*/
+    /* sorts them by name), readers don't depend on it.                     */
+    /************************************************************************/
+    struct stream_frame
+    {
+      bool is_array;
+      size_t items;
+      size_t count_index;
+    };
+
+    template<class t_derived>
+    class stream_storage_base
+    {
+    public:
+      typedef stream_frame* hsection;
+      typedef stream_frame* harray;
+      typedef storage_entry meta_entry;
+
+      stream_storage_base(const stream_sink& sink, size_t chunk_size):m_sink(sink), m_chunk_size(chunk_size), m_failed(false)
+      {
+        m_buff.reserve(m_chunk_size);
+      }
+
+      void write(const char* data, size_t size)
+      {
+        if(m_failed)
+          return;
+        m_buff.append(data, size);
+        if(m_buff.size() >= m_chunk_size)
+          flush();
+      }
+      void write(const std::string& s) { write(s.data(), s.size()); }
+      void write(char c) { write(&c, 1); }
+
+      bool flush()
+      {
+        if(!m_failed && m_buff.size())
+        {
+          m_failed = !m_sink(m_buff);
+          m_buff.clear();
+          m_buff.reserve(m_chunk_size);
+        }
+        return !m_failed;
+      }
+
+      //-------------------------- portable_storage interface
+      template<class t_value>
+      bool set_value(const std::string& value_name, const t_value& v, hsection hparent_section)
+      {
+        stream_frame* psec = enter(hparent_section);
+        CHECK_AND_ASSERT_MES(psec, false, "set_value: unknown parent section for " << value_name);
+        derived().put_name(*psec, value_name);
+        derived().put_value(v);
+        return true;
+      }
+
+      hsection open_section(const std::string& section_name, hsection hparent_section, bool /*create_if_notexist*/ = false)
+      {
+        stream_frame* psec = enter(hparent_section);
+        CHECK_AND_ASSERT_MES(psec, nullptr, "open_section: unknown parent section for " << section_name);
+        derived().put_name(*psec, section_name);
+        derived().put_section_type();
+        return derived().begin_frame(false);
+      }
+
+      template<class t_value>
+      harray insert_first_value(const std::string& value_name, const t_value& v, hsection hparent_section)
+      {
+        stream_frame* psec = enter(hparent_section);
+        CHECK_AND_ASSERT_MES(psec, nullptr, "insert_first_value: unknown parent section for " << value_name);
+        derived().put_name(*psec, value_name);
+        derived().put_array_type(v);
+        stream_frame* parr = derived().begin_frame(true);
+        insert_next_value(parr, v);
+        return parr;
+      }
+
+      template<class t_value>
+      bool insert_next_value(harray hval_array, const t_value& v)
+      {
+        stream_frame* parr = enter(hval_array);
+        CHECK_AND_ASSERT_MES(parr, false, "insert_next_value: unknown array");
+        derived().next_item(*parr);
+        derived().put_array_value(v);
+        return true;
+      }
+
+      harray insert_first_section(const std::string& section_name, hsection& hinserted_childsection, hsection hparent_section)
+      {
+        stream_frame* psec = enter(hparent_section);
+        CHECK_AND_ASSERT_MES(psec, nullptr, "insert_first_section: unknown parent section for " << section_name);
+        derived().put_name(*psec, section_name);
+        derived().put_section_array_type();
+        stream_frame* parr = derived().begin_frame(true);
+        insert_next_section(parr, hinserted_childsection);
+        return parr;
+      }
+
+      bool insert_next_section(harray hsec_array, hsection& hinserted_childsection)
+      {
+        stream_frame* parr = enter(hsec_array);
+        CHECK_AND_ASSERT_MES(parr, false, "insert_next_section: unknown array");
+        derived().next_item(*parr);
+        hinserted_childsection = derived().begin_frame(false);
+        return true;
+      }
+
+    protected:
+      t_derived& derived() { return static_cast<t_derived&>(*this); }
+
+      stream_frame* push_frame(bool is_array, size_t count_index)
+      {
+        stream_frame fr = AUTO_VAL_INIT(fr);
+        fr.is_array = is_array;
+        fr.count_index = count_index;
+        m_frames.push_back(fr);
+        return &m_frames.back();
+      }
+
+      //storing goes depth first, so any call refers to the innermost frame or to one of its
+      //parents, which means everything opened above it is complete and can be closed
+      stream_frame* enter(stream_frame* pframe)
+      {
+        if(!m_frames.size())
+          return nullptr;
+        if(!pframe)
+          pframe = &m_frames.front();
+        while(m_frames.size() && &m_frames.back() != pframe)
+        {
+          derived().end_frame(m_frames.back());
+          m_frames.pop_back();
+        }
+        return m_frames.size() ? pframe : nullptr;
+      }
+
+      bool finish()
+      {
+        CHECK_AND_ASSERT_MES(m_frames.size(), false, "stream storage: no root section");
+        enter(nullptr);
+        derived().end_frame(m_frames.back());
+        m_frames.pop_back();
+        return flush();
+      }
+
+      std::deque<stream_frame> m_frames; //deque keeps frame addresses while growing
+      std::string m_buff;
+      stream_sink m_sink;
+      size_t m_chunk_size;
+      bool m_failed;
+    };
+    //-----------------------------------------------------------------------------------------------------------
+    class json_stream_storage: public stream_storage_base<json_stream_storage>
+    {
+      friend class stream_storage_base<json_stream_storage>;
+    public:
+      json_stream_storage(const stream_sink& sink, size_t chunk_size = PORTABLE_STORAGE_STREAM_CHUNK_SIZE):stream_storage_base<json_stream_storage>(sink, chunk_size)
+      {
+        write('{');
+        push_frame(false, 0);
+      }
+
+      bool finish() { return stream_storage_base<json_stream_storage>::finish(); }
+
+    private:
+      stream_frame* begin_frame(bool is_array)
+      {
+        write(is_array ? '[' : '{');
+        return push_frame(is_array, 0);
+      }
+      void end_frame(const stream_frame& fr)
+      {
+        write(fr.is_array ? ']' : '}');
+      }
+      void next_item(stream_frame& fr)
+      {
+        if(fr.items++)
+          write(',');
+      }
+      void put_name(stream_frame& sec, const std::string& name)
+      {
+        next_item(sec);
+        write('"');
+        write(misc_utils::parse::transform_to_escape_sequence(name));
+        write("\": ", 3);
+      }
+      template<class t_value>
+      void put_array_type(const t_value&){}
+      void put_section_type(){}
+      void put_section_array_type(){}
+      template<class t_value>
+      void put_array_value(const t_value& v) { put_value(v); }
+
+      //same text as dump_as_json() gives
+      void put_value(const std::string& v)
+      {
+        write('"');
+        write(misc_utils::parse::transform_to_escape_sequence(v));
+        write('"');
+      }
+      void put_value(const bool& v) { v ? write("true", 4) : write("false", 5); }
+      void put_value(const int8_t& v) { write(std::to_string(static_cast<int32_t>(v))); }
+      void put_value(const uint8_t& v) { write(std::to_string(static_cast<int32_t>(v))); }
+      void put_value(const int16_t& v) { write(std::to_string(v)); }
+      void put_value(const uint16_t& v) { write(std::to_string(v)); }
+      void put_value(const int32_t& v) { write(std::to_string(v)); }
+      void put_value(const uint32_t& v) { write(std::to_string(v)); }
+      void put_value(const int64_t& v) { write(std::to_string(v)); }
+      void put_value(const uint64_t& v) { write(std::to_string(v)); }
+      void put_value(const double& v)
+      {
+        std::stringstream ss;
+        ss << v;
+        write(ss.str());
+      }
+      void put_value(const storage_entry& v)
+      {
+        std::stringstream ss;
+        dump_as_json(ss, v, m_frames.size());
+        write(ss.str());
+      }
+    };
+    //-----------------------------------------------------------------------------------------------------------
+    // binary format keeps counts of entries in front of sections and arrays, so the object is
+    // stored twice: first pass only counts, second one writes using the counts
+    class binary_stream_storage: public stream_storage_base<binary_stream_storage>
+    {
+      friend class stream_storage_base<binary_stream_storage>;
+    public:
+      binary_stream_storage(const stream_sink& sink, size_t chunk_size = PORTABLE_STORAGE_STREAM_CHUNK_SIZE):stream_storage_base<binary_stream_storage>(sink, chunk_size), m_counting(true), m_next_count(0)
+      {
+        m_counts.push_back(0);
+        push_frame(false, 0);
+      }
+
+      //switches from counting pass to writing pass
+      bool start_writing()
+      {
+        CHECK_AND_ASSERT_MES(m_counting && m_frames.size(), false, "binary_stream_storage: wrong state");
+        enter(nullptr);
+        m_frames.pop_back();
+        m_counting = false;
+        m_next_count = 0;
+
+        uint32_t sig_a = PORTABLE_STORAGE_SIGNATUREA;
+        uint32_t sig_b = PORTABLE_STORAGE_SIGNATUREB;
+        uint8_t ver = PORTABLE_STORAGE_FORMAT_VER;
+        write((const char*)&sig_a, sizeof(sig_a));
+        write((const char*)&sig_b, sizeof(sig_b));
+        write((const char*)&ver, sizeof(ver));
+        pack_varint(*this, static_cast<size_t>(m_counts[m_next_count++]));
+        push_frame(false, 0);
+        return true;
+      }
+
+      bool finish()
+      {
+        CHECK_AND_ASSERT_MES(!m_counting, false, "binary_stream_storage: finish() called before writing pass");
+        CHECK_AND_ASSERT_MES(m_next_count == m_counts.size(), false, "binary_stream_storage: writing pass differs from counting pass");
+        return stream_storage_base<binary_stream_storage>::finish();
+      }
+
+    private:
+      stream_frame* begin_frame(bool is_array)
+      {
+        if(m_counting)
+        {
+          m_counts.push_back(0);
+          return push_frame(is_array, m_counts.size() - 1);
+        }
+        CHECK_AND_ASSERT_THROW_MES(m_next_count < m_counts.size(), "binary_stream_storage: writing pass differs from counting pass");
+        pack_varint(*this, static_cast<size_t>(m_counts[m_next_count++]));
+        return push_frame(is_array, 0);
+      }
+      void end_frame(const stream_frame&){}
+      void next_item(stream_frame& fr)
+      {
+        if(m_counting)
+          ++m_counts[fr.count_index];
+      }
+      void put_name(stream_frame& sec, const std::string& name)
+      {
+        next_item(sec);
+        if(m_counting)
+          return;
+        CHECK_AND_ASSERT_THROW_MES(name.size() < std::numeric_limits<uint8_t>::max(), "storage_entry_name is too long: " << name.size() << ", val: " << name);
+        uint8_t len = static_cast<uint8_t>(name.size());
+        write((const char*)&len, sizeof(len));
+        write(name.data(), name.size());
+      }
+
+      static uint8_t get_type(const uint64_t&) { return SERIALIZE_TYPE_UINT64; }
+      static uint8_t get_type(const uint32_t&) { return SERIALIZE_TYPE_UINT32; }
+      static uint8_t get_type(const uint16_t&) { return SERIALIZE_TYPE_UINT16; }
+      static uint8_t get_type(const uint8_t&) { return SERIALIZE_TYPE_UINT8; }
+      static uint8_t get_type(const int64_t&) { return SERIALIZE_TYPE_INT64; }
+      static uint8_t get_type(const int32_t&) { return SERIALIZE_TYPE_INT32; }
+      static uint8_t get_type(const int16_t&) { return SERIALIZE_TYPE_INT16; }
+      static uint8_t get_type(const int8_t&) { return SERIALIZE_TYPE_INT8; }
+      static uint8_t get_type(const double&) { return SERIALIZE_TYPE_DUOBLE; }
+      static uint8_t get_type(const bool&) { return SERIALIZE_TYPE_BOOL; }
+      static uint8_t get_type(const std::string&) { return SERIALIZE_TYPE_STRING; }
+
+      template<class t_value>
+      void put_array_type(const t_value& v)
+      {
+        if(m_counting)
+          return;
+        uint8_t type = get_type(v) | SERIALIZE_FLAG_ARRAY;
+        write((const char*)&type, 1);
+      }
+      void put_section_type()
+      {
+        if(m_counting)
+          return;
+        uint8_t type = SERIALIZE_TYPE_OBJECT;
+        write((const char*)&type, 1);
+      }
+      void put_section_array_type()
+      {
+        if(m_counting)
+          return;
+        uint8_t type = SERIALIZE_TYPE_OBJECT | SERIALIZE_FLAG_ARRAY;
+        write((const char*)&type, 1);
+      }
+      template<class t_value>
+      void put_array_value(const t_value& v)
+      {
+        if(!m_counting)
+          write((const char*)&v, sizeof(v));
+      }
+      void put_array_value(const std::string& v)
+      {
+        if(!m_counting)
+          put_string(*this, v);
+      }
+      template<class t_value>
+      void put_value(const t_value& v)
+      {
+        if(m_counting)
+          return;
+        uint8_t type = get_type(v);
+        write((const char*)&type, 1);
+        put_array_value(v);
+      }
+      void put_value(const storage_entry& v)
+      {
+        if(!m_counting)
+          pack_entry_to_buff(*this, v);
+      }
+
+      bool m_counting;
+      std::vector<uint64_t> m_counts;
+      size_t m_next_count;
+    };
+  }
+}
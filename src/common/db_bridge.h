@@ -927,6 +927,12 @@ namespace db
       }
       return res;
     }
+
+    // bypasses m_cache entirely, so it's safe to call concurrently from worker threads holding their own read-only db transaction
+    std::shared_ptr<const value_t> get_no_cache(size_t k) const
+    {
+      return super::operator [](k);
+    }
   private: 
     void crop_cache()
     {
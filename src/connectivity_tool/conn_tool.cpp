@@ -39,6 +39,8 @@ namespace
   const command_line::arg_descriptor<bool>        arg_request_net_state  = {"request_net_state", "request network state information (peer list, connections count)"};
   const command_line::arg_descriptor<bool>        arg_get_daemon_info    = {"rpc_get_daemon_info", "request daemon state info vie rpc (--rpc_port option should be set ).", "", true};
   const command_line::arg_descriptor<bool>        arg_get_aliases        = {"rpc_get_aliases", "request daemon aliases all list", "", true};
+  const command_line::arg_descriptor<bool>        arg_get_p2p_traffic    = {"rpc_get_p2p_traffic", "request daemon p2p traffic statistics per command via rpc (--rpc_port option should be set ).", "", true};
+  const command_line::arg_descriptor<bool>        arg_get_rpc_stats      = {"rpc_get_rpc_stats", "request daemon rpc calls and latency statistics per route via rpc (--rpc_port option should be set ).", "", true};
   const command_line::arg_descriptor<std::string> arg_upate_maintainers_info = {"upate_maintainers_info", "Push maintainers info into the network, upate_maintainers_info=file_with_info.json", "", true};
   const command_line::arg_descriptor<std::string> arg_update_build_no    = {"update_build_no", "Updated version number in version template file", "", true};
   const command_line::arg_descriptor<std::string> arg_pack_file          = {"pack_file", "Pack(using gzip) and calculate md5 hash for file", "", true };
@@ -221,7 +223,69 @@ bool handle_get_daemon_info(po::variables_map& vm)
   << "scratchpad_size: " << res.scratchpad_size << ENDL
   << "alias_count: " << res.alias_count << ENDL
   << "transactions_cnt_per_day: " << res.transactions_cnt_per_day << ENDL
-  << "transactions_volume_per_day: " << res.transactions_volume_per_day << ENDL;
+  << "transactions_volume_per_day: " << res.transactions_volume_per_day << ENDL
+  << "rpc_cache_hits: " << res.rpc_cache_hits << ENDL
+  << "rpc_cache_misses: " << res.rpc_cache_misses << ENDL
+  << "rpc_cache_entries: " << res.rpc_cache_entries << ENDL
+  << "rpc_cache_size: " << res.rpc_cache_size << ENDL;
+  return true;
+}
+//---------------------------------------------------------------------------------------------------------------
+bool handle_get_p2p_traffic(po::variables_map& vm)
+{
+  if(!command_line::has_arg(vm, arg_rpc_port))
+  {
+    std::cout << "ERROR: rpc port not set" << ENDL;
+    return false;
+  }
+
+  epee::net_utils::http::http_simple_client http_client;
+
+  currency::COMMAND_RPC_GET_P2P_TRAFFIC_STATS::request req = AUTO_VAL_INIT(req);
+  currency::COMMAND_RPC_GET_P2P_TRAFFIC_STATS::response res = AUTO_VAL_INIT(res);
+  std::string daemon_addr = command_line::get_arg(vm, arg_ip) + ":" + std::to_string(command_line::get_arg(vm, arg_rpc_port));
+  bool r = net_utils::invoke_http_json_remote_command2(daemon_addr + "/get_p2p_traffic_stats", req, res, http_client, command_line::get_arg(vm, arg_timeout));
+  if(!r)
+  {
+    std::cout << "ERROR: failed to invoke request" << ENDL;
+    return false;
+  }
+  //one line per command: name bytes_in bytes_out messages_in messages_out handler_time_us
+  std::cout << "OK" << ENDL;
+  for (const auto& ce : res.commands)
+  {
+    std::cout << ce.name << " " << ce.bytes_in << " " << ce.bytes_out << " " << ce.messages_in << " "
+      << ce.messages_out << " " << ce.handler_time_us << ENDL;
+  }
+  return true;
+}
+//---------------------------------------------------------------------------------------------------------------
+bool handle_get_rpc_stats(po::variables_map& vm)
+{
+  if(!command_line::has_arg(vm, arg_rpc_port))
+  {
+    std::cout << "ERROR: rpc port not set" << ENDL;
+    return false;
+  }
+
+  epee::net_utils::http::http_simple_client http_client;
+
+  currency::COMMAND_RPC_GET_RPC_STATS::request req = AUTO_VAL_INIT(req);
+  currency::COMMAND_RPC_GET_RPC_STATS::response res = AUTO_VAL_INIT(res);
+  std::string daemon_addr = command_line::get_arg(vm, arg_ip) + ":" + std::to_string(command_line::get_arg(vm, arg_rpc_port));
+  bool r = net_utils::invoke_http_json_remote_command2(daemon_addr + "/get_rpc_stats", req, res, http_client, command_line::get_arg(vm, arg_timeout));
+  if(!r)
+  {
+    std::cout << "ERROR: failed to invoke request" << ENDL;
+    return false;
+  }
+  //one line per route: name calls errors total_time_us max_time_us p50_us p90_us p99_us p999_us
+  std::cout << "OK" << ENDL;
+  for (const auto& rs : res.routes)
+  {
+    std::cout << rs.name << " " << rs.calls << " " << rs.errors << " " << rs.total_time_us << " " << rs.max_time_us << " "
+      << rs.p50_us << " " << rs.p90_us << " " << rs.p99_us << " " << rs.p999_us << ENDL;
+  }
   return true;
 }
 //---------------------------------------------------------------------------------------------------------------
@@ -532,6 +596,8 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_params, arg_priv_key);
   command_line::add_arg(desc_params, arg_get_daemon_info);
   command_line::add_arg(desc_params, arg_get_aliases);
+  command_line::add_arg(desc_params, arg_get_p2p_traffic);
+  command_line::add_arg(desc_params, arg_get_rpc_stats);
   command_line::add_arg(desc_params, arg_upate_maintainers_info);
   command_line::add_arg(desc_params, arg_pack_file);
   command_line::add_arg(desc_params, arg_unpack_file);
@@ -583,6 +649,14 @@ int main(int argc, char* argv[])
   {
     return handle_get_aliases(vm) ? 0:1;
   }
+  else if(command_line::has_arg(vm, arg_get_p2p_traffic))
+  {
+    return handle_get_p2p_traffic(vm) ? 0:1;
+  }
+  else if(command_line::has_arg(vm, arg_get_rpc_stats))
+  {
+    return handle_get_rpc_stats(vm) ? 0:1;
+  }
   else if (command_line::has_arg(vm, arg_pack_file) || command_line::has_arg(vm, arg_unpack_file))
   {
     return handle_pack_file(vm) ? 0 : 1;
@@ -63,11 +63,23 @@
 #define BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT          10000  //by default, blocks ids count in synchronizing
 #define BLOCKS_SYNCHRONIZING_DEFAULT_COUNT              200    //by default, blocks count in blocks downloading
 #define CURRENCY_PROTOCOL_HOP_RELAX_COUNT               3      //value of hop, after which we use only announce of new block
+#define CURRENCY_PROTOCOL_KNOWN_TXS_PER_CONNECTION      20000  //size of per-connection filter of tx ids the peer is known to have
+#define CURRENCY_PROTOCOL_TX_INVENTORY_MAX_COUNT        1000   //max tx ids in one NOTIFY_TX_INVENTORY/NOTIFY_REQUEST_TXS/NOTIFY_REQUEST_COMPACT_BLOCK_TXS
+#define CURRENCY_PROTOCOL_TX_ANNOUNCE_QUEUE_MAX_COUNT    10000  //per-connection tx ids waiting for announce, the oldest are dropped above it
+#define CURRENCY_PROTOCOL_TX_REQUEST_TIMEOUT            30     //seconds, after that announced tx may be requested from another peer
+#define CURRENCY_PROTOCOL_TX_REQUESTED_MAX_COUNT        10000  //per-connection announced txs requested and not received yet, the rest of announcements is ignored
+#define CURRENCY_PROTOCOL_SYNC_MAX_SPANS                32     //max spans of BLOCKS_SYNCHRONIZING_DEFAULT_COUNT blocks being downloaded or waiting for processing
+#define CURRENCY_PROTOCOL_SYNC_SPAN_TIMEOUT             60     //seconds, span is given to another peer if not delivered in time (peer with unknown throughput)
+#define CURRENCY_PROTOCOL_SYNC_SPAN_MIN_TIMEOUT         15     //seconds, lower bound of span timeout derived from peer throughput
+#define CURRENCY_PROTOCOL_SYNC_MAX_PEER_STALLS          3      //peer is dropped after that many undelivered spans
+#define CURRENCY_PROTOCOL_COMPRESSION_THRESHOLD         4096   //bytes, smaller bulk payloads are sent uncompressed
+#define CURRENCY_PROTOCOL_COMPRESSION_LEVEL             1      //zlib level, favours CPU over ratio
 
 
 #define CURRENCY_ALT_BLOCK_LIVETIME_COUNT               (720*7)//one week
 #define CURRENCY_MEMPOOL_TX_LIVETIME                    86400 //seconds, one day
 #define CURRENCY_MEMPOOL_TX_FROM_ALT_BLOCK_LIVETIME     (CURRENCY_ALT_BLOCK_LIVETIME_COUNT*DIFFICULTY_TARGET) //seconds, one week
+#define CURRENCY_MEMPOOL_CHANGES_JOURNAL_SIZE           10000 //pool additions/removals kept for delta requests, older versions get full pool
 
 
 #ifndef TESTNET
@@ -79,6 +91,17 @@
 #endif
 
 #define COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT           1000
+#define COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_MAX_COUNT   5000
+#define BLOCKCHAIN_VIEW_KEY_SCAN_MIN_BLOCKS_PER_THREAD  10     //view key scan isn't split into smaller ranges than this
+#define RPC_RESPONSE_CACHE_DEFAULT_SIZE                 (64*1024*1024) //bytes of serialized responses kept by core rpc server
+#define RPC_RESPONSE_CACHE_MIN_DEPTH                    10     //responses depending on blocks closer to the top are not cached
+#define RPC_BATCH_DEFAULT_MAX_SIZE                      1000   //calls in one json-rpc batch
+#define RPC_BATCH_RESTRICTED_MAX_SIZE                   100    //same for --restricted-rpc, can't be raised by command line
+#define RPC_BATCH_DEFAULT_THREADS                       4      //threads one batch of read only calls is spread over
+#define RPC_FAST_POOL_DEFAULT_THREADS                   4      //threads for short rpc calls (getheight, getjob...)
+#define RPC_HEAVY_POOL_DEFAULT_THREADS                  2      //threads for bulk rpc calls (getblocks.bin, getrandom_outs.bin...)
+#define RPC_POOL_DEFAULT_MAX_QUEUE                      256    //requests waiting for a worker in each pool, the rest get 503
+#define RPC_SLOW_CALL_DEFAULT_THRESHOLD_MS              1000   //rpc calls running longer are logged, params only on request
 
 #define P2P_LOCAL_WHITE_PEERLIST_LIMIT                  1000
 #define P2P_LOCAL_GRAY_PEERLIST_LIMIT                   5000
@@ -90,6 +113,7 @@
 #define P2P_DEFAULT_CONNECTION_TIMEOUT                  5000       //5 seconds
 #define P2P_DEFAULT_PING_CONNECTION_TIMEOUT             2000       //2 seconds
 #define P2P_DEFAULT_INVOKE_TIMEOUT                      60*2*1000  //2 minutes
+#define P2P_NET_THREADS_COUNT                           10         //p2p server threads, unless io_service per thread mode sets one per core
 #define P2P_DEFAULT_HANDSHAKE_INVOKE_TIMEOUT            5000       //5 seconds
 #define P2P_MAINTAINERS_PUB_KEY                         "d2f6bc35dc4e4a43235ae12620df4612df590c6e1df0a18a55c5e12d81502aa7"
 #define P2P_MAINTAINERS_PUB_KEY2                        "b92345cfdeeef9dd837614e85d66b145cce38360de52102a5fbf4ef8709e88ca"
@@ -99,6 +123,8 @@
 #define P2P_IP_BLOCKTIME                                (60*60*24)  //24 hour
 #define P2P_IP_FAILS_BEFOR_BLOCK                        10
 #define P2P_IDLE_CONNECTION_KILL_INTERVAL               (5*60) //5 minutes
+#define P2P_PEERLIST_JOURNAL_FLUSH_INTERVAL             60     //seconds
+#define P2P_PEERLIST_JOURNAL_MAX_RECORDS                100000 //full snapshot is written when journal grows above
 
 
 /* This money will go to growth of the project */
@@ -137,6 +163,7 @@
 #define CURRENCY_BLOCKCHAINDATA_FOLDERNAME              "blockchain"
 #define CURRENCY_BLOCKCHAINDATA_SCRATCHPAD_CACHE        "scratchpad.cache"
 #define P2P_NET_DATA_FILENAME                           "p2pstate.bin"
+#define P2P_NET_DATA_JOURNAL_FILENAME                   "p2pstate.journal"
 #define MINER_CONFIG_FILENAME                           "miner_conf.json"
 #define GUI_CONFIG_FILENAME                             "gui_conf.json"
 #define CURRENCY_CORE_INSTANCE_LOCK_FILE                "lock.lck"
@@ -5,6 +5,9 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 
@@ -78,12 +81,14 @@ blockchain_storage::blockchain_storage(tx_memory_pool& tx_pool) : m_lmdb_adapter
                                                                  m_db_last_worked_version(BLOCKCHAIN_OPTIONS_ID_LAST_WORKED_VERSION, m_db_solo_options),
                                                                  m_db_storage_major_compability_version(BLOCKCHAIN_OPTIONS_ID_STORAGE_MAJOR_COMPABILITY_VERSION, m_db_solo_options),                                                               
                                                                  m_tx_pool(tx_pool),
+                                                                 m_pupdate_listener(nullptr),
                                                                  m_is_in_checkpoint_zone(false), 
                                                                  m_donations_account(AUTO_VAL_INIT(m_donations_account)), 
                                                                  m_royalty_account(AUTO_VAL_INIT(m_royalty_account)),
                                                                  m_is_blockchain_storing(false), 
                                                                  m_locker_file(0), 
-                                                                 m_exclusive_batch_active(false)
+                                                                 m_exclusive_batch_active(false),
+                                                                 m_view_key_scan_jobs(0)
 {
   bool r = get_donation_accounts(m_donations_account, m_royalty_account);
   CHECK_AND_ASSERT_THROW_MES(r, "failed to load donation accounts");
@@ -202,6 +207,10 @@ bool blockchain_storage::init(const boost::program_options::variables_map& vm, c
   if (!m_db_blocks.back()->bl.timestamp)
     timestamp_diff = time(nullptr) - 1341378000;
 
+  size_t scan_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+  res = m_view_key_scan_pool.init(scan_threads, scan_threads, "view-key-scan");
+  CHECK_AND_ASSERT_MES(res, false, "Unable to start view key scan workers");
+
   LOG_PRINT_GREEN("Blockchain initialized. last block: " << m_db_blocks.size() - 1
     << ", " << misc_utils::get_time_interval_string(timestamp_diff) << " time ago", LOG_LEVEL_0);
 
@@ -218,6 +227,8 @@ void blockchain_storage::initialize_db_solo_options_values()
 //------------------------------------------------------------------
 bool blockchain_storage::deinit()
 {
+  //scans already running are finished before db is closed
+  m_view_key_scan_pool.stop();
   CRITICAL_REGION_LOCAL(m_blockchain_lock);
   m_scratchpad_wr.deinit();
   m_db.close();
@@ -248,9 +259,17 @@ bool blockchain_storage::pop_block_from_blockchain()
   //pop block from core
   m_db_blocks.pop_back();
   m_tx_pool.on_blockchain_dec(m_db_blocks.size() - 1, get_top_block_id());
+  if (m_pupdate_listener)
+    m_pupdate_listener->on_block_popped(h);
   return true;
 }
 //------------------------------------------------------------------
+void blockchain_storage::set_update_listener(i_blockchain_update_listener* plistener)
+{
+  CRITICAL_REGION_LOCAL(m_blockchain_lock);
+  m_pupdate_listener = plistener;
+}
+//------------------------------------------------------------------
 bool blockchain_storage::set_checkpoints(checkpoints&& chk_pts) 
 {
   m_checkpoints = chk_pts;
@@ -909,6 +928,180 @@ bool blockchain_storage::check_tx_with_view_key(const crypto::hash& tx_hash, con
   return true;
 }
 //------------------------------------------------------------------
+bool blockchain_storage::scan_blocks_with_view_keys(const std::vector<view_key_scan_entry>& keys, uint64_t start_height, uint64_t end_height, std::vector<view_key_scan_match>& matches, bool& busy, size_t threads_count) const
+{
+  matches.clear();
+  busy = false;
+  if (keys.empty() || start_height >= end_height)
+    return true;
+
+  uint64_t blocks_count = end_height - start_height;
+  if (!threads_count)
+    threads_count = m_view_key_scan_pool.get_threads_count();
+  threads_count = static_cast<size_t>(std::min<uint64_t>(threads_count, (blocks_count + BLOCKCHAIN_VIEW_KEY_SCAN_MIN_BLOCKS_PER_THREAD - 1) / BLOCKCHAIN_VIEW_KEY_SCAN_MIN_BLOCKS_PER_THREAD));
+
+  std::vector<std::vector<view_key_scan_match> > thread_matches;
+  std::vector<char> thread_results;
+
+  std::mutex jobs_lock;
+  std::condition_variable jobs_cv;
+  size_t started_count = 0;
+  size_t finished_count = 0;
+  size_t posted_count = 0;
+  {
+    CRITICAL_REGION_LOCAL(m_exclusive_batch_lock);
+    busy = m_exclusive_batch_active;
+    if (busy)
+    {
+      LOG_PRINT_L1("scan_blocks_with_view_keys: batch exclusive operation is in progress, scan rejected");
+      return false;
+    }
+
+    // every job opens its own read-only db transaction while m_blockchain_lock is held,
+    // so all of them read the same snapshot and nobody blocks the core for the rest of the scan
+    CRITICAL_REGION_LOCAL1(m_blockchain_lock);
+    CHECK_AND_ASSERT_MES(end_height <= m_db_blocks.size(), false, "scan_blocks_with_view_keys: end_height " << end_height << " is beyond blockchain height " << m_db_blocks.size());
+
+    {
+      // only idle workers are taken: jobs have to start while m_blockchain_lock is held.
+      // own counter is used since pool marks worker idle only after the job has returned
+      std::lock_guard<std::mutex> scan_guard(m_view_key_scan_lock);
+      size_t idle = m_view_key_scan_pool.get_threads_count() - m_view_key_scan_jobs;
+      threads_count = std::min(threads_count, idle);
+      busy = !threads_count;
+      if (busy)
+      {
+        LOG_PRINT_L1("scan_blocks_with_view_keys: all " << m_view_key_scan_pool.get_threads_count() << " scan workers are busy, scan rejected");
+        return false;
+      }
+      thread_matches.resize(threads_count);
+      thread_results.resize(threads_count, 0);
+
+      for (size_t i = 0; i != threads_count; i++)
+      {
+        uint64_t from = start_height + blocks_count * i / threads_count;
+        uint64_t to = start_height + blocks_count * (i + 1) / threads_count;
+        bool posted = m_view_key_scan_pool.post([&, i, from, to]()
+        {
+          bool r = m_lmdb_adapter->begin_transaction(true);
+          {
+            std::lock_guard<std::mutex> guard(jobs_lock);
+            ++started_count;
+          }
+          jobs_cv.notify_all();
+          if (r)
+          {
+            try
+            {
+              thread_results[i] = scan_blocks_range_with_view_keys(keys, from, to, thread_matches[i]) ? 1 : 0;
+            }
+            catch (const std::exception& e)
+            {
+              LOG_ERROR("scan_blocks_with_view_keys: exception in scan job: " << e.what());
+            }
+            catch (...)
+            {
+              LOG_ERROR("scan_blocks_with_view_keys: unknown exception in scan job");
+            }
+          }
+          m_lmdb_adapter->commit_transaction();
+          {
+            std::lock_guard<std::mutex> guard(m_view_key_scan_lock);
+            --m_view_key_scan_jobs;
+          }
+          {
+            std::lock_guard<std::mutex> guard(jobs_lock);
+            ++finished_count;
+          }
+          jobs_cv.notify_all();
+        });
+        if (!posted)
+          break;
+        ++m_view_key_scan_jobs;
+        ++posted_count;
+      }
+    }
+
+    std::unique_lock<std::mutex> jobs_guard(jobs_lock);
+    jobs_cv.wait(jobs_guard, [&](){ return started_count == posted_count; });
+  }
+
+  {
+    std::unique_lock<std::mutex> jobs_guard(jobs_lock);
+    jobs_cv.wait(jobs_guard, [&](){ return finished_count == posted_count; });
+  }
+
+  CHECK_AND_ASSERT_MES(posted_count == threads_count, false, "scan_blocks_with_view_keys: scan workers are stopped");
+  for (size_t i = 0; i != threads_count; i++)
+  {
+    CHECK_AND_ASSERT_MES(thread_results[i], false, "scan_blocks_with_view_keys: scan job " << i << " failed");
+    matches.insert(matches.end(), thread_matches[i].begin(), thread_matches[i].end());
+  }
+  return true;
+}
+//------------------------------------------------------------------
+bool blockchain_storage::scan_blocks_range_with_view_keys(const std::vector<view_key_scan_entry>& keys, uint64_t start_height, uint64_t end_height, std::vector<view_key_scan_match>& matches) const
+{
+  for (uint64_t h = start_height; h != end_height; h++)
+  {
+    auto bei_ptr = m_db_blocks.get_no_cache(h);
+    std::vector<crypto::hash> tx_ids;
+    tx_ids.reserve(bei_ptr->bl.tx_hashes.size() + 1);
+    tx_ids.push_back(get_transaction_hash(bei_ptr->bl.miner_tx));
+    tx_ids.insert(tx_ids.end(), bei_ptr->bl.tx_hashes.begin(), bei_ptr->bl.tx_hashes.end());
+
+    for (const auto& tx_id : tx_ids)
+    {
+      auto tx_ptr = m_db_transactions.find(tx_id);
+      CHECK_AND_ASSERT_MES(tx_ptr, false, "can't find tx " << tx_id << " from block at height " << h);
+      const transaction& tx = tx_ptr->tx;
+
+      crypto::public_key tx_pub_key = get_tx_pub_key_from_extra(tx);
+      if (tx_pub_key == null_pkey)
+        continue;
+
+      payment_id_t payment_id;
+      bool payment_id_extracted = false;
+      for (size_t k = 0; k != keys.size(); k++)
+      {
+        crypto::key_derivation derivation = AUTO_VAL_INIT(derivation);
+        if (!crypto::generate_key_derivation(tx_pub_key, keys[k].view_secret_key, derivation))
+          continue;
+
+        for (size_t i = 0; i != tx.vout.size(); i++)
+        {
+          if (tx.vout[i].target.type() != typeid(txout_to_key))
+            continue;
+
+          crypto::public_key derived_pk = AUTO_VAL_INIT(derived_pk);
+          if (!crypto::derive_public_key(derivation, i, keys[k].spend_public_key, derived_pk))
+            continue;
+          if (derived_pk != boost::get<txout_to_key>(tx.vout[i].target).key)
+            continue;
+
+          CHECK_AND_ASSERT_MES(i < tx_ptr->m_global_output_indexes.size(), false, "tx " << tx_id << " has " << tx_ptr->m_global_output_indexes.size() << " global output indexes, output " << i << " requested");
+          if (!payment_id_extracted)
+          {
+            get_payment_id_from_tx_extra(tx, payment_id);
+            payment_id_extracted = true;
+          }
+
+          view_key_scan_match m = AUTO_VAL_INIT(m);
+          m.key_index = k;
+          m.block_height = h;
+          m.tx_id = tx_id;
+          m.payment_id = payment_id;
+          m.out_index = i;
+          m.global_out_index = tx_ptr->m_global_output_indexes[i];
+          m.amount = tx.vout[i].amount;
+          matches.push_back(m);
+        }
+      }
+    }
+  }
+  return true;
+}
+//------------------------------------------------------------------
 bool blockchain_storage::get_required_donations_value_for_next_block(uint64_t& don_am)
 {
   TRY_ENTRY();
@@ -10,6 +10,7 @@
 
 #include <boost/foreach.hpp>
 #include <atomic>
+#include <mutex>
 
 
 #include "serialization/serialization.h"
@@ -32,6 +33,7 @@
 #include "scratchpad_helpers.h"
 #include "file_io_utils.h"
 #include "common/db_lmdb_adapter.h"
+#include "net/http_worker_pool.h"
 
 MAKE_POD_C11(crypto::key_image);
 typedef std::pair<crypto::hash, uint64_t> macro_alias_1;
@@ -42,6 +44,14 @@ POD_MAKE_HASHABLE(currency, account_public_address);
 namespace currency
 {
 
+  struct i_blockchain_update_listener
+  {
+    //called under blockchain lock when block at height removed from main chain
+    virtual void on_block_popped(uint64_t height) = 0;
+  protected:
+    ~i_blockchain_update_listener(){};
+  };
+
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
@@ -93,6 +103,23 @@ namespace currency
       END_SERIALIZE()
     };
 
+    struct view_key_scan_entry
+    {
+      crypto::secret_key view_secret_key;
+      crypto::public_key spend_public_key;
+    };
+
+    struct view_key_scan_match
+    {
+      size_t key_index;                 // index in the scanned keys vector
+      uint64_t block_height;
+      crypto::hash tx_id;
+      payment_id_t payment_id;
+      uint64_t out_index;               // index of the output within the transaction
+      uint64_t global_out_index;
+      uint64_t amount;
+    };
+
     typedef db::key_to_array_accessor_base<uint64_t, std::pair<crypto::hash, uint64_t>, false>  outputs_container;
 
     blockchain_storage(tx_memory_pool& tx_pool);
@@ -101,6 +128,7 @@ namespace currency
 
     bool init(const boost::program_options::variables_map& vm, const std::string& config_folder);
     bool deinit();
+    void set_update_listener(i_blockchain_update_listener* plistener);
 
     bool start_batch_exclusive_operation();
     bool finish_batch_exclusive_operation(bool success);
@@ -198,6 +226,13 @@ namespace currency
     bool get_block_extended_info_by_height(uint64_t h, block_extended_info &blk) const;
     bool lookfor_donation(const transaction& tx, uint64_t& donation, uint64_t& royalty);
     bool check_tx_with_view_key(const crypto::hash& tx_hash, const crypto::secret_key& view_key, const account_public_address& addr, uint64_t& incoming_amount, payment_id_t& payment_id, std::vector<uint64_t>& outs_indicies) const;
+    //range is split between idle workers of m_view_key_scan_pool, at most threads_count (0 - all of them);
+    //returns false with busy = true if there is no idle worker or batch exclusive operation is in progress
+    bool scan_blocks_with_view_keys(const std::vector<view_key_scan_entry>& keys, uint64_t start_height, uint64_t end_height, std::vector<view_key_scan_match>& matches, bool& busy, size_t threads_count = 0) const;
+    //calls cb(block_extended_info, block difficulty) for main chain blocks [start_height, start_height + count) in height order, false from cb stops it;
+    //returns false with busy = true if batch exclusive operation is in progress, caller may retry later
+    template<class t_cb>
+    bool enumerate_blocks_range(uint64_t start_height, uint64_t count, t_cb cb, bool& busy) const;
 
     std::string print_key_image_details(const crypto::key_image& ki, bool& found);
 
@@ -266,6 +301,7 @@ namespace currency
     typedef std::unordered_map<crypto::hash, block_extended_info> blocks_ext_by_hash;
 
     tx_memory_pool& m_tx_pool;
+    i_blockchain_update_listener* m_pupdate_listener;
 
     //main accessor
     std::shared_ptr<db::lmdb_adapter> m_lmdb_adapter;
@@ -309,6 +345,9 @@ namespace currency
     mutable critical_section m_blockchain_lock; // TODO: add here reader/writer lock
     mutable critical_section m_exclusive_batch_lock; // TODO: add here reader/writer lock
     std::atomic<bool> m_exclusive_batch_active;
+    mutable epee::net_utils::http::worker_pool m_view_key_scan_pool;
+    mutable std::mutex m_view_key_scan_lock; //idle workers are counted and taken by one scan at a time
+    mutable size_t m_view_key_scan_jobs; //posted scan jobs that haven't finished yet, guarded by m_view_key_scan_lock
 
     bool switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::iterator>& alt_chain);
     bool pop_block_from_blockchain();
@@ -351,6 +390,7 @@ namespace currency
     bool prune_ring_signatures_if_need();
     bool prune_ring_signatures(uint64_t height, uint64_t& transactions_pruned, uint64_t& signatures_pruned);
     bool check_instance(const std::string& data_dir);
+    bool scan_blocks_range_with_view_keys(const std::vector<view_key_scan_entry>& keys, uint64_t start_height, uint64_t end_height, std::vector<view_key_scan_match>& matches) const;
   };
 
   /************************************************************************/
@@ -361,6 +401,44 @@ namespace currency
 #define CURRENT_TRANSACTION_CHAIN_ENTRY_ARCHIVE_VER     3
 #define CURRENT_BLOCK_EXTENDED_INFO_ARCHIVE_VER         1
 
+  //------------------------------------------------------------------
+  template<class t_cb>
+  bool blockchain_storage::enumerate_blocks_range(uint64_t start_height, uint64_t count, t_cb cb, bool& busy) const
+  {
+    uint64_t end_height = 0;
+    {
+      CRITICAL_REGION_LOCAL(m_exclusive_batch_lock);
+      busy = m_exclusive_batch_active;
+      if (busy)
+      {
+        LOG_PRINT_L1("enumerate_blocks_range: batch exclusive operation is in progress, rejected");
+        return false;
+      }
+
+      // read-only db transaction opened under m_blockchain_lock pins the snapshot,
+      // blocks are read after the lock is released so the core is not blocked for the whole range
+      CRITICAL_REGION_LOCAL1(m_blockchain_lock);
+      CHECK_AND_ASSERT_MES(start_height < m_db_blocks.size(), false, "enumerate_blocks_range: start_height " << start_height << " is beyond blockchain height " << m_db_blocks.size());
+      end_height = start_height + (std::min)(count, static_cast<uint64_t>(m_db_blocks.size()) - start_height);
+      bool r = m_lmdb_adapter->begin_transaction(true);
+      CHECK_AND_ASSERT_MES(r, false, "enumerate_blocks_range: failed to begin read-only db transaction");
+    }
+    misc_utils::auto_scope_leave_caller tx_closer = misc_utils::create_scope_leave_handler([this](){ m_lmdb_adapter->commit_transaction(); });
+
+    // every block is read once, bypassing m_db_blocks cache, difficulty comes from previous cumulative_difficulty
+    wide_difficulty_type prev_cumulative_difficulty = 0;
+    if (start_height)
+      prev_cumulative_difficulty = m_db_blocks.get_no_cache(start_height - 1)->cumulative_difficulty;
+    for (uint64_t h = start_height; h != end_height; h++)
+    {
+      auto bei_ptr = m_db_blocks.get_no_cache(h);
+      CHECK_AND_ASSERT_MES(bei_ptr, false, "enumerate_blocks_range: can't read block at height " << h);
+      if (!cb(*bei_ptr, bei_ptr->cumulative_difficulty - prev_cumulative_difficulty))
+        break;
+      prev_cumulative_difficulty = bei_ptr->cumulative_difficulty;
+    }
+    return true;
+  }
   //------------------------------------------------------------------
   template<class visitor_t>
   bool blockchain_storage::scan_outputkeys_for_indexes(const txin_to_key& tx_in_to_key, visitor_t& vis, uint64_t* pmax_related_block_height)
@@ -7,6 +7,7 @@
 #include <atomic>
 #include "net/net_utils_base.h"
 #include "copyable_atomic.h"
+#include "currency_protocol/currency_protocol_defs.h"
 
 namespace currency
 {
@@ -23,11 +24,13 @@ namespace currency
     };
 
     state m_state;
-    std::list<crypto::hash> m_needed_objects;
     std::unordered_set<crypto::hash> m_requested_objects;
     uint64_t m_remote_blockchain_height;
     uint64_t m_last_response_height;
     epee::copyable_atomic m_callback_request_count; //in debug purpose: problem with double callback rise
+    uint32_t m_remote_protocol_flags;  //CURRENCY_PROTOCOL_FLAG_* from peer's CORE_SYNC_DATA
+    NOTIFY_NEW_COMPACT_BLOCK::request m_pending_compact_block; //waiting for NOTIFY_RESPONSE_COMPACT_BLOCK_TXS
+    crypto::hash m_pending_compact_block_id;
     //size_t m_score;  TODO: add score calculations
   };
 
@@ -518,6 +518,11 @@ bool core::handle_incoming_tx(const blobdata& tx_blob, tx_verification_context&
     return m_mempool.get_transactions(txs);
   }
   //-----------------------------------------------------------------------------------------------
+  bool core::get_pool_transactions_changes(uint64_t since_version, uint64_t& version, bool& full, std::list<crypto::hash>& added, std::list<crypto::hash>& removed, std::list<transaction>* added_txs)
+  {
+    return m_mempool.get_transactions_changes(since_version, version, full, added, removed, added_txs);
+  }
+  //-----------------------------------------------------------------------------------------------
   bool core::get_short_chain_history(std::list<crypto::hash>& ids)
   {
     return m_blockchain_storage.get_short_chain_history(ids);
@@ -74,6 +74,7 @@ namespace currency
      void set_checkpoints(checkpoints&& chk_pts);
 
      bool get_pool_transactions(std::list<transaction>& txs);
+     bool get_pool_transactions_changes(uint64_t since_version, uint64_t& version, bool& full, std::list<crypto::hash>& added, std::list<crypto::hash>& removed, std::list<transaction>* added_txs);
      size_t get_pool_transactions_count();
      size_t get_blockchain_total_transactions();
      bool get_outs(uint64_t amount, std::list<crypto::public_key>& pkeys);
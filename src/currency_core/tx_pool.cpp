@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <algorithm>
+#include <chrono>
 #include <boost/filesystem.hpp>
 #include <unordered_set>
 #include <vector>
@@ -24,9 +25,11 @@ DISABLE_VS_WARNINGS(4244 4345 4503) //'boost::foreach_detail_::or_' : decorated
 namespace currency
 {
   //---------------------------------------------------------------------------------
-  tx_memory_pool::tx_memory_pool(blockchain_storage& bchs): m_blockchain(bchs)
+  tx_memory_pool::tx_memory_pool(blockchain_storage& bchs):
+    //versions start from startup time, so versions seen by clients before restart are always older
+    m_changes(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count(), CURRENCY_MEMPOOL_CHANGES_JOURNAL_SIZE),
+    m_blockchain(bchs)
   {
-
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::add_tx(const transaction &tx, const crypto::hash &id, tx_verification_context& tvc, bool kept_by_block)
@@ -100,6 +103,7 @@ namespace currency
         txd_p.first->second.max_used_block_height = 0;
         txd_p.first->second.kept_by_block = kept_by_block;
         txd_p.first->second.receive_time = time(nullptr);
+        on_transaction_change(id, true);
         tvc.m_verifivation_impossible = true;
         tvc.m_added_to_pool = true;
       }else
@@ -122,6 +126,7 @@ namespace currency
       txd_p.first->second.last_failed_height = 0;
       txd_p.first->second.last_failed_id = null_hash;
       txd_p.first->second.receive_time = time(nullptr);
+      on_transaction_change(id, true);
       tvc.m_added_to_pool = true;
 
       if(txd_p.first->second.fee > 0)
@@ -193,6 +198,7 @@ namespace currency
     blob_size = it->second.blob_size;
     fee = it->second.fee;
     remove_transaction_keyimages(it->second.tx);
+    on_transaction_change(id, false);
     m_transactions.erase(it);
     return true;
   }
@@ -214,6 +220,7 @@ namespace currency
       {
         LOG_PRINT_L0("Tx " << it->first << " removed from tx pool due to outdated, age: " << tx_age );
         remove_transaction_keyimages(it->second.tx);
+        on_transaction_change(it->first, false);
         m_transactions.erase(it++);
       }else
         ++it;
@@ -246,6 +253,42 @@ namespace currency
     return true;
   }
   //---------------------------------------------------------------------------------
+  void tx_memory_pool::on_transaction_change(const crypto::hash& id, bool added)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    m_changes.on_change(id, added);
+  }
+  //---------------------------------------------------------------------------------
+  uint64_t tx_memory_pool::get_version()
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    return m_changes.get_version();
+  }
+  //---------------------------------------------------------------------------------
+  bool tx_memory_pool::get_transactions_changes(uint64_t since_version, uint64_t& version, bool& full, std::list<crypto::hash>& added, std::list<crypto::hash>& removed, std::list<transaction>* added_txs)
+  {
+    CRITICAL_REGION_LOCAL(m_transactions_lock);
+    version = m_changes.get_version();
+    full = !m_changes.get_changes(since_version, [this](const crypto::hash& id) { return m_transactions.count(id) != 0; }, added, removed);
+    if (full)
+    {
+      BOOST_FOREACH(const auto& tx_vt, m_transactions)
+      {
+        added.push_back(tx_vt.first);
+        if (added_txs)
+          added_txs->push_back(tx_vt.second.tx);
+      }
+      return true;
+    }
+
+    if (added_txs)
+    {
+      for (const auto& id : added)
+        added_txs->push_back(m_transactions[id].tx);
+    }
+    return true;
+  }
+  //---------------------------------------------------------------------------------
   bool tx_memory_pool::on_blockchain_inc(uint64_t new_block_height, const crypto::hash& top_block_id)
   {
     return true;
@@ -299,6 +342,8 @@ namespace currency
     CRITICAL_REGION_LOCAL(m_transactions_lock);
     m_transactions.clear();
     m_spent_key_images.clear();
+    //nothing to report removals against, everyone gets full (empty) pool
+    m_changes.reset();
   }
   //---------------------------------------------------------------------------------
   bool tx_memory_pool::is_transaction_ready_to_go(tx_details& txd)
@@ -8,6 +8,7 @@ using namespace epee;
 
 
 #include <set>
+#include <deque>
 #include <unordered_map>
 #include <unordered_set>
 #include <boost/serialization/version.hpp>
@@ -18,6 +19,7 @@ using namespace epee;
 #include "math_helper.h"
 #include "currency_basic_impl.h"
 #include "verification_context.h"
+#include "tx_pool_changes_journal.h"
 #include "crypto/hash.h"
 #include "common/boost_serialization_helper.h"
 
@@ -57,6 +59,10 @@ namespace currency
     bool fill_block_template(block &bl, size_t median_size, uint64_t already_generated_coins, uint64_t already_donated_coins, size_t &total_size, uint64_t &fee);
     bool get_transactions(std::list<transaction>& txs);
     bool get_transaction(const crypto::hash& h, transaction& tx);
+    //every addition/removal increments pool version, returns what changed after since_version,
+    //or whole pool with full = true if since_version is too old (or from previous daemon run)
+    bool get_transactions_changes(uint64_t since_version, uint64_t& version, bool& full, std::list<crypto::hash>& added, std::list<crypto::hash>& removed, std::list<transaction>* added_txs);
+    uint64_t get_version();
     size_t get_transactions_count();
     bool remove_transaction_keyimages(const transaction& tx);
     bool have_key_images(const std::unordered_set<crypto::key_image>& kic, const transaction& tx);
@@ -98,6 +104,7 @@ namespace currency
 
   private:
     bool remove_stuck_transactions();
+    void on_transaction_change(const crypto::hash& id, bool added);
     bool is_transaction_ready_to_go(tx_details& txd);
     typedef std::unordered_map<crypto::hash, tx_details > transactions_container;
     typedef std::unordered_map<crypto::key_image, std::unordered_set<crypto::hash> > key_images_container;
@@ -105,6 +112,7 @@ namespace currency
     epee::critical_section m_transactions_lock;
     transactions_container m_transactions;
     key_images_container m_spent_key_images;
+    tx_pool_changes_journal m_changes;
     
     epee::math_helper::once_a_time_seconds<30> m_remove_stuck_tx_interval;
 
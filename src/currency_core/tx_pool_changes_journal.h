@@ -0,0 +1,101 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include "misc_language.h"
+#include "crypto/hash.h"
+
+namespace currency
+{
+  /************************************************************************/
+  /* Journal of pool additions/removals: every change increments version, */
+  /* clients ask what changed after the version they saw last.            */
+  /* Only last max_size changes are kept, older versions (and versions    */
+  /* from before reset) have to be answered with the whole pool.          */
+  /* Not thread safe, owner (tx_memory_pool) locks it.                    */
+  /************************************************************************/
+  class tx_pool_changes_journal
+  {
+  public:
+    tx_pool_changes_journal(uint64_t start_version, size_t max_size)
+      : m_version(start_version)
+      , m_start_version(start_version)
+      , m_max_size(max_size)
+    {}
+
+    void on_change(const crypto::hash& id, bool added)
+    {
+      change ch = AUTO_VAL_INIT(ch);
+      ch.version = ++m_version;
+      ch.id = id;
+      ch.added = added;
+      m_changes.push_back(ch);
+      if (m_changes.size() > m_max_size)
+      {
+        m_changes.pop_front();
+        m_start_version = m_changes.front().version - 1;
+      }
+    }
+
+    //nothing to report removals against, every known version becomes too old
+    void reset()
+    {
+      ++m_version;
+      m_changes.clear();
+      m_start_version = m_version;
+    }
+
+    uint64_t get_version() const
+    {
+      return m_version;
+    }
+
+    //returns false if since_version isn't covered by journal (too old or from the future);
+    //otherwise fills ids whose membership differs now from the one at since_version,
+    //is_in_pool(id) tells current membership
+    template<class t_is_in_pool>
+    bool get_changes(uint64_t since_version, t_is_in_pool is_in_pool, std::list<crypto::hash>& added, std::list<crypto::hash>& removed) const
+    {
+      if (since_version < m_start_version || since_version > m_version)
+        return false;
+
+      //versions in journal go one by one, state of tx at since_version is opposite to its first change after it
+      std::unordered_map<crypto::hash, bool> was_in_pool;
+      std::list<crypto::hash> touched;
+      for (auto it = m_changes.begin() + (since_version - m_start_version); it != m_changes.end(); ++it)
+      {
+        if (was_in_pool.insert(std::make_pair(it->id, !it->added)).second)
+          touched.push_back(it->id);
+      }
+      for (const auto& id : touched)
+      {
+        bool in_pool = is_in_pool(id);
+        if (in_pool == was_in_pool[id])
+          continue;
+        if (in_pool)
+          added.push_back(id);
+        else
+          removed.push_back(id);
+      }
+      return true;
+    }
+
+  private:
+    struct change
+    {
+      uint64_t version;
+      crypto::hash id;
+      bool added;
+    };
+
+    uint64_t m_version;
+    uint64_t m_start_version;       //version right before m_changes.front()
+    size_t m_max_size;
+    std::deque<change> m_changes;
+  };
+}
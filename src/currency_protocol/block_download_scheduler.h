@@ -0,0 +1,502 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+#include <boost/functional/hash.hpp>
+#include "syncobj.h"
+#include "net/net_utils_base.h"
+#include "currency_config.h"
+#include "currency_core/currency_basic.h"
+#include "currency_protocol_defs.h"
+
+namespace currency
+{
+  /************************************************************************/
+  /* Splits missing block ids (learned from chain entries of any peer)    */
+  /* into spans, hands spans out to synchronizing peers concurrently and  */
+  /* gives received spans back strictly in height order.                  */
+  /* Spans assigned to a peer that doesn't answer in time are handed out  */
+  /* again, peers that stall repeatedly are reported for dropping.        */
+  /* Chain entries that contradict queued ids are rejected; queued ids    */
+  /* that no connected peer agrees with anymore are dropped.              */
+  /************************************************************************/
+  class block_download_scheduler
+  {
+  public:
+    typedef boost::uuids::uuid peer_id;
+
+    struct downloaded_span
+    {
+      uint64_t start_height;
+      std::list<block_complete_entry> blocks;
+      epee::net_utils::connection_context_base source;
+    };
+
+    block_download_scheduler(size_t span_size = BLOCKS_SYNCHRONIZING_DEFAULT_COUNT, size_t max_spans = CURRENCY_PROTOCOL_SYNC_MAX_SPANS)
+      : m_span_size(span_size)
+      , m_max_spans(max_spans)
+      , m_next_height(0)
+      , m_tip_height(0)
+      , m_processing(false)
+    {}
+
+    //ids[i] is a block at start_height + i, ids that are already known or don't extend known tip are ignored;
+    //returns false if ids differ from the queued ones at the same heights: the peer is on another chain,
+    //it gets no spans until its next chain entry fits the queue
+    bool add_chain(const epee::net_utils::connection_context_base& peer, uint64_t start_height, const std::list<crypto::hash>& ids, size_t& added)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      peer_stat& ps = m_peers[peer.m_connection_id];
+      ps.context = peer;
+      added = 0;
+      if (m_spans.empty() && m_unsplit.empty())
+        m_next_height = m_tip_height = start_height;
+
+      uint64_t h = start_height;
+      for (auto it = ids.begin(); it != ids.end(); ++it, ++h)
+      {
+        if (h < m_tip_height)
+        {
+          const crypto::hash* queued = get_queued_id(h);
+          if (queued && *queued != *it)
+          {
+            ps.other_chain = true;
+            ps.conflict_height = h;
+            return false;
+          }
+          continue;
+        }
+        if (h > m_tip_height)
+          break;
+        m_unsplit.push_back(*it);
+        ++m_tip_height;
+        ++added;
+      }
+      ps.other_chain = false;
+      ps.chain_height = std::max(ps.chain_height, std::min(h, m_tip_height));
+      return true;
+    }
+
+    //assigns a span to the peer, returns false if there's nothing the peer could download right now
+    bool request_span(const epee::net_utils::connection_context_base& peer, uint64_t peer_height, std::list<crypto::hash>& ids, uint64_t now_ms)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      peer_stat& ps = m_peers[peer.m_connection_id];
+      ps.context = peer;
+      if (ps.banned || ps.has_span)
+        return false;
+      if (ps.other_chain)
+      {
+        ps.waiting = true;
+        return false;
+      }
+
+      // spans taken back from stalled peers go first, they are the oldest ones
+      for (auto& s : m_spans)
+      {
+        if (!s.second.received && !s.second.assigned && s.first + s.second.ids.size() <= peer_height)
+        {
+          assign(s.second, ps, now_ms);
+          ids.assign(s.second.ids.begin(), s.second.ids.end());
+          return true;
+        }
+      }
+
+      uint64_t split_height = m_tip_height - m_unsplit.size();
+      if (m_unsplit.empty() || m_spans.size() >= m_max_spans || split_height >= peer_height)
+      {
+        ps.waiting = true;
+        return false;
+      }
+
+      size_t count = static_cast<size_t>(std::min<uint64_t>(std::min<uint64_t>(m_span_size, m_unsplit.size()), peer_height - split_height));
+      span& s = m_spans[split_height];
+      s.ids.assign(m_unsplit.begin(), m_unsplit.begin() + count);
+      m_unsplit.erase(m_unsplit.begin(), m_unsplit.begin() + count);
+      m_span_by_first_id[s.ids.front()] = split_height;
+      assign(s, ps, now_ms);
+      ids.assign(s.ids.begin(), s.ids.end());
+      return true;
+    }
+
+    //returns false if blocks don't match any span still waiting for data (late answer of a stalled peer, etc)
+    bool on_span_received(const epee::net_utils::connection_context_base& peer, const std::list<crypto::hash>& ids, std::list<block_complete_entry>& blocks, uint64_t now_ms)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      peer_stat& ps = m_peers[peer.m_connection_id];
+      if (ps.has_span && ids.size() && ps.span_first_id == ids.front())
+        ps.has_span = false;
+
+      if (ids.empty())
+        return false;
+      auto id_it = m_span_by_first_id.find(ids.front());
+      if (id_it == m_span_by_first_id.end())
+        return false;
+      span& s = m_spans[id_it->second];
+      if (s.received || s.ids.size() != ids.size() || !std::equal(ids.begin(), ids.end(), s.ids.begin()))
+        return false;
+
+      if (s.assigned)
+      {
+        peer_stat& owner = m_peers[s.peer];
+        if (s.peer == peer.m_connection_id)
+        {
+          double ms_per_block = static_cast<double>(now_ms - s.assigned_time) / s.ids.size();
+          ps.ms_per_block = ps.spans_done ? ps.ms_per_block * 0.7 + ms_per_block * 0.3 : ms_per_block;
+        }
+        else
+        {
+          // answered by a peer this span was taken from, no need to wait for the new one
+          release_span(owner);
+        }
+      }
+      ps.spans_done++;
+      ps.blocks_done += s.ids.size();
+      s.assigned = false;
+      s.received = true;
+      s.source = peer;
+      s.blocks.swap(blocks);
+      return true;
+    }
+
+    //only one caller at a time processes downloaded spans
+    bool begin_processing()
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      if (m_processing)
+        return false;
+      m_processing = true;
+      return true;
+    }
+
+    //pops next span in height order, or ends processing if it isn't downloaded yet
+    bool pop_ready_or_end_processing(downloaded_span& ds)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      auto it = m_spans.begin();
+      if (it == m_spans.end() || it->first != m_next_height || !it->second.received)
+      {
+        m_processing = false;
+        return false;
+      }
+      ds.start_height = it->first;
+      ds.blocks.swap(it->second.blocks);
+      ds.source = it->second.source;
+      m_next_height += it->second.ids.size();
+      m_span_by_first_id.erase(it->second.ids.front());
+      m_spans.erase(it);
+      return true;
+    }
+
+    void end_processing()
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      m_processing = false;
+    }
+
+    //takes spans back from peers that didn't answer in time, peers that stalled too often are returned for dropping
+    void check_stalls(uint64_t now_ms, std::list<epee::net_utils::connection_context_base>& peers_to_drop)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      for (auto& s : m_spans)
+      {
+        if (!s.second.assigned)
+          continue;
+        peer_stat& ps = m_peers[s.second.peer];
+        if (now_ms - s.second.assigned_time <= get_span_timeout(ps, s.second.ids.size()))
+          continue;
+        s.second.assigned = false;
+        release_span(ps);
+        if (++ps.stalls >= CURRENCY_PROTOCOL_SYNC_MAX_PEER_STALLS && !ps.banned)
+        {
+          ps.banned = true;
+          peers_to_drop.push_back(ps.context);
+        }
+      }
+    }
+
+    //forgets peers that are not connected anymore, their spans go to other peers
+    void remove_peers_except(const std::set<peer_id>& alive)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      for (auto it = m_peers.begin(); it != m_peers.end();)
+      {
+        if (alive.count(it->first))
+        {
+          ++it;
+          continue;
+        }
+        for (auto& s : m_spans)
+        {
+          if (s.second.assigned && s.second.peer == it->first)
+            s.second.assigned = false;
+        }
+        m_peers.erase(it++);
+      }
+    }
+
+    //cuts queued ids above the height that some connected, not banned peer's chain entry agreed with
+    //(the peers that filled them are gone), peers rejected because of the dropped ids may add their chains then;
+    //returns false if nothing was dropped
+    bool drop_unsupported_tail()
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      uint64_t supported_height = m_next_height;
+      for (const auto& p : m_peers)
+      {
+        if (!p.second.banned && !p.second.other_chain)
+          supported_height = std::max(supported_height, p.second.chain_height);
+      }
+      if (supported_height >= m_tip_height)
+        return false;
+
+      uint64_t split_height = m_tip_height - m_unsplit.size();
+      if (supported_height >= split_height)
+      {
+        m_unsplit.resize(static_cast<size_t>(supported_height - split_height));
+        m_tip_height = supported_height;
+      }
+      else
+      {
+        // spans are processed in height order, so everything from the first span reaching above supported ids goes
+        m_unsplit.clear();
+        auto cut_it = m_spans.begin();
+        while (cut_it != m_spans.end() && cut_it->first + cut_it->second.ids.size() <= supported_height)
+          ++cut_it;
+        m_tip_height = cut_it == m_spans.end() ? split_height : cut_it->first;
+        for (auto it = cut_it; it != m_spans.end(); ++it)
+        {
+          if (it->second.assigned)
+          {
+            auto owner_it = m_peers.find(it->second.peer);
+            if (owner_it != m_peers.end() && owner_it->second.has_span)
+              release_span(owner_it->second);
+          }
+          m_span_by_first_id.erase(it->second.ids.front());
+        }
+        m_spans.erase(cut_it, m_spans.end());
+      }
+
+      for (auto& p : m_peers)
+      {
+        p.second.chain_height = std::min(p.second.chain_height, m_tip_height);
+        if (p.second.other_chain && p.second.conflict_height >= m_tip_height)
+        {
+          p.second.other_chain = false;
+          p.second.waiting = true;
+        }
+      }
+      return true;
+    }
+
+    //peer will be returned by get_waiting_peers() on next check
+    void set_waiting(const epee::net_utils::connection_context_base& peer)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      peer_stat& ps = m_peers[peer.m_connection_id];
+      ps.context = peer;
+      ps.waiting = true;
+    }
+
+    //peers that asked for work and got none, they should retry (or finish sync if nothing is left)
+    void get_waiting_peers(std::list<epee::net_utils::connection_context_base>& peers)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      for (auto& p : m_peers)
+      {
+        if (p.second.waiting && !p.second.banned)
+        {
+          p.second.waiting = false;
+          peers.push_back(p.second.context);
+        }
+      }
+    }
+
+    //true if blocks below the given height are still to be downloaded or processed
+    bool has_pending_work(uint64_t below_height)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      if (!m_unsplit.empty() && m_tip_height - m_unsplit.size() < below_height)
+        return true;
+      return m_spans.size() && m_spans.begin()->first < below_height;
+    }
+
+    //true if the peer took part in download already
+    bool is_peer_known(const peer_id& peer)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      return m_peers.count(peer) != 0;
+    }
+
+    //true if there are ids below the given height that aren't downloaded or being downloaded
+    bool has_unassigned_work(uint64_t below_height)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      if (!m_unsplit.empty() && m_tip_height - m_unsplit.size() < below_height)
+        return true;
+      for (const auto& s : m_spans)
+      {
+        if (!s.second.assigned && !s.second.received && s.first < below_height)
+          return true;
+      }
+      return false;
+    }
+
+    bool has_ready_span()
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      return !m_processing && m_spans.size() && m_spans.begin()->first == m_next_height && m_spans.begin()->second.received;
+    }
+
+    uint64_t get_tip_height()
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      return m_tip_height;
+    }
+
+    //average blocks per second the peer delivered, 0 if unknown
+    double get_peer_throughput(const peer_id& peer)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      auto it = m_peers.find(peer);
+      if (it == m_peers.end() || !it->second.spans_done || it->second.ms_per_block <= 0)
+        return 0;
+      return 1000.0 / it->second.ms_per_block;
+    }
+
+    //false once the span given to the peer was delivered or taken back, the peer's request for it can be forgotten then
+    bool has_span(const peer_id& peer)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      auto it = m_peers.find(peer);
+      return it != m_peers.end() && it->second.has_span;
+    }
+
+    //true (once) if first_id starts a span that was taken back from the peer, so its late answer is still welcome
+    bool take_released_span(const peer_id& peer, const crypto::hash& first_id)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      auto it = m_peers.find(peer);
+      if (it == m_peers.end())
+        return false;
+      std::deque<crypto::hash>& released = it->second.released_spans;
+      auto r_it = std::find(released.begin(), released.end(), first_id);
+      if (r_it == released.end())
+        return false;
+      released.erase(r_it);
+      return true;
+    }
+
+    //drops everything, used when downloaded blocks turned out to be invalid
+    void reset()
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      m_spans.clear();
+      m_span_by_first_id.clear();
+      m_unsplit.clear();
+      m_next_height = m_tip_height = 0;
+      m_processing = false;
+      for (auto& p : m_peers)
+      {
+        if (p.second.has_span)
+          release_span(p.second);
+        p.second.other_chain = false;
+        p.second.chain_height = 0;
+      }
+    }
+
+  private:
+    struct span
+    {
+      span() : assigned(false), received(false), assigned_time(0), peer() {}
+      std::vector<crypto::hash> ids;
+      bool assigned;
+      bool received;
+      uint64_t assigned_time;
+      peer_id peer;
+      std::list<block_complete_entry> blocks;
+      epee::net_utils::connection_context_base source;
+    };
+
+    struct peer_stat
+    {
+      peer_stat() : has_span(false), waiting(false), banned(false), other_chain(false), chain_height(0), conflict_height(0), span_first_id(null_hash), ms_per_block(0), spans_done(0), blocks_done(0), stalls(0) {}
+      epee::net_utils::connection_context_base context;
+      bool has_span;
+      bool waiting;
+      bool banned;
+      bool other_chain;
+      uint64_t chain_height;    //queued ids below it agree with the peer's last accepted chain entry
+      uint64_t conflict_height; //height of the queued id the peer's chain disagreed with, if other_chain
+      crypto::hash span_first_id;
+      std::deque<crypto::hash> released_spans; //first ids of spans requested from the peer but not expected from it anymore
+      double ms_per_block;
+      uint64_t spans_done;
+      uint64_t blocks_done;
+      uint64_t stalls;
+    };
+
+    void assign(span& s, peer_stat& ps, uint64_t now_ms)
+    {
+      s.assigned = true;
+      s.assigned_time = now_ms;
+      s.peer = ps.context.m_connection_id;
+      ps.has_span = true;
+      ps.waiting = false;
+      ps.span_first_id = s.ids.front();
+    }
+
+    //the peer is free to take another span, the one it was asked for may still arrive
+    void release_span(peer_stat& ps)
+    {
+      ps.has_span = false;
+      ps.waiting = true;
+      ps.released_spans.push_back(ps.span_first_id);
+      if (ps.released_spans.size() > m_max_spans)
+        ps.released_spans.pop_front();
+    }
+
+    const crypto::hash* get_queued_id(uint64_t height) const
+    {
+      uint64_t split_height = m_tip_height - m_unsplit.size();
+      if (height >= m_tip_height || height < m_next_height)
+        return nullptr;
+      if (height >= split_height)
+        return &m_unsplit[static_cast<size_t>(height - split_height)];
+      auto it = m_spans.upper_bound(height);
+      if (it == m_spans.begin())
+        return nullptr;
+      --it;
+      if (height - it->first >= it->second.ids.size())
+        return nullptr;
+      return &it->second.ids[static_cast<size_t>(height - it->first)];
+    }
+
+    static uint64_t get_span_timeout(const peer_stat& ps, size_t blocks_count)
+    {
+      if (!ps.spans_done)
+        return CURRENCY_PROTOCOL_SYNC_SPAN_TIMEOUT * 1000;
+      uint64_t expected = static_cast<uint64_t>(ps.ms_per_block * blocks_count) * 4;
+      return std::max<uint64_t>(expected, CURRENCY_PROTOCOL_SYNC_SPAN_MIN_TIMEOUT * 1000);
+    }
+
+    size_t m_span_size;
+    size_t m_max_spans;
+    uint64_t m_next_height;   //height of the next block to give out for processing
+    uint64_t m_tip_height;    //height after the last known id
+    std::deque<crypto::hash> m_unsplit; //ids at heights [m_tip_height - m_unsplit.size(), m_tip_height) not put into spans yet
+    std::map<uint64_t, span> m_spans;   //by start height, cover [m_next_height, m_tip_height - m_unsplit.size())
+    std::unordered_map<crypto::hash, uint64_t> m_span_by_first_id;
+    std::unordered_map<peer_id, peer_stat, boost::hash<peer_id> > m_peers;
+    bool m_processing;
+    epee::critical_section m_lock;
+  };
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <string.h>
+#include <algorithm>
+extern "C" {
+#include "zlib/zlib.h"
+}
+
+#include "common/varint.h"
+#include "currency_config.h"
+#include "misc_log_ex.h"
+
+// Compressed wrapper of bulk payloads, sent only to peers that ask for it with CURRENCY_PROTOCOL_FLAG_COMPRESSED:
+//   signature(4) | version(1) | unpacked size(varint) | zlib stream
+// Unpacked size can't exceed P2P_DEFAULT_PACKET_MAX_SIZE and the stream must inflate to exactly that size.
+// Output buffer grows with what is actually inflated, so a false claim doesn't make us allocate it.
+#define CURRENCY_PROTOCOL_COMPRESSED_SIGNATURE       "\x01\x42\x5a\x4c"
+#define CURRENCY_PROTOCOL_COMPRESSED_SIGNATURE_SIZE  4
+#define CURRENCY_PROTOCOL_COMPRESSED_VERSION         1
+#define CURRENCY_PROTOCOL_DECOMPRESSION_STEP         (64 * 1024)
+
+namespace currency
+{
+  inline bool is_compressed_payload(const std::string& buff)
+  {
+    return buff.size() >= CURRENCY_PROTOCOL_COMPRESSED_SIGNATURE_SIZE &&
+      !memcmp(buff.data(), CURRENCY_PROTOCOL_COMPRESSED_SIGNATURE, CURRENCY_PROTOCOL_COMPRESSED_SIGNATURE_SIZE);
+  }
+  //-----------------------------------------------------------------------------------------------
+  // returns false if compression failed or didn't make payload smaller, out is undefined then
+  inline bool compress_payload(const std::string& in, std::string& out, int level = CURRENCY_PROTOCOL_COMPRESSION_LEVEL)
+  {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit(&zs, level) != Z_OK)
+      return false;
+
+    out.assign(CURRENCY_PROTOCOL_COMPRESSED_SIGNATURE, CURRENCY_PROTOCOL_COMPRESSED_SIGNATURE_SIZE);
+    out.push_back(static_cast<char>(CURRENCY_PROTOCOL_COMPRESSED_VERSION));
+    tools::write_varint(std::back_inserter(out), static_cast<uint64_t>(in.size()));
+    size_t header_size = out.size();
+    out.resize(header_size + deflateBound(&zs, static_cast<uLong>(in.size())));
+
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = static_cast<uInt>(in.size());
+    zs.next_out = reinterpret_cast<Bytef*>(&out[header_size]);
+    zs.avail_out = static_cast<uInt>(out.size() - header_size);
+    int ret = deflate(&zs, Z_FINISH);
+    deflateEnd(&zs);
+    if (ret != Z_STREAM_END)
+    {
+      LOG_PRINT_L1("Failed to deflate payload, err = " << ret);
+      return false;
+    }
+    out.resize(out.size() - zs.avail_out);
+    return out.size() < in.size();
+  }
+  //-----------------------------------------------------------------------------------------------
+  inline bool decompress_payload(const std::string& in, std::string& out)
+  {
+    if (!is_compressed_payload(in) || in.size() < CURRENCY_PROTOCOL_COMPRESSED_SIGNATURE_SIZE + 1 ||
+      in[CURRENCY_PROTOCOL_COMPRESSED_SIGNATURE_SIZE] != CURRENCY_PROTOCOL_COMPRESSED_VERSION)
+      return false;
+
+    const char* p = in.data() + CURRENCY_PROTOCOL_COMPRESSED_SIGNATURE_SIZE + 1;
+    const char* end = in.data() + in.size();
+    uint64_t unpacked_size = 0;
+    int r = tools::read_varint<64>(p, end, unpacked_size);
+    if (r <= 0 || (static_cast<unsigned char>(*(p - 1)) & 0x80))
+      return false;
+    CHECK_AND_ASSERT_MES(unpacked_size <= P2P_DEFAULT_PACKET_MAX_SIZE, false,
+      "Compressed payload claims too big unpacked size: " << unpacked_size);
+
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit(&zs) != Z_OK)
+      return false;
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(p));
+    zs.avail_in = static_cast<uInt>(end - p);
+    out.clear();
+    int ret = Z_OK;
+    // one byte over the claimed size shows a stream that produces more
+    while (ret == Z_OK && out.size() <= unpacked_size)
+    {
+      size_t offset = out.size();
+      size_t step = static_cast<size_t>((std::min)(static_cast<uint64_t>((std::max)(offset, static_cast<size_t>(CURRENCY_PROTOCOL_DECOMPRESSION_STEP))), unpacked_size + 1 - offset));
+      out.resize(offset + step);
+      zs.next_out = reinterpret_cast<Bytef*>(&out[offset]);
+      zs.avail_out = static_cast<uInt>(step);
+      ret = inflate(&zs, Z_NO_FLUSH);
+      out.resize(offset + step - zs.avail_out);
+    }
+    bool ok = ret == Z_STREAM_END && zs.total_out == unpacked_size && zs.avail_in == 0;
+    inflateEnd(&zs);
+    CHECK_AND_ASSERT_MES(ok, false, "Failed to inflate payload, err = " << ret);
+    return true;
+  }
+}
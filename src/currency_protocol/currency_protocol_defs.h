@@ -14,6 +14,12 @@ namespace currency
 
 #define BC_COMMANDS_POOL_BASE 2000
 
+  // capabilities advertised in CORE_SYNC_DATA::protocol_flags, old nodes don't send the field and get 0
+#define CURRENCY_PROTOCOL_FLAG_COMPACT_BLOCKS     0x00000001
+#define CURRENCY_PROTOCOL_FLAG_TX_INVENTORY       0x00000002
+#define CURRENCY_PROTOCOL_FLAG_PACKED_BULK        0x00000004 //understands currency_protocol_packed.h payloads
+#define CURRENCY_PROTOCOL_FLAG_COMPRESSED         0x00000008 //asks for currency_protocol_compression.h payloads
+
 
   /************************************************************************/
   /*                                                                      */
@@ -110,11 +116,13 @@ namespace currency
     uint64_t current_height;
     crypto::hash  top_id;
     uint64_t last_checkpoint_height;
+    uint32_t protocol_flags;
 
     BEGIN_KV_SERIALIZE_MAP()
       KV_SERIALIZE(current_height)
       KV_SERIALIZE_VAL_POD_AS_BLOB(top_id)
       KV_SERIALIZE(last_checkpoint_height)
+      KV_SERIALIZE(protocol_flags)
     END_KV_SERIALIZE_MAP()
   };
 
@@ -150,4 +158,93 @@ namespace currency
     };
   };
 
+  /************************************************************************/
+  /* Compact block relay: block blob only, its tx_hashes are resolved     */
+  /* from the receiver's tx pool, missing ones are requested separately   */
+  /************************************************************************/
+  struct NOTIFY_NEW_COMPACT_BLOCK
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 8;
+
+    struct request
+    {
+      blobdata block;
+      uint64_t current_blockchain_height;
+      uint32_t hop;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(block)
+        KV_SERIALIZE(current_blockchain_height)
+        KV_SERIALIZE(hop)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct NOTIFY_REQUEST_COMPACT_BLOCK_TXS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 9;
+
+    struct request
+    {
+      crypto::hash block_id;
+      std::list<crypto::hash> txs;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_VAL_POD_AS_BLOB(block_id)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(txs)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct NOTIFY_RESPONSE_COMPACT_BLOCK_TXS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 10;
+
+    struct request
+    {
+      crypto::hash block_id;
+      std::list<blobdata> txs;
+      std::list<crypto::hash> missed_ids;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_VAL_POD_AS_BLOB(block_id)
+        KV_SERIALIZE(txs)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(missed_ids)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  /************************************************************************/
+  /* Tx inventory relay: ids of new pool transactions are announced, the  */
+  /* receiver requests bodies only for the ids it doesn't have            */
+  /************************************************************************/
+  struct NOTIFY_TX_INVENTORY
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 11;
+
+    struct request
+    {
+      std::list<crypto::hash> txs;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(txs)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  //answered with NOTIFY_NEW_TRANSACTIONS, ids that already left the pool are skipped
+  struct NOTIFY_REQUEST_TXS
+  {
+    const static int ID = BC_COMMANDS_POOL_BASE + 12;
+
+    struct request
+    {
+      std::list<crypto::hash> txs;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(txs)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
 }
@@ -9,7 +9,10 @@
 #include "storages/levin_abstract_invoke2.h"
 #include "warnings.h"
 #include "currency_protocol_defs.h"
+#include "currency_protocol_packed.h"
 #include "currency_protocol_handler_common.h"
+#include "known_inventory_filter.h"
+#include "block_download_scheduler.h"
 #include "currency_core/connection_context.h"
 #include "currency_core/currency_stat_info.h"
 #include "currency_core/verification_context.h"
@@ -32,12 +35,17 @@ namespace currency
     t_currency_protocol_handler(t_core& rcore, nodetool::i_p2p_endpoint<connection_context>* p_net_layout);
 
     BEGIN_INVOKE_MAP2(currency_protocol_handler)
-      HANDLE_NOTIFY_T2(NOTIFY_NEW_BLOCK, &currency_protocol_handler::handle_notify_new_block)
+      HANDLE_NOTIFY_PACKED_T2(NOTIFY_NEW_BLOCK, &currency_protocol_handler::handle_notify_new_block)
       HANDLE_NOTIFY_T2(NOTIFY_NEW_TRANSACTIONS, &currency_protocol_handler::handle_notify_new_transactions)
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_GET_OBJECTS, &currency_protocol_handler::handle_request_get_objects)
-      HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_GET_OBJECTS, &currency_protocol_handler::handle_response_get_objects)
+      HANDLE_NOTIFY_PACKED_T2(NOTIFY_RESPONSE_GET_OBJECTS, &currency_protocol_handler::handle_response_get_objects)
       HANDLE_NOTIFY_T2(NOTIFY_REQUEST_CHAIN, &currency_protocol_handler::handle_request_chain)
-      HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &currency_protocol_handler::handle_response_chain_entry)
+      HANDLE_NOTIFY_PACKED_T2(NOTIFY_RESPONSE_CHAIN_ENTRY, &currency_protocol_handler::handle_response_chain_entry)
+      HANDLE_NOTIFY_T2(NOTIFY_NEW_COMPACT_BLOCK, &currency_protocol_handler::handle_notify_new_compact_block)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_COMPACT_BLOCK_TXS, &currency_protocol_handler::handle_request_compact_block_txs)
+      HANDLE_NOTIFY_T2(NOTIFY_RESPONSE_COMPACT_BLOCK_TXS, &currency_protocol_handler::handle_response_compact_block_txs)
+      HANDLE_NOTIFY_T2(NOTIFY_TX_INVENTORY, &currency_protocol_handler::handle_notify_tx_inventory)
+      HANDLE_NOTIFY_T2(NOTIFY_REQUEST_TXS, &currency_protocol_handler::handle_request_txs)
     END_INVOKE_MAP2()
 
     bool on_idle();
@@ -52,6 +60,7 @@ namespace currency
     bool get_payload_sync_data(blobdata& data);
     bool get_payload_sync_data(CORE_SYNC_DATA& hshd);
     bool get_stat_info(core_stat_info& stat_inf);
+    void get_send_priorities(std::map<int, epee::net_utils::send_priority>& priorities);
     bool on_callback(currency_connection_context& context);
     t_core& get_core(){return m_core;}
     bool is_synchronized(){return m_synchronized;}
@@ -68,6 +77,11 @@ namespace currency
     int handle_response_get_objects(int command, NOTIFY_RESPONSE_GET_OBJECTS::request& arg, currency_connection_context& context);
     int handle_request_chain(int command, NOTIFY_REQUEST_CHAIN::request& arg, currency_connection_context& context);
     int handle_response_chain_entry(int command, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, currency_connection_context& context);
+    int handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, currency_connection_context& context);
+    int handle_request_compact_block_txs(int command, NOTIFY_REQUEST_COMPACT_BLOCK_TXS::request& arg, currency_connection_context& context);
+    int handle_response_compact_block_txs(int command, NOTIFY_RESPONSE_COMPACT_BLOCK_TXS::request& arg, currency_connection_context& context);
+    int handle_notify_tx_inventory(int command, NOTIFY_TX_INVENTORY::request& arg, currency_connection_context& context);
+    int handle_request_txs(int command, NOTIFY_REQUEST_TXS::request& arg, currency_connection_context& context);
 
 
     //----------------- i_bc_protocol_layout ---------------------------------------
@@ -75,11 +89,24 @@ namespace currency
     virtual bool relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, currency_connection_context& exclude_context);
     //----------------------------------------------------------------------------------
     //bool get_payload_sync_data(HANDSHAKE_DATA::request& hshd, currency_connection_context& context);
-    bool request_missing_objects(currency_connection_context& context, bool check_having_blocks);
+    bool request_missing_objects(currency_connection_context& context);
     size_t get_synchronizing_connections_count();
     bool on_connection_synchronized();  
     bool do_force_handshake_idle_connections();
     bool check_stop_flag_and_exit(currency_connection_context& context);
+    bool process_new_block_blob(const blobdata& block_blob, currency_connection_context& context, block_verification_context& bvc);
+    bool process_compact_block(const NOTIFY_NEW_COMPACT_BLOCK::request& arg, currency_connection_context& context);
+    //fill_txs(arg) completes arg.b.txs, called only if some peer gets the full block
+    template<class t_fill_txs>
+    bool relay_block_entry(NOTIFY_NEW_BLOCK::request& arg, currency_connection_context& exclude_context, t_fill_txs fill_txs);
+    void request_chain_resync(currency_connection_context& context);
+    void mark_txs_known(const epee::net_utils::connection_context_base& context, const std::list<crypto::hash>& tx_ids, bool received);
+    bool flush_tx_announcements();
+    template<class t_it>
+    t_it erase_requested_tx(t_it it);
+    bool process_ready_spans(currency_connection_context& context);
+    bool process_downloaded_span(block_download_scheduler::downloaded_span& ds, currency_connection_context& context);
+    bool on_idle_sync_scheduler();
     t_core& m_core;
 
     nodetool::p2p_endpoint_stub<connection_context> m_p2p_stub;
@@ -91,7 +118,26 @@ namespace currency
     std::atomic<uint64_t> m_core_inital_height;
     std::atomic<uint64_t> m_core_current_height;
     std::atomic<bool> m_want_stop;
-
+    uint32_t m_protocol_flags; //advertised in handshake, what we send is chosen by the remote flags
+
+    //per-connection tx inventory state, kept here rather than in connection context since relay runs from other connections' threads
+    struct tx_inventory_state
+    {
+      tx_inventory_state() : requested_txs(0) {}
+      known_inventory_filter known_txs;
+      std::list<crypto::hash> to_announce;
+      size_t requested_txs; //entries of m_requested_txs asked from this peer
+    };
+    struct tx_request
+    {
+      time_t time;
+      boost::uuids::uuid peer;
+    };
+    std::map<boost::uuids::uuid, tx_inventory_state> m_tx_inventory;
+    std::unordered_map<crypto::hash, tx_request> m_requested_txs; //announced txs requested from some peer and not received yet
+    critical_section m_tx_inventory_lock;
+
+    block_download_scheduler m_block_scheduler; //blocks download of initial sync, shared by all synchronizing connections
 
 
     template<class t_parametr>
@@ -99,7 +145,7 @@ namespace currency
       {
         LOG_PRINT_L2("[" << net_utils::print_connection_context_short(context) << "] post " << typeid(t_parametr).name() << " -->");
         std::string blob;
-        epee::serialization::store_t_to_binary(arg, blob);
+        store_protocol_payload(arg, blob, context.m_remote_protocol_flags);
         return m_p2p->invoke_notify_to_peer(t_parametr::ID, blob, context);
       }
 
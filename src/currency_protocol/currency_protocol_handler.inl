@@ -10,6 +10,7 @@ namespace currency
   namespace
   {
     const command_line::arg_descriptor<bool>               arg_currency_protocol_explicit_set_online = { "explicit-set-online", "Explicitly set node to online mode (needed for launch first node in network)", false, true};
+    const command_line::arg_descriptor<bool>               arg_currency_protocol_compression = { "p2p-compression", "Ask peers to compress big sync payloads sent to this node (for slow links, costs CPU on both sides)", false, true};
   }
   //-----------------------------------------------------------------------------------------------------------------------  
   template<class t_core>
@@ -21,7 +22,8 @@ namespace currency
                                                                                                               m_max_height_seen(0),
                                                                                                               m_core_inital_height(0),
                                                                                                               m_core_current_height(0),
-                                                                                                              m_want_stop(false)
+                                                                                                              m_want_stop(false),
+                                                                                                              m_protocol_flags(CURRENCY_PROTOCOL_FLAG_COMPACT_BLOCKS | CURRENCY_PROTOCOL_FLAG_TX_INVENTORY | CURRENCY_PROTOCOL_FLAG_PACKED_BULK)
 
   {
     if(!m_p2p)
@@ -32,6 +34,7 @@ namespace currency
     void t_currency_protocol_handler<t_core>::init_options(boost::program_options::options_description& desc)
     {
       command_line::add_arg(desc, arg_currency_protocol_explicit_set_online);
+      command_line::add_arg(desc, arg_currency_protocol_compression);
     }
     //-----------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
@@ -39,6 +42,8 @@ namespace currency
   {
     if (command_line::has_arg(vm, arg_currency_protocol_explicit_set_online))
       m_been_synchronized = true;
+    if (command_line::has_arg(vm, arg_currency_protocol_compression))
+      m_protocol_flags |= CURRENCY_PROTOCOL_FLAG_COMPRESSED;
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------  
@@ -66,7 +71,14 @@ namespace currency
     CHECK_AND_ASSERT_MES_CC( context.m_callback_request_count > 0, false, "false callback fired, but context.m_callback_request_count=" << context.m_callback_request_count);
     --context.m_callback_request_count;
 
-    if(context.m_state == currency_connection_context::state_synchronizing)
+    process_ready_spans(context);
+
+    if(context.m_state == currency_connection_context::state_synchronizing && m_block_scheduler.is_peer_known(context.m_connection_id))
+    {
+      //woken up by on_idle() to take a span
+      request_missing_objects(context);
+    }
+    else if(context.m_state == currency_connection_context::state_synchronizing)
     {
       NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
 
@@ -101,6 +113,21 @@ namespace currency
     });
     return have_called && res;
   }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_currency_protocol_handler<t_core>::get_send_priorities(std::map<int, epee::net_utils::send_priority>& priorities)
+  {
+    //new blocks go out first, then transactions, sync data fills what is left of the upload limit
+    priorities[NOTIFY_NEW_BLOCK::ID] = epee::net_utils::send_priority_high;
+    priorities[NOTIFY_NEW_COMPACT_BLOCK::ID] = epee::net_utils::send_priority_high;
+    priorities[NOTIFY_REQUEST_COMPACT_BLOCK_TXS::ID] = epee::net_utils::send_priority_high;
+    priorities[NOTIFY_RESPONSE_COMPACT_BLOCK_TXS::ID] = epee::net_utils::send_priority_high;
+    priorities[NOTIFY_NEW_TRANSACTIONS::ID] = epee::net_utils::send_priority_normal;
+    priorities[NOTIFY_TX_INVENTORY::ID] = epee::net_utils::send_priority_normal;
+    priorities[NOTIFY_REQUEST_TXS::ID] = epee::net_utils::send_priority_normal;
+    priorities[NOTIFY_RESPONSE_GET_OBJECTS::ID] = epee::net_utils::send_priority_bulk;
+    priorities[NOTIFY_RESPONSE_CHAIN_ENTRY::ID] = epee::net_utils::send_priority_bulk;
+  }
   //------------------------------------------------------------------------------------------------------------------------   
   template<class t_core> 
   void t_currency_protocol_handler<t_core>::log_connections()
@@ -130,6 +157,7 @@ namespace currency
   bool t_currency_protocol_handler<t_core>::process_payload_sync_data(const CORE_SYNC_DATA& hshd, currency_connection_context& context, bool is_inital)
   {
     context.m_remote_blockchain_height = hshd.current_height;
+    context.m_remote_protocol_flags = hshd.protocol_flags;
     LOG_PRINT_MAGENTA("[PROCESS_PAYLOAD_SYNC_DATA][m_been_synchronized=" << m_been_synchronized << "]: hshd.current_height = " << hshd.current_height << "(" << hshd.top_id << ")", LOG_LEVEL_3);
     if (context.m_state == currency_connection_context::state_befor_handshake && !is_inital)
     {
@@ -236,6 +264,7 @@ namespace currency
   bool t_currency_protocol_handler<t_core>::get_payload_sync_data(CORE_SYNC_DATA& hshd)
   {
     bool have_called = false;
+    hshd.protocol_flags = m_protocol_flags;
     
     m_core.get_blockchain_storage().template call_if_no_batch_exclusive_operation<bool>(have_called, [&]()
     {
@@ -287,34 +316,186 @@ namespace currency
     
 
     block_verification_context bvc = boost::value_initialized<block_verification_context>();
+    if (process_new_block_blob(arg.b.block, context, bvc) && bvc.m_added_to_main_chain)
+    {
+      ++arg.hop;
+      relay_block(arg, context);
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_currency_protocol_handler<t_core>::process_new_block_blob(const blobdata& block_blob, currency_connection_context& context, block_verification_context& bvc)
+  {
     m_core.pause_mine();
-    m_core.handle_incoming_block(arg.b.block, bvc);
+    m_core.handle_incoming_block(block_blob, bvc);
     m_core.resume_mine();
     if(bvc.m_verifivation_failed)
     {
       LOG_PRINT_CCONTEXT_L0("Block verification failed, dropping connection");
       m_p2p->drop_connection(context);
-      return 1;
+      return false;
     }
     if(bvc.m_added_to_main_chain)
     {
       m_core_current_height = bvc.height;
-      ++arg.hop;
-      //TODO: Add here announce protocol usage
-      relay_block(arg, context);
     }else if(bvc.m_marked_as_orphaned)
     {
-      LOG_PRINT_MAGENTA("[NOTIFY_NEW_BLOCK]: m_state set state_synchronizing", LOG_LEVEL_3);
-      context.m_state = currency_connection_context::state_synchronizing;
-      NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
-      m_core.get_short_chain_history(r.block_ids);
-      LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size() );
-      post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
+      request_chain_resync(context);
     }
-      
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_currency_protocol_handler<t_core>::request_chain_resync(currency_connection_context& context)
+  {
+    LOG_PRINT_MAGENTA("[NOTIFY_NEW_BLOCK]: m_state set state_synchronizing", LOG_LEVEL_3);
+    context.m_state = currency_connection_context::state_synchronizing;
+    NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
+    m_core.get_short_chain_history(r.block_ids);
+    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size() );
+    post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_currency_protocol_handler<t_core>::handle_notify_new_compact_block(int command, NOTIFY_NEW_COMPACT_BLOCK::request& arg, currency_connection_context& context)
+  {
+    LOG_PRINT_CCONTEXT_L2("NOTIFY_NEW_COMPACT_BLOCK (hop " << arg.hop << ")");
+    if (!m_synchronized || context.m_state != currency_connection_context::state_normal || context.m_remote_blockchain_height <= 1)
+      return 1;
+
+    block b = AUTO_VAL_INIT(b);
+    if (!parse_and_validate_block_from_blob(arg.block, b))
+    {
+      LOG_PRINT_CCONTEXT_L0("Failed to parse compact block, dropping connection");
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+    crypto::hash block_id = get_block_hash(b);
+    if (m_core.have_block(block_id))
+      return 1;
+
+    NOTIFY_REQUEST_COMPACT_BLOCK_TXS::request req = AUTO_VAL_INIT(req);
+    req.block_id = block_id;
+    for (const auto& tx_id : b.tx_hashes)
+    {
+      if (!m_core.get_tx_pool().have_tx(tx_id))
+        req.txs.push_back(tx_id);
+    }
+
+    if (req.txs.empty())
+    {
+      process_compact_block(arg, context);
+      return 1;
+    }
+    if (req.txs.size() > CURRENCY_PROTOCOL_TX_INVENTORY_MAX_COUNT)
+    {
+      // more than a peer answers in one request, get the block in full
+      LOG_PRINT_CCONTEXT_L1(req.txs.size() << " txs of compact block " << block_id << " missing in pool, falling back to chain sync");
+      request_chain_resync(context);
+      return 1;
+    }
+
+    // only the latest compact block per connection is kept pending, an older one is superseded anyway
+    context.m_pending_compact_block = arg;
+    context.m_pending_compact_block_id = block_id;
+    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_COMPACT_BLOCK_TXS: " << req.txs.size() << " of " << b.tx_hashes.size() << " txs missing in pool");
+    post_notify<NOTIFY_REQUEST_COMPACT_BLOCK_TXS>(req, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_currency_protocol_handler<t_core>::handle_request_compact_block_txs(int command, NOTIFY_REQUEST_COMPACT_BLOCK_TXS::request& arg, currency_connection_context& context)
+  {
+    LOG_PRINT_CCONTEXT_L2("NOTIFY_REQUEST_COMPACT_BLOCK_TXS: txs.size()=" << arg.txs.size());
+    if (arg.txs.size() > CURRENCY_PROTOCOL_TX_INVENTORY_MAX_COUNT)
+    {
+      LOG_ERROR_CCONTEXT("sent NOTIFY_REQUEST_COMPACT_BLOCK_TXS with too many ids: " << arg.txs.size() << ", dropping connection");
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+
+    NOTIFY_RESPONSE_COMPACT_BLOCK_TXS::request rsp = AUTO_VAL_INIT(rsp);
+    rsp.block_id = arg.block_id;
+
+    // the block may be already in the chain or still about to be added, so look in both blockchain and pool
+    std::list<transaction> txs;
+    m_core.get_blockchain_storage().get_transactions(arg.txs, txs, rsp.missed_ids);
+    for (const auto& tx : txs)
+      rsp.txs.push_back(t_serializable_object_to_blob(tx));
+
+    LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_RESPONSE_COMPACT_BLOCK_TXS: txs.size()=" << rsp.txs.size() << ", missed_ids.size()=" << rsp.missed_ids.size());
+    post_notify<NOTIFY_RESPONSE_COMPACT_BLOCK_TXS>(rsp, context);
     return 1;
   }
   //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_currency_protocol_handler<t_core>::handle_response_compact_block_txs(int command, NOTIFY_RESPONSE_COMPACT_BLOCK_TXS::request& arg, currency_connection_context& context)
+  {
+    LOG_PRINT_CCONTEXT_L2("NOTIFY_RESPONSE_COMPACT_BLOCK_TXS: txs.size()=" << arg.txs.size() << ", missed_ids.size()=" << arg.missed_ids.size());
+    if (context.m_pending_compact_block_id == null_hash || context.m_pending_compact_block_id != arg.block_id)
+    {
+      LOG_PRINT_CCONTEXT_L1("NOTIFY_RESPONSE_COMPACT_BLOCK_TXS for unexpected block " << arg.block_id << ", ignored");
+      return 1;
+    }
+
+    NOTIFY_NEW_COMPACT_BLOCK::request pending = AUTO_VAL_INIT(pending);
+    std::swap(pending, context.m_pending_compact_block);
+    context.m_pending_compact_block_id = null_hash;
+
+    if (!m_synchronized || context.m_state != currency_connection_context::state_normal)
+      return 1;
+
+    if (!arg.missed_ids.empty())
+    {
+      // peer can't complete the block, fall back to regular synchronization to get it in full
+      LOG_PRINT_CCONTEXT_L1("peer missed " << arg.missed_ids.size() << " txs of compact block " << arg.block_id << ", falling back to chain sync");
+      request_chain_resync(context);
+      return 1;
+    }
+
+    for (const auto& tx_blob : arg.txs)
+    {
+      currency::tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+      m_core.handle_incoming_tx(tx_blob, tvc, true);
+      if (tvc.m_verifivation_failed)
+      {
+        LOG_PRINT_CCONTEXT_L0("Compact block verification failed: transaction verification failed, dropping connection");
+        m_p2p->drop_connection(context);
+        return 1;
+      }
+    }
+
+    process_compact_block(pending, context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_currency_protocol_handler<t_core>::process_compact_block(const NOTIFY_NEW_COMPACT_BLOCK::request& arg, currency_connection_context& context)
+  {
+    block_verification_context bvc = boost::value_initialized<block_verification_context>();
+    if (!process_new_block_blob(arg.block, context, bvc) || !bvc.m_added_to_main_chain)
+      return false;
+
+    NOTIFY_NEW_BLOCK::request full_arg = AUTO_VAL_INIT(full_arg);
+    full_arg.b.block = arg.block;
+    full_arg.current_blockchain_height = arg.current_blockchain_height;
+    full_arg.hop = arg.hop + 1;
+    return relay_block_entry(full_arg, context, [&](NOTIFY_NEW_BLOCK::request& full) -> bool
+    {
+      // peers without compact relay support still need the full entry, txs are in the blockchain by now
+      block b = AUTO_VAL_INIT(b);
+      CHECK_AND_ASSERT_MES(parse_and_validate_block_from_blob(full.b.block, b), false, "failed to parse block that was just added");
+      std::list<transaction> txs;
+      std::list<crypto::hash> missed_txs;
+      m_core.get_blockchain_storage().get_transactions(b.tx_hashes, txs, missed_txs);
+      CHECK_AND_ASSERT_MES(missed_txs.empty(), false, "internal error: " << missed_txs.size() << " txs of just added block " << get_block_hash(b) << " not found");
+      for (const auto& tx : txs)
+        full.b.txs.push_back(t_serializable_object_to_blob(tx));
+      return true;
+    });
+  }
+  //------------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
   int t_currency_protocol_handler<t_core>::handle_notify_new_transactions(int command, NOTIFY_NEW_TRANSACTIONS::request& arg, currency_connection_context& context)
   {
@@ -323,6 +504,18 @@ namespace currency
     if (!m_synchronized || context.m_state != currency_connection_context::state_normal || context.m_remote_blockchain_height <= 1)
       return 1;
 
+    if (context.m_remote_protocol_flags & CURRENCY_PROTOCOL_FLAG_TX_INVENTORY)
+    {
+      std::list<crypto::hash> tx_ids;
+      for (const auto& tx_blob : arg.txs)
+      {
+        transaction tx;
+        crypto::hash tx_hash = null_hash, tx_prefix_hash = null_hash;
+        if (parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash, tx_prefix_hash))
+          tx_ids.push_back(tx_hash);
+      }
+      mark_txs_known(context, tx_ids, true);
+    }
 
     for(auto tx_blob_it = arg.txs.begin(); tx_blob_it!=arg.txs.end();)
     {
@@ -342,10 +535,7 @@ namespace currency
     }
 
     if(arg.txs.size())
-    {
-      //TODO: add announce usage here
       relay_transactions(arg, context);
-    }
 
     return true;
   }
@@ -401,170 +591,197 @@ namespace currency
 
     context.m_remote_blockchain_height = arg.current_blockchain_height;
 
-    PROF_L2_DO(uint64_t syncing_conn_count_sum = get_synchronizing_connections_count(); uint64_t syncing_conn_count_count = 1);
-
-    bool have_called = false;
-    int res = m_core.get_blockchain_storage().template call_if_no_batch_exclusive_operation<int>(have_called, [&]()
+    PROF_L1_START(block_complete_entries_prevalidation_time);
+    std::list<crypto::hash> received_ids;
+    bool late_answer = false;
+    for (const block_complete_entry& block_entry : arg.blocks)
     {
-      PROF_L1_START(block_complete_entries_prevalidation_time);
-      size_t count = 0;
-      for (const block_complete_entry& block_entry : arg.blocks)
-      {
-        CHECK_STOP_FLAG_EXIT_IF_SET(1, "Blocks processing interrupted, connection dropped");
+      CHECK_STOP_FLAG_EXIT_IF_SET(1, "Blocks processing interrupted, connection dropped");
 
-        ++count;
-        block b;
-        if (!parse_and_validate_block_from_blob(block_entry.block, b))
-        {
-          LOG_ERROR_CCONTEXT("sent wrong block: failed to parse and validate block: \r\n"
-            << string_tools::buff_to_hex_nodelimer(block_entry.block) << "\r\n dropping connection");
-          m_p2p->drop_connection(context);
-          m_p2p->add_ip_fail(context.m_remote_ip);
-          return 1;
-        }
-        //to avoid concurrency in core between connections, suspend connections which delivered block later then first one
-        if (count == 2)
-        {
-          if (m_core.have_block(get_block_hash(b)))
-          {
-            LOG_PRINT_MAGENTA("[RESPONSE_GET_OBJECTS]: m_state set state_idle", LOG_LEVEL_3);
-            context.m_state = currency_connection_context::state_idle;
-            context.m_needed_objects.clear();
-            context.m_requested_objects.clear();
-            LOG_PRINT_CCONTEXT_L1("Connection set to idle state.");
-            return 1;
-          }
-        }
-
-        auto req_it = context.m_requested_objects.find(get_block_hash(b));
-        if (req_it == context.m_requested_objects.end())
-        {
-          LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: block with id=" << string_tools::pod_to_hex(get_blob_hash(block_entry.block))
-            << " wasn't requested, dropping connection");
-          m_p2p->drop_connection(context);
-          return 1;
-        }
-        if (b.tx_hashes.size() != block_entry.txs.size())
-        {
-          LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: block with id=" << string_tools::pod_to_hex(get_blob_hash(block_entry.block))
-            << ", tx_hashes.size()=" << b.tx_hashes.size() << " mismatch with block_complete_entry.m_txs.size()=" << block_entry.txs.size() << ", dropping connection");
-          m_p2p->drop_connection(context);
-          return 1;
-        }
-
-        context.m_requested_objects.erase(req_it);
+      block b;
+      if (!parse_and_validate_block_from_blob(block_entry.block, b))
+      {
+        LOG_ERROR_CCONTEXT("sent wrong block: failed to parse and validate block: \r\n"
+          << string_tools::buff_to_hex_nodelimer(block_entry.block) << "\r\n dropping connection");
+        m_p2p->drop_connection(context);
+        m_p2p->add_ip_fail(context.m_remote_ip);
+        return 1;
       }
-      PROF_L1_FINISH(block_complete_entries_prevalidation_time);
-
-      PROF_L2_DO(syncing_conn_count_sum += get_synchronizing_connections_count(); ++syncing_conn_count_count);
 
-      if (context.m_requested_objects.size())
+      crypto::hash block_id = get_block_hash(b);
+      auto req_it = context.m_requested_objects.find(block_id);
+      if (received_ids.empty() && req_it == context.m_requested_objects.end() && m_block_scheduler.take_released_span(context.m_connection_id, block_id))
+        late_answer = true; //span was taken back from this peer after a stall, its current request stays pending
+      if (!late_answer && req_it == context.m_requested_objects.end())
       {
-        LOG_PRINT_CCONTEXT_RED("returned not all requested objects (context.m_requested_objects.size()="
-          << context.m_requested_objects.size() << "), dropping connection", LOG_LEVEL_0);
+        LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: block with id=" << string_tools::pod_to_hex(get_blob_hash(block_entry.block))
+          << " wasn't requested, dropping connection");
         m_p2p->drop_connection(context);
         return 1;
       }
-
-      PROF_L1_START(blocks_handle_time);
+      if (b.tx_hashes.size() != block_entry.txs.size())
       {
-        m_core.pause_mine();
-        m_core.get_blockchain_storage().start_batch_exclusive_operation();
-        bool success = false;
-        misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler([&, this](){
-          boost::bind(&t_core::resume_mine, &m_core);
-          m_core.get_blockchain_storage().finish_batch_exclusive_operation(success);
-        });
+        LOG_ERROR_CCONTEXT("sent wrong NOTIFY_RESPONSE_GET_OBJECTS: block with id=" << string_tools::pod_to_hex(get_blob_hash(block_entry.block))
+          << ", tx_hashes.size()=" << b.tx_hashes.size() << " mismatch with block_complete_entry.m_txs.size()=" << block_entry.txs.size() << ", dropping connection");
+        m_p2p->drop_connection(context);
+        return 1;
+      }
 
-        BOOST_FOREACH(const block_complete_entry& block_entry, arg.blocks)
-        {
-          CHECK_STOP_FLAG_EXIT_IF_SET(1, "Blocks processing interrupted, connection dropped");
-          //process transactions
-          PROF_L1_START(transactions_process_time);
-          BOOST_FOREACH(auto& tx_blob, block_entry.txs)
-          {
-            //CHECK_STOP_FLAG_EXIT_IF_SET(1, "Blocks processing interrupted, connection dropped");
-            if (check_stop_flag_and_exit(context)) 
-            {             
-              LOG_PRINT_YELLOW("Stop flag detected within NOTIFY_RESPONSE_GET_OBJECTS. ", LOG_LEVEL_0);
-              //commit transaction
-              success = true;
-              return 1; 
-            }
-            tx_verification_context tvc = AUTO_VAL_INIT(tvc);
-            m_core.handle_incoming_tx(tx_blob, tvc, true);
-            if (tvc.m_verifivation_failed)
-            {
-              LOG_ERROR_CCONTEXT("transaction verification failed on NOTIFY_RESPONSE_GET_OBJECTS, \r\ntx_id = "
-                << string_tools::pod_to_hex(get_blob_hash(tx_blob)) << ", dropping connection");
-              m_p2p->drop_connection(context);
-              return 1;
-            }
-          }
-          PROF_L1_FINISH(transactions_process_time);
+      if (!late_answer)
+        context.m_requested_objects.erase(req_it);
+      received_ids.push_back(block_id);
+    }
+    PROF_L1_FINISH(block_complete_entries_prevalidation_time);
 
-          //process block
-          PROF_L1_START(block_process_time);
-          block_verification_context bvc = boost::value_initialized<block_verification_context>();
+    if (!late_answer && context.m_requested_objects.size())
+    {
+      LOG_PRINT_CCONTEXT_RED("returned not all requested objects (context.m_requested_objects.size()="
+        << context.m_requested_objects.size() << "), dropping connection", LOG_LEVEL_0);
+      m_p2p->drop_connection(context);
+      return 1;
+    }
 
-          m_core.handle_incoming_block(block_entry.block, bvc, false);
+    size_t blocks_count = arg.blocks.size();
+    if (!m_block_scheduler.on_span_received(context, received_ids, arg.blocks, misc_utils::get_tick_count()))
+    {
+      LOG_PRINT_CCONTEXT_L1("NOTIFY_RESPONSE_GET_OBJECTS: " << blocks_count << " blocks are not needed anymore (delivered by another peer), ignored");
+    }
+    else
+    {
+      LOG_PRINT_CCONTEXT_L2("NOTIFY_RESPONSE_GET_OBJECTS: " << blocks_count << " blocks prevalidated in " << print_mcsec_as_ms(block_complete_entries_prevalidation_time)
+        << " ms, peer throughput " << std::fixed << std::setprecision(2) << m_block_scheduler.get_peer_throughput(context.m_connection_id) << " blocks/s");
+    }
 
-          if (bvc.m_verifivation_failed)
-          {
-            LOG_PRINT_CCONTEXT_L0("Block verification failed, dropping connection");
-            m_p2p->drop_connection(context);
-            m_p2p->add_ip_fail(context.m_remote_ip);
-            return 1;
+    // ask for the next span before handling downloaded ones, so this peer keeps downloading meanwhile
+    request_missing_objects(context);
+    process_ready_spans(context);
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_currency_protocol_handler<t_core>::process_ready_spans(currency_connection_context& context)
+  {
+    if (!m_block_scheduler.begin_processing())
+      return true;
+
+    bool finished = false;
+    misc_utils::auto_scope_leave_caller processing_guard = misc_utils::create_scope_leave_handler([&, this](){
+      if (!finished)
+        m_block_scheduler.end_processing();
+    });
+
+    bool have_called = false;
+    m_core.get_blockchain_storage().template call_if_no_batch_exclusive_operation<bool>(have_called, [&]()
+    {
+      block_download_scheduler::downloaded_span ds = AUTO_VAL_INIT(ds);
+      while (m_block_scheduler.pop_ready_or_end_processing(ds))
+      {
+        if (!process_downloaded_span(ds, context))
+        {
+          // blocks after the bad ones are useless, start over from chain entries
+          m_block_scheduler.reset();
+          finished = true;
+          return false;
+        }
+        ds.blocks.clear();
+      }
+      finished = true;
+      return true;
+    });
+
+    if (!have_called)
+      LOG_PRINT_CCONTEXT_MAGENTA("[PROCESS_READY_SPANS]: Core blocked, downloaded blocks will be handled later", LOG_LEVEL_1);
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_currency_protocol_handler<t_core>::process_downloaded_span(block_download_scheduler::downloaded_span& ds, currency_connection_context& context)
+  {
+    PROF_L2_DO(uint64_t syncing_conn_count_sum = get_synchronizing_connections_count(); uint64_t syncing_conn_count_count = 1);
+    PROF_L1_START(blocks_handle_time);
+    {
+      m_core.pause_mine();
+      m_core.get_blockchain_storage().start_batch_exclusive_operation();
+      bool success = false;
+      misc_utils::auto_scope_leave_caller scope_exit_handler = misc_utils::create_scope_leave_handler([&, this](){
+        m_core.resume_mine();
+        m_core.get_blockchain_storage().finish_batch_exclusive_operation(success);
+      });
+
+      BOOST_FOREACH(const block_complete_entry& block_entry, ds.blocks)
+      {
+        CHECK_STOP_FLAG_EXIT_IF_SET(true, "Blocks processing interrupted, connection dropped");
+        //process transactions
+        PROF_L1_START(transactions_process_time);
+        BOOST_FOREACH(auto& tx_blob, block_entry.txs)
+        {
+          //CHECK_STOP_FLAG_EXIT_IF_SET(1, "Blocks processing interrupted, connection dropped");
+          if (check_stop_flag_and_exit(context)) 
+          {             
+            LOG_PRINT_YELLOW("Stop flag detected within NOTIFY_RESPONSE_GET_OBJECTS. ", LOG_LEVEL_0);
+            //commit transaction
+            success = true;
+            return true; 
           }
-          if (bvc.m_marked_as_orphaned)
+          tx_verification_context tvc = AUTO_VAL_INIT(tvc);
+          m_core.handle_incoming_tx(tx_blob, tvc, true);
+          if (tvc.m_verifivation_failed)
           {
-            LOG_PRINT_CCONTEXT_L0("Block received at sync phase was marked as orphaned, dropping connection");
-            m_p2p->drop_connection(context);
-            m_p2p->add_ip_fail(context.m_remote_ip);
-            return 1;
+            LOG_ERROR("[" << net_utils::print_connection_context_short(ds.source) << "] transaction verification failed on NOTIFY_RESPONSE_GET_OBJECTS, \r\ntx_id = "
+              << string_tools::pod_to_hex(get_blob_hash(tx_blob)) << ", dropping connection");
+            m_p2p->drop_connection(ds.source);
+            return false;
           }
-          m_core_current_height = bvc.height;
-          PROF_L1_FINISH(block_process_time);
-          PROF_L1_DO(LOG_PRINT_CCONTEXT_L2("Block process time: " << print_mcsec_as_ms(block_process_time + transactions_process_time) << "(" << print_mcsec_as_ms(transactions_process_time) << "/" << print_mcsec_as_ms(block_process_time) << ") ms"));
-
-          PROF_L2_DO(syncing_conn_count_sum += get_synchronizing_connections_count(); ++syncing_conn_count_count);
         }
-        success = true;
-      }
-      PROF_L1_FINISH(blocks_handle_time);
+        PROF_L1_FINISH(transactions_process_time);
 
-      uint64_t current_height = m_core.get_current_blockchain_height();
-      LOG_PRINT_CCONTEXT_YELLOW(">>>>>>>>> sync progress: " << arg.blocks.size() << " blocks added"
-        "(" << print_mcsec_as_ms(blocks_handle_time) << "+" << print_mcsec_as_ms(block_complete_entries_prevalidation_time) << "), now have "
-        << current_height << " of " << context.m_remote_blockchain_height
-        << " ( " << std::fixed << std::setprecision(2) << current_height * 100.0 / context.m_remote_blockchain_height << "% ) and "
-        << context.m_remote_blockchain_height - current_height << " blocks left"
-        , LOG_LEVEL_0);
+        //process block
+        PROF_L1_START(block_process_time);
+        block_verification_context bvc = boost::value_initialized<block_verification_context>();
+
+        m_core.handle_incoming_block(block_entry.block, bvc, false);
+
+        if (bvc.m_verifivation_failed)
+        {
+          LOG_PRINT_L0("[" << net_utils::print_connection_context_short(ds.source) << "] Block verification failed, dropping connection");
+          m_p2p->drop_connection(ds.source);
+          m_p2p->add_ip_fail(ds.source.m_remote_ip);
+          return false;
+        }
+        if (bvc.m_marked_as_orphaned)
+        {
+          LOG_PRINT_L0("[" << net_utils::print_connection_context_short(ds.source) << "] Block received at sync phase was marked as orphaned, dropping connection");
+          m_p2p->drop_connection(ds.source);
+          m_p2p->add_ip_fail(ds.source.m_remote_ip);
+          return false;
+        }
+        m_core_current_height = bvc.height;
+        PROF_L1_FINISH(block_process_time);
+        PROF_L1_DO(LOG_PRINT_CCONTEXT_L2("Block process time: " << print_mcsec_as_ms(block_process_time + transactions_process_time) << "(" << print_mcsec_as_ms(transactions_process_time) << "/" << print_mcsec_as_ms(block_process_time) << ") ms"));
 
         PROF_L2_DO(syncing_conn_count_sum += get_synchronizing_connections_count(); ++syncing_conn_count_count);
-     
+      }
+      success = true;
+    }
+    PROF_L1_FINISH(blocks_handle_time);
 
+    uint64_t current_height = m_core.get_current_blockchain_height();
+    uint64_t target_height = std::max<uint64_t>(m_max_height_seen, current_height);
+    LOG_PRINT_CCONTEXT_YELLOW(">>>>>>>>> sync progress: " << ds.blocks.size() << " blocks from " << net_utils::print_connection_context_short(ds.source) << " added"
+      "(" << print_mcsec_as_ms(blocks_handle_time) << "), now have "
+      << current_height << " of " << target_height
+      << " ( " << std::fixed << std::setprecision(2) << current_height * 100.0 / (target_height ? target_height : 1) << "% ) and "
+      << target_height - current_height << " blocks left"
+      , LOG_LEVEL_0);
 
 #if PROFILING_LEVEL >= 2
-      double syncing_conn_count_av = syncing_conn_count_sum / static_cast<double>(syncing_conn_count_count);
-      size_t blocks_count = arg.blocks.size();
-      LOG_PRINT_CCONTEXT_YELLOW("NOTIFY_RESPONSE_GET_OBJECTS: " << blocks_count << " blocks were prevalidated in " << block_complete_entries_prevalidation_time / 1000
-        << " ms (" << std::fixed << std::setprecision(2) << block_complete_entries_prevalidation_time / 1000.0f / blocks_count << " ms per block av) and handled in " << blocks_handle_time / 1000
-        << " ms (" << std::fixed << std::setprecision(2) << blocks_handle_time / 1000.0f / blocks_count << " ms per block av)"
-        << " syncing conns av: " << std::fixed << std::setprecision(2) << syncing_conn_count_av, LOG_LEVEL_1);
+    double syncing_conn_count_av = syncing_conn_count_sum / static_cast<double>(syncing_conn_count_count);
+    size_t blocks_count = ds.blocks.size();
+    LOG_PRINT_CCONTEXT_YELLOW("NOTIFY_RESPONSE_GET_OBJECTS: " << blocks_count << " blocks were handled in " << blocks_handle_time / 1000
+      << " ms (" << std::fixed << std::setprecision(2) << blocks_handle_time / 1000.0f / blocks_count << " ms per block av)"
+      << " syncing conns av: " << std::fixed << std::setprecision(2) << syncing_conn_count_av, LOG_LEVEL_1);
 #endif
-
-      request_missing_objects(context, true);
-      return 1;
-    });
-
-    if (!have_called)
-    {
-      context.m_state = currency_connection_context::state_idle;
-      LOG_PRINT_CCONTEXT_MAGENTA("[HANDLE_RESPONSE_GET_OBJECTS]: Core blocked response, m_state set state_idle", LOG_LEVEL_0);
-    }
-      
-    return res;
+    return true;
   }
 #undef CHECK_STOP_FLAG__DROP_AND_RETURN_IF_SET
   //------------------------------------------------------------------------------------------------------------------------
@@ -596,10 +813,49 @@ namespace currency
       m_synchronized = false;
     }
 
+    flush_tx_announcements();
+    on_idle_sync_scheduler();
     return m_core.on_idle();
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core>
+  bool t_currency_protocol_handler<t_core>::on_idle_sync_scheduler()
+  {
+    std::list<epee::net_utils::connection_context_base> to_drop;
+    m_block_scheduler.check_stalls(misc_utils::get_tick_count(), to_drop);
+    for (const auto& c : to_drop)
+    {
+      LOG_PRINT_L0("[" << net_utils::print_connection_context_short(c) << "] too many blocks spans were not delivered in time, dropping connection");
+      m_p2p->drop_connection(c);
+    }
+
+    std::set<boost::uuids::uuid> alive;
+    std::list<epee::net_utils::connection_context_base> synchronizing;
+    m_p2p->for_each_connection([&](currency_connection_context& context, nodetool::peerid_type peer_id)->bool{
+      alive.insert(context.m_connection_id);
+      if (context.m_state == currency_connection_context::state_synchronizing)
+        synchronizing.push_back(context);
+      return true;
+    });
+    m_block_scheduler.remove_peers_except(alive);
+    // ids queued by peers that are gone could block peers on another chain forever
+    if (m_block_scheduler.drop_unsupported_tail())
+      LOG_PRINT_L1("Queued block ids not confirmed by connected peers dropped, download queue tip: " << m_block_scheduler.get_tip_height());
+
+    // handlers run on connections' threads, so wake up the ones that should take a span or handle downloaded blocks
+    std::list<epee::net_utils::connection_context_base> waiting;
+    m_block_scheduler.get_waiting_peers(waiting);
+    for (const auto& c : waiting)
+    {
+      if (alive.count(c.m_connection_id))
+        m_p2p->request_callback(c);
+    }
+    if (m_block_scheduler.has_ready_span() && synchronizing.size())
+      m_p2p->request_callback(synchronizing.front());
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
   int t_currency_protocol_handler<t_core>::handle_request_chain(int command, NOTIFY_REQUEST_CHAIN::request& arg, currency_connection_context& context)
   {
     LOG_PRINT_CCONTEXT_L2("NOTIFY_REQUEST_CHAIN: m_been_synchronized = " << m_been_synchronized  << "m_block_ids.size()=" << arg.block_ids.size());
@@ -642,28 +898,24 @@ namespace currency
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
-  bool t_currency_protocol_handler<t_core>::request_missing_objects(currency_connection_context& context, bool check_having_blocks)
+  bool t_currency_protocol_handler<t_core>::request_missing_objects(currency_connection_context& context)
   {
-    if(context.m_needed_objects.size())
+    if (context.m_requested_objects.size())
     {
-      //we know objects that we need, request this objects
-      NOTIFY_REQUEST_GET_OBJECTS::request req;
-      size_t count = 0;
-      auto it = context.m_needed_objects.begin();
+      if (m_block_scheduler.has_span(context.m_connection_id))
+        return true; //previous span is still being downloaded
+      //span was taken back (stall) or delivered by another peer, a late answer is still accepted by take_released_span()
+      context.m_requested_objects.clear();
+    }
 
-      while(it != context.m_needed_objects.end() && count < BLOCKS_SYNCHRONIZING_DEFAULT_COUNT)
-      {
-        if( !(check_having_blocks && m_core.have_block(*it)))
-        {
-          req.blocks.push_back(*it);
-          ++count;
-          context.m_requested_objects.insert(*it);
-        }
-        context.m_needed_objects.erase(it++);
-      }
+    NOTIFY_REQUEST_GET_OBJECTS::request req = AUTO_VAL_INIT(req);
+    if(m_block_scheduler.request_span(context, context.m_remote_blockchain_height, req.blocks, misc_utils::get_tick_count()))
+    {
+      //we know objects that we need, request this objects
+      context.m_requested_objects.insert(req.blocks.begin(), req.blocks.end());
       LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_GET_OBJECTS: blocks.size()=" << req.blocks.size() << ", txs.size()=" << req.txs.size());
       post_notify<NOTIFY_REQUEST_GET_OBJECTS>(req, context);    
-    }else if(context.m_last_response_height < context.m_remote_blockchain_height-1)
+    }else if(context.m_last_response_height < context.m_remote_blockchain_height-1 && !m_block_scheduler.has_unassigned_work(context.m_remote_blockchain_height))
     {//we have to fetch more objects ids, request blockchain entry
      
       NOTIFY_REQUEST_CHAIN::request r = boost::value_initialized<NOTIFY_REQUEST_CHAIN::request>();
@@ -682,14 +934,16 @@ namespace currency
         LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_CHAIN: m_block_ids.size()=" << r.block_ids.size());
         post_notify<NOTIFY_REQUEST_CHAIN>(r, context);
       }
+    }else if(m_block_scheduler.has_pending_work(context.m_remote_blockchain_height))
+    {
+      //spans are being downloaded by other peers, on_idle() wakes this connection up when there's work for it
+      LOG_PRINT_CCONTEXT_L2("[REQUEST_MISSING_OBJECTS] no span available, waiting");
     }else
     { 
       CHECK_AND_ASSERT_MES(context.m_last_response_height == context.m_remote_blockchain_height-1 
-                           && !context.m_needed_objects.size() 
                            && !context.m_requested_objects.size(), false, "request_missing_blocks final condition failed!" 
                            << "\r\nm_last_response_height=" << context.m_last_response_height
                            << "\r\nm_remote_blockchain_height=" << context.m_remote_blockchain_height
-                           << "\r\nm_needed_objects.size()=" << context.m_needed_objects.size()
                            << "\r\nm_requested_objects.size()=" << context.m_requested_objects.size()
                            << "\r\non connection [" << net_utils::print_connection_context_short(context)<< "]");
       
@@ -787,17 +1041,39 @@ namespace currency
           << "\r\nm_start_height=" << arg.start_height
           << "\r\nm_block_ids.size()=" << arg.m_block_ids.size());
         m_p2p->drop_connection(context);
+        return 1;
       }
 
+      //ids from all synchronizing peers go to the common scheduler, which spreads their download among peers
+      std::list<crypto::hash> needed_ids;
+      uint64_t needed_start_height = arg.start_height;
       for(auto& bl_id: arg.m_block_ids)
       {
         if (check_stop_flag_and_exit(context))
           return 1;
-        if (!m_core.have_block(bl_id))
-          context.m_needed_objects.push_back(bl_id);
+        if (needed_ids.empty() && m_core.have_block(bl_id))
+          ++needed_start_height;
+        else
+          needed_ids.push_back(bl_id);
+      }
+      size_t added = 0;
+      if (!m_block_scheduler.add_chain(context, needed_start_height, needed_ids, added))
+      {
+        //queued ids came from a peer on another chain, ask this peer again once the queue is drained
+        LOG_PRINT_CCONTEXT_L1("NOTIFY_RESPONSE_CHAIN_ENTRY: ids differ from the ones queued for download, waiting for the queue to drain");
+        context.m_last_response_height = needed_start_height - 1;
+        m_block_scheduler.set_waiting(context);
+        return 1;
+      }
+      LOG_PRINT_CCONTEXT_L2("NOTIFY_RESPONSE_CHAIN_ENTRY: " << added << " of " << needed_ids.size() << " needed ids are new to the download scheduler");
+      if (!added && needed_ids.size() && m_block_scheduler.has_pending_work(context.m_remote_blockchain_height))
+      {
+        //nothing new from this peer for now, retry from on_idle() instead of asking for the same chain again right away
+        m_block_scheduler.set_waiting(context);
+        return 1;
       }
 
-      request_missing_objects(context, false);
+      request_missing_objects(context);
       return 1;
     });
 
@@ -809,12 +1085,282 @@ namespace currency
   template<class t_core> 
   bool t_currency_protocol_handler<t_core>::relay_block(NOTIFY_NEW_BLOCK::request& arg, currency_connection_context& exclude_context)
   {
-    return relay_post_notify<NOTIFY_NEW_BLOCK>(arg, exclude_context);
+    return relay_block_entry(arg, exclude_context, [](NOTIFY_NEW_BLOCK::request&) { return true; });
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  template<class t_fill_txs>
+  bool t_currency_protocol_handler<t_core>::relay_block_entry(NOTIFY_NEW_BLOCK::request& arg, currency_connection_context& exclude_context, t_fill_txs fill_txs)
+  {
+    //full block peers are grouped by the flags that choose payload encoding, so each encoding is made once
+    std::list<epee::net_utils::connection_context_base> compact_peers;
+    std::map<uint32_t, std::list<epee::net_utils::connection_context_base> > full_peers;
+    size_t full_peers_count = 0;
+    m_p2p->for_each_connection([&](currency_connection_context& context, nodetool::peerid_type peer_id)->bool{
+      if (peer_id && context.m_connection_id != exclude_context.m_connection_id)
+      {
+        if (context.m_remote_protocol_flags & CURRENCY_PROTOCOL_FLAG_COMPACT_BLOCKS)
+          compact_peers.push_back(context);
+        else
+        {
+          full_peers[context.m_remote_protocol_flags & (CURRENCY_PROTOCOL_FLAG_PACKED_BULK | CURRENCY_PROTOCOL_FLAG_COMPRESSED)].push_back(context);
+          ++full_peers_count;
+        }
+      }
+      return true;
+    });
+
+    LOG_PRINT_L2("post relay NOTIFY_NEW_BLOCK: " << compact_peers.size() << " compact, " << full_peers_count << " full -->");
+    if (compact_peers.size())
+    {
+      NOTIFY_NEW_COMPACT_BLOCK::request compact_arg = AUTO_VAL_INIT(compact_arg);
+      compact_arg.block = arg.b.block;
+      compact_arg.current_blockchain_height = arg.current_blockchain_height;
+      compact_arg.hop = arg.hop;
+      std::string buff;
+      epee::serialization::store_t_to_binary(compact_arg, buff);
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_COMPACT_BLOCK::ID, buff, compact_peers);
+    }
+    if (full_peers.size() && !fill_txs(arg))
+      return false;
+    for (auto& group : full_peers)
+    {
+      std::string buff;
+      store_protocol_payload(arg, buff, group.first);
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_BLOCK::ID, buff, group.second);
+    }
+    return true;
   }
   //------------------------------------------------------------------------------------------------------------------------
   template<class t_core> 
   bool t_currency_protocol_handler<t_core>::relay_transactions(NOTIFY_NEW_TRANSACTIONS::request& arg, currency_connection_context& exclude_context)
   {
-    return relay_post_notify<NOTIFY_NEW_TRANSACTIONS>(arg, exclude_context);
+    std::list<epee::net_utils::connection_context_base> inventory_peers, full_peers;
+    m_p2p->for_each_connection([&](currency_connection_context& context, nodetool::peerid_type peer_id)->bool{
+      if (peer_id && context.m_connection_id != exclude_context.m_connection_id)
+      {
+        if (context.m_remote_protocol_flags & CURRENCY_PROTOCOL_FLAG_TX_INVENTORY)
+          inventory_peers.push_back(context);
+        else
+          full_peers.push_back(context);
+      }
+      return true;
+    });
+
+    LOG_PRINT_L2("post relay NOTIFY_NEW_TRANSACTIONS: " << inventory_peers.size() << " inventory, " << full_peers.size() << " full -->");
+    if (inventory_peers.size())
+    {
+      std::list<crypto::hash> tx_ids;
+      for (const auto& tx_blob : arg.txs)
+      {
+        transaction tx;
+        crypto::hash tx_hash = null_hash, tx_prefix_hash = null_hash;
+        if (!parse_and_validate_tx_from_blob(tx_blob, tx, tx_hash, tx_prefix_hash))
+        {
+          // the rest is still announced, full relay peers get all blobs as they are
+          LOG_ERROR("failed to parse tx blob passed for relay, it isn't announced");
+          continue;
+        }
+        tx_ids.push_back(tx_hash);
+      }
+
+      // ids are only queued here and sent in batches from on_idle()
+      CRITICAL_REGION_LOCAL(m_tx_inventory_lock);
+      for (const auto& c : inventory_peers)
+      {
+        tx_inventory_state& st = m_tx_inventory[c.m_connection_id];
+        for (const auto& id : tx_ids)
+        {
+          if (st.known_txs.insert(id))
+            st.to_announce.push_back(id);
+        }
+        // queue of a peer that is slower than tx flow doesn't grow without bound, it loses the oldest announcements
+        if (st.to_announce.size() > CURRENCY_PROTOCOL_TX_ANNOUNCE_QUEUE_MAX_COUNT)
+        {
+          LOG_PRINT_L1("[" << net_utils::print_connection_context_short(c) << "] tx announce queue is full, " << st.to_announce.size() - CURRENCY_PROTOCOL_TX_ANNOUNCE_QUEUE_MAX_COUNT << " oldest ids dropped");
+          auto last = st.to_announce.begin();
+          std::advance(last, st.to_announce.size() - CURRENCY_PROTOCOL_TX_ANNOUNCE_QUEUE_MAX_COUNT);
+          st.to_announce.erase(st.to_announce.begin(), last);
+        }
+      }
+    }
+    if (full_peers.size())
+    {
+      std::string buff;
+      epee::serialization::store_t_to_binary(arg, buff);
+      m_p2p->relay_notify_to_list(NOTIFY_NEW_TRANSACTIONS::ID, buff, full_peers);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  void t_currency_protocol_handler<t_core>::mark_txs_known(const epee::net_utils::connection_context_base& context, const std::list<crypto::hash>& tx_ids, bool received)
+  {
+    CRITICAL_REGION_LOCAL(m_tx_inventory_lock);
+    tx_inventory_state& st = m_tx_inventory[context.m_connection_id];
+    for (const auto& id : tx_ids)
+    {
+      st.known_txs.insert(id);
+      if (received)
+      {
+        auto it = m_requested_txs.find(id);
+        if (it != m_requested_txs.end())
+          erase_requested_tx(it);
+      }
+    }
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  template<class t_it>
+  t_it t_currency_protocol_handler<t_core>::erase_requested_tx(t_it it)
+  {
+    //should be called under m_tx_inventory_lock
+    auto st_it = m_tx_inventory.find(it->second.peer);
+    if (st_it != m_tx_inventory.end() && st_it->second.requested_txs)
+      --st_it->second.requested_txs;
+    return m_requested_txs.erase(it);
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  bool t_currency_protocol_handler<t_core>::flush_tx_announcements()
+  {
+    std::map<boost::uuids::uuid, epee::net_utils::connection_context_base> alive;
+    m_p2p->for_each_connection([&](currency_connection_context& context, nodetool::peerid_type peer_id)->bool{
+      alive[context.m_connection_id] = context;
+      return true;
+    });
+
+    std::list<std::pair<epee::net_utils::connection_context_base, NOTIFY_TX_INVENTORY::request> > to_send;
+    {
+      CRITICAL_REGION_LOCAL(m_tx_inventory_lock);
+      for (auto it = m_tx_inventory.begin(); it != m_tx_inventory.end();)
+      {
+        auto alive_it = alive.find(it->first);
+        if (alive_it == alive.end())
+        {
+          m_tx_inventory.erase(it++);
+          continue;
+        }
+        if (it->second.to_announce.size())
+        {
+          to_send.push_back(std::make_pair(alive_it->second, NOTIFY_TX_INVENTORY::request()));
+          std::list<crypto::hash>& q = it->second.to_announce;
+          auto last = q.begin();
+          std::advance(last, std::min<size_t>(q.size(), CURRENCY_PROTOCOL_TX_INVENTORY_MAX_COUNT));
+          to_send.back().second.txs.splice(to_send.back().second.txs.end(), q, q.begin(), last);
+        }
+        ++it;
+      }
+
+      time_t now = time(nullptr);
+      for (auto it = m_requested_txs.begin(); it != m_requested_txs.end();)
+      {
+        if (now - it->second.time > CURRENCY_PROTOCOL_TX_REQUEST_TIMEOUT)
+          it = erase_requested_tx(it);
+        else
+          ++it;
+      }
+    }
+
+    for (auto& s : to_send)
+    {
+      LOG_PRINT_L2("[" << net_utils::print_connection_context_short(s.first) << "] post NOTIFY_TX_INVENTORY: txs.size()=" << s.second.txs.size() << " -->");
+      std::string buff;
+      epee::serialization::store_t_to_binary(s.second, buff);
+      m_p2p->invoke_notify_to_peer(NOTIFY_TX_INVENTORY::ID, buff, s.first);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_currency_protocol_handler<t_core>::handle_notify_tx_inventory(int command, NOTIFY_TX_INVENTORY::request& arg, currency_connection_context& context)
+  {
+    LOG_PRINT_CCONTEXT_L2("NOTIFY_TX_INVENTORY: txs.size()=" << arg.txs.size());
+    if (arg.txs.size() > CURRENCY_PROTOCOL_TX_INVENTORY_MAX_COUNT)
+    {
+      LOG_ERROR_CCONTEXT("sent NOTIFY_TX_INVENTORY with too many ids: " << arg.txs.size() << ", dropping connection");
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+    mark_txs_known(context, arg.txs, false);
+
+    if (!m_synchronized || context.m_state != currency_connection_context::state_normal || context.m_remote_blockchain_height <= 1)
+      return 1;
+
+    std::list<crypto::hash> unknown_ids;
+    for (const auto& id : arg.txs)
+    {
+      if (!m_core.get_tx_pool().have_tx(id) && !m_core.get_blockchain_storage().have_tx(id))
+        unknown_ids.push_back(id);
+    }
+
+    NOTIFY_REQUEST_TXS::request req = AUTO_VAL_INIT(req);
+    {
+      // don't ask several peers for the same tx unless the first one failed to deliver it in time
+      time_t now = time(nullptr);
+      CRITICAL_REGION_LOCAL(m_tx_inventory_lock);
+      tx_inventory_state& st = m_tx_inventory[context.m_connection_id];
+      size_t skipped = 0;
+      for (const auto& id : unknown_ids)
+      {
+        auto it = m_requested_txs.find(id);
+        if (it != m_requested_txs.end() && now - it->second.time <= CURRENCY_PROTOCOL_TX_REQUEST_TIMEOUT)
+          continue;
+        // a peer announcing more than it delivers doesn't make the map grow without bound, others will announce these txs too
+        if (st.requested_txs >= CURRENCY_PROTOCOL_TX_REQUESTED_MAX_COUNT)
+        {
+          ++skipped;
+          continue;
+        }
+        if (it != m_requested_txs.end())
+          erase_requested_tx(it);
+        tx_request& r = m_requested_txs[id];
+        r.time = now;
+        r.peer = context.m_connection_id;
+        ++st.requested_txs;
+        req.txs.push_back(id);
+      }
+      if (skipped)
+        LOG_PRINT_CCONTEXT_L1("too many txs requested and not received from peer, " << skipped << " announced txs ignored");
+    }
+
+    if (req.txs.size())
+    {
+      LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_REQUEST_TXS: txs.size()=" << req.txs.size());
+      post_notify<NOTIFY_REQUEST_TXS>(req, context);
+    }
+    return 1;
+  }
+  //------------------------------------------------------------------------------------------------------------------------
+  template<class t_core>
+  int t_currency_protocol_handler<t_core>::handle_request_txs(int command, NOTIFY_REQUEST_TXS::request& arg, currency_connection_context& context)
+  {
+    LOG_PRINT_CCONTEXT_L2("NOTIFY_REQUEST_TXS: txs.size()=" << arg.txs.size());
+    if (arg.txs.size() > CURRENCY_PROTOCOL_TX_INVENTORY_MAX_COUNT)
+    {
+      LOG_ERROR_CCONTEXT("sent NOTIFY_REQUEST_TXS with too many ids: " << arg.txs.size() << ", dropping connection");
+      m_p2p->drop_connection(context);
+      return 1;
+    }
+
+    NOTIFY_NEW_TRANSACTIONS::request rsp = AUTO_VAL_INIT(rsp);
+    std::list<crypto::hash> sent_ids;
+    for (const auto& id : arg.txs)
+    {
+      transaction tx;
+      if (m_core.get_tx_pool().get_transaction(id, tx))
+      {
+        rsp.txs.push_back(t_serializable_object_to_blob(tx));
+        sent_ids.push_back(id);
+      }
+    }
+    mark_txs_known(context, sent_ids, false);
+
+    if (rsp.txs.size())
+    {
+      LOG_PRINT_CCONTEXT_L2("-->>NOTIFY_NEW_TRANSACTIONS: txs.size()=" << rsp.txs.size());
+      post_notify<NOTIFY_NEW_TRANSACTIONS>(rsp, context);
+    }
+    return 1;
   }
 }
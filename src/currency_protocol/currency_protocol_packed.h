@@ -0,0 +1,327 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <string.h>
+#include <boost/utility/value_init.hpp>
+
+#include "common/varint.h"
+#include "storages/portable_storage_template_helper.h"
+#include "currency_protocol_defs.h"
+#include "currency_protocol_compression.h"
+
+// Packed wire format of bulk notifications (NOTIFY_NEW_BLOCK, NOTIFY_RESPONSE_GET_OBJECTS,
+// NOTIFY_RESPONSE_CHAIN_ENTRY), sent only to peers with CURRENCY_PROTOCOL_FLAG_PACKED_BULK:
+//   signature(4) | version(1) | command id(varint) | fields
+// integers are varints, blobs are varint length followed by raw bytes, hash lists are
+// varint count followed by raw 32-byte hashes. Receiver tells the format by the signature,
+// portable storage payloads start with a different one.
+#define CURRENCY_PROTOCOL_PACKED_SIGNATURE       "\x01\x42\x50\x4b"
+#define CURRENCY_PROTOCOL_PACKED_SIGNATURE_SIZE  4
+#define CURRENCY_PROTOCOL_PACKED_VERSION         1
+
+namespace currency
+{
+  /************************************************************************/
+  /*                                                                      */
+  /************************************************************************/
+  class packed_writer
+  {
+  public:
+    packed_writer(std::string& buff):m_buff(buff)
+    {}
+
+    void write_varint(uint64_t v)
+    {
+      tools::write_varint(std::back_inserter(m_buff), v);
+    }
+
+    void write_blob(const std::string& blob)
+    {
+      write_varint(blob.size());
+      m_buff.append(blob);
+    }
+
+    template<class t_container>
+    void write_blob_list(const t_container& blobs)
+    {
+      write_varint(blobs.size());
+      for (const auto& b : blobs)
+        write_blob(b);
+    }
+
+    template<class t_container>
+    void write_hash_list(const t_container& hashes)
+    {
+      write_varint(hashes.size());
+      for (const auto& h : hashes)
+        m_buff.append(reinterpret_cast<const char*>(&h), sizeof(h));
+    }
+
+  private:
+    std::string& m_buff;
+  };
+
+  /************************************************************************/
+  /* Reads straight from the received buffer into the target fields       */
+  /************************************************************************/
+  class packed_reader
+  {
+  public:
+    packed_reader(const std::string& buff):m_p(buff.data()), m_end(buff.data() + buff.size())
+    {}
+
+    bool read_varint(uint64_t& v)
+    {
+      const char* p = m_p;
+      int r = tools::read_varint<64>(p, m_end, v);
+      if (r <= 0 || (static_cast<unsigned char>(*(p - 1)) & 0x80))
+        return false;
+      m_p = p;
+      return true;
+    }
+
+    template<class t_uint>
+    bool read_uint(t_uint& v)
+    {
+      uint64_t v64 = 0;
+      if (!read_varint(v64) || v64 > std::numeric_limits<t_uint>::max())
+        return false;
+      v = static_cast<t_uint>(v64);
+      return true;
+    }
+
+    bool read_blob(std::string& blob)
+    {
+      uint64_t size = 0;
+      if (!read_varint(size) || size > left())
+        return false;
+      blob.assign(m_p, static_cast<size_t>(size));
+      m_p += size;
+      return true;
+    }
+
+    //min_item_size bounds count by the bytes left, so a forged count can't cause a huge allocation
+    bool read_count(uint64_t& count, size_t min_item_size)
+    {
+      return read_varint(count) && count <= left() / min_item_size;
+    }
+
+    template<class t_container>
+    bool read_blob_list(t_container& blobs)
+    {
+      uint64_t count = 0;
+      if (!read_count(count, 1))
+        return false;
+      for (uint64_t i = 0; i != count; ++i)
+      {
+        blobs.push_back(std::string());
+        if (!read_blob(blobs.back()))
+          return false;
+      }
+      return true;
+    }
+
+    template<class t_container>
+    bool read_hash_list(t_container& hashes)
+    {
+      uint64_t count = 0;
+      if (!read_count(count, sizeof(crypto::hash)))
+        return false;
+      for (uint64_t i = 0; i != count; ++i)
+      {
+        hashes.push_back(crypto::hash());
+        memcpy(&hashes.back(), m_p, sizeof(crypto::hash));
+        m_p += sizeof(crypto::hash);
+      }
+      return true;
+    }
+
+    bool read_header(int command)
+    {
+      if (left() < CURRENCY_PROTOCOL_PACKED_SIGNATURE_SIZE + 1)
+        return false;
+      if (memcmp(m_p, CURRENCY_PROTOCOL_PACKED_SIGNATURE, CURRENCY_PROTOCOL_PACKED_SIGNATURE_SIZE) ||
+        m_p[CURRENCY_PROTOCOL_PACKED_SIGNATURE_SIZE] != CURRENCY_PROTOCOL_PACKED_VERSION)
+        return false;
+      m_p += CURRENCY_PROTOCOL_PACKED_SIGNATURE_SIZE + 1;
+      uint64_t cmd = 0;
+      return read_varint(cmd) && cmd == static_cast<uint64_t>(command);
+    }
+
+    bool is_end() const { return m_p == m_end; }
+
+  private:
+    size_t left() const { return m_end - m_p; }
+
+    const char* m_p;
+    const char* m_end;
+  };
+
+  inline bool is_packed_payload(const std::string& buff)
+  {
+    return buff.size() >= CURRENCY_PROTOCOL_PACKED_SIGNATURE_SIZE &&
+      !memcmp(buff.data(), CURRENCY_PROTOCOL_PACKED_SIGNATURE, CURRENCY_PROTOCOL_PACKED_SIGNATURE_SIZE);
+  }
+
+  inline void write_packed_header(packed_writer& w, std::string& buff, int command)
+  {
+    buff.append(CURRENCY_PROTOCOL_PACKED_SIGNATURE, CURRENCY_PROTOCOL_PACKED_SIGNATURE_SIZE);
+    buff.push_back(static_cast<char>(CURRENCY_PROTOCOL_PACKED_VERSION));
+    w.write_varint(command);
+  }
+  //-----------------------------------------------------------------------------------------------
+  inline void write_packed(packed_writer& w, const block_complete_entry& e)
+  {
+    w.write_blob(e.block);
+    w.write_blob_list(e.txs);
+  }
+
+  inline bool read_packed(packed_reader& r, block_complete_entry& e)
+  {
+    return r.read_blob(e.block) && r.read_blob_list(e.txs);
+  }
+  //-----------------------------------------------------------------------------------------------
+  inline bool pack_payload(const NOTIFY_NEW_BLOCK::request& arg, std::string& buff)
+  {
+    buff.clear();
+    packed_writer w(buff);
+    write_packed_header(w, buff, NOTIFY_NEW_BLOCK::ID);
+    write_packed(w, arg.b);
+    w.write_varint(arg.current_blockchain_height);
+    w.write_varint(arg.hop);
+    return true;
+  }
+
+  inline bool unpack_payload(const std::string& buff, NOTIFY_NEW_BLOCK::request& arg)
+  {
+    packed_reader r(buff);
+    return r.read_header(NOTIFY_NEW_BLOCK::ID) &&
+      read_packed(r, arg.b) &&
+      r.read_uint(arg.current_blockchain_height) &&
+      r.read_uint(arg.hop) &&
+      r.is_end();
+  }
+  //-----------------------------------------------------------------------------------------------
+  inline bool pack_payload(const NOTIFY_RESPONSE_GET_OBJECTS::request& arg, std::string& buff)
+  {
+    buff.clear();
+    packed_writer w(buff);
+    write_packed_header(w, buff, NOTIFY_RESPONSE_GET_OBJECTS::ID);
+    w.write_blob_list(arg.txs);
+    w.write_varint(arg.blocks.size());
+    for (const auto& b : arg.blocks)
+      write_packed(w, b);
+    w.write_hash_list(arg.missed_ids);
+    w.write_varint(arg.current_blockchain_height);
+    return true;
+  }
+
+  inline bool unpack_payload(const std::string& buff, NOTIFY_RESPONSE_GET_OBJECTS::request& arg)
+  {
+    packed_reader r(buff);
+    if (!r.read_header(NOTIFY_RESPONSE_GET_OBJECTS::ID) || !r.read_blob_list(arg.txs))
+      return false;
+    uint64_t blocks_count = 0;
+    if (!r.read_count(blocks_count, 2))
+      return false;
+    for (uint64_t i = 0; i != blocks_count; ++i)
+    {
+      arg.blocks.push_back(block_complete_entry());
+      if (!read_packed(r, arg.blocks.back()))
+        return false;
+    }
+    return r.read_hash_list(arg.missed_ids) &&
+      r.read_uint(arg.current_blockchain_height) &&
+      r.is_end();
+  }
+  //-----------------------------------------------------------------------------------------------
+  inline bool pack_payload(const NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg, std::string& buff)
+  {
+    buff.clear();
+    packed_writer w(buff);
+    write_packed_header(w, buff, NOTIFY_RESPONSE_CHAIN_ENTRY::ID);
+    w.write_varint(arg.start_height);
+    w.write_varint(arg.total_height);
+    w.write_hash_list(arg.m_block_ids);
+    return true;
+  }
+
+  inline bool unpack_payload(const std::string& buff, NOTIFY_RESPONSE_CHAIN_ENTRY::request& arg)
+  {
+    packed_reader r(buff);
+    return r.read_header(NOTIFY_RESPONSE_CHAIN_ENTRY::ID) &&
+      r.read_uint(arg.start_height) &&
+      r.read_uint(arg.total_height) &&
+      r.read_hash_list(arg.m_block_ids) &&
+      r.is_end();
+  }
+  //-----------------------------------------------------------------------------------------------
+  template<class t_request>
+  struct has_packed_format: public std::false_type {};
+  template<> struct has_packed_format<NOTIFY_NEW_BLOCK::request>: public std::true_type {};
+  template<> struct has_packed_format<NOTIFY_RESPONSE_GET_OBJECTS::request>: public std::true_type {};
+  template<> struct has_packed_format<NOTIFY_RESPONSE_CHAIN_ENTRY::request>: public std::true_type {};
+
+  //block ids are random bytes, deflate only burns CPU on them
+  template<class t_request>
+  struct is_worth_compressing: public has_packed_format<t_request> {};
+  template<> struct is_worth_compressing<NOTIFY_RESPONSE_CHAIN_ENTRY::request>: public std::false_type {};
+
+  //protocol_flags are remote peer's ones, they choose packed format and compression
+  template<class t_request>
+  typename std::enable_if<has_packed_format<t_request>::value, bool>::type
+  store_protocol_payload(t_request& arg, std::string& buff, uint32_t protocol_flags)
+  {
+    bool r = (protocol_flags & CURRENCY_PROTOCOL_FLAG_PACKED_BULK) ? pack_payload(arg, buff) : epee::serialization::store_t_to_binary(arg, buff);
+    if (r && is_worth_compressing<t_request>::value && (protocol_flags & CURRENCY_PROTOCOL_FLAG_COMPRESSED) &&
+      buff.size() >= CURRENCY_PROTOCOL_COMPRESSION_THRESHOLD)
+    {
+      std::string compressed;
+      if (compress_payload(buff, compressed))
+        buff.swap(compressed);
+    }
+    return r;
+  }
+
+  template<class t_request>
+  typename std::enable_if<!has_packed_format<t_request>::value, bool>::type
+  store_protocol_payload(t_request& arg, std::string& buff, uint32_t /*protocol_flags*/)
+  {
+    return epee::serialization::store_t_to_binary(arg, buff);
+  }
+
+  template<class t_request>
+  bool load_protocol_payload(const std::string& buff, t_request& arg)
+  {
+    if (is_compressed_payload(buff))
+    {
+      std::string unpacked;
+      if (!decompress_payload(buff, unpacked) || is_compressed_payload(unpacked))
+        return false;
+      return load_protocol_payload(unpacked, arg);
+    }
+    if (is_packed_payload(buff))
+      return unpack_payload(buff, arg);
+    return epee::serialization::load_t_from_binary(arg, buff);
+  }
+
+  template<class t_request, class t_context, class callback_t>
+  int packed_buff_to_t_adapter(int command, const std::string& in_buff, callback_t cb, t_context& context)
+  {
+    boost::value_initialized<t_request> in_struct;
+    if (!load_protocol_payload(in_buff, static_cast<t_request&>(in_struct)))
+    {
+      LOG_ERROR("Failed to load payload in notify " << command);
+      return -1;
+    }
+    return cb(command, static_cast<t_request&>(in_struct), context);
+  }
+}
+
+//like HANDLE_NOTIFY_T2, but also accepts packed and compressed payload
+#define HANDLE_NOTIFY_PACKED_T2(NOTIFY, func) \
+  if(is_notify && NOTIFY::ID == command) \
+  {handled=true;return currency::packed_buff_to_t_adapter<typename NOTIFY::request>(command, in_buff, boost::bind(func, this, _1, _2, _3), context);}
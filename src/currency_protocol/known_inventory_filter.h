@@ -0,0 +1,53 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <deque>
+#include <unordered_set>
+#include "crypto/hash.h"
+#include "currency_config.h"
+
+namespace currency
+{
+  /************************************************************************/
+  /* Bounded set of object ids, the oldest ids are forgotten first        */
+  /************************************************************************/
+  class known_inventory_filter
+  {
+  public:
+    explicit known_inventory_filter(size_t max_size = CURRENCY_PROTOCOL_KNOWN_TXS_PER_CONNECTION)
+      : m_max_size(max_size)
+    {}
+
+    //returns false if id was already known
+    bool insert(const crypto::hash& id)
+    {
+      if (!m_items.insert(id).second)
+        return false;
+      m_order.push_back(id);
+      if (m_order.size() > m_max_size)
+      {
+        m_items.erase(m_order.front());
+        m_order.pop_front();
+      }
+      return true;
+    }
+
+    bool contains(const crypto::hash& id) const
+    {
+      return m_items.count(id) != 0;
+    }
+
+    size_t size() const
+    {
+      return m_items.size();
+    }
+
+  private:
+    size_t m_max_size;
+    std::unordered_set<crypto::hash> m_items;
+    std::deque<crypto::hash> m_order;
+  };
+}
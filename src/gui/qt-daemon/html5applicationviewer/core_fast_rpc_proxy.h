@@ -38,6 +38,11 @@ namespace tools
       return m_rpc.on_get_tx_pool(req, res, m_cntxt_stub);
     }
     //------------------------------------------------------------------------------------------------------------------------------
+    bool call_COMMAND_RPC_GET_TX_POOL_CHANGES(const currency::COMMAND_RPC_GET_TX_POOL_CHANGES::request& req, currency::COMMAND_RPC_GET_TX_POOL_CHANGES::response& res)
+    {
+      return m_rpc.on_get_tx_pool_changes(req, res, m_cntxt_stub);
+    }
+    //------------------------------------------------------------------------------------------------------------------------------
     bool call_COMMAND_RPC_GET_ALIASES_BY_ADDRESS(const currency::COMMAND_RPC_GET_ALIASES_BY_ADDRESS::request& req, currency::COMMAND_RPC_GET_ALIASES_BY_ADDRESS::response& res)
     {
       return m_rpc.on_alias_by_address(req, res, m_err_stub, m_cntxt_stub);
@@ -63,6 +63,8 @@ namespace nodetool
     node_server(t_payload_net_handler& payload_handler):m_payload_handler(payload_handler), 
                                                         m_allow_local_ip(false), 
                                                         m_hide_my_port(false), 
+                                                        m_offline_mode(false),
+                                                        m_net_threads_count(P2P_NET_THREADS_COUNT),
                                                         m_alert_mode(0), 
                                                         m_maintainers_entry_local(AUTO_VAL_INIT(m_maintainers_entry_local)),
                                                         m_maintainers_info_local(AUTO_VAL_INIT(m_maintainers_info_local))
@@ -104,6 +106,8 @@ namespace nodetool
     peerlist_manager& get_peerlist_manager(){return m_peerlist;}
     bool handle_maintainers_entry(const maintainers_entry& me);
     bool get_maintainers_info(maintainers_info_external& me);
+    const epee::levin::traffic_stats& get_traffic_stats(){return m_net_server.get_config_object().m_traffic_stats;}
+    void get_connections_traffic(std::list<epee::net_utils::connection_context_base>& connections);
   private:
     typedef COMMAND_REQUEST_STAT_INFO_T<typename t_payload_net_handler::stat_info> COMMAND_REQUEST_STAT_INFO;
 
@@ -134,6 +138,7 @@ namespace nodetool
     bool init_config();
     bool make_default_config();
     bool store_config();
+    bool flush_peerlist_journal();
     bool check_trust(const proof_of_trust& tr);
 
 
@@ -143,6 +148,7 @@ namespace nodetool
     virtual void callback(p2p_connection_context& context);
     //----------------- i_p2p_endpoint -------------------------------------------------------------
     virtual bool relay_notify_to_all(int command, const std::string& data_buff, const epee::net_utils::connection_context_base& context);
+    virtual bool relay_notify_to_list(int command, const std::string& data_buff, const std::list<epee::net_utils::connection_context_base>& connections);
     virtual bool invoke_command_to_peer(int command, const std::string& req_buff, std::string& resp_buff, const epee::net_utils::connection_context_base& context);
     virtual bool invoke_notify_to_peer(int command, const std::string& req_buff, const epee::net_utils::connection_context_base& context);
     virtual bool drop_connection(const epee::net_utils::connection_context_base& context);
@@ -218,6 +224,7 @@ namespace nodetool
     bool m_allow_local_ip;
     bool m_hide_my_port;
     bool m_offline_mode;
+    size_t m_net_threads_count;
 
     //critical_section m_connections_lock;
     //connections_indexed_container m_connections;
@@ -228,6 +235,7 @@ namespace nodetool
     math_helper::once_a_time_seconds<P2P_DEFAULT_HANDSHAKE_INTERVAL> m_peer_handshake_idle_maker_interval;
     math_helper::once_a_time_seconds<1> m_connections_maker_interval;
     math_helper::once_a_time_seconds<60*30, false> m_peerlist_store_interval;
+    math_helper::once_a_time_seconds<P2P_PEERLIST_JOURNAL_FLUSH_INTERVAL, false> m_peerlist_journal_interval;
     math_helper::once_a_time_seconds<60> m_remove_dead_conn_interval;
     
     /*this code is temporary here(to show regular message if need), until we get normal GUI*/
@@ -32,6 +32,11 @@ namespace nodetool
     const command_line::arg_descriptor<std::vector<std::string> > arg_p2p_seed_node           = {"seed-node", "Connect to a node to retrieve peer addresses, and disconnect"};
     const command_line::arg_descriptor<bool>                      arg_p2p_hide_my_port        = { "hide-my-port", "Do not announce yourself as peerlist candidate", false, true };
     const command_line::arg_descriptor<bool>                      arg_p2p_offline_mode        = { "p2p-offline-mode", "Neither connect to the network, nor accept incoming connections", false, true };
+    const command_line::arg_descriptor<uint64_t>                  arg_p2p_limit_rate_up       = { "limit-rate-up", "Limit total p2p upload rate, kB/s (0 - unlimited)", 0 };
+    const command_line::arg_descriptor<uint64_t>                  arg_p2p_limit_rate_down     = { "limit-rate-down", "Limit total p2p download rate, kB/s (0 - unlimited)", 0 };
+    const command_line::arg_descriptor<uint64_t>                  arg_p2p_limit_rate_up_peer  = { "limit-rate-up-peer", "Limit p2p upload rate to each peer, kB/s (0 - unlimited)", 0 };
+    const command_line::arg_descriptor<uint64_t>                  arg_p2p_limit_rate_down_peer = { "limit-rate-down-peer", "Limit p2p download rate from each peer, kB/s (0 - unlimited)", 0 };
+    const command_line::arg_descriptor<bool>                      arg_p2p_io_service_per_thread = { "p2p-io-service-per-thread", "Pin each p2p connection to one of per-core threads with own io_service, helps with many connections", false, true };
 }
 
   //-----------------------------------------------------------------------------------
@@ -48,6 +53,11 @@ namespace nodetool
     command_line::add_arg(desc, arg_p2p_hide_my_port);   
     command_line::add_arg(desc, arg_p2p_use_only_priority_nodes);       
     command_line::add_arg(desc, arg_p2p_offline_mode);
+    command_line::add_arg(desc, arg_p2p_limit_rate_up);
+    command_line::add_arg(desc, arg_p2p_limit_rate_down);
+    command_line::add_arg(desc, arg_p2p_limit_rate_up_peer);
+    command_line::add_arg(desc, arg_p2p_limit_rate_down_peer);
+    command_line::add_arg(desc, arg_p2p_io_service_per_thread);
 
     t_payload_net_handler::init_options(desc);
   }
@@ -65,6 +75,8 @@ namespace nodetool
 
     std::string state_file_path = m_config_folder + "/" + P2P_NET_DATA_FILENAME;
     tools::unserialize_obj_from_file(*this, state_file_path);
+    //peerlist changes made after the last snapshot
+    m_peerlist.replay_journal(m_config_folder + "/" + P2P_NET_DATA_JOURNAL_FILENAME);
 
     //always use new id, to be able differ cloned computers
     m_config.m_peer_id  = crypto::rand<uint64_t>();
@@ -94,6 +106,15 @@ namespace nodetool
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  void node_server<t_payload_net_handler>::get_connections_traffic(std::list<epee::net_utils::connection_context_base>& connections)
+  {
+    m_net_server.get_config_object().foreach_connection([&](p2p_connection_context& cntx){
+      connections.push_back(cntx);
+      return true;
+    });
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::is_remote_ip_allowed(uint32_t addr)
   {
     if (m_offline_mode)
@@ -162,6 +183,14 @@ namespace nodetool
       LOG_PRINT_CYAN("Offline mode is ON", LOG_LEVEL_0);
     }
 
+    if (command_line::get_arg(vm, arg_p2p_io_service_per_thread))
+    {
+      //one thread per core for connections, plus the main one for acceptor and idle handlers
+      m_net_threads_count = (std::max)(2u, boost::thread::hardware_concurrency()) + 1;
+      m_net_server.set_io_service_per_thread(m_net_threads_count);
+      LOG_PRINT_L0("P2P connections are served by " << m_net_threads_count - 1 << " threads with own io_service each");
+    }
+
     if (command_line::has_arg(vm, arg_p2p_add_peer))
     {       
       std::vector<std::string> perrs = command_line::get_arg(vm, arg_p2p_add_peer);
@@ -205,6 +234,18 @@ namespace nodetool
     }
     if(command_line::has_arg(vm, arg_p2p_hide_my_port))
         m_hide_my_port = true;    
+
+    //should be set before the server creates connections
+    uint64_t limit_up = command_line::get_arg(vm, arg_p2p_limit_rate_up);
+    uint64_t limit_down = command_line::get_arg(vm, arg_p2p_limit_rate_down);
+    uint64_t limit_up_peer = command_line::get_arg(vm, arg_p2p_limit_rate_up_peer);
+    uint64_t limit_down_peer = command_line::get_arg(vm, arg_p2p_limit_rate_down_peer);
+    m_net_server.get_bandwidth_limiter().set_limits(limit_up * 1024, limit_down * 1024, limit_up_peer * 1024, limit_down_peer * 1024, misc_utils::get_tick_count());
+    if (limit_up || limit_down || limit_up_peer || limit_down_peer)
+    {
+      LOG_PRINT_L0("P2P rate limits, kB/s (0 - unlimited): up " << limit_up << ", down " << limit_down 
+        << ", up per peer " << limit_up_peer << ", down per peer " << limit_down_peer);
+    }
     return true;              
   }
   //-----------------------------------------------------------------------------------
@@ -291,6 +332,7 @@ namespace nodetool
     m_net_server.set_threads_prefix("P2P");
     m_net_server.get_config_object().m_pcommands_handler = this;
     m_net_server.get_config_object().m_invoke_timeout = P2P_DEFAULT_INVOKE_TIMEOUT;
+    m_payload_handler.get_send_priorities(m_net_server.get_config_object().m_send_priorities);
     m_net_server.set_connection_filter(this);
 
     //try to bind
@@ -314,8 +356,7 @@ namespace nodetool
   template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::run(bool sync_call)
   {
-    //here you can set worker threads count
-    int thrds_count = 10;
+    size_t thrds_count = m_net_threads_count;
 
     m_net_server.add_idle_handler(boost::bind(&node_server<t_payload_net_handler>::idle_worker, this), 1000);
     m_net_server.add_idle_handler(boost::bind(&t_payload_net_handler::on_idle, &m_payload_handler), 1000);
@@ -358,13 +399,39 @@ namespace nodetool
       return false;
     }
 
+    //write aside and rename, so a crash never leaves a half-written state file
     std::string state_file_path = m_config_folder + "/" + P2P_NET_DATA_FILENAME;
-    tools::serialize_obj_to_file(*this, state_file_path);    
+    std::string tmp_state_file_path = state_file_path + ".tmp";
+    if (!tools::serialize_obj_to_file(*this, tmp_state_file_path))
+    {
+      LOG_PRINT_L0("Failed to store p2p state to " << tmp_state_file_path);
+      m_peerlist.on_snapshot_discarded();
+      return false;
+    }
+    boost::system::error_code ec;
+    boost::filesystem::rename(tmp_state_file_path, state_file_path, ec);
+    if (ec)
+    {
+      LOG_PRINT_L0("Failed to rename " << tmp_state_file_path << " to " << state_file_path << ": " << ec.message());
+      m_peerlist.on_snapshot_discarded();
+      return false;
+    }
+    m_peerlist.on_snapshot_stored(m_config_folder + "/" + P2P_NET_DATA_JOURNAL_FILENAME);
     CATCH_ENTRY_L0("node_server<t_payload_net_handler>::save", false);
     return true;
   }
   //-----------------------------------------------------------------------------------
   template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::flush_peerlist_journal()
+  {
+    if (!tools::create_directories_if_necessary(m_config_folder))
+      return false;
+    if (m_peerlist.get_journal_file_records() > P2P_PEERLIST_JOURNAL_MAX_RECORDS)
+      return store_config(); //compact journal into a new snapshot
+    return m_peerlist.flush_journal(m_config_folder + "/" + P2P_NET_DATA_JOURNAL_FILENAME);
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
   bool node_server<t_payload_net_handler>::send_stop_signal()
   {
     m_net_server.send_stop_signal();
@@ -847,6 +914,7 @@ namespace nodetool
     m_peer_handshake_idle_maker_interval.do_call(boost::bind(&node_server<t_payload_net_handler>::peer_sync_idle_maker, this));
     m_connections_maker_interval.do_call(boost::bind(&node_server<t_payload_net_handler>::connections_maker, this));
     m_peerlist_store_interval.do_call(boost::bind(&node_server<t_payload_net_handler>::store_config, this));
+    m_peerlist_journal_interval.do_call(boost::bind(&node_server<t_payload_net_handler>::flush_peerlist_journal, this));
     m_remove_dead_conn_interval.do_call([this](){return remove_dead_connections();});
 
     m_calm_alert_interval.do_call([&](){return clam_alert_worker();});
@@ -1070,10 +1138,20 @@ namespace nodetool
       return true;
     });
 
-    BOOST_FOREACH(const auto& c_id, connections)
-    {
-      m_net_server.get_config_object().notify(command, data_buff, c_id);
-    }
+    // one copy of payload is shared by send queues of all connections
+    epee::net_utils::shared_send_buffer shared_buff = boost::make_shared<const std::string>(data_buff);
+    m_net_server.get_config_object().notify_to_list(command, shared_buff, connections);
+    return true;
+  }
+  //-----------------------------------------------------------------------------------
+  template<class t_payload_net_handler>
+  bool node_server<t_payload_net_handler>::relay_notify_to_list(int command, const std::string& data_buff, const std::list<epee::net_utils::connection_context_base>& connections)
+  {
+    std::list<boost::uuids::uuid> connection_ids;
+    BOOST_FOREACH(const auto& c, connections)
+      connection_ids.push_back(c.m_connection_id);
+    epee::net_utils::shared_send_buffer shared_buff = boost::make_shared<const std::string>(data_buff);
+    m_net_server.get_config_object().notify_to_list(command, shared_buff, connection_ids);
     return true;
   }
   //-----------------------------------------------------------------------------------
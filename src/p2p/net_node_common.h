@@ -21,6 +21,7 @@ namespace nodetool
   struct i_p2p_endpoint
   {
     virtual bool relay_notify_to_all(int command, const std::string& data_buff, const epee::net_utils::connection_context_base& context)=0;
+    virtual bool relay_notify_to_list(int command, const std::string& data_buff, const std::list<epee::net_utils::connection_context_base>& connections)=0;
     virtual bool invoke_command_to_peer(int command, const std::string& req_buff, std::string& resp_buff, const epee::net_utils::connection_context_base& context)=0;
     virtual bool invoke_notify_to_peer(int command, const std::string& req_buff, const epee::net_utils::connection_context_base& context)=0;
     virtual bool drop_connection(const epee::net_utils::connection_context_base& context)=0;
@@ -40,6 +41,10 @@ namespace nodetool
     {
       return false;
     }
+    virtual bool relay_notify_to_list(int command, const std::string& data_buff, const std::list<epee::net_utils::connection_context_base>& connections)
+    {
+      return false;
+    }
     virtual bool invoke_command_to_peer(int command, const std::string& req_buff, std::string& resp_buff, const epee::net_utils::connection_context_base& context)
     {
       return false;
@@ -7,12 +7,16 @@
 #include <list>
 #include <set>
 #include <map>
+#include <vector>
+#include <fstream>
 #include <boost/foreach.hpp>
+#include <boost/filesystem/operations.hpp>
 //#include <boost/bimap.hpp>
 //#include <boost/bimap/multiset_of.hpp>
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
 #include <boost/serialization/version.hpp>
+#include <boost/serialization/vector.hpp>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/ordered_index.hpp>
@@ -24,14 +28,28 @@
 #include "net/local_ip.h"
 #include "p2p_protocol_defs.h"
 #include "currency_config.h"
+#include "crypto/crypto.h"
 #include "net_peerlist_boost_serialization.h"
+#include "net_peerlist_container.h"
 #include "common/boost_serialization_helper.h"
 
-#define CURRENT_PEERLIST_STORAGE_ARCHIVE_VER    7
+#define CURRENT_PEERLIST_STORAGE_ARCHIVE_VER    9
 
 namespace nodetool
 {
 
+#pragma pack(push, 1)
+  //one change of the peerlist, appended to the journal file between full state snapshots;
+  //first record of the file carries id of the snapshot the journal applies to
+  struct peerlist_journal_record
+  {
+    uint8_t op;
+    uint32_t ip;
+    uint32_t port;
+    uint64_t id;
+    int64_t last_seen;
+  };
+#pragma pack(pop)
 
   /************************************************************************/
   /*                                                                      */
@@ -39,6 +57,8 @@ namespace nodetool
   class peerlist_manager
   {
   public: 
+    peerlist_manager():m_allow_local_ip(false), m_journal_file_records(0), m_snapshot_id(0), m_storing_snapshot_id(0), m_storing_journal_size(0), m_snapshot_pending(false)
+    {}
     bool init(bool allow_local_ip);
     bool deinit();
     size_t get_white_peers_count(){CRITICAL_REGION_LOCAL(m_peerlist_lock); return m_peers_white.size();}
@@ -57,46 +77,31 @@ namespace nodetool
     void trim_white_peerlist();
     void trim_gray_peerlist();
 
+    //incremental persistence: changes made since the last snapshot are appended to the journal file
+    bool flush_journal(const std::string& path);
+    bool replay_journal(const std::string& path);
+    //records in the journal file, used to decide when a full snapshot is worth writing
+    size_t get_journal_file_records(){CRITICAL_REGION_LOCAL(m_peerlist_lock); return m_journal_file_records;}
+    //to be called once a snapshot is stored and renamed into place (flush_journal() fails in between),
+    //journal of the previous one is removed
+    bool on_snapshot_stored(const std::string& path);
+    //to be called if a serialized snapshot couldn't be stored, the journal file stays in use
+    void on_snapshot_discarded();
     
   private:
-    struct by_time{};
-    struct by_id{};
-    struct by_addr{};
-
-    struct modify_all_but_id
-    {
-      modify_all_but_id(const peerlist_entry& ple):m_ple(ple){}
-      void operator()(peerlist_entry& e)
-      {
-        e.id = m_ple.id;
-      }
-    private:
-      const peerlist_entry& m_ple;
-    };
-
-    struct modify_all
-    {
-      modify_all(const peerlist_entry& ple):m_ple(ple){}
-      void operator()(peerlist_entry& e)
-      {
-        e = m_ple;
-      }
-    private:
-      const peerlist_entry& m_ple;
-    };
-
-    struct modify_last_seen
+    enum journal_op
     {
-      modify_last_seen(time_t last_seen):m_last_seen(last_seen){}
-      void operator()(peerlist_entry& e)
-      {
-        e.last_seen = m_last_seen;
-      }
-    private:
-      time_t m_last_seen;
+      journal_op_white_upsert = 0,
+      journal_op_white_erase = 1,
+      journal_op_gray_upsert = 2,
+      journal_op_gray_erase = 3,
+      journal_op_snapshot_id = 4
     };
 
+    struct by_time{};
+    struct by_addr{};
 
+    //storage format up to CURRENT_PEERLIST_STORAGE_ARCHIVE_VER 7, kept for loading old state files
     typedef boost::multi_index_container<
       peerlist_entry,
       boost::multi_index::indexed_by<
@@ -105,34 +110,48 @@ namespace nodetool
       // sort by peerlist_entry::last_seen<
       boost::multi_index::ordered_non_unique<boost::multi_index::tag<by_time>, boost::multi_index::member<peerlist_entry,time_t,&peerlist_entry::last_seen> >
       > 
-    > peers_indexed;
+    > peers_indexed_v7;
 
-    typedef boost::multi_index_container<
-      peerlist_entry,
-      boost::multi_index::indexed_by<
-      // access by peerlist_entry::id<
-      boost::multi_index::ordered_unique<boost::multi_index::tag<by_id>, boost::multi_index::member<peerlist_entry,uint64_t,&peerlist_entry::id> >,
-      // access by peerlist_entry::net_adress
-      boost::multi_index::ordered_unique<boost::multi_index::tag<by_addr>, boost::multi_index::member<peerlist_entry,net_address,&peerlist_entry::adr> >,
-      // sort by peerlist_entry::last_seen<
-      boost::multi_index::ordered_non_unique<boost::multi_index::tag<by_time>, boost::multi_index::member<peerlist_entry,time_t,&peerlist_entry::last_seen> >
-      > 
-    > peers_indexed_old;
   public:    
     
     template <class Archive, class t_version_type>
     void serialize(Archive &ar,  const t_version_type ver)
     {
-      if(ver < CURRENT_PEERLIST_STORAGE_ARCHIVE_VER)
+      if(ver < 7)
         throw std::runtime_error("not supported storage format");
       CHECK_PROJECT_NAME();
       CRITICAL_REGION_LOCAL(m_peerlist_lock);
-      ar & m_peers_white;
-      ar & m_peers_gray;
+      if(ver < 8)
+      {
+        peers_indexed_v7 white, gray;
+        ar & white;
+        ar & gray;
+        peers_from_v7(white, m_peers_white);
+        peers_from_v7(gray, m_peers_gray);
+        return;
+      }
+      serialize_peers(ar, m_peers_white);
+      serialize_peers(ar, m_peers_gray);
+      if(ver < 9)
+        return;
+      if(Archive::is_loading::value)
+      {
+        ar & m_snapshot_id;
+        return;
+      }
+      //snapshot covers changes journaled so far, they are dropped in on_snapshot_stored() once the file is in place
+      m_storing_snapshot_id = crypto::rand<uint64_t>();
+      m_storing_journal_size = m_journal.size();
+      m_snapshot_pending = true;
+      ar & m_storing_snapshot_id;
     }
 
   private: 
-    bool peers_indexed_from_old(const peers_indexed_old& pio, peers_indexed& pi);
+    void peers_from_v7(const peers_indexed_v7& pio, peers_hashed_list& pl);
+    template <class Archive>
+    void serialize_peers(Archive &ar, peers_hashed_list& pl);
+    void journal_change(journal_op op, const peerlist_entry& pe);
+    bool apply_journal_record(const peerlist_journal_record& rec);
 
     friend class boost::serialization::access;
     epee::critical_section m_peerlist_lock;
@@ -140,8 +159,14 @@ namespace nodetool
     bool m_allow_local_ip;
 
 
-    peers_indexed m_peers_gray;
-    peers_indexed m_peers_white;
+    peers_hashed_list m_peers_gray;
+    peers_hashed_list m_peers_white;
+    std::vector<peerlist_journal_record> m_journal;
+    size_t m_journal_file_records;
+    uint64_t m_snapshot_id;         //snapshot the journal file applies to
+    uint64_t m_storing_snapshot_id; //snapshot being stored
+    size_t m_storing_journal_size;  //changes covered by the snapshot being stored
+    bool m_snapshot_pending;        //snapshot serialized, but not stored yet: journal file may belong to the old one or to the new one
   };
   //--------------------------------------------------------------------------------------------------
   inline
@@ -158,35 +183,159 @@ namespace nodetool
   }
   //--------------------------------------------------------------------------------------------------
   inline 
-  bool peerlist_manager::peers_indexed_from_old(const peers_indexed_old& pio, peers_indexed& pi)
+  void peerlist_manager::peers_from_v7(const peers_indexed_v7& pio, peers_hashed_list& pl)
+  {
+    pl.clear();
+    for(const auto& x: pio)
+      pl.upsert(x);
+  }
+  //--------------------------------------------------------------------------------------------------
+  template <class Archive>
+  void peerlist_manager::serialize_peers(Archive &ar, peers_hashed_list& pl)
+  {
+    //stored as plain vector, oldest first, so loading appends at the list tail
+    std::vector<peerlist_entry> v;
+    if(!Archive::is_loading::value)
+    {
+      v.reserve(pl.size());
+      pl.for_each_oldest_first([&](const peerlist_entry& pe){v.push_back(pe); return true;});
+    }
+    ar & v;
+    if(Archive::is_loading::value)
+    {
+      pl.clear();
+      for(const auto& pe: v)
+        pl.upsert(pe);
+    }
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline void peerlist_manager::journal_change(journal_op op, const peerlist_entry& pe)
+  {
+    peerlist_journal_record rec = AUTO_VAL_INIT(rec);
+    rec.op = static_cast<uint8_t>(op);
+    rec.ip = pe.adr.ip;
+    rec.port = pe.adr.port;
+    rec.id = pe.id;
+    rec.last_seen = pe.last_seen;
+    m_journal.push_back(rec);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline bool peerlist_manager::apply_journal_record(const peerlist_journal_record& rec)
+  {
+    peerlist_entry pe = AUTO_VAL_INIT(pe);
+    pe.adr.ip = rec.ip;
+    pe.adr.port = rec.port;
+    pe.id = rec.id;
+    pe.last_seen = static_cast<time_t>(rec.last_seen);
+    switch(rec.op)
+    {
+    case journal_op_white_upsert: m_peers_white.upsert(pe); return true;
+    case journal_op_white_erase:  m_peers_white.erase(pe.adr); return true;
+    case journal_op_gray_upsert:  m_peers_gray.upsert(pe); return true;
+    case journal_op_gray_erase:   m_peers_gray.erase(pe.adr); return true;
+    default:
+      return false;
+    }
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline bool peerlist_manager::flush_journal(const std::string& path)
+  {
+    TRY_ENTRY();
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    CHECK_AND_ASSERT_MES(!m_snapshot_pending, false, "Peerlist journal can't be flushed while a snapshot is being stored");
+    if(m_journal.empty())
+      return true;
+    boost::system::error_code ec;
+    bool new_file = !boost::filesystem::exists(path, ec) || !boost::filesystem::file_size(path, ec);
+    std::ofstream journal_file(path, std::ios_base::binary | std::ios_base::out | std::ios_base::app);
+    CHECK_AND_ASSERT_MES(!journal_file.fail(), false, "Failed to open peerlist journal " << path);
+    if(new_file)
+    {
+      peerlist_journal_record header = AUTO_VAL_INIT(header);
+      header.op = journal_op_snapshot_id;
+      header.id = m_snapshot_id;
+      journal_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    }
+    journal_file.write(reinterpret_cast<const char*>(&m_journal[0]), m_journal.size() * sizeof(peerlist_journal_record));
+    journal_file.flush();
+    CHECK_AND_ASSERT_MES(!journal_file.fail(), false, "Failed to write peerlist journal " << path);
+    m_journal_file_records += m_journal.size();
+    m_journal.clear();
+    return true;
+    CATCH_ENTRY_L0("peerlist_manager::flush_journal()", false);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline bool peerlist_manager::replay_journal(const std::string& path)
   {
-    for(auto x: pio)
+    TRY_ENTRY();
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    m_journal_file_records = 0;
+    std::ifstream journal_file(path, std::ios_base::binary | std::ios_base::in);
+    if(journal_file.fail())
+      return true; //no changes since the last snapshot
+
+    //journal left from an older snapshot (crash between storing a snapshot and removing the journal) is stale
+    peerlist_journal_record rec = AUTO_VAL_INIT(rec);
+    if(!journal_file.read(reinterpret_cast<char*>(&rec), sizeof(rec)) || rec.op != journal_op_snapshot_id || rec.id != m_snapshot_id)
+    {
+      LOG_PRINT_L0("Peerlist journal " << path << " doesn't match the state file, ignored");
+      journal_file.close();
+      boost::system::error_code ec;
+      boost::filesystem::remove(path, ec);
+      return true;
+    }
+
+    //a torn record at the end (crash in the middle of a write) is just ignored
+    while(journal_file.read(reinterpret_cast<char*>(&rec), sizeof(rec)))
     {
-      auto by_addr_it = pi.get<by_addr>().find(x.adr);
-      if(by_addr_it == pi.get<by_addr>().end())
+      if(!apply_journal_record(rec))
       {
-        pi.insert(x);
+        LOG_PRINT_L0("Unknown record in peerlist journal " << path << ", rest of the journal skipped");
+        break;
       }
+      ++m_journal_file_records;
     }
-
+    LOG_PRINT_L1("Peerlist journal replayed: " << m_journal_file_records << " records");
     return true;
+    CATCH_ENTRY_L0("peerlist_manager::replay_journal()", false);
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline bool peerlist_manager::on_snapshot_stored(const std::string& path)
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    CHECK_AND_ASSERT_MES(m_snapshot_pending, false, "on_snapshot_stored() called without a serialized snapshot");
+    m_snapshot_pending = false;
+    m_snapshot_id = m_storing_snapshot_id;
+    m_journal.erase(m_journal.begin(), m_journal.begin() + (std::min)(m_storing_journal_size, m_journal.size()));
+    m_storing_journal_size = 0;
+    m_journal_file_records = 0;
+    boost::system::error_code ec;
+    boost::filesystem::remove(path, ec);
+    return !ec;
+  }
+  //--------------------------------------------------------------------------------------------------
+  inline void peerlist_manager::on_snapshot_discarded()
+  {
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    m_snapshot_pending = false;
+    m_storing_journal_size = 0;
   }
   //--------------------------------------------------------------------------------------------------
   inline void peerlist_manager::trim_white_peerlist()
   {
-    while(m_peers_gray.size() > P2P_LOCAL_GRAY_PEERLIST_LIMIT)
+    while(m_peers_white.size() > P2P_LOCAL_WHITE_PEERLIST_LIMIT)
     {
-      peers_indexed::index<by_time>::type& sorted_index=m_peers_gray.get<by_time>();
-      sorted_index.erase(sorted_index.begin());
+      journal_change(journal_op_white_erase, m_peers_white.oldest());
+      m_peers_white.erase(m_peers_white.oldest().adr);
     }
   }
   //--------------------------------------------------------------------------------------------------
   inline void peerlist_manager::trim_gray_peerlist()
   {
-    while(m_peers_white.size() > P2P_LOCAL_WHITE_PEERLIST_LIMIT)
+    while(m_peers_gray.size() > P2P_LOCAL_GRAY_PEERLIST_LIMIT)
     {
-      peers_indexed::index<by_time>::type& sorted_index=m_peers_white.get<by_time>();
-      sorted_index.erase(sorted_index.begin());
+      journal_change(journal_op_gray_erase, m_peers_gray.oldest());
+      m_peers_gray.erase(m_peers_gray.oldest().adr);
     }
   }
   //--------------------------------------------------------------------------------------------------
@@ -207,24 +356,14 @@ namespace nodetool
   bool peerlist_manager::get_white_peer_by_index(peerlist_entry& p, size_t i)
   {
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
-    if(i >= m_peers_white.size())
-      return false;
-
-    peers_indexed::index<by_time>::type& by_time_index = m_peers_white.get<by_time>();
-    p = *epee::misc_utils::move_it_backward(--by_time_index.end(), i);    
-    return true;
+    return m_peers_white.get_by_index_from_newest(i, p);
   }
   //--------------------------------------------------------------------------------------------------
   inline
     bool peerlist_manager::get_gray_peer_by_index(peerlist_entry& p, size_t i)
   {
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
-    if(i >= m_peers_gray.size())
-      return false;
-
-    peers_indexed::index<by_time>::type& by_time_index = m_peers_gray.get<by_time>();
-    p = *epee::misc_utils::move_it_backward(--by_time_index.end(), i);    
-    return true;
+    return m_peers_gray.get_by_index_from_newest(i, p);
   }
   //--------------------------------------------------------------------------------------------------
   inline 
@@ -245,16 +384,14 @@ namespace nodetool
   {
     
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
-    peers_indexed::index<by_time>::type& by_time_index=m_peers_white.get<by_time>();
     uint32_t cnt = 0;
-    BOOST_REVERSE_FOREACH(const peers_indexed::value_type& vl, by_time_index)
+    m_peers_white.for_each_newest_first([&](const peerlist_entry& vl)
     {
       if(!vl.last_seen)
-        continue;
+        return true;
       bs_head.push_back(vl);      
-      if(cnt++ > depth)
-        break;
-    }
+      return cnt++ <= depth;
+    });
     return true;
   }
   //--------------------------------------------------------------------------------------------------
@@ -262,18 +399,8 @@ namespace nodetool
   bool peerlist_manager::get_peerlist_full(std::list<peerlist_entry>& pl_gray, std::list<peerlist_entry>& pl_white)
   {    
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
-    peers_indexed::index<by_time>::type& by_time_index_gr=m_peers_gray.get<by_time>();
-    BOOST_REVERSE_FOREACH(const peers_indexed::value_type& vl, by_time_index_gr)
-    {
-      pl_gray.push_back(vl);      
-    }
-
-    peers_indexed::index<by_time>::type& by_time_index_wt=m_peers_white.get<by_time>();
-    BOOST_REVERSE_FOREACH(const peers_indexed::value_type& vl, by_time_index_wt)
-    {
-      pl_white.push_back(vl);      
-    }
-
+    m_peers_gray.for_each_newest_first([&](const peerlist_entry& vl){pl_gray.push_back(vl); return true;});
+    m_peers_white.for_each_newest_first([&](const peerlist_entry& vl){pl_white.push_back(vl); return true;});
     return true;
   }
   //--------------------------------------------------------------------------------------------------
@@ -307,25 +434,14 @@ namespace nodetool
     if(!is_ip_allowed(ple.adr.ip))
       return true;
 
-     CRITICAL_REGION_LOCAL(m_peerlist_lock);
-    //find in white list
-    auto by_addr_it_wt = m_peers_white.get<by_addr>().find(ple.adr);
-    if(by_addr_it_wt == m_peers_white.get<by_addr>().end())
-    {
-      //put new record into white list
-      m_peers_white.insert(ple);
+    CRITICAL_REGION_LOCAL(m_peerlist_lock);
+    //put new record into white list or update existing one
+    journal_change(journal_op_white_upsert, ple);
+    if(m_peers_white.upsert(ple))
       trim_white_peerlist();
-    }else
-    {
-      //update record in white list 
-      m_peers_white.replace(by_addr_it_wt, ple);      
-    }
     //remove from gray list, if need
-    auto by_addr_it_gr = m_peers_gray.get<by_addr>().find(ple.adr);
-    if(by_addr_it_gr != m_peers_gray.get<by_addr>().end())
-    {
-      m_peers_gray.erase(by_addr_it_gr);
-    }
+    if(m_peers_gray.erase(ple.adr))
+      journal_change(journal_op_gray_erase, ple);
     return true;
     CATCH_ENTRY_L0("peerlist_manager::append_with_peer_white()", false);
   }
@@ -339,22 +455,13 @@ namespace nodetool
 
     CRITICAL_REGION_LOCAL(m_peerlist_lock);
     //find in white list
-    auto by_addr_it_wt = m_peers_white.get<by_addr>().find(ple.adr);
-    if(by_addr_it_wt != m_peers_white.get<by_addr>().end())
+    if(m_peers_white.find(ple.adr))
       return true;
 
-    //update gray list
-    auto by_addr_it_gr = m_peers_gray.get<by_addr>().find(ple.adr);
-    if(by_addr_it_gr == m_peers_gray.get<by_addr>().end())
-    {
-      //put new record into white list
-      m_peers_gray.insert(ple);
-      trim_gray_peerlist();    
-    }else
-    {
-      //update record in white list 
-      m_peers_gray.replace(by_addr_it_gr, ple);      
-    }
+    //put new record into gray list or update existing one
+    journal_change(journal_op_gray_upsert, ple);
+    if(m_peers_gray.upsert(ple))
+      trim_gray_peerlist();
     return true;
     CATCH_ENTRY_L0("peerlist_manager::append_with_peer_gray()", false);
     return true;
@@ -0,0 +1,119 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <map>
+#include <unordered_map>
+#include <boost/noncopyable.hpp>
+
+#include "p2p_protocol_defs.h"
+
+namespace nodetool
+{
+  struct net_address_hash
+  {
+    size_t operator()(const net_address& a) const
+    {
+      uint64_t v = (static_cast<uint64_t>(a.ip) << 32) | a.port;
+      return std::hash<uint64_t>()(v);
+    }
+  };
+
+  /************************************************************************/
+  /* Peers hashed by address and indexed by last_seen (oldest first).     */
+  /* Entries of the same last_seen keep the order they were touched in,   */
+  /* placing a peer with any last_seen is O(log n).                       */
+  /************************************************************************/
+  class peers_hashed_list: private boost::noncopyable
+  {
+    struct peer_node;
+    typedef std::multimap<time_t, const peer_node*> by_time_index;
+    struct peer_node
+    {
+      peerlist_entry pe;
+      by_time_index::iterator time_it;
+    };
+    typedef std::unordered_map<net_address, peer_node, net_address_hash> peers_map;
+
+  public:
+    ~peers_hashed_list()
+    {
+      clear();
+    }
+
+    size_t size() const { return m_by_time.size(); }
+    bool empty() const { return m_by_time.empty(); }
+
+    const peerlist_entry* find(const net_address& adr) const
+    {
+      auto it = m_peers.find(adr);
+      return it == m_peers.end() ? nullptr : &it->second.pe;
+    }
+
+    //returns true if a new peer was added
+    bool upsert(const peerlist_entry& pe)
+    {
+      auto res = m_peers.insert(std::make_pair(pe.adr, peer_node()));
+      peer_node& n = res.first->second;
+      if (!res.second)
+        m_by_time.erase(n.time_it);
+      n.pe = pe;
+      //equal keys go after the existing ones
+      n.time_it = m_by_time.insert(std::make_pair(pe.last_seen, &n));
+      return res.second;
+    }
+
+    bool erase(const net_address& adr)
+    {
+      auto it = m_peers.find(adr);
+      if (it == m_peers.end())
+        return false;
+      m_by_time.erase(it->second.time_it);
+      m_peers.erase(it);
+      return true;
+    }
+
+    const peerlist_entry& oldest() const { return m_by_time.begin()->second->pe; }
+
+    void clear()
+    {
+      m_by_time.clear();
+      m_peers.clear();
+    }
+
+    //i == 0 is the most recently seen peer
+    bool get_by_index_from_newest(size_t i, peerlist_entry& pe) const
+    {
+      if (i >= m_by_time.size())
+        return false;
+      auto it = m_by_time.rbegin();
+      std::advance(it, i);
+      pe = it->second->pe;
+      return true;
+    }
+
+    //callback returns false to stop
+    template<class t_callback>
+    void for_each_newest_first(t_callback cb) const
+    {
+      for (auto it = m_by_time.rbegin(); it != m_by_time.rend(); ++it)
+        if (!cb(it->second->pe))
+          return;
+    }
+
+    template<class t_callback>
+    void for_each_oldest_first(t_callback cb) const
+    {
+      for (auto it = m_by_time.begin(); it != m_by_time.end(); ++it)
+        if (!cb(it->second->pe))
+          return;
+    }
+
+  private:
+    //unordered_map keeps node addresses stable on rehash, so the index may point to them directly
+    peers_map m_peers;
+    by_time_index m_by_time;
+  };
+}
@@ -3,7 +3,9 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 
+#include <set>
 #include <boost/foreach.hpp>
+#include <boost/preprocessor/stringize.hpp>
 #include "include_base_utils.h"
 #include <boost/serialization/variant.hpp>
 using namespace epee;
@@ -16,6 +18,7 @@ using namespace epee;
 #include "misc_language.h"
 #include "crypto/hash.h"
 #include "core_rpc_server_error_codes.h"
+#include "p2p_traffic_stats.h"
 #include "currency_core/alias_helper.h"
 
 namespace currency
@@ -25,6 +28,14 @@ namespace currency
     const command_line::arg_descriptor<std::string> arg_rpc_bind_ip   = {"rpc-bind-ip", "IP for RPC Server", "127.0.0.1"};
     const command_line::arg_descriptor<std::string> arg_rpc_bind_port = {"rpc-bind-port", "Port for RPC Server", std::to_string(RPC_DEFAULT_PORT)};
     const command_line::arg_descriptor<bool> arg_rpc_restricted_rpc = { "restricted-rpc", "Restrict RPC to view only commands", false};
+    const command_line::arg_descriptor<uint64_t> arg_rpc_cache_size = { "rpc-cache-size", "Size of cache for responses on old blocks and transactions, MB (0 - disabled)", RPC_RESPONSE_CACHE_DEFAULT_SIZE / (1024 * 1024)};
+    const command_line::arg_descriptor<uint64_t> arg_rpc_batch_max_size = { "rpc-batch-max-size", "Max calls in one json-rpc batch (0 - batches disabled), capped by " BOOST_PP_STRINGIZE(RPC_BATCH_RESTRICTED_MAX_SIZE) " with --restricted-rpc", RPC_BATCH_DEFAULT_MAX_SIZE};
+    const command_line::arg_descriptor<uint64_t> arg_rpc_batch_threads = { "rpc-batch-threads", "Threads to run read only calls of one json-rpc batch on", RPC_BATCH_DEFAULT_THREADS};
+    const command_line::arg_descriptor<uint64_t> arg_rpc_fast_threads = { "rpc-fast-threads", "Worker threads for short rpc calls (0 - handle them on io threads)", RPC_FAST_POOL_DEFAULT_THREADS};
+    const command_line::arg_descriptor<uint64_t> arg_rpc_heavy_threads = { "rpc-heavy-threads", "Worker threads for bulk rpc calls (0 - handle them on io threads)", RPC_HEAVY_POOL_DEFAULT_THREADS};
+    const command_line::arg_descriptor<uint64_t> arg_rpc_max_queued = { "rpc-max-queued-requests", "Requests waiting for a worker in each pool, extra ones are answered with 503", RPC_POOL_DEFAULT_MAX_QUEUE};
+    const command_line::arg_descriptor<uint64_t> arg_rpc_slow_call_threshold = { "rpc-slow-call-threshold-ms", "Log rpc calls running longer than this (0 - disabled)", RPC_SLOW_CALL_DEFAULT_THRESHOLD_MS};
+    const command_line::arg_descriptor<bool> arg_rpc_slow_call_log_params = { "rpc-slow-call-log-params", "Log params of slow rpc calls, except the ones carrying secret keys", false};
   }
   //-----------------------------------------------------------------------------------
   void core_rpc_server::init_options(boost::program_options::options_description& desc)
@@ -32,27 +43,179 @@ namespace currency
     command_line::add_arg(desc, arg_rpc_bind_ip);
     command_line::add_arg(desc, arg_rpc_bind_port);
     command_line::add_arg(desc, arg_rpc_restricted_rpc);
+    command_line::add_arg(desc, arg_rpc_cache_size);
+    command_line::add_arg(desc, arg_rpc_batch_max_size);
+    command_line::add_arg(desc, arg_rpc_batch_threads);
+    command_line::add_arg(desc, arg_rpc_fast_threads);
+    command_line::add_arg(desc, arg_rpc_heavy_threads);
+    command_line::add_arg(desc, arg_rpc_max_queued);
+    command_line::add_arg(desc, arg_rpc_slow_call_threshold);
+    command_line::add_arg(desc, arg_rpc_slow_call_log_params);
   }
   //------------------------------------------------------------------------------------------------------------------------------
   core_rpc_server::core_rpc_server(core& cr, nodetool::node_server<currency::t_currency_protocol_handler<currency::core> >& p2p):m_core(cr), m_p2p(p2p), m_session_counter(0)
   {}
   //------------------------------------------------------------------------------------------------------------------------------
+  core_rpc_server::~core_rpc_server()
+  {
+    m_core.get_blockchain_storage().set_update_listener(nullptr);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::handle_command_line(const boost::program_options::variables_map& vm)
   {
     m_bind_ip = command_line::get_arg(vm, arg_rpc_bind_ip);
     m_port = command_line::get_arg(vm, arg_rpc_bind_port);
     m_restricted = command_line::get_arg(vm, arg_rpc_restricted_rpc);
+    m_response_cache.set_max_size(static_cast<size_t>(command_line::get_arg(vm, arg_rpc_cache_size) * 1024 * 1024));
+    m_batch_config.max_size = static_cast<size_t>(command_line::get_arg(vm, arg_rpc_batch_max_size));
+    if (m_restricted)
+      m_batch_config.max_size = (std::min)(m_batch_config.max_size, static_cast<size_t>(RPC_BATCH_RESTRICTED_MAX_SIZE));
+    m_batch_config.threads = static_cast<size_t>((std::max)(command_line::get_arg(vm, arg_rpc_batch_threads), uint64_t(1)));
+    m_batch_config.is_read_only = &core_rpc_server::is_read_only_json_rpc_method;
+    get_http_route_stats().set_slow_call_threshold_ms(command_line::get_arg(vm, arg_rpc_slow_call_threshold));
+    get_http_route_stats().set_log_slow_call_params(command_line::get_arg(vm, arg_rpc_slow_call_log_params));
+    get_http_route_stats().hide_params("check_tx_with_view_key");
+    get_http_route_stats().hide_params("scan_with_view_keys");
+    get_http_route_stats().hide_params("/json_rpc[batch]");
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::is_read_only_json_rpc_method(const std::string& method)
+  {
+    //calls that neither change daemon state nor depend on order of calls in batch
+    static const std::set<std::string> read_only_methods = {
+      "getblockcount", "on_getblockhash", "getlastblockheader", "getblockheaderbyhash", "getblockheaderbyheight", "getblockheaders_range",
+      "get_alias_details", "get_alias_by_address", "get_addendums", "f_block_json", "f_transaction_json",
+      "getblock", "check_tx_with_view_key", "validate_signed_text"
+    };
+    return read_only_methods.count(method) != 0;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::is_heavy_request(const epee::net_utils::http::http_request_info& query_info)
+  {
+    //calls that read lots of blockchain data or hold m_blockchain_lock for long
+    static const std::set<std::string> heavy_uris = {
+      "/getblocks.bin", "/getblockheaders_range.bin", "/get_o_indexes.bin", "/getrandom_outs.bin", "/get_tx_pool.bin",
+      "/check_keyimages.bin", "/gettransactions", "/sendrawtransaction", "/getfullscratchpad2"
+    };
+    static const std::set<std::string> heavy_methods = {
+      "getblockheaders_range", "get_all_alias_details", "f_blocks_list_json", "f_pool_json", "getblock",
+      "check_tx_with_view_key", "scan_with_view_keys", "relay_txs", "reset_transaction_pool", "getfullscratchpad"
+    };
+    const std::string& path = query_info.m_uri_content.m_path;
+    if (heavy_uris.count(path))
+      return true;
+    if (path != "/json_rpc")
+      return false;
+    if (epee::json_rpc::is_batch_request(query_info.m_body))
+      return true;
+    std::string method;
+    return epee::json_rpc::peek_method_name(query_info.m_body, method) && heavy_methods.count(method) != 0;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  epee::net_utils::http::worker_pool* core_rpc_server::get_request_worker_pool(const epee::net_utils::http::http_request_info& query_info)
+  {
+    //io threads only parse requests and send responses, handlers run on pools so slow calls can't hold up fast ones
+    epee::net_utils::http::worker_pool& pool = is_heavy_request(query_info) ? m_heavy_pool : m_fast_pool;
+    return pool.get_threads_count() ? &pool : nullptr;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::init(const boost::program_options::variables_map& vm)
   {
     m_net_server.set_threads_prefix("RPC");
     bool r = handle_command_line(vm);
     CHECK_AND_ASSERT_MES(r, false, "Failed to process command line in core_rpc_server");
+    m_core.get_blockchain_storage().set_update_listener(this);
+
+    size_t max_queued = static_cast<size_t>(command_line::get_arg(vm, arg_rpc_max_queued));
+    r = m_fast_pool.init(static_cast<size_t>(command_line::get_arg(vm, arg_rpc_fast_threads)), max_queued, "RPC-fast");
+    CHECK_AND_ASSERT_MES(r, false, "Failed to start fast rpc worker pool");
+    r = m_heavy_pool.init(static_cast<size_t>(command_line::get_arg(vm, arg_rpc_heavy_threads)), max_queued, "RPC-heavy");
+    CHECK_AND_ASSERT_MES(r, false, "Failed to start heavy rpc worker pool");
     return epee::http_server_impl_base<core_rpc_server, connection_context>::init(m_port, m_bind_ip);
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::send_stop_signal()
+  {
+    //queued calls are finished while core is still alive, new ones get 503
+    m_fast_pool.stop();
+    m_heavy_pool.stop();
+    return epee::http_server_impl_base<core_rpc_server, connection_context>::send_stop_signal();
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void core_rpc_server::on_block_popped(uint64_t height)
+  {
+    m_response_cache.on_block_popped(height);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_cached_response(const std::string& key, std::string& body, uint64_t& epoch)
+  {
+    if (!m_response_cache.is_enabled())
+      return false;
+    return m_response_cache.get(key, m_core.get_current_blockchain_height(), body, epoch);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_cacheable_height(const COMMAND_RPC_GET_TRANSACTIONS::request& req, COMMAND_RPC_GET_TRANSACTIONS::response& res, uint64_t& height, uint64_t*& pdepth)
+  {
+    if (res.status != CORE_RPC_STATUS_OK || !res.missed_tx.empty() || res.txs_as_hex.size() != req.txs_hashes.size())
+      return false;
+    height = 0;
+    for (const auto& tx_hex_str : req.txs_hashes)
+    {
+      crypto::hash tx_id = null_hash;
+      crypto::hash block_id = null_hash;
+      uint64_t block_height = 0;
+      if (!parse_hash256(tx_hex_str, tx_id) || !m_core.get_blockchain_storage().get_block_containing_tx(tx_id, block_id, block_height))
+        return false;
+      height = (std::max)(height, block_height);
+    }
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_cacheable_height(const COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH::request& req, COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH::response& res, uint64_t& height, uint64_t*& pdepth)
+  {
+    //block could be found in alt chains as well
+    crypto::hash block_id = null_hash;
+    if (res.status != CORE_RPC_STATUS_OK || !parse_hash256(req.hash, block_id) || block_id != m_core.get_block_id_by_height(res.block_header.height))
+      return false;
+    height = res.block_header.height;
+    pdepth = &res.block_header.depth;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_cacheable_height(const COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::request& req, COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::response& res, uint64_t& height, uint64_t*& pdepth)
+  {
+    if (res.status != CORE_RPC_STATUS_OK)
+      return false;
+    height = req.height;
+    pdepth = &res.block_header.depth;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_cacheable_height(const COMMAND_RPC_GETBLOCK::request& req, COMMAND_RPC_GETBLOCK::response& res, uint64_t& height, uint64_t*& pdepth)
+  {
+    height = req.height;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_cacheable_height(const F_COMMAND_RPC_GET_BLOCK_DETAILS::request& req, F_COMMAND_RPC_GET_BLOCK_DETAILS::response& res, uint64_t& height, uint64_t*& pdepth)
+  {
+    if (res.status != CORE_RPC_STATUS_OK || res.block.hash != string_tools::pod_to_hex(m_core.get_block_id_by_height(res.block.height)))
+      return false;
+    height = res.block.height;
+    pdepth = &res.block.depth;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::get_cacheable_height(const F_COMMAND_RPC_GET_TRANSACTION_DETAILS::request& req, F_COMMAND_RPC_GET_TRANSACTION_DETAILS::response& res, uint64_t& height, uint64_t*& pdepth)
+  {
+    //empty block hash means transaction wasn't found in blockchain
+    if (res.status != CORE_RPC_STATUS_OK || res.ablock.hash.empty())
+      return false;
+    height = res.ablock.height;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::check_core_ready()
   {
 #ifndef TESTNET
@@ -115,6 +278,13 @@ namespace currency
     res.synchronization_start_height = m_p2p.get_payload_object().get_core_inital_height();
     res.max_net_seen_height = m_p2p.get_payload_object().get_max_seen_height();
     m_p2p.get_maintainers_info(res.mi);
+
+    rpc_response_cache::stats cache_stats = AUTO_VAL_INIT(cache_stats);
+    m_response_cache.get_stats(cache_stats);
+    res.rpc_cache_hits = cache_stats.hits;
+    res.rpc_cache_misses = cache_stats.misses;
+    res.rpc_cache_entries = cache_stats.entries;
+    res.rpc_cache_size = cache_stats.size;
     
     res.status = CORE_RPC_STATUS_OK;
     return true;
@@ -127,6 +297,25 @@ namespace currency
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_p2p_traffic_stats(const COMMAND_RPC_GET_P2P_TRAFFIC_STATS::request& req, COMMAND_RPC_GET_P2P_TRAFFIC_STATS::response& res, connection_context& cntx)
+  {
+    //peer details are not shown in restricted mode
+    std::list<epee::net_utils::connection_context_base> connections;
+    if (!m_restricted)
+      m_p2p.get_connections_traffic(connections);
+    fill_p2p_traffic_stats(m_p2p.get_traffic_stats(), connections, time(NULL), res);
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_rpc_stats(const COMMAND_RPC_GET_RPC_STATS::request& req, COMMAND_RPC_GET_RPC_STATS::response& res, connection_context& cntx)
+  {
+    get_http_route_stats().get_stats(res.routes);
+    res.slow_call_threshold_ms = get_http_route_stats().get_slow_call_threshold_ms();
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res, connection_context& cntx)
   {
     CHECK_CORE_READY();
@@ -232,6 +421,24 @@ namespace currency
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_tx_pool_changes(const COMMAND_RPC_GET_TX_POOL_CHANGES::request& req, COMMAND_RPC_GET_TX_POOL_CHANGES::response& res, connection_context& cntx)
+  {
+    CHECK_CORE_READY();
+    std::list<transaction> txs;
+    if (!m_core.get_pool_transactions_changes(req.since_version, res.version, res.full_sync, res.added_ids, res.removed_ids, req.include_txs ? &txs : nullptr))
+    {
+      res.status = "Failed to call get_pool_transactions_changes()";
+      return true;
+    }
+
+    for(auto& tx: txs)
+    {
+      res.added_txs.push_back(t_serializable_object_to_blob(tx));
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool core_rpc_server::on_check_keyimages(const COMMAND_RPC_CHECK_KEYIMAGES::request& req, COMMAND_RPC_CHECK_KEYIMAGES::response& res, connection_context& cntx)
   {
     m_core.get_blockchain_storage().check_keyimages(req.images, res.images_stat);
@@ -717,6 +924,66 @@ namespace currency
     res.status = CORE_RPC_STATUS_OK;
     return true;
   }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_block_headers_range(const COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::request& req, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::response& res, epee::json_rpc::error& error_resp, connection_context& cntx)
+  {
+    CHECK_CORE_READY_WE();
+    res.current_height = m_core.get_current_blockchain_height();
+    if (res.current_height <= req.start_height)
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_TOO_BIG_HEIGHT;
+      error_resp.message = std::string("To big height: ") + std::to_string(req.start_height) + ", current blockchain height = " + std::to_string(res.current_height);
+      return false;
+    }
+
+    uint64_t count = (std::min)(req.count, static_cast<uint64_t>(COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_MAX_COUNT));
+    res.headers.reserve(static_cast<size_t>((std::min)(count, res.current_height - req.start_height)));
+    bool busy = false;
+    bool r = m_core.get_blockchain_storage().enumerate_blocks_range(req.start_height, count, [&](const blockchain_storage::block_extended_info& bei, const wide_difficulty_type& difficulty)
+    {
+      res.headers.push_back(AUTO_VAL_INIT(block_header_range_entry()));
+      block_header_range_entry& entry = res.headers.back();
+      entry.major_version = bei.bl.major_version;
+      entry.minor_version = bei.bl.minor_version;
+      entry.timestamp = bei.bl.timestamp;
+      entry.prev_hash = string_tools::pod_to_hex(bei.bl.prev_id);
+      entry.nonce = bei.bl.nonce;
+      entry.height = bei.height;
+      entry.hash = string_tools::pod_to_hex(get_block_hash(bei.bl));
+      entry.difficulty = difficulty.convert_to<uint64_t>();
+      entry.reward = get_block_reward(bei.bl);
+      entry.block_size = bei.block_cumulative_size;
+      entry.tx_count = bei.bl.tx_hashes.size() + 1;
+      entry.already_generated_coins = bei.already_generated_coins;
+      return true;
+    }, busy);
+    if (busy)
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_CORE_BUSY;
+      error_resp.message = "Core is busy";
+      return false;
+    }
+    if (!r)
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+      error_resp.message = "Internal error: can't read blocks from " + std::to_string(req.start_height) + '.';
+      return false;
+    }
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_get_block_headers_range_bin(const COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::request& req, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::response& res, connection_context& cntx)
+  {
+    epee::json_rpc::error error_resp = AUTO_VAL_INIT(error_resp);
+    if (!on_get_block_headers_range(req, res, error_resp, cntx))
+    {
+      LOG_PRINT_L1("RPC: getblockheaders_range.bin failed: " << error_resp.message);
+      res.headers.clear();
+      res.status = error_resp.code == CORE_RPC_ERROR_CODE_CORE_BUSY ? CORE_RPC_STATUS_BUSY : CORE_RPC_STATUS_FAILED;
+    }
+    return true;
+  }
   
 bool core_rpc_server::f_on_blocks_list_json(const F_COMMAND_RPC_GET_BLOCKS_LIST::request& req, F_COMMAND_RPC_GET_BLOCKS_LIST::response& res, epee::json_rpc::error& error_resp, connection_context& cntx) {
     if(!check_core_ready())
@@ -1503,5 +1770,82 @@ bool core_rpc_server::f_getMixin(const transaction& transaction, uint64_t& mixin
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool core_rpc_server::on_scan_with_view_keys(const COMMAND_RPC_SCAN_WITH_VIEW_KEYS::request& req, COMMAND_RPC_SCAN_WITH_VIEW_KEYS::response& res, epee::json_rpc::error& error_resp, connection_context& cntx)
+  {
+    CHECK_CORE_READY_WE();
+
+    if (req.keys.empty() || req.keys.size() > CORE_RPC_SCAN_VIEW_KEYS_MAX_KEYS)
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_WRONG_PARAM;
+      error_resp.message = "Invalid parameter: keys count should be in range [1, " + std::to_string(CORE_RPC_SCAN_VIEW_KEYS_MAX_KEYS) + "]";
+      return false;
+    }
+
+    std::vector<blockchain_storage::view_key_scan_entry> keys;
+    keys.reserve(req.keys.size());
+    for (const auto& ke : req.keys)
+    {
+      blockchain_storage::view_key_scan_entry e = AUTO_VAL_INIT(e);
+      if (ke.view_key.size() != sizeof(crypto::secret_key) * 2 || !string_tools::hex_to_pod(ke.view_key, e.view_secret_key))
+      {
+        error_resp.code = CORE_RPC_ERROR_CODE_WRONG_PARAM;
+        error_resp.message = "Invalid parameter: view_key #" + std::to_string(keys.size());
+        return false;
+      }
+      if (ke.spend_public_key.size() != sizeof(crypto::public_key) * 2 || !string_tools::hex_to_pod(ke.spend_public_key, e.spend_public_key))
+      {
+        error_resp.code = CORE_RPC_ERROR_CODE_WRONG_PARAM;
+        error_resp.message = "Invalid parameter: spend_public_key #" + std::to_string(keys.size());
+        return false;
+      }
+      keys.push_back(e);
+    }
+
+    uint64_t current_height = m_core.get_current_blockchain_height();
+    uint64_t end_height = req.end_height ? req.end_height : current_height;
+    if (req.start_height > end_height || end_height > current_height)
+    {
+      error_resp.code = CORE_RPC_ERROR_CODE_TOO_BIG_HEIGHT;
+      error_resp.message = "Invalid height range [" + std::to_string(req.start_height) + ", " + std::to_string(end_height) + "), current blockchain height is " + std::to_string(current_height);
+      return false;
+    }
+    // big ranges are served in several calls, the client continues from next_height
+    if (end_height - req.start_height > CORE_RPC_SCAN_VIEW_KEYS_MAX_BLOCKS)
+      end_height = req.start_height + CORE_RPC_SCAN_VIEW_KEYS_MAX_BLOCKS;
+
+    std::vector<blockchain_storage::view_key_scan_match> matches;
+    bool busy = false;
+    if (!m_core.get_blockchain_storage().scan_blocks_with_view_keys(keys, req.start_height, end_height, matches, busy))
+    {
+      if (busy)
+      {
+        error_resp.code = CORE_RPC_ERROR_CODE_CORE_BUSY;
+        error_resp.message = "Core is busy";
+      }
+      else
+      {
+        error_resp.code = CORE_RPC_ERROR_CODE_INTERNAL_ERROR;
+        error_resp.message = "Internal error: scan_blocks_with_view_keys failed, see daemon log for details";
+      }
+      return false;
+    }
+
+    for (const auto& m : matches)
+    {
+      COMMAND_RPC_SCAN_WITH_VIEW_KEYS::out_entry oe = AUTO_VAL_INIT(oe);
+      oe.key_index = m.key_index;
+      oe.block_height = m.block_height;
+      oe.tx_hash = epee::string_tools::pod_to_hex(m.tx_id);
+      oe.payment_id_hex = epee::string_tools::buff_to_hex_nodelimer(m.payment_id);
+      oe.out_index = m.out_index;
+      oe.global_out_index = m.global_out_index;
+      oe.amount = m.amount;
+      res.outs.push_back(oe);
+    }
+    res.next_height = end_height;
+    res.status = CORE_RPC_STATUS_OK;
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
 
 }
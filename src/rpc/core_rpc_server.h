@@ -13,21 +13,28 @@
 #include "p2p/net_node.h"
 #include "currency_protocol/currency_protocol_handler.h"
 #include "mining_protocol_defs.h"
+#include "rpc_response_cache.h"
 
 namespace currency
 {
   /************************************************************************/
   /*                                                                      */
   /************************************************************************/
-  class core_rpc_server: public epee::http_server_impl_base<core_rpc_server>
+  class core_rpc_server: public epee::http_server_impl_base<core_rpc_server>,
+                         public i_blockchain_update_listener
   {
   public:
     typedef epee::net_utils::connection_context_base connection_context;
 
     core_rpc_server(core& cr, nodetool::node_server<currency::t_currency_protocol_handler<currency::core> >& p2p);
+    ~core_rpc_server();
 
     static void init_options(boost::program_options::options_description& desc);
     bool init(const boost::program_options::variables_map& vm);
+    bool send_stop_signal();
+
+    //i_http_server_handler
+    virtual epee::net_utils::http::worker_pool* get_request_worker_pool(const epee::net_utils::http::http_request_info& query_info);
 
     bool on_get_height(const COMMAND_RPC_GET_HEIGHT::request& req, COMMAND_RPC_GET_HEIGHT::response& res, connection_context& cntx);
     bool on_get_blocks(const COMMAND_RPC_GET_BLOCKS_FAST::request& req, COMMAND_RPC_GET_BLOCKS_FAST::response& res, connection_context& cntx);
@@ -41,8 +48,11 @@ namespace currency
     bool on_stop_daemon(const COMMAND_RPC_STOP_DAEMON::request& req, COMMAND_RPC_STOP_DAEMON::response& res, connection_context& cntx);
     bool on_set_maintainers_info(const COMMAND_RPC_SET_MAINTAINERS_INFO::request& req, COMMAND_RPC_SET_MAINTAINERS_INFO::response& res, connection_context& cntx);
     bool on_get_tx_pool(const COMMAND_RPC_GET_TX_POOL::request& req, COMMAND_RPC_GET_TX_POOL::response& res, connection_context& cntx);
+    bool on_get_tx_pool_changes(const COMMAND_RPC_GET_TX_POOL_CHANGES::request& req, COMMAND_RPC_GET_TX_POOL_CHANGES::response& res, connection_context& cntx);
     bool on_check_keyimages(const COMMAND_RPC_CHECK_KEYIMAGES::request& req, COMMAND_RPC_CHECK_KEYIMAGES::response& res, connection_context& cntx);
     bool on_relay_txs_to_net(const currency::COMMAND_RPC_RELAY_TXS::request& rqt, currency::COMMAND_RPC_RELAY_TXS::response& rsp, connection_context& cntx);
+    bool on_get_p2p_traffic_stats(const COMMAND_RPC_GET_P2P_TRAFFIC_STATS::request& req, COMMAND_RPC_GET_P2P_TRAFFIC_STATS::response& res, connection_context& cntx);
+    bool on_get_rpc_stats(const COMMAND_RPC_GET_RPC_STATS::request& req, COMMAND_RPC_GET_RPC_STATS::response& res, connection_context& cntx);
     
 
     //json_rpc
@@ -54,6 +64,8 @@ namespace currency
     bool on_get_last_block_header(const COMMAND_RPC_GET_LAST_BLOCK_HEADER::request& req, COMMAND_RPC_GET_LAST_BLOCK_HEADER::response& res, epee::json_rpc::error& error_resp, connection_context& cntx);
     bool on_get_block_header_by_hash(const COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH::request& req, COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH::response& res, epee::json_rpc::error& error_resp, connection_context& cntx);
     bool on_get_block_header_by_height(const COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::request& req, COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::response& res, epee::json_rpc::error& error_resp, connection_context& cntx);
+    bool on_get_block_headers_range(const COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::request& req, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::response& res, epee::json_rpc::error& error_resp, connection_context& cntx);
+    bool on_get_block_headers_range_bin(const COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::request& req, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE::response& res, connection_context& cntx);
     bool f_on_blocks_list_json(const F_COMMAND_RPC_GET_BLOCKS_LIST::request& req, F_COMMAND_RPC_GET_BLOCKS_LIST::response& res, epee::json_rpc::error& error_resp, connection_context& cntx);
     bool f_on_block_json(const F_COMMAND_RPC_GET_BLOCK_DETAILS::request& req, F_COMMAND_RPC_GET_BLOCK_DETAILS::response& res, epee::json_rpc::error& error_resp, connection_context& cntx);
     bool f_getMixin(const transaction& transaction, uint64_t& mixin);
@@ -66,6 +78,7 @@ namespace currency
     bool on_reset_transaction_pool(const COMMAND_RPC_RESET_TX_POOL::request& req, COMMAND_RPC_RESET_TX_POOL::response& res, connection_context& cntx);
     bool on_validate_signed_text(const COMMAND_RPC_VALIDATE_SIGNED_TEXT::request& req, COMMAND_RPC_VALIDATE_SIGNED_TEXT::response& res, connection_context& cntx);
     bool on_check_tx_with_view_key(const COMMAND_RPC_CHECK_TX_WITH_VIEW_KEY::request& req, COMMAND_RPC_CHECK_TX_WITH_VIEW_KEY::response& res, epee::json_rpc::error& error_resp, connection_context& cntx);
+    bool on_scan_with_view_keys(const COMMAND_RPC_SCAN_WITH_VIEW_KEYS::request& req, COMMAND_RPC_SCAN_WITH_VIEW_KEYS::response& res, epee::json_rpc::error& error_resp, connection_context& cntx);
 
     
     //mining rpc
@@ -84,38 +97,44 @@ namespace currency
 
     BEGIN_URI_MAP2()
       MAP_URI_AUTO_JON2("/getheight", on_get_height, COMMAND_RPC_GET_HEIGHT)
-      MAP_URI_AUTO_BIN2("/getblocks.bin", on_get_blocks, COMMAND_RPC_GET_BLOCKS_FAST)
+      MAP_URI_AUTO_BIN2_STREAMED("/getblocks.bin", on_get_blocks, COMMAND_RPC_GET_BLOCKS_FAST)
+      MAP_URI_AUTO_BIN2_STREAMED("/getblockheaders_range.bin", on_get_block_headers_range_bin, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE)
       MAP_URI_AUTO_BIN2("/get_o_indexes.bin", on_get_indexes, COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES)      
       MAP_URI_AUTO_BIN2("/getrandom_outs.bin", on_get_random_outs, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS)
       MAP_URI_AUTO_BIN2("/set_maintainers_info.bin", on_set_maintainers_info, COMMAND_RPC_SET_MAINTAINERS_INFO)
       MAP_URI_AUTO_BIN2("/get_tx_pool.bin", on_get_tx_pool, COMMAND_RPC_GET_TX_POOL)
+      MAP_URI_AUTO_BIN2("/get_tx_pool_changes.bin", on_get_tx_pool_changes, COMMAND_RPC_GET_TX_POOL_CHANGES)
       MAP_URI_AUTO_BIN2("/check_keyimages.bin", on_check_keyimages, COMMAND_RPC_CHECK_KEYIMAGES)
-      MAP_URI_AUTO_JON2("/gettransactions", on_get_transactions, COMMAND_RPC_GET_TRANSACTIONS)
+      MAP_URI_AUTO_JON2_CACHED("/gettransactions", on_get_transactions, COMMAND_RPC_GET_TRANSACTIONS)
       MAP_URI_AUTO_JON2("/sendrawtransaction", on_send_raw_tx, COMMAND_RPC_SEND_RAW_TX)
       MAP_URI_AUTO_JON2_IF("/start_mining", on_start_mining, COMMAND_RPC_START_MINING, !m_restricted)
       MAP_URI_AUTO_JON2_IF("/stop_mining", on_stop_mining, COMMAND_RPC_STOP_MINING, !m_restricted)
       MAP_URI_AUTO_JON2("/getinfo", on_get_info, COMMAND_RPC_GET_INFO)
+      MAP_URI_AUTO_JON2("/get_p2p_traffic_stats", on_get_p2p_traffic_stats, COMMAND_RPC_GET_P2P_TRAFFIC_STATS)
+      MAP_URI_AUTO_JON2("/get_rpc_stats", on_get_rpc_stats, COMMAND_RPC_GET_RPC_STATS)
       MAP_URI_AUTO_JON2_IF("/stop_daemon", on_stop_daemon, COMMAND_RPC_STOP_DAEMON, !m_restricted)
       MAP_URI2("/getfullscratchpad2", on_getfullscratchpad2)
-      BEGIN_JSON_RPC_MAP("/json_rpc")
+      BEGIN_JSON_RPC_MAP_WITH_BATCH("/json_rpc", m_batch_config)
         MAP_JON_RPC("getblockcount",             on_getblockcount,              COMMAND_RPC_GETBLOCKCOUNT)
         MAP_JON_RPC_WE("on_getblockhash",        on_getblockhash,               COMMAND_RPC_GETBLOCKHASH)
         MAP_JON_RPC_WE("getblocktemplate",       on_getblocktemplate,           COMMAND_RPC_GETBLOCKTEMPLATE)
         MAP_JON_RPC_WE("submitblock",            on_submitblock,                COMMAND_RPC_SUBMITBLOCK)
         MAP_JON_RPC_WE("getlastblockheader",     on_get_last_block_header,      COMMAND_RPC_GET_LAST_BLOCK_HEADER)
-        MAP_JON_RPC_WE("getblockheaderbyhash",   on_get_block_header_by_hash,   COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH)
-        MAP_JON_RPC_WE("getblockheaderbyheight", on_get_block_header_by_height, COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT)
+        MAP_JON_RPC_WE_CACHED("getblockheaderbyhash",   on_get_block_header_by_hash,   COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH)
+        MAP_JON_RPC_WE_CACHED("getblockheaderbyheight", on_get_block_header_by_height, COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT)
+        MAP_JON_RPC_WE_STREAMED("getblockheaders_range", on_get_block_headers_range, COMMAND_RPC_GET_BLOCK_HEADERS_RANGE)
         MAP_JON_RPC_WE("get_alias_details",      on_get_alias_details,          COMMAND_RPC_GET_ALIAS_DETAILS)
-        MAP_JON_RPC_WE("get_all_alias_details",  on_get_all_aliases,            COMMAND_RPC_GET_ALL_ALIASES)
+        MAP_JON_RPC_WE_STREAMED("get_all_alias_details", on_get_all_aliases,           COMMAND_RPC_GET_ALL_ALIASES)
         MAP_JON_RPC_WE("get_alias_by_address",   on_alias_by_address,           COMMAND_RPC_GET_ALIASES_BY_ADDRESS)
         MAP_JON_RPC_WE("get_addendums",          on_get_addendums,              COMMAND_RPC_GET_ADDENDUMS)
-        MAP_JON_RPC_WE("f_blocks_list_json",     f_on_blocks_list_json,         F_COMMAND_RPC_GET_BLOCKS_LIST)
-        MAP_JON_RPC_WE("f_block_json",           f_on_block_json,               F_COMMAND_RPC_GET_BLOCK_DETAILS)
-        MAP_JON_RPC_WE("f_transaction_json",     f_on_transaction_json,         F_COMMAND_RPC_GET_TRANSACTION_DETAILS)
-        MAP_JON_RPC_WE("f_pool_json",            f_on_pool_json,                F_COMMAND_RPC_GET_POOL)
+        MAP_JON_RPC_WE_STREAMED("f_blocks_list_json",  f_on_blocks_list_json,         F_COMMAND_RPC_GET_BLOCKS_LIST)
+        MAP_JON_RPC_WE_CACHED("f_block_json",           f_on_block_json,               F_COMMAND_RPC_GET_BLOCK_DETAILS)
+        MAP_JON_RPC_WE_CACHED("f_transaction_json",     f_on_transaction_json,         F_COMMAND_RPC_GET_TRANSACTION_DETAILS)
+        MAP_JON_RPC_WE_STREAMED("f_pool_json",         f_on_pool_json,                F_COMMAND_RPC_GET_POOL)
         MAP_JON_RPC_IF("reset_transaction_pool", on_reset_transaction_pool,     COMMAND_RPC_RESET_TX_POOL, !m_restricted)
-        MAP_JON_RPC_WE("getblock",               on_getblock,                   COMMAND_RPC_GETBLOCK)
+        MAP_JON_RPC_WE_CACHED("getblock",               on_getblock,                   COMMAND_RPC_GETBLOCK)
         MAP_JON_RPC_WE("check_tx_with_view_key", on_check_tx_with_view_key,     COMMAND_RPC_CHECK_TX_WITH_VIEW_KEY)
+        MAP_JON_RPC_WE_IF("scan_with_view_keys", on_scan_with_view_keys,       COMMAND_RPC_SCAN_WITH_VIEW_KEYS, !m_restricted)
         MAP_JON_RPC("relay_txs",              on_relay_txs_to_net,           COMMAND_RPC_RELAY_TXS)
         MAP_JON_RPC("validate_signed_text",      on_validate_signed_text,       COMMAND_RPC_VALIDATE_SIGNED_TEXT)
         //remote miner rpc
@@ -131,6 +150,22 @@ namespace currency
 
     //-----------------------
     bool handle_command_line(const boost::program_options::variables_map& vm);
+    static bool is_read_only_json_rpc_method(const std::string& method);
+    static bool is_heavy_request(const epee::net_utils::http::http_request_info& query_info);
+
+    //i_blockchain_update_listener
+    virtual void on_block_popped(uint64_t height);
+
+    //response cache, used by *_CACHED map entries
+    bool get_cached_response(const std::string& key, std::string& body, uint64_t& epoch);
+    template<class t_request, class t_response>
+    void store_cacheable_response(const std::string& key, uint64_t epoch, const t_request& req, t_response& res, std::string& body, size_t indent);
+    bool get_cacheable_height(const COMMAND_RPC_GET_TRANSACTIONS::request& req, COMMAND_RPC_GET_TRANSACTIONS::response& res, uint64_t& height, uint64_t*& pdepth);
+    bool get_cacheable_height(const COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH::request& req, COMMAND_RPC_GET_BLOCK_HEADER_BY_HASH::response& res, uint64_t& height, uint64_t*& pdepth);
+    bool get_cacheable_height(const COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::request& req, COMMAND_RPC_GET_BLOCK_HEADER_BY_HEIGHT::response& res, uint64_t& height, uint64_t*& pdepth);
+    bool get_cacheable_height(const COMMAND_RPC_GETBLOCK::request& req, COMMAND_RPC_GETBLOCK::response& res, uint64_t& height, uint64_t*& pdepth);
+    bool get_cacheable_height(const F_COMMAND_RPC_GET_BLOCK_DETAILS::request& req, F_COMMAND_RPC_GET_BLOCK_DETAILS::response& res, uint64_t& height, uint64_t*& pdepth);
+    bool get_cacheable_height(const F_COMMAND_RPC_GET_TRANSACTION_DETAILS::request& req, F_COMMAND_RPC_GET_TRANSACTION_DETAILS::response& res, uint64_t& height, uint64_t*& pdepth);
     bool check_core_ready();
     bool get_addendum_for_hi(const mining::height_info& hi, std::list<mining::addendum>& res);
     bool get_job(const std::string& job_id, mining::job_details& job, epee::json_rpc::error& err, connection_context& cntx);
@@ -151,5 +186,45 @@ namespace currency
     epee::critical_section m_session_jobs_lock;
     std::map<std::string, currency::block> m_session_jobs; //session id -> blob
     std::atomic<size_t> m_session_counter;
+    rpc_response_cache m_response_cache;
+    epee::json_rpc::batch_config m_batch_config;
+    epee::net_utils::http::worker_pool m_fast_pool;
+    epee::net_utils::http::worker_pool m_heavy_pool;
   };
+  //------------------------------------------------------------------------------------------------------------------------------
+  template<class t_request, class t_response>
+  void core_rpc_server::store_cacheable_response(const std::string& key, uint64_t epoch, const t_request& req, t_response& res, std::string& body, size_t indent)
+  {
+    uint64_t height = 0;
+    uint64_t* pdepth = nullptr;
+    if (!m_response_cache.is_enabled() || !get_cacheable_height(req, res, height, pdepth) ||
+        height + RPC_RESPONSE_CACHE_MIN_DEPTH > m_core.get_current_blockchain_height())
+    {
+      epee::serialization::store_t_to_json(res, body, indent);
+      return;
+    }
+
+    //depth changes with every new block, so it's kept as placeholder in cache
+    uint64_t depth = 0;
+    if (pdepth)
+    {
+      depth = *pdepth;
+      *pdepth = RPC_RESPONSE_CACHE_DEPTH_PLACEHOLDER;
+    }
+    epee::serialization::store_t_to_json(res, body, indent);
+    size_t depth_pos = std::string::npos;
+    if (pdepth)
+    {
+      *pdepth = depth;
+      depth_pos = body.find(RPC_RESPONSE_CACHE_DEPTH_PLACEHOLDER_STR);
+      if (depth_pos == std::string::npos || depth_pos != body.rfind(RPC_RESPONSE_CACHE_DEPTH_PLACEHOLDER_STR))
+      {
+        epee::serialization::store_t_to_json(res, body, indent);
+        return;
+      }
+    }
+    m_response_cache.put(key, body, height, depth_pos, epoch);
+    if (pdepth)
+      body.replace(depth_pos, sizeof(RPC_RESPONSE_CACHE_DEPTH_PLACEHOLDER_STR) - 1, std::to_string(depth));
+  }
 }
@@ -10,6 +10,7 @@
 #include "p2p/p2p_protocol_defs.h"
 #include "rpc/mining_protocol_defs.h"
 #include "storages/portable_storage_base.h"
+#include "net/http_route_stats.h"
 
 namespace currency
 {
@@ -20,6 +21,9 @@ namespace currency
 #define CORE_RPC_STATUS_FAILED              "FAILED"
 #define CORE_RPC_STATUS_INVALID_ARGUMENT    "INVALID_ARGUMENT"
 
+#define CORE_RPC_SCAN_VIEW_KEYS_MAX_KEYS          1000
+#define CORE_RPC_SCAN_VIEW_KEYS_MAX_BLOCKS        10000
+
 struct EMPTY_STRUCT {
   BEGIN_KV_SERIALIZE_MAP()
   END_KV_SERIALIZE_MAP()
@@ -142,6 +146,39 @@ struct EMPTY_STRUCT {
     };
   };
   //-----------------------------------------------
+  struct COMMAND_RPC_GET_TX_POOL_CHANGES
+  {
+    struct request
+    {
+      uint64_t since_version;   //version from previous response, 0 on first call
+      bool include_txs;         //return blobs of added transactions too
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(since_version)
+        KV_SERIALIZE(include_txs)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      uint64_t version;
+      bool full_sync;           //since_version is unknown to daemon, added_ids is whole pool
+      std::list<crypto::hash> added_ids;
+      std::list<blobdata> added_txs;
+      std::list<crypto::hash> removed_ids;
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(version)
+        KV_SERIALIZE(full_sync)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(added_ids)
+        KV_SERIALIZE(added_txs)
+        KV_SERIALIZE_CONTAINER_POD_AS_BLOB(removed_ids)
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+  //-----------------------------------------------
   struct COMMAND_RPC_CHECK_KEYIMAGES
   {
     struct request
@@ -334,6 +371,10 @@ struct EMPTY_STRUCT {
       uint64_t max_net_seen_height;
       uint64_t transactions_cnt_per_day;
       uint64_t transactions_volume_per_day;
+      uint64_t rpc_cache_hits;
+      uint64_t rpc_cache_misses;
+      uint64_t rpc_cache_entries;
+      uint64_t rpc_cache_size;
       nodetool::maintainers_info_external mi;
 
       BEGIN_KV_SERIALIZE_MAP()
@@ -357,6 +398,10 @@ struct EMPTY_STRUCT {
         KV_SERIALIZE(max_net_seen_height)
         KV_SERIALIZE(transactions_cnt_per_day)
         KV_SERIALIZE(transactions_volume_per_day)
+        KV_SERIALIZE(rpc_cache_hits)
+        KV_SERIALIZE(rpc_cache_misses)
+        KV_SERIALIZE(rpc_cache_entries)
+        KV_SERIALIZE(rpc_cache_size)
         KV_SERIALIZE(mi)
       END_KV_SERIALIZE_MAP()
     };
@@ -609,6 +654,64 @@ struct EMPTY_STRUCT {
 
   };
 
+  struct block_header_range_entry
+  {
+    uint8_t major_version;
+    uint8_t minor_version;
+    uint64_t timestamp;
+    std::string prev_hash;
+    uint64_t nonce;
+    uint64_t height;
+    std::string hash;
+    difficulty_type difficulty;
+    uint64_t reward;
+    uint64_t block_size;     //block_cumulative_size: block blob plus its transactions
+    uint64_t tx_count;       //including miner tx
+    uint64_t already_generated_coins;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(major_version)
+      KV_SERIALIZE(minor_version)
+      KV_SERIALIZE(timestamp)
+      KV_SERIALIZE(prev_hash)
+      KV_SERIALIZE(nonce)
+      KV_SERIALIZE(height)
+      KV_SERIALIZE(hash)
+      KV_SERIALIZE(difficulty)
+      KV_SERIALIZE(reward)
+      KV_SERIALIZE(block_size)
+      KV_SERIALIZE(tx_count)
+      KV_SERIALIZE(already_generated_coins)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct COMMAND_RPC_GET_BLOCK_HEADERS_RANGE
+  {
+    struct request
+    {
+      uint64_t start_height;
+      uint64_t count;         //capped by COMMAND_RPC_GET_BLOCK_HEADERS_RANGE_MAX_COUNT
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE(count)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::vector<block_header_range_entry> headers;
+      uint64_t current_height;
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(headers)
+        KV_SERIALIZE(current_height)
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_GET_ALIAS_DETAILS
   {
     struct request
@@ -1075,5 +1178,160 @@ struct F_COMMAND_RPC_GET_BLOCKCHAIN_SETTINGS {
     };
   };
 
+  struct COMMAND_RPC_SCAN_WITH_VIEW_KEYS
+  {
+    struct key_entry
+    {
+      std::string view_key;           // view secret key, hex
+      std::string spend_public_key;   // hex
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(view_key)
+        KV_SERIALIZE(spend_public_key)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct request
+    {
+      std::list<key_entry> keys;
+      uint64_t start_height;
+      uint64_t end_height;            // exclusive, 0 means current blockchain height
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(keys)
+        KV_SERIALIZE(start_height)
+        KV_SERIALIZE(end_height)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct out_entry
+    {
+      uint64_t key_index;
+      uint64_t block_height;
+      std::string tx_hash;
+      std::string payment_id_hex;
+      uint64_t out_index;
+      uint64_t global_out_index;
+      uint64_t amount;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(key_index)
+        KV_SERIALIZE(block_height)
+        KV_SERIALIZE(tx_hash)
+        KV_SERIALIZE(payment_id_hex)
+        KV_SERIALIZE(out_index)
+        KV_SERIALIZE(global_out_index)
+        KV_SERIALIZE(amount)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::list<out_entry> outs;
+      uint64_t next_height;           // start_height for the next call, equals end_height when the requested range is done
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(outs)
+        KV_SERIALIZE(next_height)
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  //-----------------------------------------------
+  struct COMMAND_RPC_GET_P2P_TRAFFIC_STATS
+  {
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct command_entry
+    {
+      int command;
+      std::string name;
+      uint64_t bytes_in;
+      uint64_t bytes_out;
+      uint64_t messages_in;
+      uint64_t messages_out;
+      uint64_t handler_time_us;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(command)
+        KV_SERIALIZE(name)
+        KV_SERIALIZE(bytes_in)
+        KV_SERIALIZE(bytes_out)
+        KV_SERIALIZE(messages_in)
+        KV_SERIALIZE(messages_out)
+        KV_SERIALIZE(handler_time_us)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct peer_entry
+    {
+      std::string connection_id;
+      std::string ip;
+      uint32_t port;
+      bool is_income;
+      uint64_t live_time;
+      uint64_t bytes_in;
+      uint64_t bytes_out;
+      uint64_t messages_in;
+      uint64_t messages_out;
+      uint64_t handler_time_us;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(connection_id)
+        KV_SERIALIZE(ip)
+        KV_SERIALIZE(port)
+        KV_SERIALIZE(is_income)
+        KV_SERIALIZE(live_time)
+        KV_SERIALIZE(bytes_in)
+        KV_SERIALIZE(bytes_out)
+        KV_SERIALIZE(messages_in)
+        KV_SERIALIZE(messages_out)
+        KV_SERIALIZE(handler_time_us)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::list<command_entry> commands;  // totals since daemon start
+      std::list<peer_entry> peers;        // current connections, empty in restricted mode
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(commands)
+        KV_SERIALIZE(peers)
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  //-----------------------------------------------
+  struct COMMAND_RPC_GET_RPC_STATS
+  {
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::list<epee::net_utils::http::route_stat> routes;  // per uri/json-rpc method, totals since start
+      uint64_t slow_call_threshold_ms;
+      std::string status;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(routes)
+        KV_SERIALIZE(slow_call_threshold_ms)
+        KV_SERIALIZE(status)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
 }
 
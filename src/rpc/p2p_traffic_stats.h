@@ -0,0 +1,80 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <list>
+#include <string>
+#include "net/levin_traffic_stats.h"
+#include "net/net_utils_base.h"
+#include "string_tools.h"
+#include "currency_core/currency_stat_info.h"
+#include "core_rpc_server_commands_defs.h"
+
+namespace currency
+{
+#define LEVIN_COMMAND_NAME_CASE(id, name) case id: return name;
+  inline std::string get_levin_command_name(int command)
+  {
+    switch (command)
+    {
+      LEVIN_COMMAND_NAME_CASE(0,                                   "other")
+      LEVIN_COMMAND_NAME_CASE(nodetool::COMMAND_HANDSHAKE_T<CORE_SYNC_DATA>::ID, "COMMAND_HANDSHAKE")
+      LEVIN_COMMAND_NAME_CASE(nodetool::COMMAND_TIMED_SYNC_T<CORE_SYNC_DATA>::ID, "COMMAND_TIMED_SYNC")
+      LEVIN_COMMAND_NAME_CASE(nodetool::COMMAND_PING::ID,          "COMMAND_PING")
+      LEVIN_COMMAND_NAME_CASE(nodetool::COMMAND_REQUEST_STAT_INFO_T<core_stat_info>::ID, "COMMAND_REQUEST_STAT_INFO")
+      LEVIN_COMMAND_NAME_CASE(nodetool::COMMAND_REQUEST_NETWORK_STATE::ID, "COMMAND_REQUEST_NETWORK_STATE")
+      LEVIN_COMMAND_NAME_CASE(nodetool::COMMAND_REQUEST_PEER_ID::ID, "COMMAND_REQUEST_PEER_ID")
+      LEVIN_COMMAND_NAME_CASE(NOTIFY_NEW_BLOCK::ID,                "NOTIFY_NEW_BLOCK")
+      LEVIN_COMMAND_NAME_CASE(NOTIFY_NEW_TRANSACTIONS::ID,         "NOTIFY_NEW_TRANSACTIONS")
+      LEVIN_COMMAND_NAME_CASE(NOTIFY_REQUEST_GET_OBJECTS::ID,      "NOTIFY_REQUEST_GET_OBJECTS")
+      LEVIN_COMMAND_NAME_CASE(NOTIFY_RESPONSE_GET_OBJECTS::ID,     "NOTIFY_RESPONSE_GET_OBJECTS")
+      LEVIN_COMMAND_NAME_CASE(NOTIFY_REQUEST_CHAIN::ID,            "NOTIFY_REQUEST_CHAIN")
+      LEVIN_COMMAND_NAME_CASE(NOTIFY_RESPONSE_CHAIN_ENTRY::ID,     "NOTIFY_RESPONSE_CHAIN_ENTRY")
+      LEVIN_COMMAND_NAME_CASE(NOTIFY_NEW_COMPACT_BLOCK::ID,        "NOTIFY_NEW_COMPACT_BLOCK")
+      LEVIN_COMMAND_NAME_CASE(NOTIFY_REQUEST_COMPACT_BLOCK_TXS::ID, "NOTIFY_REQUEST_COMPACT_BLOCK_TXS")
+      LEVIN_COMMAND_NAME_CASE(NOTIFY_RESPONSE_COMPACT_BLOCK_TXS::ID, "NOTIFY_RESPONSE_COMPACT_BLOCK_TXS")
+      LEVIN_COMMAND_NAME_CASE(NOTIFY_TX_INVENTORY::ID,             "NOTIFY_TX_INVENTORY")
+      LEVIN_COMMAND_NAME_CASE(NOTIFY_REQUEST_TXS::ID,              "NOTIFY_REQUEST_TXS")
+    default:
+      return "COMMAND_" + std::to_string(command);
+    }
+  }
+#undef LEVIN_COMMAND_NAME_CASE
+  //------------------------------------------------------------------------------------------------------------------------------
+  inline void fill_p2p_traffic_stats(const epee::levin::traffic_stats& traffic, const std::list<epee::net_utils::connection_context_base>& connections,
+    time_t now, COMMAND_RPC_GET_P2P_TRAFFIC_STATS::response& res)
+  {
+    std::list<epee::levin::command_traffic_stat> stats;
+    traffic.get_stats(stats);
+    for (const auto& st : stats)
+    {
+      COMMAND_RPC_GET_P2P_TRAFFIC_STATS::command_entry ce = AUTO_VAL_INIT(ce);
+      ce.command = st.command;
+      ce.name = get_levin_command_name(st.command);
+      ce.bytes_in = st.bytes_in;
+      ce.bytes_out = st.bytes_out;
+      ce.messages_in = st.messages_in;
+      ce.messages_out = st.messages_out;
+      ce.handler_time_us = st.handler_time_us;
+      res.commands.push_back(ce);
+    }
+
+    for (const auto& cntxt : connections)
+    {
+      COMMAND_RPC_GET_P2P_TRAFFIC_STATS::peer_entry pe = AUTO_VAL_INIT(pe);
+      pe.connection_id = epee::string_tools::get_str_from_guid_a(cntxt.m_connection_id);
+      pe.ip = epee::string_tools::get_ip_string_from_int32(cntxt.m_remote_ip);
+      pe.port = cntxt.m_remote_port;
+      pe.is_income = cntxt.m_is_income;
+      pe.live_time = now - cntxt.m_started;
+      pe.bytes_in = cntxt.m_recv_cnt;
+      pe.bytes_out = cntxt.m_send_cnt;
+      pe.messages_in = cntxt.m_recv_msgs.load(std::memory_order_relaxed);
+      pe.messages_out = cntxt.m_send_msgs.load(std::memory_order_relaxed);
+      pe.handler_time_us = cntxt.m_handler_time_us.load(std::memory_order_relaxed);
+      res.peers.push_back(pe);
+    }
+  }
+}
@@ -0,0 +1,179 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include "syncobj.h"
+#include "currency_config.h"
+
+//written instead of "depth" value into cached body, real depth is put there on every hit
+#define RPC_RESPONSE_CACHE_DEPTH_PLACEHOLDER      UINT64_MAX
+#define RPC_RESPONSE_CACHE_DEPTH_PLACEHOLDER_STR  "18446744073709551615"
+
+namespace currency
+{
+  /************************************************************************/
+  /* Byte-budgeted LRU of serialized rpc responses that depend only on    */
+  /* blocks buried deep enough to not change. Each entry remembers the    */
+  /* highest block it depends on, so popping blocks drops what was built  */
+  /* on them.                                                             */
+  /************************************************************************/
+  class rpc_response_cache
+  {
+  public:
+    struct stats
+    {
+      uint64_t hits;
+      uint64_t misses;
+      uint64_t evictions;
+      uint64_t invalidations;
+      uint64_t entries;
+      uint64_t size;
+      uint64_t max_size;
+    };
+
+    rpc_response_cache(size_t max_size = RPC_RESPONSE_CACHE_DEFAULT_SIZE)
+      : m_max_size(max_size)
+      , m_size(0)
+      , m_epoch(0)
+      , m_hits(0)
+      , m_misses(0)
+      , m_evictions(0)
+      , m_invalidations(0)
+    {}
+
+    void set_max_size(size_t max_size)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      m_max_size = max_size;
+      shrink_to(m_max_size);
+    }
+
+    bool is_enabled() const { return m_max_size != 0; }
+
+    //epoch is taken before the response is built and given back to put(), so that a response
+    //built from a chain that was reorganized meanwhile is never stored
+    bool get(const std::string& key, uint64_t current_height, std::string& body, uint64_t& epoch)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      epoch = m_epoch;
+      auto it = m_entries.find(key);
+      if (it == m_entries.end())
+      {
+        ++m_misses;
+        return false;
+      }
+      ++m_hits;
+      m_lru.splice(m_lru.begin(), m_lru, it->second.lru_it);
+
+      const entry& e = it->second;
+      if (e.depth_pos == std::string::npos)
+      {
+        body = e.body;
+        return true;
+      }
+      std::string depth = std::to_string(current_height - e.height - 1);
+      body.reserve(e.body.size() + depth.size());
+      body.assign(e.body, 0, e.depth_pos);
+      body += depth;
+      body.append(e.body, e.depth_pos + sizeof(RPC_RESPONSE_CACHE_DEPTH_PLACEHOLDER_STR) - 1, std::string::npos);
+      return true;
+    }
+
+    //height is the highest block response depends on, depth_pos is offset of
+    //RPC_RESPONSE_CACHE_DEPTH_PLACEHOLDER_STR in body or npos
+    bool put(const std::string& key, const std::string& body, uint64_t height, size_t depth_pos, uint64_t epoch)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      size_t cost = entry_cost(key, body);
+      if (epoch != m_epoch || cost > m_max_size / 4 || m_entries.count(key))
+        return false;
+
+      shrink_to(m_max_size - cost);
+      m_lru.push_front(key);
+      entry& e = m_entries[key];
+      e.body = body;
+      e.height = height;
+      e.depth_pos = depth_pos;
+      e.lru_it = m_lru.begin();
+      m_size += cost;
+      return true;
+    }
+
+    //block at height was removed from main chain
+    void on_block_popped(uint64_t height)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      ++m_epoch;
+      //pops are rare and come in short runs, plain scan is fine here
+      for (auto it = m_entries.begin(); it != m_entries.end();)
+      {
+        if (it->second.height >= height)
+        {
+          m_size -= entry_cost(it->first, it->second.body);
+          m_lru.erase(it->second.lru_it);
+          it = m_entries.erase(it);
+          ++m_invalidations;
+        }
+        else
+        {
+          ++it;
+        }
+      }
+    }
+
+    void get_stats(stats& st)
+    {
+      CRITICAL_REGION_LOCAL(m_lock);
+      st.hits = m_hits;
+      st.misses = m_misses;
+      st.evictions = m_evictions;
+      st.invalidations = m_invalidations;
+      st.entries = m_entries.size();
+      st.size = m_size;
+      st.max_size = m_max_size;
+    }
+
+  private:
+    struct entry
+    {
+      std::string body;
+      uint64_t height;
+      size_t depth_pos;
+      std::list<std::string>::iterator lru_it;
+    };
+
+    static size_t entry_cost(const std::string& key, const std::string& body)
+    {
+      //key is kept twice: in map and in lru list
+      return 2 * key.size() + body.size() + sizeof(entry);
+    }
+
+    void shrink_to(size_t size)
+    {
+      while (m_size > size && !m_lru.empty())
+      {
+        auto it = m_entries.find(m_lru.back());
+        m_size -= entry_cost(it->first, it->second.body);
+        m_entries.erase(it);
+        m_lru.pop_back();
+        ++m_evictions;
+      }
+    }
+
+    epee::critical_section m_lock;
+    std::unordered_map<std::string, entry> m_entries;
+    std::list<std::string> m_lru;
+    size_t m_max_size;
+    size_t m_size;
+    uint64_t m_epoch;
+    uint64_t m_hits;
+    uint64_t m_misses;
+    uint64_t m_evictions;
+    uint64_t m_invalidations;
+  };
+}
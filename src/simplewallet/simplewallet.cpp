@@ -16,6 +16,7 @@
 #include "storages/http_abstract_invoke.h"
 #include "rpc/core_rpc_server_commands_defs.h"
 #include "wallet/wallet_rpc_server.h"
+#include "wallet/wallets_host_rpc_server.h"
 #include "crypto/mnemonic-encoding.h"
 #include "version.h"
 
@@ -45,6 +46,8 @@ namespace
   const command_line::arg_descriptor<int> arg_daemon_port = { "daemon-port", "Use daemon instance at port <arg> instead of default", 0 };
   const command_line::arg_descriptor<uint32_t> arg_log_level = { "set-log", "", 0, true };
   const command_line::arg_descriptor<bool> arg_offline_mode = { "offline-mode", "Don't connect to daemon, work offline (for cold-signing process)", false, true };
+  const command_line::arg_descriptor<std::string> arg_hosted_wallets_file = { "hosted-wallets-file", "Host many wallets in rpc mode, <arg> lists \"<wallet file> [<password>]\" per line, wallets are served at /wallet/<name>/json_rpc. "
+    "Passwords of lines without one are read from stdin, one per line in the same order. Passwords are kept in the file as plain text, so a file with them is loaded only if it isn't accessible to group and others", "", true };
 
   const command_line::arg_descriptor< std::vector<std::string> > arg_command = {"command", ""};
 
@@ -1583,6 +1586,98 @@ bool simple_wallet::sweep_below(const std::vector<std::string> &args)
   return true;
 }
 //----------------------------------------------------------------------------------------------------
+//----------------------------------------------------------------------------------------------------
+static int run_wallets_host(const po::variables_map& vm, const std::string& daemon_address)
+{
+  std::string list_file = command_line::get_arg(vm, arg_hosted_wallets_file);
+  std::string list_buff;
+  if (!file_io_utils::load_file_to_string(list_file, list_buff))
+  {
+    LOG_ERROR("Failed to read hosted wallets list: " << list_file);
+    return 1;
+  }
+
+  std::vector<std::string> lines;
+  boost::split(lines, list_buff, boost::is_any_of("\r\n"), boost::token_compress_on);
+  std::list<std::pair<std::string, std::string> > wallet_lines;
+  bool has_passwords = false;
+  for (auto& line : lines)
+  {
+    boost::trim(line);
+    if (line.empty() || line[0] == '#')
+      continue;
+    size_t sep = line.find_first_of(" \t");
+    wallet_lines.push_back(std::make_pair(line.substr(0, sep), sep == std::string::npos ? std::string() : boost::trim_copy(line.substr(sep))));
+    has_passwords |= !wallet_lines.back().second.empty();
+  }
+
+#ifndef WIN32
+  //plain text passwords are read only from a file nobody else can read
+  boost::system::error_code ec;
+  boost::filesystem::file_status st = boost::filesystem::status(list_file, ec);
+  if (has_passwords && (ec || (st.permissions() & (boost::filesystem::group_all | boost::filesystem::others_all))))
+  {
+    LOG_ERROR("Hosted wallets list " << list_file << " has passwords and is accessible to group or others, restrict it with \"chmod 600\" or move passwords to stdin");
+    return 1;
+  }
+#endif
+
+  tools::wallets_host host;
+  host.init(daemon_address);
+  for (auto& wl : wallet_lines)
+  {
+    const std::string& wallet_file = wl.first;
+    std::string name = boost::filesystem::path(wallet_file).stem().string();
+    tools::password_container pwd_container;
+    if (!wl.second.empty())
+    {
+      pwd_container.password(std::move(wl.second));
+    }
+    else
+    {
+      std::cout << "Wallet " << name << " ";
+      if (!pwd_container.read_password())
+      {
+        LOG_ERROR("Failed to read password of wallet " << wallet_file);
+        return 1;
+      }
+    }
+
+    std::shared_ptr<tools::wallet2> wal(new tools::wallet2());
+    try
+    {
+      LOG_PRINT_L0("Loading wallet " << name << "...");
+      wal->load(wallet_file, pwd_container.password());
+    }
+    catch (const std::exception& e)
+    {
+      LOG_ERROR("Wallet " << wallet_file << " initialize failed: " << e.what());
+      return 1;
+    }
+    if (!host.add_wallet(name, wal))
+      return 1;
+  }
+  LOG_PRINT_GREEN("Loaded " << host.get_wallets().size() << " wallets, synchronizing...", LOG_LEVEL_0);
+  size_t blocks_fetched = 0;
+  bool ok = false;
+  host.refresh(blocks_fetched, ok);
+
+  tools::wallets_host_rpc_server wrpc(host);
+  bool r = wrpc.init(vm);
+  CHECK_AND_ASSERT_MES(r, 1, "Failed to initialize wallets host rpc server");
+
+  tools::signal_handler::install([&wrpc, &host] {
+    host.stop();
+    wrpc.send_stop_signal();
+  });
+  LOG_PRINT_L0("Starting wallets host rpc server");
+  wrpc.run();
+  LOG_PRINT_L0("Stopped wallets host rpc server");
+  LOG_PRINT_L0("Storing wallets...");
+  host.store_all();
+  return 0;
+}
+//----------------------------------------------------------------------------------------------------
 int main(int argc, char* argv[])
 {
 #ifdef WIN32
@@ -1609,6 +1704,7 @@ int main(int argc, char* argv[])
   command_line::add_arg(desc_params, arg_command);
   command_line::add_arg(desc_params, arg_log_level);
   command_line::add_arg(desc_params, arg_offline_mode);
+  command_line::add_arg(desc_params, arg_hosted_wallets_file);
   tools::wallet_rpc_server::init_options(desc_params);
 
   po::positional_options_description positional_options;
@@ -1661,7 +1757,8 @@ int main(int argc, char* argv[])
   {
     log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL, LOG_LEVEL_2);
     //runs wallet with rpc interface 
-    if(!command_line::has_arg(vm, arg_wallet_file) )
+    bool hosting_mode = command_line::has_arg(vm, arg_hosted_wallets_file);
+    if(!hosting_mode && !command_line::has_arg(vm, arg_wallet_file) )
     {
       LOG_ERROR("Wallet file not set.");
       return 1;
@@ -1671,7 +1768,7 @@ int main(int argc, char* argv[])
       LOG_ERROR("Daemon address not set.");
       return 1;
     }
-    if(!command_line::has_arg(vm, arg_password) )
+    if(!hosting_mode && !command_line::has_arg(vm, arg_password) )
     {
       LOG_ERROR("Wallet password not set.");
       return 1;
@@ -1695,6 +1792,16 @@ int main(int argc, char* argv[])
     if (daemon_address.empty())
       daemon_address = std::string("http://") + daemon_host + ":" + std::to_string(daemon_port);
 
+    if (hosting_mode)
+    {
+      if (offline_mode)
+      {
+        LOG_ERROR("Wallets hosting mode can't work offline.");
+        return 1;
+      }
+      return run_wallets_host(vm, daemon_address);
+    }
+
     tools::wallet2 wal;
     try
     {
@@ -5,7 +5,7 @@
 
 #pragma once
 #include "include_base_utils.h"
-#include "net/http_client.h"
+#include "net/http_client_pool.h"
 #include "core_rpc_proxy.h"
 
 #define WALLET_RCP_CONNECTION_TIMEOUT                          200000
@@ -20,6 +20,7 @@ namespace tools
     bool call_COMMAND_RPC_GET_BLOCKS_FAST(const currency::COMMAND_RPC_GET_BLOCKS_FAST::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_FAST::response& rsp);
     bool call_COMMAND_RPC_GET_INFO(const currency::COMMAND_RPC_GET_INFO::request& rqt, currency::COMMAND_RPC_GET_INFO::response& rsp);
     bool call_COMMAND_RPC_GET_TX_POOL(const currency::COMMAND_RPC_GET_TX_POOL::request& rqt, currency::COMMAND_RPC_GET_TX_POOL::response& rsp);
+    bool call_COMMAND_RPC_GET_TX_POOL_CHANGES(const currency::COMMAND_RPC_GET_TX_POOL_CHANGES::request& rqt, currency::COMMAND_RPC_GET_TX_POOL_CHANGES::response& rsp);
     bool call_COMMAND_RPC_GET_ALIASES_BY_ADDRESS(const currency::COMMAND_RPC_GET_ALIASES_BY_ADDRESS::request& rqt, currency::COMMAND_RPC_GET_ALIASES_BY_ADDRESS::response& rsp);
     bool call_COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS(const currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& rqt, currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& rsp);
     bool call_COMMAND_RPC_SEND_RAW_TX(const currency::COMMAND_RPC_SEND_RAW_TX::request& rqt, currency::COMMAND_RPC_SEND_RAW_TX::response& rsp);
@@ -33,7 +34,8 @@ namespace tools
     bool check_connection();
     bool get_transfer_address(const std::string& adr_str, currency::account_public_address& addr, currency::payment_id_t& payment_id);
     
-    epee::net_utils::http::http_simple_client m_http_client;
+    //keep-alive connections, calls from different threads don't wait for each other
+    epee::net_utils::http::http_client_pool<> m_http_clients;
     std::string m_daemon_address;
 
   };
@@ -5,6 +5,8 @@
 
 #include <boost/archive/binary_oarchive.hpp>
 #include <boost/archive/binary_iarchive.hpp>
+#include <queue>
+#include <unordered_set>
 
 #include <boost/utility/value_init.hpp>
 #include "include_base_utils.h"
@@ -42,12 +44,16 @@ void fill_transfer_details(const currency::transaction& tx, const tools::money_t
 void wallet2::init(const std::string& daemon_address)
 {
   m_upper_transaction_size_limit = 0;
+  m_pool_version = 0;
+  m_pool_changes_unsupported = false;
   m_core_proxy->set_connection_addr(daemon_address);
 }
 //----------------------------------------------------------------------------------------------------
 bool wallet2::set_core_proxy(std::shared_ptr<i_core_proxy>& proxy)
 {
   m_core_proxy = proxy;
+  m_pool_version = 0;
+  m_pool_changes_unsupported = false;
   return true;
 }
 //----------------------------------------------------------------------------------------------------
@@ -56,7 +62,7 @@ std::shared_ptr<i_core_proxy> wallet2::get_core_proxy()
   return m_core_proxy;
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t height, const currency::block& b)
+void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t height, const currency::block& b, const std::vector<size_t>* found_outs)
 {
   std::string recipient, recipient_alias;
   process_unconfirmed(tx, recipient, recipient_alias);
@@ -66,8 +72,21 @@ void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t
   bool r = parse_and_validate_tx_extra(tx, tx_pub_key);
   CHECK_AND_THROW_WALLET_EX(!r, error::tx_extra_parse_error, tx);
 
-  r = lookup_acc_outs(m_account.get_keys(), tx, tx_pub_key, outs, tx_money_got_in_outs);
-  CHECK_AND_THROW_WALLET_EX(!r, error::acc_outs_lookup_error, tx, tx_pub_key, m_account.get_keys());
+  if (found_outs)
+  {
+    outs = *found_outs;
+    for (size_t o : outs)
+    {
+      CHECK_AND_THROW_WALLET_EX(tx.vout.size() <= o, error::wallet_internal_error, "wrong found out in transaction: internal index=" +
+        std::to_string(o) + ", total_outs=" + std::to_string(tx.vout.size()));
+      tx_money_got_in_outs += tx.vout[o].amount;
+    }
+  }
+  else
+  {
+    r = lookup_acc_outs(m_account.get_keys(), tx, tx_pub_key, outs, tx_money_got_in_outs);
+    CHECK_AND_THROW_WALLET_EX(!r, error::acc_outs_lookup_error, tx, tx_pub_key, m_account.get_keys());
+  }
 
   money_transfer2_details mtd;
 
@@ -123,6 +142,7 @@ void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t
       td.m_key_image = ki;
 
       m_key_images[td.m_key_image] = m_transfers.size()-1;
+      add_transfer_to_indices(m_transfers.size()-1);
       LOG_PRINT_L0("Received money: " << print_money(td.amount()) << ", with tx: " << get_transaction_hash(tx));
       if (0 != m_callback)
         m_callback->on_money_received(height, td.m_tx, td.m_internal_output_index);
@@ -142,7 +162,7 @@ void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t
       LOG_PRINT_L0("Spent money: " << print_money(boost::get<currency::txin_to_key>(in).amount) << ", with tx: " << get_transaction_hash(tx));
       tx_money_spent_in_ins += boost::get<currency::txin_to_key>(in).amount;
       transfer_details& td = m_transfers[it->second];
-      td.m_spent = true;
+      set_transfer_spent_flag(it->second, true);
       
       mtd.spent_indices.push_back(i);
 
@@ -163,7 +183,8 @@ void wallet2::process_new_transaction(const currency::transaction& tx, uint64_t
         payment.m_amount       = received;
         payment.m_block_height = height;
         payment.m_unlock_time  = tx.unlock_time;
-        m_payments.emplace(payment_id, payment);
+        auto pit = m_payments.emplace(payment_id, payment);
+        add_payment_to_index(payment_id, pit->second);
         LOG_PRINT_L2("Payment found: " << payment_id << " / " << payment.m_tx_hash << " / " << payment.m_amount);
       }
     }
@@ -210,6 +231,7 @@ void wallet2::handle_money_received2(const currency::block& b, const currency::t
   wallet_rpc::wallet_transfer_info& wti = m_transfer_history.back();
   prepare_wti(wti, get_block_height(b), b.timestamp, tx, amount, td);
   wti.is_income = true;
+  m_transfer_history_by_height.insert(std::make_pair(wti.height, m_transfer_history.size() - 1));
 
   if (m_callback)
     m_callback->on_transfer2(wti);
@@ -221,6 +243,7 @@ void wallet2::handle_money_spent2(const currency::block& b, const currency::tran
   wallet_rpc::wallet_transfer_info& wti = m_transfer_history.back();
   prepare_wti(wti, get_block_height(b), b.timestamp, in_tx, amount, td);
   wti.is_income = false;
+  m_transfer_history_by_height.insert(std::make_pair(wti.height, m_transfer_history.size() - 1));
   wti.destinations = recipient;
   wti.destination_alias = recipient_alias;
 
@@ -239,27 +262,29 @@ void wallet2::process_unconfirmed(const currency::transaction& tx, std::string&
   }
 }
 //----------------------------------------------------------------------------------------------------
-void wallet2::process_new_blockchain_entry(const currency::block& b, currency::block_complete_entry& bche, crypto::hash& bl_id, uint64_t height)
+bool wallet2::is_block_scanned(const currency::block& b) const
+{
+  //optimization: seeking only for blocks that are not older then the wallet creation time plus 1 day. 1 day is for possible user incorrect time setup
+  return b.timestamp + 60*60*24 > m_account.get_createtime();
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::process_new_blockchain_entry(const currency::block& b, const std::vector<currency::transaction>& txs, const crypto::hash& bl_id, uint64_t height, const block_found_outs* found_outs)
 {
   //handle transactions from new block
   CHECK_AND_THROW_WALLET_EX(height != m_blockchain.size(), error::wallet_internal_error,
     "current_index=" + std::to_string(height) + ", m_blockchain.size()=" + std::to_string(m_blockchain.size()));
 
-  //optimization: seeking only for blocks that are not older then the wallet creation time plus 1 day. 1 day is for possible user incorrect time setup
-  if(b.timestamp + 60*60*24 > m_account.get_createtime())
+  if(is_block_scanned(b))
   {
+    CHECK_AND_THROW_WALLET_EX(found_outs && found_outs->size() != txs.size() + 1, error::wallet_internal_error,
+      "found outs are given for " + std::to_string(found_outs->size()) + " transactions, block has " + std::to_string(txs.size() + 1));
     TIME_MEASURE_START(miner_tx_handle_time);
-    process_new_transaction(b.miner_tx, height, b);
+    process_new_transaction(b.miner_tx, height, b, found_outs ? &found_outs->front() : nullptr);
     TIME_MEASURE_FINISH(miner_tx_handle_time);
 
     TIME_MEASURE_START(txs_handle_time);
-    BOOST_FOREACH(auto& txblob, bche.txs)
-    {
-      currency::transaction tx;
-      bool r = parse_and_validate_tx_from_blob(txblob, tx);
-      CHECK_AND_THROW_WALLET_EX(!r, error::tx_parse_error, txblob);
-      process_new_transaction(tx, height, b);
-    }
+    for (size_t i = 0; i != txs.size(); ++i)
+      process_new_transaction(txs[i], height, b, found_outs ? &(*found_outs)[i + 1] : nullptr);
     TIME_MEASURE_FINISH(txs_handle_time);
     LOG_PRINT_L2("Processed block: " << bl_id << ", height " << height << ", " <<  miner_tx_handle_time + txs_handle_time << "(" << miner_tx_handle_time << "/" << txs_handle_time <<")ms");
   }else
@@ -268,6 +293,7 @@ void wallet2::process_new_blockchain_entry(const currency::block& b, currency::b
   }
   m_blockchain.push_back(bl_id);
   ++m_local_bc_height;
+  update_unlocked_transfers();
 
   if (0 != m_callback)
     m_callback->on_new_block(height, b);
@@ -310,41 +336,77 @@ void wallet2::pull_blocks(size_t& blocks_added)
   CHECK_AND_THROW_WALLET_EX(!r, error::no_connection_to_daemon, "getblocks.bin");
   CHECK_AND_THROW_WALLET_EX(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "getblocks.bin");
   CHECK_AND_THROW_WALLET_EX(res.status != CORE_RPC_STATUS_OK, error::get_blocks_error, res.status);
-  CHECK_AND_THROW_WALLET_EX(m_blockchain.size() <= res.start_height, error::wallet_internal_error,
-    "wrong daemon response: m_start_height=" + std::to_string(res.start_height) +
-    " not less than local blockchain size=" + std::to_string(m_blockchain.size()));
 
-  size_t current_index = res.start_height;
-  BOOST_FOREACH(auto& bl_entry, res.blocks)
+  std::vector<parsed_block_entry> blocks;
+  parse_blocks(res.blocks, blocks);
+  r = process_parsed_blocks(res.start_height, blocks, blocks_added);
+  CHECK_AND_THROW_WALLET_EX(!r, error::wallet_internal_error, "wrong daemon response: blocks starting from height " + std::to_string(res.start_height) +
+    " don't connect to local blockchain");
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::parse_blocks(const std::list<currency::block_complete_entry>& entries, std::vector<parsed_block_entry>& blocks)
+{
+  blocks.resize(entries.size());
+  size_t i = 0;
+  BOOST_FOREACH(auto& bl_entry, entries)
   {
-    currency::block bl;
-    r = currency::parse_and_validate_block_from_blob(bl_entry.block, bl);
+    parsed_block_entry& pbe = blocks[i++];
+    bool r = currency::parse_and_validate_block_from_blob(bl_entry.block, pbe.bl);
     CHECK_AND_THROW_WALLET_EX(!r, error::block_parse_error, bl_entry.block);
+    pbe.bl_id = get_block_hash(pbe.bl);
 
-    crypto::hash bl_id = get_block_hash(bl);
+    pbe.txs.resize(bl_entry.txs.size());
+    size_t j = 0;
+    BOOST_FOREACH(auto& txblob, bl_entry.txs)
+    {
+      r = parse_and_validate_tx_from_blob(txblob, pbe.txs[j++]);
+      CHECK_AND_THROW_WALLET_EX(!r, error::tx_parse_error, txblob);
+    }
+  }
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::process_parsed_blocks(uint64_t start_height, const std::vector<parsed_block_entry>& blocks, size_t& blocks_added, const std::vector<block_found_outs>* found_outs)
+{
+  blocks_added = 0;
+  CHECK_AND_THROW_WALLET_EX(found_outs && found_outs->size() != blocks.size(), error::wallet_internal_error,
+    "found outs are given for " + std::to_string(found_outs->size()) + " blocks, batch has " + std::to_string(blocks.size()));
+  CHECK_AND_THROW_WALLET_EX(m_blockchain.size() <= start_height, error::wallet_internal_error,
+    "wrong daemon response: m_start_height=" + std::to_string(start_height) +
+    " not less than local blockchain size=" + std::to_string(m_blockchain.size()));
+
+  //blocks fetched for another wallet may fork off deeper than our local chain can be fixed by detaching at start_height
+  if (!blocks.empty() && start_height != 0 && blocks.front().bl.prev_id != m_blockchain[start_height - 1])
+    return false;
+
+  size_t current_index = start_height;
+  for (size_t i = 0; i != blocks.size(); ++i)
+  {
+    const parsed_block_entry& pbe = blocks[i];
+    const block_found_outs* block_outs = found_outs ? &(*found_outs)[i] : nullptr;
     if(current_index >= m_blockchain.size())
     {
-      process_new_blockchain_entry(bl, bl_entry, bl_id, current_index);
+      process_new_blockchain_entry(pbe.bl, pbe.txs, pbe.bl_id, current_index, block_outs);
       ++blocks_added;
     }
-    else if(bl_id != m_blockchain[current_index])
+    else if(pbe.bl_id != m_blockchain[current_index])
     {
       //split detected here !!!
-      CHECK_AND_THROW_WALLET_EX(current_index == res.start_height, error::wallet_internal_error,
-        "wrong daemon response: split starts from the first block in response " + string_tools::pod_to_hex(bl_id) + 
-        " (height " + std::to_string(res.start_height) + "), local block id at this height: " +
+      CHECK_AND_THROW_WALLET_EX(current_index == start_height, error::wallet_internal_error,
+        "wrong daemon response: split starts from the first block in response " + string_tools::pod_to_hex(pbe.bl_id) + 
+        " (height " + std::to_string(start_height) + "), local block id at this height: " +
         string_tools::pod_to_hex(m_blockchain[current_index]));
 
       detach_blockchain(current_index);
-      process_new_blockchain_entry(bl, bl_entry, bl_id, current_index);
+      process_new_blockchain_entry(pbe.bl, pbe.txs, pbe.bl_id, current_index, block_outs);
     }
     else
     {
-      LOG_PRINT_L2("Block " << bl_id << " @ " << current_index << " is already in wallet's blockchain");
+      LOG_PRINT_L2("Block " << pbe.bl_id << " @ " << current_index << " is already in wallet's blockchain");
     }
 
     ++current_index;
   }
+  return true;
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::refresh()
@@ -397,6 +459,47 @@ void wallet2::update_current_tx_limit()
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::scan_tx_pool()
+{
+  if (m_pool_changes_unsupported)
+  {
+    scan_whole_tx_pool();
+    return;
+  }
+
+  //get only pool changes since previous scan
+  currency::COMMAND_RPC_GET_TX_POOL_CHANGES::request req = AUTO_VAL_INIT(req);
+  currency::COMMAND_RPC_GET_TX_POOL_CHANGES::response res = AUTO_VAL_INIT(res);
+  req.since_version = m_pool_version;
+  req.include_txs = true;
+  bool r = m_core_proxy->call_COMMAND_RPC_GET_TX_POOL_CHANGES(req, res);
+  if (!r)
+  {
+    //daemon may be too old to have get_tx_pool_changes.bin
+    LOG_PRINT_L1("get_tx_pool_changes failed, requesting whole pool");
+    scan_whole_tx_pool();
+    //daemon is reachable, so it's the endpoint that is missing: don't ask for it again
+    LOG_PRINT_L0("Daemon doesn't support get_tx_pool_changes, whole pool will be requested on every refresh");
+    m_pool_changes_unsupported = true;
+    return;
+  }
+  CHECK_AND_THROW_WALLET_EX(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "get_tx_pool_changes");
+  CHECK_AND_THROW_WALLET_EX(res.status != CORE_RPC_STATUS_OK, error::get_blocks_error, res.status);
+
+  std::unordered_map<crypto::hash, wallet_rpc::wallet_transfer_info> unconfirmed_in_transfers_local;
+  if (res.full_sync)
+    unconfirmed_in_transfers_local = std::move(m_unconfirmed_in_transfers);
+  else
+  {
+    for (const auto& id : res.removed_ids)
+      m_unconfirmed_in_transfers.erase(id);
+  }
+  for (const auto &tx_blob : res.added_txs)
+    process_pool_transaction(tx_blob, unconfirmed_in_transfers_local);
+  update_unconfirmed_balance();
+  m_pool_version = res.version;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::scan_whole_tx_pool()
 {
   //get transaction pool content 
   currency::COMMAND_RPC_GET_TX_POOL::request req = AUTO_VAL_INIT(req);
@@ -407,53 +510,66 @@ void wallet2::scan_tx_pool()
   CHECK_AND_THROW_WALLET_EX(res.status != CORE_RPC_STATUS_OK, error::get_blocks_error, res.status);
   
   std::unordered_map<crypto::hash, wallet_rpc::wallet_transfer_info> unconfirmed_in_transfers_local(std::move(m_unconfirmed_in_transfers));
-  m_unconfirmed_balance = 0;
   for (const auto &tx_blob : res.txs)
+    process_pool_transaction(tx_blob, unconfirmed_in_transfers_local);
+  update_unconfirmed_balance();
+  m_pool_version = 0;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::update_unconfirmed_balance()
+{
+  //delta scans keep transfers seen earlier, so balance is counted over all of them
+  m_unconfirmed_balance = 0;
+  for (const auto& tr : m_unconfirmed_in_transfers)
+    m_unconfirmed_balance += tr.second.amount;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::process_pool_transaction(const currency::blobdata& tx_blob, std::unordered_map<crypto::hash, wallet_rpc::wallet_transfer_info>& unconfirmed_in_transfers_local)
+{
+  currency::transaction tx;
+  bool r = parse_and_validate_tx_from_blob(tx_blob, tx);
+  CHECK_AND_THROW_WALLET_EX(!r, error::tx_parse_error, tx_blob);
+  crypto::hash tx_hash = currency::get_transaction_hash(tx);
+  auto it = unconfirmed_in_transfers_local.find(tx_hash);
+  if (it != unconfirmed_in_transfers_local.end())
   {
-    currency::transaction tx;
-    bool r = parse_and_validate_tx_from_blob(tx_blob, tx);
-    CHECK_AND_THROW_WALLET_EX(!r, error::tx_parse_error, tx_blob);
-    crypto::hash tx_hash = currency::get_transaction_hash(tx);
-    auto it = unconfirmed_in_transfers_local.find(tx_hash);
-    if (it != unconfirmed_in_transfers_local.end())
-    {
-      m_unconfirmed_in_transfers.insert(*it);
-      continue;
-    }
+    m_unconfirmed_in_transfers.insert(*it);
+    return;
+  }
+  if (m_unconfirmed_in_transfers.count(tx_hash))
+    return;
 
-    // read extra
-    std::vector<size_t> outs;
-    uint64_t tx_money_got_in_outs = 0;
-    crypto::public_key tx_pub_key = null_pkey;
-    r = parse_and_validate_tx_extra(tx, tx_pub_key);
-    CHECK_AND_THROW_WALLET_EX(!r, error::tx_extra_parse_error, tx);
-    //check if we have money
-    r = lookup_acc_outs(m_account.get_keys(), tx, tx_pub_key, outs, tx_money_got_in_outs);
-    CHECK_AND_THROW_WALLET_EX(!r, error::acc_outs_lookup_error, tx, tx_pub_key, m_account.get_keys());
-    //check if we have spendings
-    uint64_t tx_money_spent_in_ins = 0;
-    // check all outputs for spending (compare key images)
-    for(auto& in: tx.vin)
-    {
-      if (in.type() != typeid(currency::txin_to_key))
-        continue;
-      if(m_key_images.count(boost::get<currency::txin_to_key>(in).k_image))
-        tx_money_spent_in_ins += boost::get<currency::txin_to_key>(in).amount;
-    }
+  // read extra
+  std::vector<size_t> outs;
+  uint64_t tx_money_got_in_outs = 0;
+  crypto::public_key tx_pub_key = null_pkey;
+  r = parse_and_validate_tx_extra(tx, tx_pub_key);
+  CHECK_AND_THROW_WALLET_EX(!r, error::tx_extra_parse_error, tx);
+  //check if we have money
+  r = lookup_acc_outs(m_account.get_keys(), tx, tx_pub_key, outs, tx_money_got_in_outs);
+  CHECK_AND_THROW_WALLET_EX(!r, error::acc_outs_lookup_error, tx, tx_pub_key, m_account.get_keys());
+  //check if we have spendings
+  uint64_t tx_money_spent_in_ins = 0;
+  // check all outputs for spending (compare key images)
+  for(auto& in: tx.vin)
+  {
+    if (in.type() != typeid(currency::txin_to_key))
+      continue;
+    if(m_key_images.count(boost::get<currency::txin_to_key>(in).k_image))
+      tx_money_spent_in_ins += boost::get<currency::txin_to_key>(in).amount;
+  }
 
-    if (!tx_money_spent_in_ins && tx_money_got_in_outs)
-    {
-      //prepare notification about pending transaction
-      wallet_rpc::wallet_transfer_info wti = AUTO_VAL_INIT(wti);
-      wti.timestamp = time(NULL);
-      wti.is_income = true;
-      wti.tx = tx;
-      prepare_wti(wti, 0, 0, tx, tx_money_got_in_outs, money_transfer2_details());
-      m_unconfirmed_in_transfers[tx_hash] = wti;
-      m_unconfirmed_balance += wti.amount;
-      if (m_callback)
-        m_callback->on_transfer2(wti);
-    }
+  if (!tx_money_spent_in_ins && tx_money_got_in_outs)
+  {
+    //prepare notification about pending transaction
+    wallet_rpc::wallet_transfer_info wti = AUTO_VAL_INIT(wti);
+    wti.timestamp = time(NULL);
+    wti.is_income = true;
+    wti.tx = tx;
+    prepare_wti(wti, 0, 0, tx, tx_money_got_in_outs, money_transfer2_details());
+    m_unconfirmed_in_transfers[tx_hash] = wti;
+    if (m_callback)
+      m_callback->on_transfer2(wti);
   }
 }
 //----------------------------------------------------------------------------------------------------
@@ -558,6 +674,8 @@ void wallet2::detach_blockchain(uint64_t height)
       ++it;
   }
 
+  rebuild_indices();
+
   LOG_PRINT_L0("Detached blockchain on height " << height << ", transfers detached " << transfers_detached << ", blocks detached " << blocks_detached);
 }
 //----------------------------------------------------------------------------------------------------
@@ -575,11 +693,13 @@ bool wallet2::clear()
   m_key_images.clear();
   m_transfer_history.clear();
   m_unconfirmed_in_transfers.clear();
+  m_pool_version = 0;
   // m_tx_keys is not cleared intentionally, considered to be safe
   currency::block b;
   currency::generate_genesis_block(b);
   m_blockchain.push_back(get_block_hash(b));
   m_local_bc_height = 1;
+  rebuild_indices();
   return true;
 }
 //----------------------------------------------------------------------------------------------------
@@ -766,6 +886,7 @@ void wallet2::load(const std::string& wallet_, const std::string& password)
     clear();
   }
   m_local_bc_height = m_blockchain.size();
+  rebuild_indices();
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::store()
@@ -776,12 +897,8 @@ void wallet2::store()
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::unlocked_balance()
 {
-  uint64_t amount = 0;
-  BOOST_FOREACH(transfer_details& td, m_transfers)
-    if(!td.m_spent && is_transfer_unlocked(td))
-      amount += td.amount();
-
-  return amount;
+  update_unlocked_transfers();
+  return m_balance_unlocked;
 }
 //----------------------------------------------------------------------------------------------------
 int64_t wallet2::unconfirmed_balance()
@@ -793,11 +910,7 @@ int64_t wallet2::unconfirmed_balance()
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::balance()
 {
-  uint64_t amount = 0;
-  BOOST_FOREACH(auto& td, m_transfers)
-    if(!td.m_spent)
-      amount += td.amount();
-
+  uint64_t amount = m_balance_unspent;
 
   BOOST_FOREACH(auto& utx, m_unconfirmed_txs)
     amount+= utx.second.m_change;
@@ -812,38 +925,33 @@ void wallet2::get_transfers(wallet2::transfer_container& incoming_transfers) con
 //----------------------------------------------------------------------------------------------------
 bool wallet2::get_transfers(const wallet_rpc::COMMAND_RPC_GET_TRANSFERS::request& req, wallet_rpc::COMMAND_RPC_GET_TRANSFERS::response& res) const 
 {
-  uint64_t tr_count = m_transfer_history.size();
-  if (!tr_count)
-    return true;
-  uint64_t i = tr_count;
-
-  do
+  auto add_transfer = [&](const wallet_rpc::wallet_transfer_info& thi)
   {
-    --i;
-    const wallet_rpc::wallet_transfer_info& thi = m_transfer_history[i];
+    if (thi.is_income && req.in)
+      res.in.push_back(thi);
+    if (!thi.is_income && req.out)
+      res.out.push_back(thi);
+  };
 
-    // handle filter_by_height
-    if (req.filter_by_height)
+  if (req.filter_by_height)
+  {
+    //walk the height index backwards to keep newest-first order, unconfirmed (zero height) entries are skipped
+    if (req.min_height <= req.max_height)
     {
-      if (!thi.height) // unconfirmed
-        continue;
-
-      if (thi.height < req.min_height)
+      auto it_begin = m_transfer_history_by_height.lower_bound(std::max<uint64_t>(req.min_height, 1));
+      auto it = m_transfer_history_by_height.upper_bound(req.max_height);
+      while (it != it_begin)
       {
-        //no need to scan more
-        break;
-      }
-      if (thi.height > req.max_height)
-      {
-        continue;
+        --it;
+        add_transfer(m_transfer_history[it->second]);
       }
     }
-    
-    if (thi.is_income && req.in)
-      res.in.push_back(thi);
-    if (!thi.is_income && req.out)
-      res.out.push_back(thi);   
-  } while (i != 0);
+  }
+  else
+  {
+    for (auto it = m_transfer_history.rbegin(); it != m_transfer_history.rend(); ++it)
+      add_transfer(*it);
+  }
 
   if (req.pool)
   {
@@ -866,13 +974,83 @@ bool wallet2::get_transfers(const wallet_rpc::COMMAND_RPC_GET_TRANSFERS::request
 //----------------------------------------------------------------------------------------------------
 void wallet2::get_payments(const payment_id_t& payment_id, std::list<wallet2::payment_details>& payments, uint64_t min_height) const
 {
-  auto range = m_payments.equal_range(payment_id);
-  std::for_each(range.first, range.second, [&payments, &min_height](const payment_container::value_type& x) {
-    if (min_height < x.second.m_block_height)
-    {
-      payments.push_back(x.second);
-    }
-  });
+  auto it = m_payments_by_height.find(payment_id);
+  if (it == m_payments_by_height.end())
+    return;
+
+  payment_order_key min_key = AUTO_VAL_INIT(min_key);
+  min_key.height = min_height;
+  for (auto pit = it->second.lower_bound(min_key); pit != it->second.end(); ++pit)
+  {
+    if (min_height < pit->first.height)
+      payments.push_back(*pit->second);
+  }
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::get_payments_page(const std::vector<currency::payment_id_t>& payment_ids, uint64_t min_height, const payments_page_cursor* start_after, size_t count, std::list<std::pair<currency::payment_id_t, payment_details> >& payments, payments_page_cursor& next) const
+{
+  //payments at and below the detach height may be different now, skipping them by a stale cursor would lose the new ones
+  CHECK_AND_THROW_WALLET_EX(start_after && !is_payments_cursor_valid(*start_after), error::wallet_common_error,
+    "payments cursor at height " + std::to_string(start_after->key.height) + " is not on the wallet's chain anymore");
+  typedef std::map<payment_order_key, const payment_details*>::const_iterator index_iterator;
+  struct payments_cursor
+  {
+    const currency::payment_id_t* payment_id;
+    index_iterator it;
+    index_iterator end;
+  };
+
+  //position a cursor on every requested payment id index
+  std::vector<payments_cursor> cursors;
+  std::unordered_set<currency::payment_id_t> seen_ids;
+  payment_order_key min_key = AUTO_VAL_INIT(min_key);
+  min_key.height = min_height;
+  for (const auto& pid : payment_ids)
+  {
+    if (!seen_ids.insert(pid).second)
+      continue;
+    auto idx_it = m_payments_by_height.find(pid);
+    if (idx_it == m_payments_by_height.end())
+      continue;
+
+    payments_cursor c = AUTO_VAL_INIT(c);
+    c.payment_id = &idx_it->first;
+    c.end = idx_it->second.end();
+    c.it = idx_it->second.lower_bound(min_key);
+    if (start_after && min_key < start_after->key)
+      c.it = idx_it->second.upper_bound(start_after->key);
+    while (c.it != c.end && c.it->first.height <= min_height)
+      ++c.it;
+    if (c.it != c.end)
+      cursors.push_back(c);
+  }
+
+  //k-way merge by (height, tx hash)
+  auto cursor_greater = [&cursors](size_t a, size_t b) { return cursors[b].it->first < cursors[a].it->first; };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(cursor_greater)> heap(cursor_greater);
+  for (size_t i = 0; i != cursors.size(); ++i)
+    heap.push(i);
+
+  next = payments_page_cursor();
+  if (start_after)
+    next = *start_after;
+  while (!heap.empty() && payments.size() < count)
+  {
+    size_t i = heap.top();
+    heap.pop();
+    payments.push_back(std::make_pair(*cursors[i].payment_id, *cursors[i].it->second));
+    next.key = cursors[i].it->first;
+    next.block_hash = m_blockchain[next.key.height];
+    if (++cursors[i].it != cursors[i].end)
+      heap.push(i);
+  }
+
+  return !heap.empty();
+}
+//----------------------------------------------------------------------------------------------------
+bool wallet2::is_payments_cursor_valid(const payments_page_cursor& cursor) const
+{
+  return cursor.key.height < m_blockchain.size() && m_blockchain[cursor.key.height] == cursor.block_hash;
 }
 //----------------------------------------------------------------------------------------------------
 void wallet2::sign_transfer(const std::string& tx_sources_blob, std::string& signed_tx_blob, currency::transaction& tx)
@@ -977,13 +1155,13 @@ void wallet2::finalize_transaction(const currency::create_tx_arg& create_tx_para
     {
       //unlock funds if transaction rejected
       for (auto& s : create_tx_param.sources)
-        m_transfers[s.transfer_index].m_spent = false;
+        set_transfer_spent_flag(s.transfer_index, false);
     }
     else
     {
       //unlock funds if transaction rejected
       for (auto& s : create_tx_param.sources)
-        m_transfers[s.transfer_index].m_spent = true;
+        set_transfer_spent_flag(s.transfer_index, true);
     }
     CHECK_AND_THROW_WALLET_EX(!r, error::no_connection_to_daemon, "sendrawtransaction");
     CHECK_AND_THROW_WALLET_EX(daemon_send_resp.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "sendrawtransaction");
@@ -993,7 +1171,7 @@ void wallet2::finalize_transaction(const currency::create_tx_arg& create_tx_para
   {
     //unlock funds if transaction rejected
     for (auto& s : create_tx_param.sources)
-      m_transfers[s.transfer_index].m_spent = true;
+      set_transfer_spent_flag(s.transfer_index, true);
   }
 
   std::string recipient;
@@ -1064,6 +1242,143 @@ bool wallet2::is_transfer_unlocked(const transfer_details& td) const
   return true;
 }
 //----------------------------------------------------------------------------------------------------
+uint64_t wallet2::get_transfer_unlock_blockchain_size(const transfer_details& td) const
+{
+  //height-based counterpart of is_transfer_unlocked(): transfer becomes spendable when m_blockchain.size() reaches returned value
+  uint64_t unlock_size = td.m_block_height + DEFAULT_TX_SPENDABLE_AGE;
+  if (td.m_tx.unlock_time + 1 > CURRENCY_LOCKED_TX_ALLOWED_DELTA_BLOCKS)
+    unlock_size = std::max<uint64_t>(unlock_size, td.m_tx.unlock_time + 1 - CURRENCY_LOCKED_TX_ALLOWED_DELTA_BLOCKS);
+  return unlock_size;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::add_transfer_to_indices(size_t transfer_index)
+{
+  transfer_details& td = m_transfers[transfer_index];
+  td.m_unlocked = false;
+  if (!td.m_spent)
+  {
+    m_unspent_transfers.insert(transfer_index);
+    m_balance_unspent += td.amount();
+  }
+
+  if (td.m_tx.unlock_time >= CURRENCY_MAX_BLOCK_NUMBER)
+  {
+    //time-based unlock can't be indexed by height, such transfers are rare and checked in update_unlocked_transfers()
+    m_time_locked_transfers.insert(transfer_index);
+    return;
+  }
+
+  uint64_t unlock_size = get_transfer_unlock_blockchain_size(td);
+  if (unlock_size <= m_blockchain.size())
+    set_transfer_unlocked(transfer_index);
+  else
+    m_height_locked_transfers.insert(std::make_pair(unlock_size, transfer_index));
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::set_transfer_unlocked(size_t transfer_index)
+{
+  transfer_details& td = m_transfers[transfer_index];
+  td.m_unlocked = true;
+  if (!td.m_spent)
+  {
+    m_balance_unlocked += td.amount();
+    m_free_transfers_by_amount[td.amount()].insert(transfer_index);
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::set_transfer_spent_flag(size_t transfer_index, bool spent)
+{
+  CHECK_AND_THROW_WALLET_EX(transfer_index >= m_transfers.size(), error::wallet_internal_error, "invalid transfer index: " + std::to_string(transfer_index) +
+    ", m_transfers.size() = " + std::to_string(m_transfers.size()));
+  transfer_details& td = m_transfers[transfer_index];
+  if (td.m_spent == spent)
+    return;
+
+  td.m_spent = spent;
+  uint64_t amount = td.amount();
+  if (spent)
+  {
+    m_unspent_transfers.erase(transfer_index);
+    m_balance_unspent -= amount;
+    if (td.m_unlocked)
+    {
+      m_balance_unlocked -= amount;
+      auto it = m_free_transfers_by_amount.find(amount);
+      if (it != m_free_transfers_by_amount.end())
+      {
+        it->second.erase(transfer_index);
+        if (it->second.empty())
+          m_free_transfers_by_amount.erase(it);
+      }
+    }
+  }
+  else
+  {
+    m_unspent_transfers.insert(transfer_index);
+    m_balance_unspent += amount;
+    if (td.m_unlocked)
+    {
+      m_balance_unlocked += amount;
+      m_free_transfers_by_amount[amount].insert(transfer_index);
+    }
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::update_unlocked_transfers()
+{
+  uint64_t blockchain_size = m_blockchain.size();
+  while (!m_height_locked_transfers.empty() && m_height_locked_transfers.begin()->first <= blockchain_size)
+  {
+    set_transfer_unlocked(m_height_locked_transfers.begin()->second);
+    m_height_locked_transfers.erase(m_height_locked_transfers.begin());
+  }
+
+  for (auto it = m_time_locked_transfers.begin(); it != m_time_locked_transfers.end(); )
+  {
+    if (is_transfer_unlocked(m_transfers[*it]))
+    {
+      set_transfer_unlocked(*it);
+      it = m_time_locked_transfers.erase(it);
+    }
+    else
+    {
+      ++it;
+    }
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::add_payment_to_index(const currency::payment_id_t& payment_id, const payment_details& payment)
+{
+  payment_order_key key = AUTO_VAL_INIT(key);
+  key.height = payment.m_block_height;
+  key.tx_hash = payment.m_tx_hash;
+  key.index = 0;
+  auto& index = m_payments_by_height[payment_id];
+  while (!index.emplace(key, &payment).second)
+    ++key.index;
+}
+//----------------------------------------------------------------------------------------------------
+void wallet2::rebuild_indices()
+{
+  m_balance_unspent = 0;
+  m_balance_unlocked = 0;
+  m_unspent_transfers.clear();
+  m_height_locked_transfers.clear();
+  m_time_locked_transfers.clear();
+  m_free_transfers_by_amount.clear();
+  for (size_t i = 0; i != m_transfers.size(); ++i)
+    add_transfer_to_indices(i);
+  update_unlocked_transfers();
+
+  m_payments_by_height.clear();
+  for (const auto& p : m_payments)
+    add_payment_to_index(p.first, p.second);
+
+  m_transfer_history_by_height.clear();
+  for (size_t i = 0; i != m_transfer_history.size(); ++i)
+    m_transfer_history_by_height.insert(std::make_pair(m_transfer_history[i].height, i));
+}
+//----------------------------------------------------------------------------------------------------
 bool wallet2::is_tx_spendtime_unlocked(uint64_t unlock_time) const
 {
   if(unlock_time < CURRENCY_MAX_BLOCK_NUMBER)
@@ -1153,37 +1468,32 @@ uint64_t wallet2::select_indices_for_transfer(std::list<size_t>& selected_indexe
 //----------------------------------------------------------------------------------------------------
 uint64_t wallet2::select_transfers(uint64_t needed_money, size_t fake_outputs_count, uint64_t dust, const std::vector<size_t>& outs_to_spend, std::list<transfer_container::iterator>& selected_transfers)
 {
-  std::map<uint64_t, std::list<size_t> > found_free_amounts;
+  update_unlocked_transfers();
+  auto is_mixattr_applicable = [&](size_t i)
+  {
+    const transfer_details& td = m_transfers[i];
+    return currency::is_mixattr_applicable_for_fake_outs_counter(boost::get<currency::txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).mix_attr, fake_outputs_count);
+  };
 
-  std::vector<size_t> outs_indices_allowed_to_be_spent;
-  outs_indices_allowed_to_be_spent.reserve(m_transfers.size());
+  std::list<size_t> selected_indexes;
+  uint64_t found_money = 0;
   if (outs_to_spend.empty())
   {
     // if outs_to_spend is empty -- it means all outs are allowed to be spent
-    for (size_t i = 0; i < m_transfers.size(); ++i)
-      outs_indices_allowed_to_be_spent.push_back(i);
+    found_money = select_indices_from_free_index(selected_indexes, m_free_transfers_by_amount, needed_money, is_mixattr_applicable);
   }
   else
   {
+    std::map<uint64_t, std::list<size_t> > found_free_amounts;
     for (size_t idx : outs_to_spend)
     {
       CHECK_AND_THROW_WALLET_EX(!(idx < m_transfers.size()), error::wallet_common_error, std::string("invalid output index given: ") + std::to_string(idx));
-      outs_indices_allowed_to_be_spent.push_back(idx);
-    }
-  }
-
-  for (size_t i : outs_indices_allowed_to_be_spent)
-  {
-    const transfer_details& td = m_transfers[i];
-    if (!td.m_spent && is_transfer_unlocked(td) && 
-      currency::is_mixattr_applicable_for_fake_outs_counter(boost::get<currency::txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).mix_attr, fake_outputs_count))
-    {
-      found_free_amounts[td.m_tx.vout[td.m_internal_output_index].amount].push_back(i);
+      const transfer_details& td = m_transfers[idx];
+      if (!td.m_spent && td.m_unlocked && is_mixattr_applicable(idx))
+        found_free_amounts[td.amount()].push_back(idx);
     }
+    found_money = select_indices_for_transfer(selected_indexes, found_free_amounts, needed_money);
   }
-
-  std::list<size_t> selected_indexes;
-  uint64_t found_money = select_indices_for_transfer(selected_indexes, found_free_amounts, needed_money);
   for(auto i: selected_indexes)
     selected_transfers.push_back(m_transfers.begin() + i);
   
@@ -1291,7 +1601,20 @@ std::string wallet2::get_transfers_str(bool include_spent /*= true*/, bool inclu
   ss << header << ENDL;
   if (!m_transfers.empty())
   {
-    for (size_t i = 0; i != m_transfers.size(); ++i)
+    //unspent-only listing is served from the index instead of the whole m_transfers
+    std::vector<size_t> indices;
+    if (include_spent)
+    {
+      indices.reserve(m_transfers.size());
+      for (size_t i = 0; i != m_transfers.size(); ++i)
+        indices.push_back(i);
+    }
+    else
+    {
+      indices.assign(m_unspent_transfers.begin(), m_unspent_transfers.end());
+    }
+
+    for (size_t i : indices)
     {
       const transfer_details& td = m_transfers[i];
 
@@ -1324,21 +1647,23 @@ void wallet2::sweep_below(size_t fake_outs_count, const currency::account_public
   amount_total = 0;
   outs_swept = 0;
   
+  update_unlocked_transfers();
   std::vector<size_t> selected_transfers;
-  selected_transfers.reserve(m_transfers.size());
-  for (size_t i = 0; i < m_transfers.size(); ++i)
+  for (auto it = m_free_transfers_by_amount.begin(); it != m_free_transfers_by_amount.end() && it->first < threshold_amount; ++it)
   {
-    const transfer_details& td = m_transfers[i];
-    uint64_t amount = td.amount();
-    if (!td.m_spent && is_transfer_unlocked(td) &&
-      amount < threshold_amount &&
-      currency::is_mixattr_applicable_for_fake_outs_counter(boost::get<currency::txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).mix_attr, fake_outs_count))
+    for (size_t i : it->second)
     {
-      selected_transfers.push_back(i);
-      outs_total += 1;
-      amount_total += amount;
+      const transfer_details& td = m_transfers[i];
+      if (currency::is_mixattr_applicable_for_fake_outs_counter(boost::get<currency::txout_to_key>(td.m_tx.vout[td.m_internal_output_index].target).mix_attr, fake_outs_count))
+      {
+        selected_transfers.push_back(i);
+        outs_total += 1;
+        amount_total += it->first;
+      }
     }
   }
+  // keep the oldest outputs first, as if m_transfers were scanned in order
+  std::sort(selected_transfers.begin(), selected_transfers.end());
 
   CHECK_AND_THROW_WALLET_EX(selected_transfers.empty(), error::wallet_common_error, "No spendable outputs meet the criterion");
 
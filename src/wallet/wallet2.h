@@ -8,6 +8,8 @@
 #include <boost/serialization/list.hpp>
 #include <boost/serialization/vector.hpp>
 #include <atomic>
+#include <set>
+#include <map>
 
 #include "include_base_utils.h"
 
@@ -46,6 +48,17 @@ namespace tools
 
     
 
+  //block with already parsed transactions, lets several wallets share one download and parse (see wallets_host)
+  struct parsed_block_entry
+  {
+    currency::block bl;
+    crypto::hash bl_id;
+    std::vector<currency::transaction> txs;
+  };
+
+  //wallet's outputs in one parsed block, miner tx first, found in advance by a pass shared with other wallets (see wallets_host)
+  typedef std::vector<std::vector<size_t> > block_found_outs;
+
   struct tx_dust_policy
   {
     uint64_t dust_threshold;
@@ -62,9 +75,9 @@ namespace tools
 
   class wallet2
   {
-    wallet2(const wallet2&) : m_run(true), m_is_view_only(false), m_callback(0), m_unconfirmed_balance(0) {};
+    wallet2(const wallet2&) : m_run(true), m_is_view_only(false), m_callback(0), m_unconfirmed_balance(0), m_pool_version(0), m_pool_changes_unsupported(false), m_balance_unspent(0), m_balance_unlocked(0) {};
   public:
-    wallet2() : m_run(true), m_callback(0), m_is_view_only(false), m_core_proxy(new default_http_core_proxy()), m_unconfirmed_balance(0)
+    wallet2() : m_run(true), m_callback(0), m_is_view_only(false), m_core_proxy(new default_http_core_proxy()), m_unconfirmed_balance(0), m_pool_version(0), m_pool_changes_unsupported(false), m_balance_unspent(0), m_balance_unlocked(0)
     {};
     struct transfer_details
     {
@@ -74,6 +87,7 @@ namespace tools
       uint64_t m_global_output_index;
       bool m_spent;
       crypto::key_image m_key_image; //TODO: key_image stored twice :(
+      bool m_unlocked; // runtime only, not serialized: transfer is counted in m_balance_unlocked (if not spent)
 
       uint64_t amount() const
       {
@@ -103,7 +117,33 @@ namespace tools
     
     typedef std::unordered_multimap<currency::payment_id_t, payment_details> payment_container;
 
+    //stable ordering of payments used for paginated queries
+    struct payment_order_key
+    {
+      uint64_t height;
+      crypto::hash tx_hash;
+      uint64_t index; //tells apart entries of one tx, if it got into m_payments more than once
+
+      bool operator<(const payment_order_key& other) const
+      {
+        if (height != other.height)
+          return height < other.height;
+        int r = std::memcmp(&tx_hash, &other.tx_hash, sizeof(tx_hash));
+        if (r)
+          return r < 0;
+        return index < other.index;
+      }
+    };
+
+    //position after the last payment of a page, block_hash tells if it's still on the wallet's chain
+    struct payments_page_cursor
+    {
+      payment_order_key key;
+      crypto::hash block_hash;
+    };
+
     typedef std::vector<transfer_details> transfer_container;
+    typedef std::map<uint64_t, std::set<size_t> > free_transfers_index; // amount -> indices of unspent unlocked transfers
 
     struct keys_file_data
     {
@@ -139,6 +179,11 @@ namespace tools
     void refresh(size_t & blocks_fetched);
     void refresh(size_t & blocks_fetched, bool& received_money);
     bool refresh(size_t & blocks_fetched, bool& received_money, bool& ok);
+    bool process_parsed_blocks(uint64_t start_height, const std::vector<parsed_block_entry>& blocks, size_t& blocks_added, const std::vector<block_found_outs>* found_outs = nullptr);
+    bool is_block_scanned(const currency::block& b) const;
+    static void parse_blocks(const std::list<currency::block_complete_entry>& entries, std::vector<parsed_block_entry>& blocks);
+    void get_short_chain_history(std::list<crypto::hash>& ids);
+    void resend_unconfirmed();
 
     void sign_transfer(const std::string& tx_sources_blob, std::string& signed_tx_blob, currency::transaction& tx);
     void sign_transfer_files(const std::string& tx_sources_file, const std::string& signed_tx_file, currency::transaction& tx);
@@ -175,6 +220,10 @@ namespace tools
     bool get_transfers(const wallet_rpc::COMMAND_RPC_GET_TRANSFERS::request& req, wallet_rpc::COMMAND_RPC_GET_TRANSFERS::response& res) const;
     std::string get_transfers_str(bool include_spent = true, bool include_unspent = true) const;
     void get_payments(const currency::payment_id_t& payment_id, std::list<payment_details>& payments, uint64_t min_height = 0) const;
+    //returns true if there are more payments after the page; next is the cursor after its last payment, start_after (if any) for an empty page
+    bool get_payments_page(const std::vector<currency::payment_id_t>& payment_ids, uint64_t min_height, const payments_page_cursor* start_after, size_t count, std::list<std::pair<currency::payment_id_t, payment_details> >& payments, payments_page_cursor& next) const;
+    //false once the cursor's block is detached, paging has to start over then
+    bool is_payments_cursor_valid(const payments_page_cursor& cursor) const;
     bool get_transfer_address(const std::string& adr_str, currency::account_public_address& addr, currency::payment_id_t& payment_id);
     bool store_keys(const std::string& keys_file_name, const std::string& password, bool save_as_view_wallet = false);
     uint64_t get_blockchain_current_height() const { return m_local_bc_height; }
@@ -202,20 +251,31 @@ namespace tools
 
     }
     static uint64_t select_indices_for_transfer(std::list<size_t>& ind, std::map<uint64_t, std::list<size_t> >& found_free_amounts, uint64_t needed_money);
+    template<class t_predicate>
+    static uint64_t select_indices_from_free_index(std::list<size_t>& ind, const free_transfers_index& free_index, uint64_t needed_money, t_predicate pred);
   private:
 
     void load_keys(const std::string& keys_file_name, const std::string& password);
-    void process_new_transaction(const currency::transaction& tx, uint64_t height, const currency::block& b);
-    void process_new_blockchain_entry(const currency::block& b, currency::block_complete_entry& bche, crypto::hash& bl_id, uint64_t height);
+    void process_new_transaction(const currency::transaction& tx, uint64_t height, const currency::block& b, const std::vector<size_t>* found_outs = nullptr);
+    void process_new_blockchain_entry(const currency::block& b, const std::vector<currency::transaction>& txs, const crypto::hash& bl_id, uint64_t height, const block_found_outs* found_outs = nullptr);
     void detach_blockchain(uint64_t height);
-    void get_short_chain_history(std::list<crypto::hash>& ids);
     bool is_tx_spendtime_unlocked(uint64_t unlock_time) const;
     bool is_transfer_unlocked(const transfer_details& td) const;
+    uint64_t get_transfer_unlock_blockchain_size(const transfer_details& td) const;
+    void add_transfer_to_indices(size_t transfer_index);
+    void set_transfer_spent_flag(size_t transfer_index, bool spent);
+    void set_transfer_unlocked(size_t transfer_index);
+    void update_unlocked_transfers();
+    void add_payment_to_index(const currency::payment_id_t& payment_id, const payment_details& payment);
+    void rebuild_indices();
     bool clear();
     void pull_blocks(size_t& blocks_added);
     uint64_t select_transfers(uint64_t needed_money, size_t fake_outputs_count, uint64_t dust, const std::vector<size_t>& outs_to_spend, std::list<transfer_container::iterator>& selected_transfers);
     bool prepare_file_names(const std::string& file_path);
     void process_unconfirmed(const currency::transaction& tx, std::string& recipient, std::string& recipient_alias);
+    void scan_whole_tx_pool();
+    void process_pool_transaction(const currency::blobdata& tx_blob, std::unordered_map<crypto::hash, wallet_rpc::wallet_transfer_info>& unconfirmed_in_transfers_local);
+    void update_unconfirmed_balance();
     void add_sent_unconfirmed_tx(const currency::transaction& tx, uint64_t change_amount, std::string recipient);
     void update_current_tx_limit();
     void prepare_wti(wallet_rpc::wallet_transfer_info& wti, uint64_t height, uint64_t timestamp, const currency::transaction& tx, uint64_t amount, const money_transfer2_details& td)const;
@@ -224,7 +284,6 @@ namespace tools
     std::string get_alias_for_address(const std::string& addr);
     void wallet_transfer_info_from_unconfirmed_transfer_details(const unconfirmed_transfer_details& utd, wallet_rpc::wallet_transfer_info& wti)const;
     void finalize_transaction(const currency::create_tx_arg& create_tx_param, const currency::create_tx_res& create_tx_result, bool do_not_relay = false);
-    void resend_unconfirmed();
 
     currency::account_base m_account;
     bool m_is_view_only;
@@ -244,9 +303,21 @@ namespace tools
     std::vector<wallet_rpc::wallet_transfer_info> m_transfer_history;
     std::unordered_map<crypto::hash, wallet_rpc::wallet_transfer_info> m_unconfirmed_in_transfers;
     uint64_t m_unconfirmed_balance;
+    uint64_t m_pool_version; //daemon pool version m_unconfirmed_in_transfers is in sync with, 0 - not synced
+    bool m_pool_changes_unsupported; //daemon has no get_tx_pool_changes.bin, whole pool is requested every time
     std::shared_ptr<i_core_proxy> m_core_proxy;
     i_wallet2_callback* m_callback;
     std::unordered_map<crypto::hash, crypto::secret_key> m_tx_keys;
+
+    //indices and aggregates below are not serialized, they are maintained incrementally and rebuilt by rebuild_indices() on load and detach
+    uint64_t m_balance_unspent;
+    uint64_t m_balance_unlocked;
+    std::set<size_t> m_unspent_transfers;
+    std::multimap<uint64_t, size_t> m_height_locked_transfers;                   // blockchain size required to unlock -> transfer index
+    std::set<size_t> m_time_locked_transfers;                                    // transfers with timestamp-based unlock_time
+    free_transfers_index m_free_transfers_by_amount;                             // unspent and unlocked transfers, used for inputs selection
+    std::unordered_map<currency::payment_id_t, std::map<payment_order_key, const payment_details*> > m_payments_by_height; // pointers into m_payments
+    std::multimap<uint64_t, size_t> m_transfer_history_by_height;                // height -> index in m_transfer_history
   };
 }
 
@@ -396,6 +467,62 @@ namespace tools
     //----------------------------------------------------------------------------------------------------
   }
   //----------------------------------------------------------------------------------------------------
+  // Does the same selection as select_indices_for_transfer() but walks the persistent index in place instead of
+  // consuming a copy: outputs are taken only from the top, so consumed ones are those in buckets at or above 'limit'
+  // plus the already passed part of the current top bucket. Transfers not matching 'pred' are skipped.
+  template<class t_predicate>
+  uint64_t wallet2::select_indices_from_free_index(std::list<size_t>& selected_indexes, const free_transfers_index& free_index, uint64_t needed_money, t_predicate pred)
+  {
+    typedef std::set<size_t>::const_reverse_iterator bucket_iterator;
+    auto find_in_bucket = [&pred](free_transfers_index::const_iterator bucket, bucket_iterator from) -> bucket_iterator
+    {
+      while (from != bucket->second.rend() && !pred(*from))
+        ++from;
+      return from;
+    };
+
+    uint64_t found_money = 0;
+    free_transfers_index::const_iterator limit = free_index.end();
+    bucket_iterator top_pos;
+    bool top_started = false;
+    while (found_money < needed_money && limit != free_index.begin())
+    {
+      bool found_single = false;
+      for (auto it = free_index.lower_bound(needed_money - found_money); it != free_index.end() && (limit == free_index.end() || it->first < limit->first); ++it)
+      {
+        bool is_top = top_started && std::next(it) == limit;
+        bucket_iterator p = find_in_bucket(it, is_top ? top_pos : it->second.rbegin());
+        if (p != it->second.rend())
+        {
+          found_money += it->first;
+          selected_indexes.push_back(*p);
+          found_single = true;
+          break;
+        }
+      }
+      if (found_single)
+        break;
+
+      free_transfers_index::const_iterator top = std::prev(limit);
+      if (!top_started)
+      {
+        top_pos = top->second.rbegin();
+        top_started = true;
+      }
+      top_pos = find_in_bucket(top, top_pos);
+      if (top_pos == top->second.rend())
+      {
+        limit = top;
+        top_started = false;
+        continue;
+      }
+      found_money += top->first;
+      selected_indexes.push_back(*top_pos);
+      ++top_pos;
+    }
+    return found_money;
+  }
+  //----------------------------------------------------------------------------------------------------
   template<typename T>
   void wallet2::transfer(const std::vector<currency::tx_destination_entry>& dsts, size_t fake_outputs_count,
     uint64_t unlock_time, uint64_t fee, const std::vector<uint8_t>& extra, T destination_split_strategy, const tx_dust_policy& dust_policy)
@@ -540,7 +667,7 @@ namespace tools
     {
       //mark outputs as spent 
       BOOST_FOREACH(transfer_container::iterator it, selected_transfers)
-        it->m_spent = true;
+        set_transfer_spent_flag(it - m_transfers.begin(), true);
       //do offline sig
       blobdata bl = t_serializable_object_to_blob(create_tx_param);
       crypto::do_chacha_crypt(bl, m_account.get_keys().m_view_secret_key);
@@ -15,19 +15,57 @@ using namespace epee;
 
 namespace tools
 {
+  namespace
+  {
+    //cursor format: "<block height>-<tx hash hex>-<index>-<block hash hex>" of the last payment returned
+    std::string payment_cursor_to_str(const wallet2::payments_page_cursor& cursor)
+    {
+      return std::to_string(cursor.key.height) + "-" + epee::string_tools::pod_to_hex(cursor.key.tx_hash) + "-" +
+        std::to_string(cursor.key.index) + "-" + epee::string_tools::pod_to_hex(cursor.block_hash);
+    }
+
+    bool payment_cursor_from_str(const std::string& str, wallet2::payments_page_cursor& cursor)
+    {
+      std::vector<std::string> parts;
+      boost::split(parts, str, boost::is_any_of("-"));
+      if (parts.size() != 4)
+        return false;
+      if (!epee::string_tools::get_xtype_from_string(cursor.key.height, parts[0]) || !epee::string_tools::get_xtype_from_string(cursor.key.index, parts[2]))
+        return false;
+      return epee::string_tools::hex_to_pod(parts[1], cursor.key.tx_hash) && epee::string_tools::hex_to_pod(parts[3], cursor.block_hash);
+    }
+  }
   //-----------------------------------------------------------------------------------
   const command_line::arg_descriptor<std::string> wallet_rpc_server::arg_rpc_bind_port = {"rpc-bind-port", "Starts wallet as rpc server for wallet operations, sets bind port for server", "", true};
   const command_line::arg_descriptor<std::string> wallet_rpc_server::arg_rpc_bind_ip = {"rpc-bind-ip", "Specify ip to bind rpc server", "127.0.0.1"};
+  const command_line::arg_descriptor<uint64_t> wallet_rpc_server::arg_rpc_slow_call_threshold = {"rpc-slow-call-threshold-ms", "Log rpc calls running longer than this (0 - disabled)", RPC_SLOW_CALL_DEFAULT_THRESHOLD_MS};
+  const command_line::arg_descriptor<bool> wallet_rpc_server::arg_rpc_slow_call_log_params = {"rpc-slow-call-log-params", "Log params of slow rpc calls, except the ones carrying secret keys", false};
 
   void wallet_rpc_server::init_options(boost::program_options::options_description& desc)
   {
     command_line::add_arg(desc, arg_rpc_bind_ip);
     command_line::add_arg(desc, arg_rpc_bind_port);
+    command_line::add_arg(desc, arg_rpc_slow_call_threshold);
+    command_line::add_arg(desc, arg_rpc_slow_call_log_params);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  void wallet_rpc_server::init_http_route_stats(const boost::program_options::variables_map& vm)
+  {
+    get_http_route_stats().set_slow_call_threshold_ms(command_line::get_arg(vm, arg_rpc_slow_call_threshold));
+    get_http_route_stats().set_log_slow_call_params(command_line::get_arg(vm, arg_rpc_slow_call_log_params));
+    get_http_route_stats().hide_params("clonetelepod");
+    get_http_route_stats().hide_params("withdrawtelepod");
+    get_http_route_stats().hide_params("sign_transfer");
+    get_http_route_stats().hide_params("/json_rpc[batch]");
   }
   //------------------------------------------------------------------------------------------------------------------------------
   wallet_rpc_server::wallet_rpc_server(wallet2& w):m_wallet(w)
   {}
   //------------------------------------------------------------------------------------------------------------------------------
+  wallet_rpc_server::wallet_rpc_server(wallet2& w, boost::asio::io_service& external_io_service)
+    :epee::http_server_impl_base<wallet_rpc_server>(external_io_service), m_wallet(w)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::run(bool offline_mode)
   {
     if (!offline_mode)
@@ -49,6 +87,7 @@ namespace tools
   {
     m_bind_ip = command_line::get_arg(vm, arg_rpc_bind_ip);
     m_port = command_line::get_arg(vm, arg_rpc_bind_port);
+    init_http_route_stats(vm);
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
@@ -247,6 +286,66 @@ namespace tools
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_get_bulk_payments_paged(const wallet_rpc::COMMAND_RPC_GET_BULK_PAYMENTS_PAGED::request& req, wallet_rpc::COMMAND_RPC_GET_BULK_PAYMENTS_PAGED::response& res, epee::json_rpc::error& er, connection_context& cntx)
+  {
+    std::vector<currency::payment_id_t> payment_ids;
+    payment_ids.reserve(req.payment_ids.size());
+    for (auto& payment_id_str : req.payment_ids)
+    {
+      currency::payment_id_t payment_id;
+      if (!currency::parse_payment_id_from_hex_str(payment_id_str, payment_id))
+      {
+        er.code = WALLET_RPC_ERROR_CODE_WRONG_PAYMENT_ID;
+        er.message = "Payment ID has invalid format: " + payment_id_str;
+        return false;
+      }
+      payment_ids.push_back(payment_id);
+    }
+
+    wallet2::payments_page_cursor start_after = AUTO_VAL_INIT(start_after);
+    if (!req.cursor.empty() && !payment_cursor_from_str(req.cursor, start_after))
+    {
+      er.code = WALLET_RPC_ERROR_CODE_WRONG_ARGUMENT;
+      er.message = "Invalid cursor: " + req.cursor;
+      return false;
+    }
+    if (!req.cursor.empty() && !m_wallet.is_payments_cursor_valid(start_after))
+    {
+      er.code = WALLET_RPC_ERROR_CODE_STALE_CURSOR;
+      er.message = "Cursor block at height " + std::to_string(start_after.key.height) + " was detached, request payments from min_block_height again";
+      return false;
+    }
+
+    size_t count = WALLET_RPC_BULK_PAYMENTS_MAX_PAGE_SIZE;
+    if (req.count && req.count < count)
+      count = static_cast<size_t>(req.count);
+
+    std::list<std::pair<currency::payment_id_t, wallet2::payment_details> > payment_list;
+    wallet2::payments_page_cursor next = AUTO_VAL_INIT(next);
+    res.has_more = m_wallet.get_payments_page(payment_ids, req.min_block_height, req.cursor.empty() ? nullptr : &start_after, count, payment_list, next);
+
+    res.payments.clear();
+    for (auto & p : payment_list)
+    {
+      const wallet2::payment_details& payment = p.second;
+      wallet_rpc::payment_details rpc_payment;
+      rpc_payment.payment_id   = epee::string_tools::buff_to_hex_nodelimer(p.first);
+      rpc_payment.tx_hash      = epee::string_tools::pod_to_hex(payment.m_tx_hash);
+      rpc_payment.amount       = payment.m_amount;
+      rpc_payment.block_height = payment.m_block_height;
+      rpc_payment.unlock_time  = payment.m_unlock_time;
+      res.payments.push_back(std::move(rpc_payment));
+    }
+
+    //with no new payments the cursor stays where it was, so pollers can keep asking with it
+    if (!payment_list.empty())
+      res.next_cursor = payment_cursor_to_str(next);
+    else
+      res.next_cursor = req.cursor;
+
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
   bool wallet_rpc_server::on_get_transfers(const wallet_rpc::COMMAND_RPC_GET_TRANSFERS::request& req, wallet_rpc::COMMAND_RPC_GET_TRANSFERS::response& res, epee::json_rpc::error& er, connection_context& cntx)
   {
     return m_wallet.get_transfers(req, res);
@@ -713,6 +812,13 @@ namespace tools
     return true;
   }
   //------------------------------------------------------------------------------------------------------------------------------
+  bool wallet_rpc_server::on_get_rpc_stats(const wallet_rpc::COMMAND_RPC_GET_RPC_STATS::request& req, wallet_rpc::COMMAND_RPC_GET_RPC_STATS::response& res, epee::json_rpc::error& er, connection_context& cntx)
+  {
+    get_http_route_stats().get_stats(res.routes);
+    res.slow_call_threshold_ms = get_http_route_stats().get_slow_call_threshold_ms();
+    return true;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
 
 }
 
@@ -7,6 +7,7 @@
 #include "currency_core/currency_basic.h"
 #include "crypto/hash.h"
 #include "wallet_rpc_server_error_codes.h"
+#include "net/http_route_stats.h"
 namespace tools
 {
 namespace wallet_rpc
@@ -14,6 +15,8 @@ namespace wallet_rpc
 #define WALLET_RPC_STATUS_OK      "OK"
 #define WALLET_RPC_STATUS_BUSY    "BUSY"
 
+#define WALLET_RPC_BULK_PAYMENTS_MAX_PAGE_SIZE   1000
+
 
   struct wallet_transfer_info_details
   {
@@ -250,6 +253,37 @@ namespace wallet_rpc
     };
   };
 
+  struct COMMAND_RPC_GET_BULK_PAYMENTS_PAGED
+  {
+    struct request
+    {
+      std::vector<std::string> payment_ids;
+      uint64_t min_block_height;
+      std::string cursor;       //empty for the first page, otherwise next_cursor from the previous response; after a reorg below it WALLET_RPC_ERROR_CODE_STALE_CURSOR is returned
+      uint64_t count;           //0 or anything above WALLET_RPC_BULK_PAYMENTS_MAX_PAGE_SIZE means max page size
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(payment_ids)
+        KV_SERIALIZE(min_block_height)
+        KV_SERIALIZE(cursor)
+        KV_SERIALIZE(count)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::list<payment_details> payments;  //ordered by block_height, then by tx_hash
+      std::string next_cursor;              //position after the last returned payment, keep it for incremental polling
+      bool has_more;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(payments)
+        KV_SERIALIZE(next_cursor)
+        KV_SERIALIZE(has_more)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
   struct COMMAND_RPC_GET_TRANSFERS
   {
     struct request
@@ -496,6 +530,26 @@ namespace wallet_rpc
     };
   };
 
+  struct COMMAND_RPC_GET_RPC_STATS
+  {
+    struct request
+    {
+      BEGIN_KV_SERIALIZE_MAP()
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      std::list<epee::net_utils::http::route_stat> routes;
+      uint64_t slow_call_threshold_ms;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(routes)
+        KV_SERIALIZE(slow_call_threshold_ms)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
 }
 }
 
@@ -11,3 +11,4 @@
 #define WALLET_RPC_ERROR_CODE_GENERIC_TRANSFER_ERROR  -4
 #define WALLET_RPC_ERROR_CODE_WRONG_PAYMENT_ID        -5
 #define WALLET_RPC_ERROR_CODE_WRONG_ARGUMENT          -6
+#define WALLET_RPC_ERROR_CODE_STALE_CURSOR            -7
@@ -0,0 +1,287 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "include_base_utils.h"
+using namespace epee;
+
+#include <thread>
+
+#include "wallets_host.h"
+#include "rpc/core_rpc_server_commands_defs.h"
+#include "profile_tools.h"
+
+namespace tools
+{
+//----------------------------------------------------------------------------------------------------
+wallets_host::wallets_host() : m_core_proxy(new default_http_core_proxy()), m_run(true)
+{}
+//----------------------------------------------------------------------------------------------------
+wallets_host::wallets_host(const std::shared_ptr<i_core_proxy>& core_proxy) : m_core_proxy(core_proxy), m_run(true)
+{}
+//----------------------------------------------------------------------------------------------------
+void wallets_host::init(const std::string& daemon_address)
+{
+  m_daemon_address = daemon_address;
+  m_core_proxy->set_connection_addr(daemon_address);
+}
+//----------------------------------------------------------------------------------------------------
+bool wallets_host::add_wallet(const std::string& name, const std::shared_ptr<wallet2>& w)
+{
+  CHECK_AND_ASSERT_MES(w, false, "wallet " << name << " is null");
+  CHECK_AND_ASSERT_MES(m_wallets.find(name) == m_wallets.end(), false, "wallet " << name << " is already loaded");
+
+  //all hosted wallets talk to the daemon through one connection
+  w->set_core_proxy(m_core_proxy);
+  w->init(m_daemon_address);
+  m_wallets[name] = w;
+  m_wallet_locks[name].reset(new epee::critical_section());
+  return true;
+}
+//----------------------------------------------------------------------------------------------------
+epee::critical_section& wallets_host::get_wallet_lock(const std::string& name)
+{
+  auto it = m_wallet_locks.find(name);
+  CHECK_AND_THROW_WALLET_EX(it == m_wallet_locks.end(), error::wallet_internal_error, "wallet " + name + " is not hosted");
+  return *it->second;
+}
+//----------------------------------------------------------------------------------------------------
+std::shared_ptr<wallet2> wallets_host::get_wallet(const std::string& name) const
+{
+  auto it = m_wallets.find(name);
+  if (it == m_wallets.end())
+    return std::shared_ptr<wallet2>();
+  return it->second;
+}
+//----------------------------------------------------------------------------------------------------
+void wallets_host::find_outs(const std::vector<parsed_block_entry>& blocks, const std::vector<std::shared_ptr<wallet2> >& wallets,
+  std::vector<std::vector<block_found_outs> >& found_outs, size_t threads_count)
+{
+  found_outs.assign(wallets.size(), std::vector<block_found_outs>(blocks.size()));
+  if (blocks.empty() || wallets.empty())
+    return;
+
+  if (!threads_count)
+    threads_count = std::max<size_t>(1, std::thread::hardware_concurrency());
+  threads_count = std::min(threads_count, (blocks.size() + WALLETS_HOST_FIND_OUTS_MIN_BLOCKS_PER_THREAD - 1) / WALLETS_HOST_FIND_OUTS_MIN_BLOCKS_PER_THREAD);
+
+  //failed[t][w] is set when thread t met a tx that wallet w must handle on its own to report the error
+  std::vector<std::vector<char> > failed(threads_count, std::vector<char>(wallets.size(), 0));
+  auto find_in_range = [&](size_t t, size_t from, size_t to)
+  {
+    for (size_t b = from; b != to; ++b)
+    {
+      const parsed_block_entry& pbe = blocks[b];
+      for (size_t i = 0; i != pbe.txs.size() + 1; ++i)
+      {
+        const currency::transaction& tx = i ? pbe.txs[i - 1] : pbe.bl.miner_tx;
+        crypto::public_key tx_pub_key = currency::null_pkey;
+        bool extra_parsed = currency::parse_and_validate_tx_extra(tx, tx_pub_key);
+        for (size_t w = 0; w != wallets.size(); ++w)
+        {
+          if (!wallets[w]->is_block_scanned(pbe.bl))
+            continue;
+          block_found_outs& block_outs = found_outs[w][b];
+          block_outs.resize(pbe.txs.size() + 1);
+          if (!extra_parsed)
+            continue;
+          uint64_t money = 0;
+          if (!currency::lookup_acc_outs(wallets[w]->get_account().get_keys(), tx, tx_pub_key, block_outs[i], money))
+            failed[t][w] = 1;
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t t = 1; t < threads_count; ++t)
+    workers.emplace_back(find_in_range, t, blocks.size() * t / threads_count, blocks.size() * (t + 1) / threads_count);
+  find_in_range(0, 0, blocks.size() / threads_count);
+  for (auto& th : workers)
+    th.join();
+
+  for (size_t w = 0; w != wallets.size(); ++w)
+  {
+    for (size_t t = 0; t != threads_count; ++t)
+    {
+      if (failed[t][w])
+        found_outs[w].clear();
+    }
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallets_host::pull_blocks(size_t& blocks_added)
+{
+  blocks_added = 0;
+  if (m_wallets.empty())
+    return;
+
+  //ask for blocks on behalf of the most lagging wallet, wallets that are ahead skip blocks they already have
+  currency::COMMAND_RPC_GET_BLOCKS_FAST::request req = AUTO_VAL_INIT(req);
+  currency::COMMAND_RPC_GET_BLOCKS_FAST::response res = AUTO_VAL_INIT(res);
+  uint64_t lagging_height = 0;
+  std::string lagging;
+  for (auto& w : m_wallets)
+  {
+    CRITICAL_REGION_LOCAL(*m_wallet_locks[w.first]);
+    if (lagging.empty() || w.second->get_blockchain_current_height() < lagging_height)
+    {
+      lagging = w.first;
+      lagging_height = w.second->get_blockchain_current_height();
+      req.block_ids.clear();
+      w.second->get_short_chain_history(req.block_ids);
+    }
+  }
+
+  bool r = m_core_proxy->call_COMMAND_RPC_GET_BLOCKS_FAST(req, res);
+  CHECK_AND_THROW_WALLET_EX(!r, error::no_connection_to_daemon, "getblocks.bin");
+  CHECK_AND_THROW_WALLET_EX(res.status == CORE_RPC_STATUS_BUSY, error::daemon_busy, "getblocks.bin");
+  CHECK_AND_THROW_WALLET_EX(res.status != CORE_RPC_STATUS_OK, error::get_blocks_error, res.status);
+
+  //download, parse and output lookup go without wallet locks, so requests to wallets aren't held by them
+  TIME_MEASURE_START(parse_time);
+  std::vector<parsed_block_entry> blocks;
+  wallet2::parse_blocks(res.blocks, blocks);
+  TIME_MEASURE_FINISH(parse_time);
+
+  TIME_MEASURE_START(find_outs_time);
+  std::vector<std::shared_ptr<wallet2> > wallets;
+  for (auto& w : m_wallets)
+    wallets.push_back(w.second);
+  std::vector<std::vector<block_found_outs> > found_outs;
+  find_outs(blocks, wallets, found_outs);
+  TIME_MEASURE_FINISH(find_outs_time);
+
+  TIME_MEASURE_START(process_time);
+  size_t wallet_index = 0;
+  for (auto& w : m_wallets)
+  {
+    const std::vector<block_found_outs>& wallet_outs = found_outs[wallet_index++];
+    CRITICAL_REGION_LOCAL(*m_wallet_locks[w.first]);
+    size_t added = 0;
+    bool processed = false;
+    try
+    {
+      processed = w.second->process_parsed_blocks(res.start_height, blocks, added, wallet_outs.empty() ? nullptr : &wallet_outs);
+    }
+    catch (const std::exception& e)
+    {
+      LOG_ERROR("Wallet " << w.first << " failed to process blocks from height " << res.start_height << ": " << e.what());
+    }
+
+    if (!processed)
+    {
+      //this wallet is on a fork that can't be resolved with the shared batch, let it sync on its own
+      LOG_PRINT_L0("Wallet " << w.first << " doesn't match shared blocks batch, refreshing it separately");
+      bool received_money = false;
+      bool ok = false;
+      w.second->refresh(added, received_money, ok);
+    }
+    blocks_added += added;
+  }
+  TIME_MEASURE_FINISH(process_time);
+  LOG_PRINT_L1("Shared blocks batch: " << blocks.size() << " blocks from height " << res.start_height << " for " << m_wallets.size() << " wallets, parsed in "
+    << parse_time << "ms, outputs found in " << find_outs_time << "ms, processed in " << process_time << "ms");
+}
+//----------------------------------------------------------------------------------------------------
+void wallets_host::refresh(size_t& blocks_fetched)
+{
+  blocks_fetched = 0;
+  size_t added_blocks = 0;
+  size_t try_count = 0;
+
+  while (m_run.load(std::memory_order_relaxed))
+  {
+    try
+    {
+      pull_blocks(added_blocks);
+      blocks_fetched += added_blocks;
+      if (!added_blocks)
+        break;
+    }
+    catch (const std::exception&)
+    {
+      blocks_fetched += added_blocks;
+      if (try_count < 3)
+      {
+        LOG_PRINT_L1("Another try pull_blocks (try_count=" << try_count << ")...");
+        ++try_count;
+      }
+      else
+      {
+        LOG_ERROR("pull_blocks failed, try_count=" << try_count);
+        throw;
+      }
+    }
+  }
+
+  if (!blocks_fetched)
+    return;
+
+  for (auto& w : m_wallets)
+  {
+    CRITICAL_REGION_LOCAL(*m_wallet_locks[w.first]);
+    try
+    {
+      w.second->resend_unconfirmed();
+    }
+    catch (const std::exception& e)
+    {
+      LOG_ERROR("Wallet " << w.first << " failed to resend unconfirmed transactions: " << e.what());
+    }
+  }
+}
+//----------------------------------------------------------------------------------------------------
+bool wallets_host::refresh(size_t& blocks_fetched, bool& ok)
+{
+  try
+  {
+    refresh(blocks_fetched);
+    ok = true;
+  }
+  catch (...)
+  {
+    ok = false;
+  }
+  return ok;
+}
+//----------------------------------------------------------------------------------------------------
+void wallets_host::run_refresh_loop(uint64_t interval_ms)
+{
+  while (m_run.load(std::memory_order_relaxed))
+  {
+    size_t blocks_fetched = 0;
+    bool ok = false;
+    refresh(blocks_fetched, ok);
+
+    std::unique_lock<std::mutex> lock(m_stop_lock);
+    m_stop_cv.wait_for(lock, std::chrono::milliseconds(interval_ms), [this](){ return !m_run.load(std::memory_order_relaxed); });
+  }
+}
+//----------------------------------------------------------------------------------------------------
+void wallets_host::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_stop_lock);
+    m_run.store(false, std::memory_order_relaxed);
+  }
+  m_stop_cv.notify_all();
+}
+//----------------------------------------------------------------------------------------------------
+void wallets_host::store_all()
+{
+  for (auto& w : m_wallets)
+  {
+    CRITICAL_REGION_LOCAL(*m_wallet_locks[w.first]);
+    try
+    {
+      w.second->store();
+    }
+    catch (const std::exception& e)
+    {
+      LOG_ERROR("Failed to store wallet " << w.first << ": " << e.what());
+    }
+  }
+}
+//----------------------------------------------------------------------------------------------------
+}
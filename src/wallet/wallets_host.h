@@ -0,0 +1,64 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+
+#include "syncobj.h"
+#include "wallet2.h"
+
+#define WALLETS_HOST_REFRESH_INTERVAL_MS                20000
+#define WALLETS_HOST_FIND_OUTS_MIN_BLOCKS_PER_THREAD    20
+
+namespace tools
+{
+  /************************************************************************/
+  /* Keeps many wallets in one process: blocks are downloaded and parsed  */
+  /* once and then handed to every wallet, so each extra wallet costs     */
+  /* only its own output scanning                                         */
+  /*                                                                      */
+  /* Refresh runs in its own thread (run_refresh_loop), anything else     */
+  /* that touches a hosted wallet must hold get_wallet_lock() of it       */
+  /************************************************************************/
+  class wallets_host
+  {
+  public:
+    wallets_host();
+    explicit wallets_host(const std::shared_ptr<i_core_proxy>& core_proxy);
+
+    void init(const std::string& daemon_address);
+    bool add_wallet(const std::string& name, const std::shared_ptr<wallet2>& w);
+    std::shared_ptr<wallet2> get_wallet(const std::string& name) const;
+    const std::map<std::string, std::shared_ptr<wallet2> >& get_wallets() const { return m_wallets; }
+    epee::critical_section& get_wallet_lock(const std::string& name);
+
+    void refresh(size_t& blocks_fetched);
+    bool refresh(size_t& blocks_fetched, bool& ok);
+    //refreshes every interval_ms until stop()
+    void run_refresh_loop(uint64_t interval_ms = WALLETS_HOST_REFRESH_INTERVAL_MS);
+    void store_all();
+    void stop();
+
+    //one pass over the batch for all wallets: tx public key is taken once per tx and tested against every wallet's keys,
+    //found_outs[i] is empty for wallet i if the pass couldn't be done for it
+    static void find_outs(const std::vector<parsed_block_entry>& blocks, const std::vector<std::shared_ptr<wallet2> >& wallets,
+      std::vector<std::vector<block_found_outs> >& found_outs, size_t threads_count = 0);
+
+  private:
+    void pull_blocks(size_t& blocks_added);
+
+    std::map<std::string, std::shared_ptr<wallet2> > m_wallets;
+    std::map<std::string, std::unique_ptr<epee::critical_section> > m_wallet_locks;
+    std::shared_ptr<i_core_proxy> m_core_proxy;
+    std::string m_daemon_address;
+    std::atomic<bool> m_run;
+    std::mutex m_stop_lock;
+    std::condition_variable m_stop_cv;
+  };
+}
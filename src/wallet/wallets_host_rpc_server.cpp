@@ -0,0 +1,73 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "include_base_utils.h"
+using namespace epee;
+
+#include <thread>
+
+#include "wallets_host_rpc_server.h"
+#include "common/command_line.h"
+
+#define WALLETS_HOST_URI_PREFIX "/wallet/"
+
+namespace tools
+{
+  //------------------------------------------------------------------------------------------------------------------------------
+  wallets_host_rpc_server::wallets_host_rpc_server(wallets_host& host):m_host(host)
+  {}
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallets_host_rpc_server::init(const boost::program_options::variables_map& vm)
+  {
+    m_net_server.set_threads_prefix("RPC");
+    //per-wallet servers are used only as request handlers, they share our io_service and never listen themselves
+    for (auto& w : m_host.get_wallets())
+      m_wallet_servers[w.first].reset(new wallet_rpc_server(*w.second, m_net_server.get_io_service()));
+
+    std::string bind_ip = command_line::get_arg(vm, wallet_rpc_server::arg_rpc_bind_ip);
+    std::string port = command_line::get_arg(vm, wallet_rpc_server::arg_rpc_bind_port);
+    wallet_rpc_server::init_http_route_stats(vm);
+    return epee::http_server_impl_base<wallets_host_rpc_server, connection_context>::init(port, bind_ip);
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallets_host_rpc_server::run()
+  {
+    //refresh has its own thread, a request waits only while the shared batch is being applied to its own wallet
+    std::thread refresh_thread([this](){ m_host.run_refresh_loop(); });
+    bool r = epee::http_server_impl_base<wallets_host_rpc_server, connection_context>::run(1, true);
+    m_host.stop();
+    refresh_thread.join();
+    return r;
+  }
+  //------------------------------------------------------------------------------------------------------------------------------
+  bool wallets_host_rpc_server::handle_http_request(const epee::net_utils::http::http_request_info& query_info,
+    epee::net_utils::http::http_response_info& response,
+    connection_context& conn_context)
+  {
+    LOG_PRINT_L2("HTTP [" << epee::string_tools::get_ip_string_from_int32(conn_context.m_remote_ip) << "] " << query_info.m_http_method_str << " " << query_info.m_URI);
+    const std::string prefix = WALLETS_HOST_URI_PREFIX;
+    auto it = m_wallet_servers.end();
+    size_t name_end = std::string::npos;
+    if (query_info.m_URI.compare(0, prefix.size(), prefix) == 0)
+    {
+      name_end = query_info.m_URI.find('/', prefix.size());
+      if (name_end != std::string::npos)
+        it = m_wallet_servers.find(query_info.m_URI.substr(prefix.size(), name_end - prefix.size()));
+    }
+
+    if (it == m_wallet_servers.end())
+    {
+      response.m_response_code = 404;
+      response.m_response_comment = "Not found";
+      return true;
+    }
+
+    //wallet's server sees the request with its own uri
+    epee::net_utils::http::http_request_info wallet_query_info = query_info;
+    wallet_query_info.m_URI.erase(0, name_end);
+
+    CRITICAL_REGION_LOCAL(m_host.get_wallet_lock(it->first));
+    return it->second->handle_http_request(wallet_query_info, response, conn_context);
+  }
+}
@@ -0,0 +1,38 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma  once 
+
+#include <map>
+#include <memory>
+#include <boost/program_options/variables_map.hpp>
+#include "net/http_server_impl_base.h"
+#include "wallet_rpc_server.h"
+#include "wallets_host.h"
+
+namespace tools
+{
+  /************************************************************************/
+  /* Serves every wallet of wallets_host on one port:                     */
+  /*   /wallet/<name>/json_rpc -> wallet_rpc_server of wallet <name>      */
+  /************************************************************************/
+  class wallets_host_rpc_server: public epee::http_server_impl_base<wallets_host_rpc_server>
+  {
+  public:
+    typedef epee::net_utils::connection_context_base connection_context;
+
+    wallets_host_rpc_server(wallets_host& host);
+
+    bool init(const boost::program_options::variables_map& vm);
+    bool run();
+
+    bool handle_http_request(const epee::net_utils::http::http_request_info& query_info,
+      epee::net_utils::http::http_response_info& response,
+      connection_context& conn_context);
+
+  private:
+    wallets_host& m_host;
+    std::map<std::string, std::unique_ptr<wallet_rpc_server> > m_wallet_servers;
+  };
+}
@@ -81,6 +81,9 @@ int main(int argc, char* argv[])
 
     GENERATE_AND_PLAY(prun_ring_signatures);
     GENERATE_AND_PLAY(get_random_outs_test);
+    GENERATE_AND_PLAY(enumerate_blocks_range_test);
+    GENERATE_AND_PLAY(scan_blocks_with_view_keys_test);
+    GENERATE_AND_PLAY(compact_block_relay_test);
     GENERATE_AND_PLAY(mix_attr_tests);
     GENERATE_AND_PLAY(gen_simple_chain_001);
     GENERATE_AND_PLAY(gen_simple_chain_split_1);
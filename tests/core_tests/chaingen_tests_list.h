@@ -16,6 +16,9 @@
 #include "alias_tests.h"
 #include "mixin_attr.h"
 #include "get_random_outs.h"
+#include "enumerate_blocks_range.h"
+#include "scan_blocks_with_view_keys.h"
+#include "compact_block_relay.h"
 #include "pruning_ring_signatures.h"
 /************************************************************************/
 /*                                                                      */
@@ -0,0 +1,417 @@
+// Copyright (c) 2012-2013 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chaingen.h"
+#include "chaingen_tests_list.h"
+
+#include "currency_core/miner.h"
+#include "currency_protocol/currency_protocol_handler.h"
+#include "compact_block_relay.h"
+
+using namespace epee;
+using namespace currency;
+
+#define COMPACT_BLOCK_RELAY_TEST_AMOUNT 11111111111
+
+namespace
+{
+  template<class t_request>
+  bool load_sent(const std::string& buff, t_request& arg)
+  {
+    return epee::serialization::load_t_from_binary(arg, buff);
+  }
+
+  //full blocks may go packed or compressed
+  bool load_sent(const std::string& buff, NOTIFY_NEW_BLOCK::request& arg)
+  {
+    return load_protocol_payload(buff, arg);
+  }
+
+  //remembers what handler sends, connections are given by the test
+  struct test_p2p_endpoint: public nodetool::p2p_endpoint_stub<currency_connection_context>
+  {
+    struct sent_notify
+    {
+      int command;
+      std::string buff;
+      boost::uuids::uuid to;
+    };
+
+    virtual bool relay_notify_to_list(int command, const std::string& data_buff, const std::list<epee::net_utils::connection_context_base>& connections)
+    {
+      for (const auto& c : connections)
+        invoke_notify_to_peer(command, data_buff, c);
+      return true;
+    }
+    virtual bool invoke_notify_to_peer(int command, const std::string& req_buff, const epee::net_utils::connection_context_base& context)
+    {
+      sent_notify sn = AUTO_VAL_INIT(sn);
+      sn.command = command;
+      sn.buff = req_buff;
+      sn.to = context.m_connection_id;
+      sent.push_back(sn);
+      return true;
+    }
+    virtual bool drop_connection(const epee::net_utils::connection_context_base& context)
+    {
+      dropped.push_back(context.m_connection_id);
+      return true;
+    }
+    virtual void for_each_connection(std::function<bool(currency_connection_context&, nodetool::peerid_type)> f)
+    {
+      for (auto& c : connections)
+      {
+        if (!f(c, 1))
+          break;
+      }
+    }
+
+    template<class t_notify>
+    size_t count_sent(const currency_connection_context& to) const
+    {
+      size_t count = 0;
+      for (const auto& sn : sent)
+      {
+        if (sn.command == t_notify::ID && sn.to == to.m_connection_id)
+          ++count;
+      }
+      return count;
+    }
+
+    template<class t_notify>
+    bool get_sent(const currency_connection_context& to, typename t_notify::request& arg) const
+    {
+      for (auto it = sent.rbegin(); it != sent.rend(); ++it)
+      {
+        if (it->command == t_notify::ID && it->to == to.m_connection_id)
+          return load_sent(it->buff, arg);
+      }
+      return false;
+    }
+
+    std::list<currency_connection_context> connections;
+    std::list<sent_notify> sent;
+    std::list<boost::uuids::uuid> dropped;
+  };
+
+  typedef t_currency_protocol_handler<core> protocol_handler;
+
+  //synchronized handler with peers: source, compact one and full one
+  struct relay_setup
+  {
+    relay_setup(core& c) : handler(c, &p2p)
+    {
+      source = &add_peer(1, CURRENCY_PROTOCOL_FLAG_COMPACT_BLOCKS);
+      compact = &add_peer(2, CURRENCY_PROTOCOL_FLAG_COMPACT_BLOCKS);
+      full = &add_peer(3, 0);
+      handler.on_idle();
+    }
+
+    currency_connection_context& add_peer(uint8_t n, uint32_t flags)
+    {
+      boost::uuids::uuid id = boost::uuids::uuid();
+      id.data[0] = n;
+      currency_connection_context context = AUTO_VAL_INIT(context);
+      static_cast<epee::net_utils::connection_context_base&>(context) = epee::net_utils::connection_context_base(id, 0, 10000 + n, false);
+      context.m_state = currency_connection_context::state_normal;
+      context.m_remote_blockchain_height = 1000;
+      context.m_remote_protocol_flags = flags;
+      context.m_pending_compact_block_id = null_hash;
+      p2p.connections.push_back(context);
+      return p2p.connections.back();
+    }
+
+    template<class t_notify>
+    bool receive(typename t_notify::request& arg, currency_connection_context& from)
+    {
+      std::string buff, out;
+      epee::serialization::store_t_to_binary(arg, buff);
+      bool handled = false;
+      handler.handle_invoke_map(true, t_notify::ID, buff, out, from, handled);
+      return handled;
+    }
+
+    test_p2p_endpoint p2p;
+    protocol_handler handler;
+    currency_connection_context* source;
+    currency_connection_context* compact;
+    currency_connection_context* full;
+  };
+
+  //mines next block on top of the core from its pool, like a remote miner would
+  bool make_next_block(core& c, block& b)
+  {
+    account_base miner;
+    miner.generate();
+    wide_difficulty_type diffic = 0;
+    uint64_t height = 0;
+    bool r = c.get_block_template(b, miner.get_keys().m_account_address, diffic, height, blobdata(), false, alias_info());
+    CHECK_AND_ASSERT_MES(r, false, "get_block_template failed");
+    std::vector<crypto::hash> scratchpad;
+    r = c.get_blockchain_storage().copy_scratchpad(scratchpad);
+    CHECK_AND_ASSERT_MES(r && scratchpad.size(), false, "copy_scratchpad failed");
+    r = miner::find_nonce_for_given_block(b, diffic, height, [&](uint64_t index) -> crypto::hash&
+    {
+      return scratchpad[index % scratchpad.size()];
+    });
+    CHECK_AND_ASSERT_MES(r, false, "find_nonce_for_given_block failed");
+    return true;
+  }
+
+  NOTIFY_NEW_COMPACT_BLOCK::request make_compact_block(core& c, const block& b)
+  {
+    NOTIFY_NEW_COMPACT_BLOCK::request arg = AUTO_VAL_INIT(arg);
+    arg.block = block_to_blob(b);
+    arg.current_blockchain_height = c.get_current_blockchain_height() + 1;
+    arg.hop = 0;
+    return arg;
+  }
+
+  //block went on and was relayed compact to compact peer and with all txs to full peer, not back to source
+  bool check_relayed(core& c, relay_setup& rs, const block& b)
+  {
+    crypto::hash id = get_block_hash(b);
+    CHECK_AND_ASSERT_MES(c.get_blockchain_storage().get_top_block_id() == id, false, "block " << id << " isn't on top");
+
+    NOTIFY_NEW_COMPACT_BLOCK::request compact_arg = AUTO_VAL_INIT(compact_arg);
+    CHECK_AND_ASSERT_MES(rs.p2p.get_sent<NOTIFY_NEW_COMPACT_BLOCK>(*rs.compact, compact_arg), false, "compact peer didn't get the block");
+    CHECK_AND_ASSERT_MES(compact_arg.block == block_to_blob(b) && compact_arg.hop == 1, false, "compact peer got wrong block");
+    CHECK_AND_ASSERT_MES(!rs.p2p.count_sent<NOTIFY_NEW_BLOCK>(*rs.compact), false, "compact peer got full block");
+
+    NOTIFY_NEW_BLOCK::request full_arg = AUTO_VAL_INIT(full_arg);
+    CHECK_AND_ASSERT_MES(rs.p2p.get_sent<NOTIFY_NEW_BLOCK>(*rs.full, full_arg), false, "full peer didn't get the block");
+    CHECK_AND_ASSERT_MES(full_arg.b.block == block_to_blob(b) && full_arg.hop == 1, false, "full peer got wrong block");
+    CHECK_AND_ASSERT_MES(full_arg.b.txs.size() == b.tx_hashes.size(), false, "full peer got " << full_arg.b.txs.size() << " txs of " << b.tx_hashes.size());
+    auto tx_it = full_arg.b.txs.begin();
+    for (const auto& tx_id : b.tx_hashes)
+    {
+      transaction tx;
+      CHECK_AND_ASSERT_MES(parse_and_validate_tx_from_blob(*tx_it++, tx) && get_transaction_hash(tx) == tx_id, false, "full peer got wrong tx instead of " << tx_id);
+    }
+
+    CHECK_AND_ASSERT_MES(!rs.p2p.count_sent<NOTIFY_NEW_COMPACT_BLOCK>(*rs.source) && !rs.p2p.count_sent<NOTIFY_NEW_BLOCK>(*rs.source), false, "block was relayed back to source");
+    CHECK_AND_ASSERT_MES(rs.p2p.dropped.empty(), false, "connection was dropped");
+    return true;
+  }
+}
+
+compact_block_relay_test::compact_block_relay_test()
+{
+  REGISTER_CALLBACK_METHOD(compact_block_relay_test, check_missing_txs_request);
+  REGISTER_CALLBACK_METHOD(compact_block_relay_test, check_reconstruction);
+  REGISTER_CALLBACK_METHOD(compact_block_relay_test, check_tx_announce_queue_cap);
+  REGISTER_CALLBACK_METHOD(compact_block_relay_test, check_tx_inventory_limits);
+}
+
+bool compact_block_relay_test::generate(std::vector<test_event_entry>& events) const
+{
+  uint64_t ts_start = 1338224400;
+  GENERATE_ACCOUNT(miner_account);
+  MAKE_GENESIS_BLOCK(events, blk_0, miner_account, ts_start);
+  MAKE_ACCOUNT(events, bob_account);
+  REWIND_BLOCKS(events, blk_0r, blk_0, miner_account);
+  REWIND_BLOCKS(events, blk_0rr, blk_0r, miner_account);
+  //these go to the pool
+  MAKE_TX(events, tx_1, miner_account, bob_account, COMPACT_BLOCK_RELAY_TEST_AMOUNT, blk_0rr);
+  MAKE_TX(events, tx_2, miner_account, bob_account, COMPACT_BLOCK_RELAY_TEST_AMOUNT, blk_0rr);
+  MAKE_TX(events, tx_3, miner_account, bob_account, COMPACT_BLOCK_RELAY_TEST_AMOUNT, blk_0rr);
+  DO_CALLBACK(events, "check_missing_txs_request");
+  MAKE_TX(events, tx_4, miner_account, bob_account, COMPACT_BLOCK_RELAY_TEST_AMOUNT, blk_0rr);
+  MAKE_TX(events, tx_5, miner_account, bob_account, COMPACT_BLOCK_RELAY_TEST_AMOUNT, blk_0rr);
+  DO_CALLBACK(events, "check_reconstruction");
+  DO_CALLBACK(events, "check_tx_announce_queue_cap");
+  DO_CALLBACK(events, "check_tx_inventory_limits");
+  return true;
+}
+
+bool compact_block_relay_test::check_missing_txs_request(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  relay_setup rs(c);
+  CHECK_AND_ASSERT_MES(rs.handler.is_synchronized(), false, "handler isn't synchronized");
+  CHECK_AND_ASSERT_MES(c.get_pool_transactions_count() == 3, false, "unexpected pool size " << c.get_pool_transactions_count());
+
+  block b = AUTO_VAL_INIT(b);
+  CHECK_AND_ASSERT_MES(make_next_block(c, b), false, "failed to make block");
+  CHECK_AND_ASSERT_MES(b.tx_hashes.size() == 3, false, "unexpected block txs count " << b.tx_hashes.size());
+  crypto::hash prev_top = c.get_blockchain_storage().get_top_block_id();
+
+  //this node hasn't seen the last tx
+  crypto::hash missing_id = b.tx_hashes.back();
+  transaction missing_tx = AUTO_VAL_INIT(missing_tx);
+  size_t blob_size = 0;
+  uint64_t fee = 0;
+  CHECK_AND_ASSERT_MES(c.get_tx_pool().take_tx(missing_id, missing_tx, blob_size, fee), false, "take_tx failed");
+
+  //only missing tx is requested, block waits for it
+  NOTIFY_NEW_COMPACT_BLOCK::request compact_arg = make_compact_block(c, b);
+  CHECK_AND_ASSERT_MES(rs.receive<NOTIFY_NEW_COMPACT_BLOCK>(compact_arg, *rs.source), false, "NOTIFY_NEW_COMPACT_BLOCK not handled");
+  NOTIFY_REQUEST_COMPACT_BLOCK_TXS::request txs_req = AUTO_VAL_INIT(txs_req);
+  CHECK_AND_ASSERT_MES(rs.p2p.get_sent<NOTIFY_REQUEST_COMPACT_BLOCK_TXS>(*rs.source, txs_req), false, "missing txs weren't requested");
+  CHECK_AND_ASSERT_MES(txs_req.block_id == get_block_hash(b), false, "missing txs requested for wrong block");
+  CHECK_AND_ASSERT_MES(txs_req.txs == std::list<crypto::hash>(1, missing_id), false, "requested " << txs_req.txs.size() << " txs instead of the missing one");
+  CHECK_AND_ASSERT_MES(c.get_blockchain_storage().get_top_block_id() == prev_top, false, "block was added without missing tx");
+
+  //serving side: known txs are given, unknown are reported missed
+  crypto::hash unknown_id = crypto::cn_fast_hash("unknown tx", 10);
+  NOTIFY_REQUEST_COMPACT_BLOCK_TXS::request serve_req = AUTO_VAL_INIT(serve_req);
+  serve_req.block_id = get_block_hash(b);
+  serve_req.txs.push_back(b.tx_hashes.front());
+  serve_req.txs.push_back(unknown_id);
+  CHECK_AND_ASSERT_MES(rs.receive<NOTIFY_REQUEST_COMPACT_BLOCK_TXS>(serve_req, *rs.compact), false, "NOTIFY_REQUEST_COMPACT_BLOCK_TXS not handled");
+  NOTIFY_RESPONSE_COMPACT_BLOCK_TXS::request served = AUTO_VAL_INIT(served);
+  CHECK_AND_ASSERT_MES(rs.p2p.get_sent<NOTIFY_RESPONSE_COMPACT_BLOCK_TXS>(*rs.compact, served), false, "txs request wasn't answered");
+  CHECK_AND_ASSERT_MES(served.block_id == serve_req.block_id && served.txs.size() == 1 && served.missed_ids == std::list<crypto::hash>(1, unknown_id), false, "txs request answered wrong");
+  transaction served_tx;
+  CHECK_AND_ASSERT_MES(parse_and_validate_tx_from_blob(served.txs.front(), served_tx) && get_transaction_hash(served_tx) == b.tx_hashes.front(), false, "wrong tx served");
+
+  //too many ids: not answered, connection dropped
+  serve_req.txs.assign(CURRENCY_PROTOCOL_TX_INVENTORY_MAX_COUNT + 1, b.tx_hashes.front());
+  CHECK_AND_ASSERT_MES(rs.receive<NOTIFY_REQUEST_COMPACT_BLOCK_TXS>(serve_req, *rs.compact), false, "NOTIFY_REQUEST_COMPACT_BLOCK_TXS not handled");
+  CHECK_AND_ASSERT_MES(rs.p2p.count_sent<NOTIFY_RESPONSE_COMPACT_BLOCK_TXS>(*rs.compact) == 1, false, "oversized txs request was answered");
+  CHECK_AND_ASSERT_MES(rs.p2p.dropped == std::list<boost::uuids::uuid>(1, rs.compact->m_connection_id), false, "connection with oversized txs request wasn't dropped");
+  rs.p2p.dropped.clear();
+
+  //response for another block is ignored, pending block is kept
+  NOTIFY_RESPONSE_COMPACT_BLOCK_TXS::request txs_rsp = AUTO_VAL_INIT(txs_rsp);
+  txs_rsp.block_id = unknown_id;
+  txs_rsp.txs.push_back(tx_to_blob(missing_tx));
+  CHECK_AND_ASSERT_MES(rs.receive<NOTIFY_RESPONSE_COMPACT_BLOCK_TXS>(txs_rsp, *rs.source), false, "NOTIFY_RESPONSE_COMPACT_BLOCK_TXS not handled");
+  CHECK_AND_ASSERT_MES(rs.source->m_pending_compact_block_id == get_block_hash(b), false, "pending block was dropped by unrelated response");
+  CHECK_AND_ASSERT_MES(c.get_blockchain_storage().get_top_block_id() == prev_top, false, "block was added by unrelated response");
+
+  //peer can't give missing tx: regular chain sync is requested instead
+  txs_rsp = AUTO_VAL_INIT(txs_rsp);
+  txs_rsp.block_id = get_block_hash(b);
+  txs_rsp.missed_ids.push_back(missing_id);
+  CHECK_AND_ASSERT_MES(rs.receive<NOTIFY_RESPONSE_COMPACT_BLOCK_TXS>(txs_rsp, *rs.source), false, "NOTIFY_RESPONSE_COMPACT_BLOCK_TXS not handled");
+  CHECK_AND_ASSERT_MES(rs.source->m_state == currency_connection_context::state_synchronizing, false, "missed txs didn't start chain sync");
+  CHECK_AND_ASSERT_MES(rs.p2p.count_sent<NOTIFY_REQUEST_CHAIN>(*rs.source) == 1, false, "chain wasn't requested");
+  CHECK_AND_ASSERT_MES(rs.source->m_pending_compact_block_id == null_hash, false, "pending block wasn't dropped");
+  CHECK_AND_ASSERT_MES(c.get_blockchain_storage().get_top_block_id() == prev_top, false, "block was added without missing tx");
+
+  //same block again, this time peer gives the tx
+  rs.source->m_state = currency_connection_context::state_normal;
+  rs.p2p.sent.clear();
+  CHECK_AND_ASSERT_MES(rs.receive<NOTIFY_NEW_COMPACT_BLOCK>(compact_arg, *rs.source), false, "NOTIFY_NEW_COMPACT_BLOCK not handled");
+  CHECK_AND_ASSERT_MES(rs.p2p.count_sent<NOTIFY_REQUEST_COMPACT_BLOCK_TXS>(*rs.source) == 1, false, "missing txs weren't requested again");
+  txs_rsp = AUTO_VAL_INIT(txs_rsp);
+  txs_rsp.block_id = get_block_hash(b);
+  txs_rsp.txs.push_back(tx_to_blob(missing_tx));
+  CHECK_AND_ASSERT_MES(rs.receive<NOTIFY_RESPONSE_COMPACT_BLOCK_TXS>(txs_rsp, *rs.source), false, "NOTIFY_RESPONSE_COMPACT_BLOCK_TXS not handled");
+  CHECK_AND_ASSERT_MES(check_relayed(c, rs, b), false, "block with requested tx wasn't relayed");
+  CHECK_AND_ASSERT_MES(c.get_pool_transactions_count() == 0, false, "block txs left in pool");
+  return true;
+}
+
+bool compact_block_relay_test::check_reconstruction(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  relay_setup rs(c);
+  block b = AUTO_VAL_INIT(b);
+  CHECK_AND_ASSERT_MES(make_next_block(c, b), false, "failed to make block");
+  CHECK_AND_ASSERT_MES(b.tx_hashes.size() == 2, false, "unexpected block txs count " << b.tx_hashes.size());
+
+  //all txs are in pool: block goes on at once, nothing is requested
+  NOTIFY_NEW_COMPACT_BLOCK::request compact_arg = make_compact_block(c, b);
+  CHECK_AND_ASSERT_MES(rs.receive<NOTIFY_NEW_COMPACT_BLOCK>(compact_arg, *rs.source), false, "NOTIFY_NEW_COMPACT_BLOCK not handled");
+  CHECK_AND_ASSERT_MES(!rs.p2p.count_sent<NOTIFY_REQUEST_COMPACT_BLOCK_TXS>(*rs.source), false, "txs were requested though all are in pool");
+  CHECK_AND_ASSERT_MES(check_relayed(c, rs, b), false, "reconstructed block wasn't relayed");
+
+  //known block isn't processed nor relayed again
+  rs.p2p.sent.clear();
+  CHECK_AND_ASSERT_MES(rs.receive<NOTIFY_NEW_COMPACT_BLOCK>(compact_arg, *rs.compact), false, "NOTIFY_NEW_COMPACT_BLOCK not handled");
+  CHECK_AND_ASSERT_MES(rs.p2p.sent.empty(), false, "known block caused " << rs.p2p.sent.size() << " notifications");
+  return true;
+}
+
+bool compact_block_relay_test::check_tx_announce_queue_cap(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  relay_setup rs(c);
+  currency_connection_context& inventory = rs.add_peer(4, CURRENCY_PROTOCOL_FLAG_TX_INVENTORY);
+
+  //more txs than announce queue holds arrive before anything is flushed
+  const size_t dropped_count = 10;
+  NOTIFY_NEW_TRANSACTIONS::request arg = AUTO_VAL_INIT(arg);
+  std::list<crypto::hash> ids;
+  for (size_t i = 0; i != CURRENCY_PROTOCOL_TX_ANNOUNCE_QUEUE_MAX_COUNT + dropped_count; ++i)
+  {
+    transaction tx = AUTO_VAL_INIT(tx);
+    tx.unlock_time = i;
+    arg.txs.push_back(tx_to_blob(tx));
+    ids.push_back(get_transaction_hash(tx));
+  }
+  CHECK_AND_ASSERT_MES(static_cast<i_currency_protocol&>(rs.handler).relay_transactions(arg, *rs.source), false, "relay_transactions failed");
+
+  //oldest ids were dropped, the rest is announced in order
+  rs.p2p.sent.clear();
+  for (size_t i = 0; i != CURRENCY_PROTOCOL_TX_ANNOUNCE_QUEUE_MAX_COUNT / CURRENCY_PROTOCOL_TX_INVENTORY_MAX_COUNT + 1; ++i)
+    rs.handler.on_idle();
+  std::list<crypto::hash> announced;
+  for (const auto& sn : rs.p2p.sent)
+  {
+    if (sn.command != NOTIFY_TX_INVENTORY::ID || sn.to != inventory.m_connection_id)
+      continue;
+    NOTIFY_TX_INVENTORY::request inv = AUTO_VAL_INIT(inv);
+    CHECK_AND_ASSERT_MES(load_sent(sn.buff, inv), false, "failed to load NOTIFY_TX_INVENTORY");
+    announced.splice(announced.end(), inv.txs);
+  }
+  auto first_kept = ids.begin();
+  std::advance(first_kept, dropped_count);
+  CHECK_AND_ASSERT_MES(announced == std::list<crypto::hash>(first_kept, ids.end()), false, "announced " << announced.size() << " txs instead of the last " << CURRENCY_PROTOCOL_TX_ANNOUNCE_QUEUE_MAX_COUNT);
+  return true;
+}
+
+bool compact_block_relay_test::check_tx_inventory_limits(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  relay_setup rs(c);
+  currency_connection_context& inventory = rs.add_peer(4, CURRENCY_PROTOCOL_FLAG_TX_INVENTORY);
+  currency_connection_context& other_inventory = rs.add_peer(5, CURRENCY_PROTOCOL_FLAG_TX_INVENTORY);
+
+  //broken blob among relayed ones: the good one is still announced, full peer gets both
+  NOTIFY_NEW_TRANSACTIONS::request arg = AUTO_VAL_INIT(arg);
+  transaction tx = AUTO_VAL_INIT(tx);
+  arg.txs.push_back("broken tx blob");
+  arg.txs.push_back(tx_to_blob(tx));
+  CHECK_AND_ASSERT_MES(static_cast<i_currency_protocol&>(rs.handler).relay_transactions(arg, *rs.source), false, "relay_transactions failed");
+  NOTIFY_NEW_TRANSACTIONS::request full_arg = AUTO_VAL_INIT(full_arg);
+  CHECK_AND_ASSERT_MES(rs.p2p.get_sent<NOTIFY_NEW_TRANSACTIONS>(*rs.full, full_arg) && full_arg.txs == arg.txs, false, "full peer didn't get relayed txs");
+  rs.handler.on_idle();
+  NOTIFY_TX_INVENTORY::request inv = AUTO_VAL_INIT(inv);
+  CHECK_AND_ASSERT_MES(rs.p2p.get_sent<NOTIFY_TX_INVENTORY>(inventory, inv), false, "good tx wasn't announced");
+  CHECK_AND_ASSERT_MES(inv.txs == std::list<crypto::hash>(1, get_transaction_hash(tx)), false, "announced " << inv.txs.size() << " txs instead of the good one");
+
+  //peer announcing txs it never delivers gets at most the limit of them requested
+  const size_t batches = CURRENCY_PROTOCOL_TX_REQUESTED_MAX_COUNT / CURRENCY_PROTOCOL_TX_INVENTORY_MAX_COUNT + 1;
+  std::list<crypto::hash> last_batch;
+  rs.p2p.sent.clear();
+  for (size_t b = 0; b != batches; ++b)
+  {
+    NOTIFY_TX_INVENTORY::request announce = AUTO_VAL_INIT(announce);
+    for (size_t i = 0; i != CURRENCY_PROTOCOL_TX_INVENTORY_MAX_COUNT; ++i)
+    {
+      uint64_t n = b * CURRENCY_PROTOCOL_TX_INVENTORY_MAX_COUNT + i;
+      announce.txs.push_back(crypto::cn_fast_hash(&n, sizeof(n)));
+    }
+    last_batch = announce.txs;
+    CHECK_AND_ASSERT_MES(rs.receive<NOTIFY_TX_INVENTORY>(announce, inventory), false, "NOTIFY_TX_INVENTORY not handled");
+  }
+  size_t requested = 0;
+  for (const auto& sn : rs.p2p.sent)
+  {
+    if (sn.command != NOTIFY_REQUEST_TXS::ID || sn.to != inventory.m_connection_id)
+      continue;
+    NOTIFY_REQUEST_TXS::request req = AUTO_VAL_INIT(req);
+    CHECK_AND_ASSERT_MES(load_sent(sn.buff, req), false, "failed to load NOTIFY_REQUEST_TXS");
+    requested += req.txs.size();
+  }
+  CHECK_AND_ASSERT_MES(requested == CURRENCY_PROTOCOL_TX_REQUESTED_MAX_COUNT, false, "requested " << requested << " txs from one peer");
+  CHECK_AND_ASSERT_MES(rs.p2p.dropped.empty(), false, "connection was dropped");
+
+  //ignored announcements are requested from another peer
+  NOTIFY_TX_INVENTORY::request announce = AUTO_VAL_INIT(announce);
+  announce.txs = last_batch;
+  CHECK_AND_ASSERT_MES(rs.receive<NOTIFY_TX_INVENTORY>(announce, other_inventory), false, "NOTIFY_TX_INVENTORY not handled");
+  NOTIFY_REQUEST_TXS::request req = AUTO_VAL_INIT(req);
+  CHECK_AND_ASSERT_MES(rs.p2p.get_sent<NOTIFY_REQUEST_TXS>(other_inventory, req) && req.txs == last_batch, false, "ignored txs weren't requested from another peer");
+  return true;
+}
@@ -0,0 +1,21 @@
+// Copyright (c) 2012-2013 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once 
+#include "chaingen.h"
+
+/************************************************************************/
+/* Compact blocks received by real protocol handler on top of the core */
+/************************************************************************/
+struct compact_block_relay_test : public test_chain_unit_base
+{
+  compact_block_relay_test();
+
+  bool generate(std::vector<test_event_entry>& events) const;
+
+  bool check_missing_txs_request(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+  bool check_reconstruction(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+  bool check_tx_announce_queue_cap(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+  bool check_tx_inventory_limits(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+};
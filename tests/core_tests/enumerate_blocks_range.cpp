@@ -0,0 +1,121 @@
+// Copyright (c) 2012-2013 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chaingen.h"
+#include "chaingen_tests_list.h"
+
+#include "enumerate_blocks_range.h"
+
+using namespace epee;
+using namespace currency;
+
+namespace
+{
+  struct visited_block
+  {
+    uint64_t height;
+    crypto::hash id;
+    wide_difficulty_type difficulty;
+  };
+
+  bool enumerate(core& c, uint64_t start_height, uint64_t count, std::vector<visited_block>& visited, bool& busy, size_t stop_after = SIZE_MAX)
+  {
+    visited.clear();
+    return c.get_blockchain_storage().enumerate_blocks_range(start_height, count, [&](const blockchain_storage::block_extended_info& bei, const wide_difficulty_type& difficulty)
+    {
+      visited_block vb = AUTO_VAL_INIT(vb);
+      vb.height = bei.height;
+      vb.id = get_block_hash(bei.bl);
+      vb.difficulty = difficulty;
+      visited.push_back(vb);
+      return visited.size() < stop_after;
+    }, busy);
+  }
+
+  bool check_visited(core& c, const std::vector<visited_block>& visited, uint64_t start_height, uint64_t count)
+  {
+    CHECK_AND_ASSERT_MES(visited.size() == count, false, "visited " << visited.size() << " blocks from " << start_height << ", expected " << count);
+    for (size_t i = 0; i != visited.size(); ++i)
+    {
+      uint64_t h = start_height + i;
+      blockchain_storage::block_extended_info bei = AUTO_VAL_INIT(bei);
+      bool r = c.get_blockchain_storage().get_block_extended_info_by_height(h, bei);
+      CHECK_AND_ASSERT_MES(r, false, "can't get block " << h);
+      wide_difficulty_type expected_difficulty = bei.cumulative_difficulty;
+      if (h)
+      {
+        blockchain_storage::block_extended_info prev_bei = AUTO_VAL_INIT(prev_bei);
+        r = c.get_blockchain_storage().get_block_extended_info_by_height(h - 1, prev_bei);
+        CHECK_AND_ASSERT_MES(r, false, "can't get block " << h - 1);
+        expected_difficulty -= prev_bei.cumulative_difficulty;
+      }
+      CHECK_AND_ASSERT_MES(visited[i].height == h, false, "wrong height " << visited[i].height << ", expected " << h);
+      CHECK_AND_ASSERT_MES(visited[i].id == get_block_hash(bei.bl), false, "wrong block at height " << h);
+      CHECK_AND_ASSERT_MES(visited[i].difficulty == expected_difficulty, false, "wrong difficulty " << visited[i].difficulty << " at height " << h << ", expected " << expected_difficulty);
+      CHECK_AND_ASSERT_MES(expected_difficulty == c.get_blockchain_storage().block_difficulty(h), false, "difficulty differs from block_difficulty() at height " << h);
+    }
+    return true;
+  }
+}
+
+enumerate_blocks_range_test::enumerate_blocks_range_test()
+{
+  REGISTER_CALLBACK_METHOD(enumerate_blocks_range_test, check_enumerate_blocks_range);
+}
+
+bool enumerate_blocks_range_test::generate(std::vector<test_event_entry>& events) const
+{
+  uint64_t ts_start = 1338224400;
+  GENERATE_ACCOUNT(miner_account);
+  MAKE_GENESIS_BLOCK(events, blk_0, miner_account, ts_start);
+  REWIND_BLOCKS_N(events, blk_0r, blk_0, miner_account, 20);
+  DO_CALLBACK(events, "check_enumerate_blocks_range");
+  return true;
+}
+
+bool enumerate_blocks_range_test::check_enumerate_blocks_range(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  uint64_t height = c.get_current_blockchain_height();
+  CHECK_AND_ASSERT_MES(height == 21, false, "unexpected blockchain height " << height);
+  std::vector<visited_block> visited;
+  bool busy = true;
+
+  //whole chain, difficulty of genesis is its cumulative difficulty
+  bool r = enumerate(c, 0, height, visited, busy);
+  CHECK_AND_ASSERT_MES(r && !busy, false, "enumerate_blocks_range(0, " << height << ") failed");
+  CHECK_AND_ASSERT_MES(check_visited(c, visited, 0, height), false, "whole chain check failed");
+
+  //range in the middle, difficulty of the first block comes from the block before range
+  r = enumerate(c, 5, 7, visited, busy);
+  CHECK_AND_ASSERT_MES(r && !busy, false, "enumerate_blocks_range(5, 7) failed");
+  CHECK_AND_ASSERT_MES(check_visited(c, visited, 5, 7), false, "middle range check failed");
+
+  //count beyond the top is cut at the top block
+  r = enumerate(c, height - 3, 1000, visited, busy);
+  CHECK_AND_ASSERT_MES(r && !busy, false, "enumerate_blocks_range(" << height - 3 << ", 1000) failed");
+  CHECK_AND_ASSERT_MES(check_visited(c, visited, height - 3, 3), false, "range past the top check failed");
+
+  //callback stops enumeration
+  r = enumerate(c, 1, 10, visited, busy, 4);
+  CHECK_AND_ASSERT_MES(r && !busy, false, "stopped enumerate_blocks_range failed");
+  CHECK_AND_ASSERT_MES(check_visited(c, visited, 1, 4), false, "stopped range check failed");
+
+  //zero count
+  r = enumerate(c, 3, 0, visited, busy);
+  CHECK_AND_ASSERT_MES(r && !busy && visited.empty(), false, "empty range failed");
+
+  //start beyond the top is an error, not busy
+  r = enumerate(c, height, 1, visited, busy);
+  CHECK_AND_ASSERT_MES(!r && !busy && visited.empty(), false, "start at blockchain height was accepted");
+
+  //batch exclusive operation makes it busy
+  c.get_blockchain_storage().start_batch_exclusive_operation();
+  r = enumerate(c, 0, height, visited, busy);
+  c.get_blockchain_storage().finish_batch_exclusive_operation(true);
+  CHECK_AND_ASSERT_MES(!r && busy && visited.empty(), false, "enumerate_blocks_range during batch exclusive operation wasn't rejected as busy");
+
+  r = enumerate(c, 0, 1, visited, busy);
+  CHECK_AND_ASSERT_MES(r && !busy && visited.size() == 1, false, "enumerate_blocks_range after batch exclusive operation failed");
+  return true;
+}
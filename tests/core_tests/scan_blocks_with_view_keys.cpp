@@ -0,0 +1,222 @@
+// Copyright (c) 2012-2013 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <thread>
+
+#include "chaingen.h"
+#include "chaingen_tests_list.h"
+
+#include "scan_blocks_with_view_keys.h"
+
+using namespace epee;
+using namespace currency;
+
+#define SCAN_VIEW_KEYS_TEST_PAYMENT_ID  "scan test payment"
+
+namespace
+{
+  //accounts pushed to events by generate(): miner, alice, bob
+  bool get_accounts(const std::vector<test_event_entry>& events, std::vector<account_base>& accounts)
+  {
+    for (const auto& ev : events)
+    {
+      if (ev.type() == typeid(account_base))
+        accounts.push_back(boost::get<account_base>(ev));
+    }
+    CHECK_AND_ASSERT_MES(accounts.size() == 3, false, "expected 3 accounts in events, found " << accounts.size());
+    return true;
+  }
+
+  //same matches found the plain way: every tx of every block checked with lookup_acc_outs()
+  bool find_expected(core& c, const std::vector<account_base>& accounts, uint64_t start_height, uint64_t end_height, std::vector<blockchain_storage::view_key_scan_match>& expected)
+  {
+    expected.clear();
+    blockchain_storage& bcs = c.get_blockchain_storage();
+    for (uint64_t h = start_height; h != end_height; ++h)
+    {
+      block b = AUTO_VAL_INIT(b);
+      CHECK_AND_ASSERT_MES(bcs.get_block_by_height(h, b), false, "can't get block " << h);
+      std::list<transaction> txs;
+      std::list<crypto::hash> missed;
+      bcs.get_transactions(b.tx_hashes, txs, missed);
+      CHECK_AND_ASSERT_MES(missed.empty(), false, "block " << h << " txs are missing");
+      txs.push_front(b.miner_tx);
+
+      for (const auto& tx : txs)
+      {
+        crypto::hash tx_id = get_transaction_hash(tx);
+        std::vector<uint64_t> global_indexes;
+        CHECK_AND_ASSERT_MES(bcs.get_tx_outputs_gindexs(tx_id, global_indexes), false, "can't get global indexes of tx " << tx_id);
+        payment_id_t payment_id;
+        get_payment_id_from_tx_extra(tx, payment_id);
+        for (size_t k = 0; k != accounts.size(); ++k)
+        {
+          std::vector<size_t> outs;
+          uint64_t money = 0;
+          CHECK_AND_ASSERT_MES(lookup_acc_outs(accounts[k].get_keys(), tx, outs, money), false, "lookup_acc_outs failed");
+          for (size_t o : outs)
+          {
+            blockchain_storage::view_key_scan_match m = AUTO_VAL_INIT(m);
+            m.key_index = k;
+            m.block_height = h;
+            m.tx_id = tx_id;
+            m.payment_id = payment_id;
+            m.out_index = o;
+            m.global_out_index = global_indexes[o];
+            m.amount = tx.vout[o].amount;
+            expected.push_back(m);
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  bool check_matches(const std::vector<blockchain_storage::view_key_scan_match>& expected, const std::vector<blockchain_storage::view_key_scan_match>& matches)
+  {
+    CHECK_AND_ASSERT_MES(matches.size() == expected.size(), false, "found " << matches.size() << " outputs, expected " << expected.size());
+    for (size_t i = 0; i != matches.size(); ++i)
+    {
+      const blockchain_storage::view_key_scan_match& m = matches[i];
+      const blockchain_storage::view_key_scan_match& e = expected[i];
+      CHECK_AND_ASSERT_MES(m.key_index == e.key_index && m.block_height == e.block_height && m.tx_id == e.tx_id && m.out_index == e.out_index, false,
+        "match " << i << " is output " << m.out_index << " of tx " << m.tx_id << " at " << m.block_height << " for key " << m.key_index <<
+        ", expected output " << e.out_index << " of tx " << e.tx_id << " at " << e.block_height << " for key " << e.key_index);
+      CHECK_AND_ASSERT_MES(m.global_out_index == e.global_out_index && m.amount == e.amount && m.payment_id == e.payment_id, false,
+        "match " << i << " has wrong global index, amount or payment id");
+    }
+    return true;
+  }
+}
+
+scan_blocks_with_view_keys_test::scan_blocks_with_view_keys_test()
+{
+  REGISTER_CALLBACK_METHOD(scan_blocks_with_view_keys_test, check_scan_blocks_with_view_keys);
+}
+
+bool scan_blocks_with_view_keys_test::generate(std::vector<test_event_entry>& events) const
+{
+  uint64_t ts_start = 1338224400;
+  GENERATE_ACCOUNT(miner_account);
+  MAKE_GENESIS_BLOCK(events, blk_0, miner_account, ts_start);
+  events.push_back(miner_account);
+  MAKE_ACCOUNT(events, alice_account);
+  MAKE_ACCOUNT(events, bob_account);
+  REWIND_BLOCKS(events, blk_0r, blk_0, miner_account);
+
+  //alice gets a payment with payment id, bob the next block reward and a plain transfer in the block after
+  std::vector<tx_source_entry> sources;
+  std::vector<tx_destination_entry> destinations;
+  fill_tx_sources_and_destinations(events, blk_0r, miner_account, alice_account, MK_COINS(5), TESTS_DEFAULT_FEE, 0, sources, destinations);
+  std::vector<uint8_t> extra;
+  CHECK_AND_ASSERT_MES(set_payment_id_to_tx_extra(extra, SCAN_VIEW_KEYS_TEST_PAYMENT_ID), false, "set_payment_id_to_tx_extra failed");
+  transaction tx_1 = AUTO_VAL_INIT(tx_1);
+  keypair tx_1_key = AUTO_VAL_INIT(tx_1_key);
+  CHECK_AND_ASSERT_MES(construct_tx(miner_account.get_keys(), sources, destinations, extra, tx_1, tx_1_key, 0, CURRENCY_TO_KEY_OUT_RELAXED), false, "construct_tx failed");
+  events.push_back(tx_1);
+  MAKE_NEXT_BLOCK_TX1(events, blk_1, blk_0r, bob_account, tx_1);
+  MAKE_TX(events, tx_2, miner_account, bob_account, MK_COINS(3), blk_1);
+  MAKE_NEXT_BLOCK_TX1(events, blk_2, blk_1, miner_account, tx_2);
+
+  //enough blocks for the scan to be split between threads
+  REWIND_BLOCKS_N(events, blk_2r, blk_2, miner_account, 3 * BLOCKCHAIN_VIEW_KEY_SCAN_MIN_BLOCKS_PER_THREAD);
+  DO_CALLBACK(events, "check_scan_blocks_with_view_keys");
+  return true;
+}
+
+bool scan_blocks_with_view_keys_test::check_scan_blocks_with_view_keys(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events)
+{
+  blockchain_storage& bcs = c.get_blockchain_storage();
+  uint64_t height = c.get_current_blockchain_height();
+  uint64_t payments_height = CURRENCY_MINED_MONEY_UNLOCK_WINDOW + 1;
+  CHECK_AND_ASSERT_MES(height == payments_height + 2 + 3 * BLOCKCHAIN_VIEW_KEY_SCAN_MIN_BLOCKS_PER_THREAD, false, "unexpected blockchain height " << height);
+
+  std::vector<account_base> accounts;
+  CHECK_AND_ASSERT_MES(get_accounts(events, accounts), false, "failed to get accounts");
+  std::vector<blockchain_storage::view_key_scan_entry> keys;
+  for (const auto& acc : accounts)
+  {
+    blockchain_storage::view_key_scan_entry e = AUTO_VAL_INIT(e);
+    e.view_secret_key = acc.get_keys().m_view_secret_key;
+    e.spend_public_key = acc.get_keys().m_account_address.m_spend_public_key;
+    keys.push_back(e);
+  }
+
+  //whole chain: result doesn't depend on how it's split between threads
+  std::vector<blockchain_storage::view_key_scan_match> expected, matches;
+  bool busy = false;
+  CHECK_AND_ASSERT_MES(find_expected(c, accounts, 0, height, expected), false, "failed to find expected outputs");
+  size_t threads_counts[] = {1, 3, 4, 100, 0};
+  for (size_t threads_count : threads_counts)
+  {
+    CHECK_AND_ASSERT_MES(bcs.scan_blocks_with_view_keys(keys, 0, height, matches, busy, threads_count), false, "scan with " << threads_count << " threads failed");
+    CHECK_AND_ASSERT_MES(check_matches(expected, matches), false, "scan with " << threads_count << " threads gave wrong outputs");
+  }
+
+  //alice's only output is the payment, bob's are block reward and transfer right after it
+  size_t alice_count = 0, bob_count = 0;
+  for (const auto& m : matches)
+  {
+    if (m.key_index == 1)
+    {
+      ++alice_count;
+      CHECK_AND_ASSERT_MES(m.block_height == payments_height && m.payment_id == SCAN_VIEW_KEYS_TEST_PAYMENT_ID, false, "wrong alice's output at " << m.block_height);
+    }
+    else if (m.key_index == 2)
+    {
+      ++bob_count;
+      CHECK_AND_ASSERT_MES((m.block_height == payments_height || m.block_height == payments_height + 1) && m.payment_id.empty(), false, "wrong bob's output at " << m.block_height);
+    }
+  }
+  CHECK_AND_ASSERT_MES(alice_count && bob_count, false, "alice's or bob's outputs not found");
+
+  //inner range and single key
+  CHECK_AND_ASSERT_MES(find_expected(c, accounts, payments_height, payments_height + 12, expected), false, "failed to find expected outputs");
+  CHECK_AND_ASSERT_MES(bcs.scan_blocks_with_view_keys(keys, payments_height, payments_height + 12, matches, busy, 4), false, "range scan failed");
+  CHECK_AND_ASSERT_MES(check_matches(expected, matches), false, "range scan gave wrong outputs");
+  std::vector<blockchain_storage::view_key_scan_entry> alice_keys(1, keys[1]);
+  CHECK_AND_ASSERT_MES(bcs.scan_blocks_with_view_keys(alice_keys, 0, height, matches, busy, 4), false, "single key scan failed");
+  CHECK_AND_ASSERT_MES(matches.size() == alice_count && matches.front().key_index == 0, false, "single key scan found " << matches.size() << " outputs");
+
+  //empty requests, range beyond the top
+  CHECK_AND_ASSERT_MES(bcs.scan_blocks_with_view_keys(keys, 5, 5, matches, busy) && matches.empty(), false, "empty range isn't empty");
+  CHECK_AND_ASSERT_MES(bcs.scan_blocks_with_view_keys(std::vector<blockchain_storage::view_key_scan_entry>(), 0, height, matches, busy) && matches.empty(), false, "scan without keys isn't empty");
+  //error, not busy
+  CHECK_AND_ASSERT_MES(!bcs.scan_blocks_with_view_keys(keys, 0, height + 1, matches, busy) && !busy, false, "range beyond the top was scanned or reported as busy");
+
+  //rejected as busy while batch exclusive operation is running
+  CHECK_AND_ASSERT_MES(bcs.start_batch_exclusive_operation(), false, "start_batch_exclusive_operation failed");
+  bool r = bcs.scan_blocks_with_view_keys(keys, 0, height, matches, busy);
+  CHECK_AND_ASSERT_MES(bcs.finish_batch_exclusive_operation(true), false, "finish_batch_exclusive_operation failed");
+  CHECK_AND_ASSERT_MES(!r && busy, false, "scan wasn't rejected as busy during batch exclusive operation");
+  CHECK_AND_ASSERT_MES(bcs.scan_blocks_with_view_keys(alice_keys, 0, height, matches, busy) && matches.size() == alice_count, false, "scan after batch exclusive operation failed");
+
+  //concurrent scans share the workers: each one is either done right or rejected as busy
+  CHECK_AND_ASSERT_MES(find_expected(c, accounts, 0, height, expected), false, "failed to find expected outputs");
+  std::vector<std::vector<blockchain_storage::view_key_scan_match> > concurrent_matches(16);
+  std::vector<char> concurrent_results(concurrent_matches.size(), 0), concurrent_busy(concurrent_matches.size(), 0);
+  std::vector<std::thread> scanners;
+  for (size_t i = 0; i != concurrent_matches.size(); ++i)
+  {
+    scanners.emplace_back([&, i]()
+    {
+      bool scan_busy = false;
+      concurrent_results[i] = bcs.scan_blocks_with_view_keys(keys, 0, height, concurrent_matches[i], scan_busy) ? 1 : 0;
+      concurrent_busy[i] = scan_busy ? 1 : 0;
+    });
+  }
+  for (auto& t : scanners)
+    t.join();
+  size_t done_count = 0;
+  for (size_t i = 0; i != concurrent_matches.size(); ++i)
+  {
+    CHECK_AND_ASSERT_MES(concurrent_results[i] || concurrent_busy[i], false, "concurrent scan " << i << " failed without being busy");
+    if (!concurrent_results[i])
+      continue;
+    ++done_count;
+    CHECK_AND_ASSERT_MES(check_matches(expected, concurrent_matches[i]), false, "concurrent scan " << i << " gave wrong outputs");
+  }
+  CHECK_AND_ASSERT_MES(done_count, false, "all concurrent scans were rejected");
+  return true;
+}
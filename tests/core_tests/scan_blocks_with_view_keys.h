@@ -0,0 +1,15 @@
+// Copyright (c) 2012-2013 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+#include "chaingen.h"
+
+struct scan_blocks_with_view_keys_test : public test_chain_unit_base
+{
+  scan_blocks_with_view_keys_test();
+
+  bool generate(std::vector<test_event_entry>& events) const;
+
+  bool check_scan_blocks_with_view_keys(currency::core& c, size_t ev_index, const std::vector<test_event_entry>& events);
+};
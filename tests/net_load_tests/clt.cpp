@@ -26,6 +26,11 @@ namespace
   const size_t CONNECTION_TIMEOUT = 10000;
   const size_t DEFAULT_OPERATION_TIMEOUT = 30000;
   const size_t RESERVED_CONN_CNT = 1;
+  const size_t BROADCAST_CONNECTION_COUNT = 1000;
+  const size_t BROADCAST_MESSAGE_COUNT = 100;
+  const size_t BROADCAST_MESSAGE_SIZE = 256;
+
+  bool g_io_service_per_thread = false;
 
   template<typename t_predicate>
   bool busy_wait_for(size_t timeout_ms, const t_predicate& predicate, size_t sleep_ms = 10)
@@ -164,6 +169,8 @@ namespace
 
       m_tcp_server.get_config_object().m_pcommands_handler = &m_commands_handler;
       m_tcp_server.get_config_object().m_invoke_timeout = CONNECTION_TIMEOUT;
+      if (g_io_service_per_thread)
+        m_tcp_server.set_io_service_per_thread(m_thread_count);
 
       ASSERT_TRUE(m_tcp_server.init_server(clt_port, "127.0.0.1"));
       ASSERT_TRUE(m_tcp_server.run_server(m_thread_count, false));
@@ -594,6 +601,47 @@ TEST_F(net_load_test_clt, permament_open_and_close_and_connections_closed_by_ser
   ASSERT_EQ(RESERVED_CONN_CNT, m_tcp_server.get_config_object().get_connections_count());
 }
 
+TEST_F(net_load_test_clt, connections_and_broadcast_messages_per_second)
+{
+  // Open connections
+  t_connection_opener_1 connection_opener(m_tcp_server, BROADCAST_CONNECTION_COUNT);
+  uint64_t open_start = epee::misc_utils::get_tick_count();
+  parallel_exec([&] {
+    while (connection_opener.open());
+  });
+
+  EXPECT_TRUE(busy_wait_for(DEFAULT_OPERATION_TIMEOUT, [&]{ return BROADCAST_CONNECTION_COUNT + RESERVED_CONN_CNT <= m_commands_handler.new_connection_counter() + connection_opener.error_count(); }, 1));
+  uint64_t open_time = (std::max)(uint64_t(1), epee::misc_utils::get_tick_count() - open_start);
+  size_t opened = m_commands_handler.new_connection_counter() - RESERVED_CONN_CNT;
+  ASSERT_EQ(0, connection_opener.error_count());
+  LOG_PRINT_L0("opened " << opened << " connections in " << open_time << " ms, " << opened * 1000 / open_time << " connections/s");
+
+  // Wait for server to see them all, otherwise broadcast misses some
+  CMD_GET_STATISTICS::response srv_stat;
+  ASSERT_TRUE(busy_wait_for_server_statistics(srv_stat, [&](const CMD_GET_STATISTICS::response& stat) { return opened + RESERVED_CONN_CNT <= stat.opened_connections_count; }));
+
+  // Server notifies every connection but the command one
+  CMD_START_BROADCAST_TEST::request req;
+  req.message_count = BROADCAST_MESSAGE_COUNT;
+  req.message_size = BROADCAST_MESSAGE_SIZE;
+  size_t expected = opened * BROADCAST_MESSAGE_COUNT;
+  uint64_t broadcast_start = epee::misc_utils::get_tick_count();
+  ASSERT_TRUE(epee::net_utils::notify_remote_command2(m_cmd_conn_id, CMD_START_BROADCAST_TEST::ID, req, m_tcp_server.get_config_object()));
+  EXPECT_TRUE(busy_wait_for(DEFAULT_OPERATION_TIMEOUT, [&]{ return expected <= m_commands_handler.notify_counter(); }, 1));
+  uint64_t broadcast_time = (std::max)(uint64_t(1), epee::misc_utils::get_tick_count() - broadcast_start);
+  LOG_PRINT_L0("received " << m_commands_handler.notify_counter() << " of " << expected << " messages in " << broadcast_time << " ms, " <<
+    m_commands_handler.notify_counter() * 1000 / broadcast_time << " messages/s");
+  ASSERT_EQ(expected, m_commands_handler.notify_counter());
+
+  // Close connections
+  parallel_exec([&](size_t thread_idx) {
+    for (size_t i = thread_idx; i < BROADCAST_CONNECTION_COUNT; i += m_thread_count)
+      connection_opener.close(i);
+  });
+  EXPECT_TRUE(busy_wait_for(DEFAULT_OPERATION_TIMEOUT, [&]{ return m_commands_handler.new_connection_counter() - RESERVED_CONN_CNT <= m_commands_handler.close_connection_counter(); }));
+  ASSERT_EQ(RESERVED_CONN_CNT, m_tcp_server.get_config_object().get_connections_count());
+}
+
 int main(int argc, char** argv)
 {
   epee::debug::get_set_enable_assert(true, false);
@@ -602,5 +650,6 @@ int main(int argc, char** argv)
   epee::log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
 
   ::testing::InitGoogleTest(&argc, argv);
+  g_io_service_per_thread = has_io_service_per_thread_arg(argc, argv);
   return RUN_ALL_TESTS();
 }
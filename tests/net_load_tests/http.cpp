@@ -0,0 +1,139 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "include_base_utils.h"
+#include "misc_log_ex.h"
+#include "misc_os_dependent.h"
+#include "net/abstract_tcp_server2.h"
+#include "net/http_protocol_handler.h"
+
+// Measures requests per second of epee http server on small rpc-like requests,
+// each client keeps its connection alive and sends requests one by one or pipelined.
+// Usage: net_load_tests_http [client_count] [requests_per_client]
+
+using namespace epee;
+
+namespace
+{
+  const uint32_t http_srv_port = 36233;
+  const char* const http_request =
+    "POST /json_rpc HTTP/1.1\r\n"
+    "Host: 127.0.0.1\r\n"
+    "User-Agent: net_load_tests\r\n"
+    "Accept: */*\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: 56\r\n"
+    "\r\n"
+    "{\"jsonrpc\":\"2.0\",\"id\":\"0\",\"method\":\"getlastblockheader\"}";
+
+  struct http_load_handler : public net_utils::http::i_http_server_handler<net_utils::connection_context_base>
+  {
+    virtual bool handle_http_request(const net_utils::http::http_request_info& query_info, net_utils::http::http_response_info& response, net_utils::connection_context_base& context)
+    {
+      response.m_mime_tipe = "application/json";
+      response.m_body = "{\"id\":\"0\",\"jsonrpc\":\"2.0\",\"result\":{\"height\":100000,\"status\":\"OK\"}}";
+      return true;
+    }
+  };
+
+  typedef net_utils::boosted_tcp_server<net_utils::http::http_custom_handler<net_utils::connection_context_base> > http_test_server;
+
+  // reads until count responses are received, returns false on error
+  bool read_responses(boost::asio::ip::tcp::socket& sock, std::string& buff, size_t count)
+  {
+    char tmp[16384];
+    while (count)
+    {
+      std::string::size_type head_end = buff.find("\r\n\r\n");
+      if (std::string::npos != head_end)
+      {
+        // server always sends it, see get_response_header()
+        std::string::size_type len_pos = buff.find("Content-Length: ");
+        CHECK_AND_ASSERT_MES(len_pos < head_end, false, "No content length in response");
+        size_t len = strtoul(buff.c_str() + len_pos + 16, NULL, 10);
+        if (buff.size() >= head_end + 4 + len)
+        {
+          buff.erase(0, head_end + 4 + len);
+          --count;
+          continue;
+        }
+      }
+      boost::system::error_code ec;
+      size_t read = sock.read_some(boost::asio::buffer(tmp), ec);
+      CHECK_AND_ASSERT_MES(!ec, false, "read failed: " << ec.message());
+      buff.append(tmp, read);
+    }
+    return true;
+  }
+
+  void run_clients(size_t client_count, size_t requests_per_client, size_t pipeline_depth)
+  {
+    std::atomic<size_t> done(0);
+    std::atomic<size_t> failed(0);
+    uint64_t start = misc_utils::get_tick_count();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i != client_count; ++i)
+    {
+      threads.push_back(std::thread([&] {
+        boost::asio::io_service io_service;
+        boost::asio::ip::tcp::socket sock(io_service);
+        boost::system::error_code ec;
+        sock.connect(boost::asio::ip::tcp::endpoint(boost::asio::ip::address::from_string("127.0.0.1"), http_srv_port), ec);
+        if (ec)
+        {
+          failed += requests_per_client;
+          return;
+        }
+        std::string batch;
+        for (size_t j = 0; j != pipeline_depth; ++j)
+          batch += http_request;
+        std::string buff;
+        for (size_t sent = 0; sent < requests_per_client; sent += pipeline_depth)
+        {
+          boost::asio::write(sock, boost::asio::buffer(batch), ec);
+          if (ec || !read_responses(sock, buff, pipeline_depth))
+          {
+            failed += requests_per_client - sent;
+            return;
+          }
+          done += pipeline_depth;
+        }
+      }));
+    }
+    for (auto& th : threads)
+      th.join();
+    uint64_t time = (std::max)(uint64_t(1), misc_utils::get_tick_count() - start);
+    LOG_PRINT_L0("clients: " << client_count << ", pipeline depth: " << pipeline_depth << ", requests: " << done << " (failed " << failed << ") in "
+      << time << " ms, " << done * 1000 / time << " requests/s");
+  }
+}
+
+int main(int argc, char** argv)
+{
+  log_space::get_set_log_detalisation_level(true, LOG_LEVEL_0);
+  log_space::log_singletone::add_logger(LOGGER_CONSOLE, NULL, NULL);
+
+  size_t client_count = 1 < argc ? boost::lexical_cast<size_t>(argv[1]) : 16;
+  size_t requests_per_client = 2 < argc ? boost::lexical_cast<size_t>(argv[2]) : 20000;
+  size_t thread_count = (std::max)(2u, std::thread::hardware_concurrency() / 2);
+
+  http_load_handler handler;
+  http_test_server server;
+  server.get_config_object().m_phandler = &handler;
+  CHECK_AND_ASSERT_MES(server.init_server(http_srv_port, "127.0.0.1"), 1, "Failed to init http server");
+  CHECK_AND_ASSERT_MES(server.run_server(thread_count, false), 1, "Failed to run http server");
+
+  run_clients(client_count, requests_per_client, 1);
+  run_clients(client_count, requests_per_client, 16);
+
+  server.send_stop_signal();
+  server.timed_wait_server_stop(10000);
+  return 0;
+}
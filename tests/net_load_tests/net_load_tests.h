@@ -49,7 +49,7 @@ namespace net_load_tests
 
     virtual int notify(int command, const std::string& in_buff, test_connection_context& context)
     {
-      //m_notify_counter.inc();
+      m_notify_counter.inc();
       //std::unique_lock<std::mutex> lock(m_mutex);
       //m_last_command = command;
       //m_last_in_buf = in_buff;
@@ -76,7 +76,7 @@ namespace net_load_tests
     }
 
     //size_t invoke_counter() const { return m_invoke_counter.get(); }
-    //size_t notify_counter() const { return m_notify_counter.get(); }
+    size_t notify_counter() const { return m_notify_counter.get(); }
     //size_t callback_counter() const { return m_callback_counter.get(); }
     size_t new_connection_counter() const { return m_new_connection_counter.get(); }
     size_t close_connection_counter() const { return m_close_connection_counter.get(); }
@@ -92,7 +92,7 @@ namespace net_load_tests
 
   protected:
     //unit_test::call_counter m_invoke_counter;
-    //unit_test::call_counter m_notify_counter;
+    unit_test::call_counter m_notify_counter;
     //unit_test::call_counter m_callback_counter;
     unit_test::call_counter m_new_connection_counter;
     unit_test::call_counter m_close_connection_counter;
@@ -179,6 +179,15 @@ namespace net_load_tests
   };
 
   const unsigned int min_thread_count = 2;
+
+  // both clt and srv take --io-service-per-thread, run them with and without it to compare
+  inline bool has_io_service_per_thread_arg(int argc, char** argv)
+  {
+    for (int i = 1; i < argc; ++i)
+      if (std::string(argv[i]) == "--io-service-per-thread")
+        return true;
+    return false;
+  }
   const std::string clt_port("36230");
   const std::string srv_port("36231");
 
@@ -190,7 +199,9 @@ namespace net_load_tests
     cmd_reset_statistics_id,
     cmd_shutdown_id,
     cmd_send_data_requests_id,
-    cmd_data_request_id
+    cmd_data_request_id,
+    cmd_start_broadcast_test_id,
+    cmd_broadcast_data_id
   };
 
   struct CMD_CLOSE_ALL_CONNECTIONS
@@ -324,4 +335,34 @@ namespace net_load_tests
       END_KV_SERIALIZE_MAP()
     };
   };
+
+  struct CMD_START_BROADCAST_TEST
+  {
+    const static int ID = cmd_start_broadcast_test_id;
+
+    struct request
+    {
+      uint64_t message_count;
+      uint64_t message_size;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(message_count)
+        KV_SERIALIZE(message_size)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  struct CMD_BROADCAST_DATA
+  {
+    const static int ID = cmd_broadcast_data_id;
+
+    struct request
+    {
+      std::string data;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(data)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
 }
@@ -59,6 +59,7 @@ namespace
       HANDLE_NOTIFY_T2(CMD_CLOSE_ALL_CONNECTIONS, &srv_levin_commands_handler::handle_close_all_connections)
       HANDLE_NOTIFY_T2(CMD_SHUTDOWN, &srv_levin_commands_handler::handle_shutdown)
       HANDLE_NOTIFY_T2(CMD_SEND_DATA_REQUESTS, &srv_levin_commands_handler::handle_send_data_requests)
+      HANDLE_NOTIFY_T2(CMD_START_BROADCAST_TEST, &srv_levin_commands_handler::handle_start_broadcast_test)
       HANDLE_INVOKE_T2(CMD_GET_STATISTICS, &srv_levin_commands_handler::handle_get_statistics)
       HANDLE_INVOKE_T2(CMD_RESET_STATISTICS, &srv_levin_commands_handler::handle_reset_statistics)
       HANDLE_INVOKE_T2(CMD_START_OPEN_CLOSE_TEST, &srv_levin_commands_handler::handle_start_open_close_test)
@@ -136,6 +137,27 @@ namespace
       return 1;
     }
 
+    int handle_start_broadcast_test(int /*command*/, const CMD_START_BROADCAST_TEST::request& req, test_connection_context& context)
+    {
+      std::list<boost::uuids::uuid> connections;
+      m_tcp_server.get_config_object().foreach_connection([&](test_connection_context& ctx) {
+        if (ctx.m_connection_id != context.m_connection_id)
+          connections.push_back(ctx.m_connection_id);
+        return true;
+      });
+
+      CMD_BROADCAST_DATA::request data;
+      data.data.resize(req.message_size);
+      std::string buff;
+      epee::serialization::store_t_to_binary(data, buff);
+      epee::net_utils::shared_send_buffer shared_buff = boost::make_shared<const std::string>(buff);
+
+      LOG_PRINT_L0("Broadcasting " << req.message_count << " messages to " << connections.size() << " connections");
+      for (uint64_t i = 0; i != req.message_count; ++i)
+        m_tcp_server.get_config_object().notify_to_list(CMD_BROADCAST_DATA::ID, shared_buff, connections);
+      return 1;
+    }
+
   private:
     void close_connections(boost::uuids::uuid cmd_conn_id)
     {
@@ -196,6 +218,11 @@ int main(int argc, char** argv)
   size_t thread_count = (std::max)(min_thread_count, std::thread::hardware_concurrency() / 2);
 
   test_tcp_server tcp_server;
+  if (has_io_service_per_thread_arg(argc, argv))
+  {
+    LOG_PRINT_L0("Using io_service per thread");
+    tcp_server.set_io_service_per_thread(thread_count);
+  }
   if (!tcp_server.init_server(srv_port, "127.0.0.1"))
     return 1;
 
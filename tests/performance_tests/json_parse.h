@@ -0,0 +1,115 @@
+// Copyright (c) 2012-2013 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <boost/filesystem.hpp>
+
+#include "include_base_utils.h"
+#include "file_io_utils.h"
+#include "serialization/keyvalue_serialization.h"
+#include "storages/portable_storage_template_helper.h"
+
+//parses every rpc request sample from utils/*.json
+class test_json_parse_fixtures
+{
+public:
+  static const size_t loop_count = 10000;
+
+  bool init()
+  {
+    boost::system::error_code ec;
+    boost::filesystem::directory_iterator it(JSON_FIXTURES_DIR, ec), end;
+    for (; !ec && it != end; ++it)
+    {
+      if (it->path().extension() != ".json")
+        continue;
+      std::string buff;
+      if (!epee::file_io_utils::load_file_to_string(it->path().string(), buff))
+        return false;
+      m_docs.push_back(buff);
+    }
+    if (m_docs.empty())
+    {
+      std::cout << "no json fixtures found in " << JSON_FIXTURES_DIR << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  bool test()
+  {
+    for (const auto& doc : m_docs)
+    {
+      epee::serialization::portable_storage ps;
+      if (!ps.load_from_json(doc))
+        return false;
+    }
+    return true;
+  }
+
+private:
+  std::vector<std::string> m_docs;
+};
+
+//transfer request with many destinations, parsed straight into the request struct
+template<size_t destinations_count>
+class test_json_parse_transfer
+{
+public:
+  static const size_t loop_count = 100000 / destinations_count;
+
+  struct destination
+  {
+    uint64_t amount;
+    std::string address;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(amount)
+      KV_SERIALIZE(address)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct request
+  {
+    std::list<destination> destinations;
+    uint64_t fee;
+    uint64_t mixin;
+    uint64_t unlock_time;
+    std::string payment_id_hex;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(destinations)
+      KV_SERIALIZE(fee)
+      KV_SERIALIZE(mixin)
+      KV_SERIALIZE(unlock_time)
+      KV_SERIALIZE(payment_id_hex)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  bool init()
+  {
+    request req = AUTO_VAL_INIT(req);
+    for (size_t i = 0; i != destinations_count; ++i)
+    {
+      destination d = AUTO_VAL_INIT(d);
+      d.amount = 10000000000 + i;
+      d.address = "1B17qSzwmq1BFNFYfkwLgXDazEkNWrEfWfGw1xZiEPB6AoAJEaPrBaEH1bnAC2998dgQvyzE2MWsNBiqLDS4xUurLQduxMQ";
+      req.destinations.push_back(d);
+    }
+    req.fee = 1000000000;
+    req.payment_id_hex = "82bc157ece092fb6203cda";
+    m_doc = epee::serialization::store_t_to_json(req);
+    return true;
+  }
+
+  bool test()
+  {
+    request req = AUTO_VAL_INIT(req);
+    return epee::serialization::load_t_from_json(req, m_doc) && req.destinations.size() == destinations_count;
+  }
+
+private:
+  std::string m_doc;
+};
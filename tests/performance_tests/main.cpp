@@ -15,6 +15,11 @@
 #include "generate_key_image_helper.h"
 #include "is_out_to_acc.h"
 #include "keccak_test.h"
+#include "json_parse.h"
+#include "merge_peerlist.h"
+#include "protocol_pack.h"
+#include "protocol_compression.h"
+#include "select_transfers.h"
 
 int main(int argc, char** argv)
 {
@@ -43,6 +48,28 @@ int main(int argc, char** argv)
   TEST_PERFORMANCE1(test_wild_keccak2, 100000000);
 
   measure_keccak_over_scratchpad();
+
+  TEST_PERFORMANCE0(test_json_parse_fixtures);
+  TEST_PERFORMANCE1(test_json_parse_transfer, 10);
+  TEST_PERFORMANCE1(test_json_parse_transfer, 1000);
+
+  TEST_PERFORMANCE0(test_merge_peerlist);
+
+  TEST_PERFORMANCE1(test_store_get_objects, false);
+  TEST_PERFORMANCE1(test_store_get_objects, true);
+  TEST_PERFORMANCE1(test_load_get_objects, false);
+  TEST_PERFORMANCE1(test_load_get_objects, true);
+
+  TEST_PERFORMANCE1(test_compress_sync_payload, 1);
+  TEST_PERFORMANCE1(test_compress_sync_payload, 6);
+  TEST_PERFORMANCE1(test_compress_sync_payload, 9);
+  TEST_PERFORMANCE1(test_decompress_sync_payload, 1);
+  TEST_PERFORMANCE0(test_compress_chain_entry);
+
+  TEST_PERFORMANCE2(test_select_transfers, 100000, false);
+  TEST_PERFORMANCE2(test_select_transfers, 100000, true);
+  TEST_PERFORMANCE2(test_select_transfers, 1000000, false);
+  TEST_PERFORMANCE2(test_select_transfers, 1000000, true);
   /*
   TEST_PERFORMANCE2(test_construct_tx, 1, 1);
   TEST_PERFORMANCE2(test_construct_tx, 1, 2);
@@ -0,0 +1,53 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include "net/net_utils_base.h"
+#include "p2p/net_peerlist.h"
+
+//full gray list, every handshake brings P2P_DEFAULT_PEERS_IN_HANDSHAKE peers, most of them known,
+//last_seen of remote peers is older than local ones and comes unsorted
+class test_merge_peerlist
+{
+public:
+  static const size_t loop_count = 10000;
+
+  bool init()
+  {
+    m_plm.init(false);
+    std::list<nodetool::peerlist_entry> outer_bs;
+    for (uint32_t i = 0; i != P2P_LOCAL_GRAY_PEERLIST_LIMIT; ++i)
+      outer_bs.push_back(make_peer(i, 1000 + i));
+    m_plm.merge_peerlist(outer_bs);
+    m_merges = 0;
+    return m_plm.get_gray_peers_count() == P2P_LOCAL_GRAY_PEERLIST_LIMIT;
+  }
+
+  bool test()
+  {
+    std::list<nodetool::peerlist_entry> outer_bs;
+    for (uint32_t i = 0; i != P2P_DEFAULT_PEERS_IN_HANDSHAKE; ++i)
+    {
+      uint32_t n = (m_merges * 37 + i * 13) % (2 * P2P_LOCAL_GRAY_PEERLIST_LIMIT);
+      outer_bs.push_back(make_peer(n, 1000 + (m_merges * 7919 + i * 104729) % P2P_LOCAL_GRAY_PEERLIST_LIMIT));
+    }
+    ++m_merges;
+    return m_plm.merge_peerlist(outer_bs) && m_plm.get_gray_peers_count() == P2P_LOCAL_GRAY_PEERLIST_LIMIT;
+  }
+
+private:
+  static nodetool::peerlist_entry make_peer(uint32_t n, time_t last_seen)
+  {
+    nodetool::peerlist_entry ple = AUTO_VAL_INIT(ple);
+    ple.adr.ip = MAKE_IP(100, ((n >> 16) & 0xff), ((n >> 8) & 0xff), (n & 0xff));
+    ple.adr.port = 8080;
+    ple.id = n;
+    ple.last_seen = last_seen;
+    return ple;
+  }
+
+  nodetool::peerlist_manager m_plm;
+  uint32_t m_merges;
+};
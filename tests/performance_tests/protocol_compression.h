@@ -0,0 +1,146 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <random>
+
+#include "common/varint.h"
+#include "crypto/hash.h"
+#include "currency_protocol/currency_protocol_compression.h"
+#include "currency_protocol/currency_protocol_packed.h"
+
+namespace
+{
+  // tx-like blob: small structured fields mixed with incompressible keys and signatures
+  std::string make_tx_like_blob(std::mt19937& rng, size_t inputs, size_t outputs)
+  {
+    std::string blob;
+    blob.push_back(1);
+    blob.push_back(0);
+    for (size_t i = 0; i != inputs; ++i)
+    {
+      blob.push_back(2);
+      tools::write_varint(std::back_inserter(blob), static_cast<uint64_t>(1000000) * (rng() % 10));
+      blob.push_back(static_cast<char>(4));
+      for (size_t j = 0; j != 4; ++j)
+        tools::write_varint(std::back_inserter(blob), static_cast<uint64_t>(rng() % 100000));
+      for (size_t j = 0; j != 32; ++j)
+        blob.push_back(static_cast<char>(rng()));
+    }
+    for (size_t i = 0; i != outputs; ++i)
+    {
+      tools::write_varint(std::back_inserter(blob), static_cast<uint64_t>(100000000) * (rng() % 10));
+      blob.push_back(2);
+      for (size_t j = 0; j != 32; ++j)
+        blob.push_back(static_cast<char>(rng()));
+    }
+    for (size_t i = 0; i != inputs * 4 * 64; ++i)
+      blob.push_back(static_cast<char>(rng()));
+    return blob;
+  }
+
+  // initial sync answer in packed form
+  std::string make_sync_like_payload()
+  {
+    std::mt19937 rng(1);
+    currency::NOTIFY_RESPONSE_GET_OBJECTS::request r = AUTO_VAL_INIT(r);
+    for (size_t i = 0; i != BLOCKS_SYNCHRONIZING_DEFAULT_COUNT; ++i)
+    {
+      currency::block_complete_entry e;
+      e.block = make_tx_like_blob(rng, 1, 8);
+      for (size_t j = 0; j != i % 4; ++j)
+        e.txs.push_back(make_tx_like_blob(rng, 2, 4));
+      r.blocks.push_back(e);
+    }
+    r.current_blockchain_height = 300000;
+    std::string packed;
+    currency::pack_payload(r, packed);
+    return packed;
+  }
+
+  // chain entry in packed form, block ids are random bytes
+  std::string make_chain_entry_payload()
+  {
+    currency::NOTIFY_RESPONSE_CHAIN_ENTRY::request ce = AUTO_VAL_INIT(ce);
+    for (uint64_t i = 0; i != BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT; ++i)
+      ce.m_block_ids.push_back(crypto::cn_fast_hash(&i, sizeof(i)));
+    std::string packed;
+    currency::pack_payload(ce, packed);
+    return packed;
+  }
+}
+
+//deflate of a sync answer at the given level, init() prints the bytes saved
+template<int level>
+class test_compress_sync_payload
+{
+public:
+  static const size_t loop_count = 20;
+
+  bool init()
+  {
+    m_packed = make_sync_like_payload();
+    std::string compressed;
+    if (!currency::compress_payload(m_packed, compressed, level))
+      return false;
+    std::cout << "level " << level << ": " << m_packed.size() << " -> " << compressed.size() << " bytes" << std::endl;
+    return true;
+  }
+
+  bool test()
+  {
+    std::string compressed;
+    return currency::compress_payload(m_packed, compressed, level);
+  }
+
+private:
+  std::string m_packed;
+};
+
+template<int level>
+class test_decompress_sync_payload
+{
+public:
+  static const size_t loop_count = 20;
+
+  bool init()
+  {
+    m_packed = make_sync_like_payload();
+    return currency::compress_payload(m_packed, m_compressed, level);
+  }
+
+  bool test()
+  {
+    std::string unpacked;
+    return currency::decompress_payload(m_compressed, unpacked) && unpacked.size() == m_packed.size();
+  }
+
+private:
+  std::string m_packed;
+  std::string m_compressed;
+};
+
+//time wasted on block ids, which deflate can't shrink
+class test_compress_chain_entry
+{
+public:
+  static const size_t loop_count = 20;
+
+  bool init()
+  {
+    m_packed = make_chain_entry_payload();
+    return true;
+  }
+
+  bool test()
+  {
+    std::string compressed;
+    currency::compress_payload(m_packed, compressed);
+    return true;
+  }
+
+private:
+  std::string m_packed;
+};
@@ -0,0 +1,81 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include "currency_protocol/currency_protocol_defs.h"
+#include "currency_protocol/currency_protocol_packed.h"
+#include "storages/portable_storage_template_helper.h"
+
+namespace
+{
+  // typical initial sync answer: 200 blocks with a few transactions each
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request make_get_objects_request()
+  {
+    currency::NOTIFY_RESPONSE_GET_OBJECTS::request r = AUTO_VAL_INIT(r);
+    for (size_t i = 0; i != 200; ++i)
+    {
+      currency::block_complete_entry e;
+      e.block = std::string(200 + i, static_cast<char>(i));
+      for (size_t j = 0; j != 4; ++j)
+        e.txs.push_back(std::string(1000 + j, static_cast<char>(j)));
+      r.blocks.push_back(e);
+    }
+    r.current_blockchain_height = 123456;
+    return r;
+  }
+
+  bool store_get_objects(bool packed, const currency::NOTIFY_RESPONSE_GET_OBJECTS::request& r, std::string& buff)
+  {
+    return packed ? currency::pack_payload(r, buff) : epee::serialization::store_t_to_binary(r, buff);
+  }
+}
+
+//packed or portable storage serialization of NOTIFY_RESPONSE_GET_OBJECTS
+template<bool packed>
+class test_store_get_objects
+{
+public:
+  static const size_t loop_count = 100;
+
+  bool init()
+  {
+    m_request = make_get_objects_request();
+    std::string buff;
+    if (!store_get_objects(packed, m_request, buff))
+      return false;
+    std::cout << (packed ? "packed: " : "portable storage: ") << buff.size() << " bytes" << std::endl;
+    return true;
+  }
+
+  bool test()
+  {
+    std::string buff;
+    return store_get_objects(packed, m_request, buff);
+  }
+
+private:
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request m_request;
+};
+
+template<bool packed>
+class test_load_get_objects
+{
+public:
+  static const size_t loop_count = 100;
+
+  bool init()
+  {
+    return store_get_objects(packed, make_get_objects_request(), m_buff);
+  }
+
+  bool test()
+  {
+    currency::NOTIFY_RESPONSE_GET_OBJECTS::request r = AUTO_VAL_INIT(r);
+    return packed ? currency::unpack_payload(m_buff, r) : epee::serialization::load_t_from_binary(r, m_buff);
+  }
+
+private:
+  std::string m_buff;
+};
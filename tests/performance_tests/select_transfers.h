@@ -0,0 +1,43 @@
+// Copyright (c) 2012-2014 The Boolberry developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include "wallet/wallet2.h"
+
+//selection of outputs for a transfer: rebuilding the amounts map from all transfers (previous approach) vs wallet's free index
+template<size_t outs_count, bool from_free_index>
+class test_select_transfers
+{
+public:
+  static const size_t loop_count = 10;
+
+  bool init()
+  {
+    // mostly dust outputs plus a few big ones, as in a wallet receiving many mining payouts
+    m_amounts.resize(outs_count);
+    for (size_t i = 0; i != outs_count; ++i)
+      m_amounts[i] = (i % 1000 == 0) ? 1000000 * (1 + i % 7) : 1 + i % 97;
+    for (size_t i = 0; i != outs_count; ++i)
+      m_free_index[m_amounts[i]].insert(i);
+    return true;
+  }
+
+  bool test()
+  {
+    const uint64_t needed_money = 3500000;
+    std::list<size_t> selected_indexes;
+    if (from_free_index)
+      return needed_money <= tools::wallet2::select_indices_from_free_index(selected_indexes, m_free_index, needed_money, [](size_t) { return true; });
+
+    std::map<uint64_t, std::list<size_t> > found_free_amounts;
+    for (size_t i = 0; i != outs_count; ++i)
+      found_free_amounts[m_amounts[i]].push_back(i);
+    return needed_money <= tools::wallet2::select_indices_for_transfer(selected_indexes, found_free_amounts, needed_money);
+  }
+
+private:
+  std::vector<uint64_t> m_amounts;
+  tools::wallet2::free_transfers_index m_free_index;
+};
@@ -0,0 +1,323 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "currency_protocol/block_download_scheduler.h"
+
+namespace
+{
+  crypto::hash make_id(uint64_t height)
+  {
+    crypto::hash h = currency::null_hash;
+    *reinterpret_cast<uint64_t*>(&h) = height + 1;
+    return h;
+  }
+
+  std::list<crypto::hash> make_ids(uint64_t start_height, size_t count)
+  {
+    std::list<crypto::hash> ids;
+    for (size_t i = 0; i != count; ++i)
+      ids.push_back(make_id(start_height + i));
+    return ids;
+  }
+
+  epee::net_utils::connection_context_base make_peer(uint8_t n)
+  {
+    boost::uuids::uuid id = boost::uuids::uuid();
+    id.data[0] = n;
+    return epee::net_utils::connection_context_base(id, MAKE_IP(127, 0, 0, n), 10000 + n, false);
+  }
+
+  std::list<currency::block_complete_entry> make_blocks(size_t count)
+  {
+    return std::list<currency::block_complete_entry>(count);
+  }
+
+  size_t add_chain(currency::block_download_scheduler& s, uint64_t start_height, const std::list<crypto::hash>& ids)
+  {
+    size_t added = 0;
+    EXPECT_TRUE(s.add_chain(make_peer(100), start_height, ids, added));
+    return added;
+  }
+}
+
+TEST(block_download_scheduler, spans_are_spread_among_peers)
+{
+  currency::block_download_scheduler s(10, 4);
+  ASSERT_EQ(25, add_chain(s, 100, make_ids(100, 25)));
+  // overlapping entry from another peer adds only the new tail
+  ASSERT_EQ(10, add_chain(s, 110, make_ids(110, 25)));
+
+  auto p1 = make_peer(1), p2 = make_peer(2), p3 = make_peer(3), p4 = make_peer(4);
+  std::list<crypto::hash> ids1, ids2, ids3, ids4;
+  ASSERT_TRUE(s.request_span(p1, 1000, ids1, 0));
+  ASSERT_TRUE(s.request_span(p2, 1000, ids2, 0));
+  ASSERT_TRUE(s.request_span(p3, 1000, ids3, 0));
+  ASSERT_EQ(make_ids(100, 10), ids1);
+  ASSERT_EQ(make_ids(110, 10), ids2);
+  ASSERT_EQ(make_ids(120, 10), ids3);
+
+  // only one span in flight per peer
+  std::list<crypto::hash> extra;
+  ASSERT_FALSE(s.request_span(p1, 1000, extra, 0));
+
+  // span end is limited by peer's height
+  ASSERT_FALSE(s.request_span(p4, 130, ids4, 0));
+  ASSERT_TRUE(s.request_span(p4, 135, ids4, 0));
+  ASSERT_EQ(make_ids(130, 5), ids4);
+  ASSERT_FALSE(s.has_unassigned_work(1000));
+  ASSERT_TRUE(s.has_pending_work(1000));
+}
+
+TEST(block_download_scheduler, spans_are_given_back_in_height_order)
+{
+  currency::block_download_scheduler s(10, 4);
+  add_chain(s, 0, make_ids(0, 20));
+  auto p1 = make_peer(1), p2 = make_peer(2);
+  std::list<crypto::hash> ids1, ids2;
+  ASSERT_TRUE(s.request_span(p1, 1000, ids1, 0));
+  ASSERT_TRUE(s.request_span(p2, 1000, ids2, 0));
+
+  auto blocks2 = make_blocks(10);
+  ASSERT_TRUE(s.on_span_received(p2, ids2, blocks2, 100));
+  ASSERT_FALSE(s.has_ready_span());
+
+  currency::block_download_scheduler::downloaded_span ds = AUTO_VAL_INIT(ds);
+  ASSERT_TRUE(s.begin_processing());
+  ASSERT_FALSE(s.pop_ready_or_end_processing(ds));
+
+  auto blocks1 = make_blocks(10);
+  ASSERT_TRUE(s.on_span_received(p1, ids1, blocks1, 100));
+  ASSERT_TRUE(s.has_ready_span());
+  ASSERT_TRUE(s.begin_processing());
+  ASSERT_FALSE(s.begin_processing());
+  ASSERT_TRUE(s.pop_ready_or_end_processing(ds));
+  ASSERT_EQ(0, ds.start_height);
+  ASSERT_EQ(p1.m_connection_id, ds.source.m_connection_id);
+  ASSERT_TRUE(s.pop_ready_or_end_processing(ds));
+  ASSERT_EQ(10, ds.start_height);
+  ASSERT_EQ(p2.m_connection_id, ds.source.m_connection_id);
+  ASSERT_FALSE(s.pop_ready_or_end_processing(ds));
+  ASSERT_FALSE(s.has_pending_work(1000));
+}
+
+TEST(block_download_scheduler, stalled_span_is_reassigned)
+{
+  currency::block_download_scheduler s(10, 4);
+  add_chain(s, 0, make_ids(0, 10));
+  auto slow = make_peer(1), fast = make_peer(2);
+  std::list<crypto::hash> ids_slow, ids_fast;
+  ASSERT_TRUE(s.request_span(slow, 1000, ids_slow, 0));
+  ASSERT_FALSE(s.request_span(fast, 1000, ids_fast, 0));
+
+  std::list<epee::net_utils::connection_context_base> to_drop;
+  s.check_stalls(CURRENCY_PROTOCOL_SYNC_SPAN_TIMEOUT * 1000, to_drop);
+  ASSERT_FALSE(s.has_unassigned_work(1000));
+  s.check_stalls(CURRENCY_PROTOCOL_SYNC_SPAN_TIMEOUT * 1000 + 1, to_drop);
+  ASSERT_TRUE(to_drop.empty());
+  ASSERT_TRUE(s.has_unassigned_work(1000));
+
+  std::list<epee::net_utils::connection_context_base> waiting;
+  s.get_waiting_peers(waiting);
+  ASSERT_EQ(2, waiting.size());
+  ASSERT_FALSE(s.has_span(slow.m_connection_id));
+
+  ASSERT_TRUE(s.request_span(fast, 1000, ids_fast, 70000));
+  ASSERT_EQ(ids_slow, ids_fast);
+  auto blocks_fast = make_blocks(10);
+  ASSERT_TRUE(s.on_span_received(fast, ids_fast, blocks_fast, 71000));
+  ASSERT_NEAR(10.0, s.get_peer_throughput(fast.m_connection_id), 0.001);
+
+  // late answer of the stalled peer is ignored
+  auto blocks_slow = make_blocks(10);
+  ASSERT_FALSE(s.on_span_received(slow, ids_slow, blocks_slow, 72000));
+}
+
+TEST(block_download_scheduler, peer_is_dropped_after_repeated_stalls)
+{
+  currency::block_download_scheduler s(1, 100);
+  add_chain(s, 0, make_ids(0, 100));
+  auto p = make_peer(1);
+  std::list<epee::net_utils::connection_context_base> to_drop;
+  uint64_t now = 0;
+  for (size_t i = 0; i != CURRENCY_PROTOCOL_SYNC_MAX_PEER_STALLS; ++i)
+  {
+    std::list<crypto::hash> ids;
+    ASSERT_TRUE(s.request_span(p, 1000, ids, now));
+    now += CURRENCY_PROTOCOL_SYNC_SPAN_TIMEOUT * 1000 + 1;
+    s.check_stalls(now, to_drop);
+  }
+  ASSERT_EQ(1, to_drop.size());
+  std::list<crypto::hash> ids;
+  ASSERT_FALSE(s.request_span(p, 1000, ids, now));
+
+  std::set<boost::uuids::uuid> alive;
+  s.remove_peers_except(alive);
+  ASSERT_TRUE(s.request_span(p, 1000, ids, now));
+}
+
+TEST(block_download_scheduler, window_limits_spans_ahead)
+{
+  currency::block_download_scheduler s(10, 2);
+  add_chain(s, 0, make_ids(0, 100));
+  auto p1 = make_peer(1), p2 = make_peer(2), p3 = make_peer(3);
+  std::list<crypto::hash> ids1, ids2, ids3;
+  ASSERT_TRUE(s.request_span(p1, 1000, ids1, 0));
+  ASSERT_TRUE(s.request_span(p2, 1000, ids2, 0));
+  ASSERT_FALSE(s.request_span(p3, 1000, ids3, 0));
+
+  auto blocks1 = make_blocks(10);
+  ASSERT_TRUE(s.on_span_received(p1, ids1, blocks1, 10));
+  ASSERT_FALSE(s.request_span(p3, 1000, ids3, 0));
+
+  currency::block_download_scheduler::downloaded_span ds = AUTO_VAL_INIT(ds);
+  ASSERT_TRUE(s.begin_processing());
+  ASSERT_TRUE(s.pop_ready_or_end_processing(ds));
+  ASSERT_FALSE(s.pop_ready_or_end_processing(ds));
+  ASSERT_TRUE(s.request_span(p3, 1000, ids3, 0));
+  ASSERT_EQ(make_ids(20, 10), ids3);
+
+  s.reset();
+  ASSERT_FALSE(s.has_pending_work(1000));
+  ASSERT_FALSE(s.request_span(p1, 1000, ids1, 0));
+}
+
+TEST(block_download_scheduler, late_answer_of_stalled_peer_is_accepted)
+{
+  currency::block_download_scheduler s(10, 4);
+  add_chain(s, 0, make_ids(0, 20));
+  auto slow = make_peer(1);
+  std::list<crypto::hash> ids_slow, ids_next;
+  ASSERT_TRUE(s.request_span(slow, 1000, ids_slow, 0));
+  ASSERT_TRUE(s.has_span(slow.m_connection_id));
+
+  std::list<epee::net_utils::connection_context_base> to_drop;
+  s.check_stalls(CURRENCY_PROTOCOL_SYNC_SPAN_TIMEOUT * 1000 + 1, to_drop);
+  ASSERT_FALSE(s.has_span(slow.m_connection_id));
+
+  // peer's request is released, it may take another span while the old one is on its way
+  ASSERT_TRUE(s.request_span(slow, 1000, ids_next, 70000));
+  ASSERT_EQ(ids_slow, ids_next);
+  ASSERT_FALSE(s.take_released_span(slow.m_connection_id, make_id(10)));
+  ASSERT_TRUE(s.take_released_span(slow.m_connection_id, make_id(0)));
+  ASSERT_FALSE(s.take_released_span(slow.m_connection_id, make_id(0)));
+  auto blocks = make_blocks(10);
+  ASSERT_TRUE(s.on_span_received(slow, ids_slow, blocks, 71000));
+  ASSERT_FALSE(s.has_span(slow.m_connection_id));
+}
+
+TEST(block_download_scheduler, span_delivered_by_previous_owner_releases_new_one)
+{
+  currency::block_download_scheduler s(10, 4);
+  add_chain(s, 0, make_ids(0, 10));
+  auto slow = make_peer(1), other = make_peer(2);
+  std::list<crypto::hash> ids_slow, ids_other;
+  ASSERT_TRUE(s.request_span(slow, 1000, ids_slow, 0));
+  std::list<epee::net_utils::connection_context_base> to_drop;
+  s.check_stalls(CURRENCY_PROTOCOL_SYNC_SPAN_TIMEOUT * 1000 + 1, to_drop);
+  ASSERT_TRUE(s.request_span(other, 1000, ids_other, 70000));
+  ASSERT_TRUE(s.has_span(other.m_connection_id));
+
+  ASSERT_TRUE(s.take_released_span(slow.m_connection_id, make_id(0)));
+  auto blocks = make_blocks(10);
+  ASSERT_TRUE(s.on_span_received(slow, ids_slow, blocks, 71000));
+  ASSERT_FALSE(s.has_span(other.m_connection_id));
+  ASSERT_TRUE(s.take_released_span(other.m_connection_id, make_id(0)));
+}
+
+TEST(block_download_scheduler, chain_from_another_fork_is_rejected)
+{
+  currency::block_download_scheduler s(10, 4);
+  auto p1 = make_peer(1), p2 = make_peer(2);
+  size_t added = 0;
+  ASSERT_TRUE(s.add_chain(p1, 0, make_ids(0, 30), added));
+  ASSERT_EQ(30, added);
+  std::list<crypto::hash> ids1, ids2;
+  ASSERT_TRUE(s.request_span(p1, 1000, ids1, 0));
+
+  // differs inside a span already handed out
+  std::list<crypto::hash> fork = make_ids(0, 40);
+  *std::next(fork.begin(), 5) = make_id(1000);
+  ASSERT_FALSE(s.add_chain(p2, 0, fork, added));
+  ASSERT_EQ(0, added);
+  ASSERT_FALSE(s.request_span(p2, 1000, ids2, 0));
+
+  // differs among ids not split into spans yet, nothing is appended
+  fork = make_ids(0, 40);
+  *std::next(fork.begin(), 25) = make_id(1000);
+  ASSERT_FALSE(s.add_chain(p2, 0, fork, added));
+  ASSERT_EQ(30, s.get_tip_height());
+  ASSERT_FALSE(s.request_span(p2, 1000, ids2, 0));
+
+  // agrees with the queue, extends it and the peer is given spans again
+  ASSERT_TRUE(s.add_chain(p2, 20, make_ids(20, 20), added));
+  ASSERT_EQ(10, added);
+  ASSERT_TRUE(s.request_span(p2, 1000, ids2, 0));
+  ASSERT_EQ(make_ids(10, 10), ids2);
+}
+
+TEST(block_download_scheduler, queue_of_dropped_peer_is_released)
+{
+  currency::block_download_scheduler s(10, 4);
+  auto p1 = make_peer(1), p2 = make_peer(2), p3 = make_peer(3);
+  size_t added = 0;
+  ASSERT_TRUE(s.add_chain(p1, 0, make_ids(0, 30), added));
+  std::list<crypto::hash> ids1, ids2, ids3;
+  ASSERT_TRUE(s.request_span(p1, 1000, ids1, 0));
+  ASSERT_TRUE(s.request_span(p3, 1000, ids3, 0));
+
+  std::list<crypto::hash> fork = make_ids(0, 40);
+  *std::next(fork.begin(), 15) = make_id(1000);
+  ASSERT_FALSE(s.add_chain(p2, 0, fork, added));
+  std::list<epee::net_utils::connection_context_base> waiting;
+  s.get_waiting_peers(waiting);
+  ASSERT_TRUE(waiting.empty());
+
+  // filling peer is still connected, queue stays
+  ASSERT_FALSE(s.drop_unsupported_tail());
+  ASSERT_EQ(30, s.get_tip_height());
+
+  // once it's gone, ids nobody agrees with are dropped starting with the span the fork differs in
+  std::set<boost::uuids::uuid> alive;
+  alive.insert(p2.m_connection_id);
+  alive.insert(p3.m_connection_id);
+  s.remove_peers_except(alive);
+  ASSERT_TRUE(s.drop_unsupported_tail());
+  ASSERT_EQ(0, s.get_tip_height());
+  ASSERT_FALSE(s.has_span(p3.m_connection_id));
+  ASSERT_FALSE(s.drop_unsupported_tail());
+
+  // rejected peer is waiting again and its chain is taken now
+  s.get_waiting_peers(waiting);
+  ASSERT_EQ(2, waiting.size());
+  ASSERT_TRUE(s.add_chain(p2, 0, fork, added));
+  ASSERT_EQ(40, added);
+  ASSERT_TRUE(s.request_span(p2, 1000, ids2, 0));
+  ASSERT_EQ(make_ids(0, 10), ids2);
+}
+
+TEST(block_download_scheduler, queue_agreed_by_connected_peer_is_kept)
+{
+  currency::block_download_scheduler s(10, 4);
+  auto p1 = make_peer(1), p2 = make_peer(2), p3 = make_peer(3);
+  size_t added = 0;
+  ASSERT_TRUE(s.add_chain(p1, 0, make_ids(0, 30), added));
+  ASSERT_TRUE(s.add_chain(p3, 0, make_ids(0, 20), added));
+  std::list<crypto::hash> fork = make_ids(0, 30);
+  *std::next(fork.begin(), 25) = make_id(1000);
+  ASSERT_FALSE(s.add_chain(p2, 0, fork, added));
+
+  // only the part p3 agreed with stays, p2 conflicted above it
+  std::set<boost::uuids::uuid> alive;
+  alive.insert(p2.m_connection_id);
+  alive.insert(p3.m_connection_id);
+  s.remove_peers_except(alive);
+  ASSERT_TRUE(s.drop_unsupported_tail());
+  ASSERT_EQ(20, s.get_tip_height());
+  ASSERT_TRUE(s.add_chain(p2, 0, fork, added));
+  ASSERT_EQ(10, added);
+  ASSERT_EQ(30, s.get_tip_height());
+}
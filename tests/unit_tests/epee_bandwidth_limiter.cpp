@@ -0,0 +1,65 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "net/bandwidth_limiter.h"
+
+using namespace epee::net_utils;
+
+TEST(token_bucket, unlimited_bucket_grants_everything)
+{
+  token_bucket b;
+  uint64_t wait_ms = 0;
+  ASSERT_FALSE(b.is_limited());
+  ASSERT_EQ(10000000, b.peek(10000000, 1, send_priority_bulk, 0, wait_ms));
+  ASSERT_EQ(0, wait_ms);
+}
+
+TEST(token_bucket, lower_classes_leave_reserve)
+{
+  token_bucket b;
+  b.set_rate(80000, 0); // burst is one second of rate
+  uint64_t wait_ms = 0;
+  b.consume(80000 - 15000, 0);
+
+  // 15000 left: bulk keeps 20000 aside, normal keeps 10000, high takes all
+  ASSERT_EQ(0, b.peek(1000, 1000, send_priority_bulk, 0, wait_ms));
+  ASSERT_GT(wait_ms, 0);
+  ASSERT_EQ(5000, b.peek(8000, 1000, send_priority_normal, 0, wait_ms));
+  ASSERT_EQ(8000, b.peek(8000, 1000, send_priority_high, 0, wait_ms));
+
+  // refill: 1000 bytes per 12.5ms
+  wait_ms = 0;
+  ASSERT_EQ(0, b.peek(1000, 1000, send_priority_bulk, 0, wait_ms));
+  ASSERT_EQ(1000, b.peek(1000, 1000, send_priority_bulk, wait_ms, wait_ms));
+}
+
+TEST(token_bucket, debt_pauses_download)
+{
+  token_bucket b;
+  b.set_rate(16384, 0);
+  b.consume(16384 + 8192, 0);
+  uint64_t wait_ms = b.get_debt_wait_ms(0);
+  ASSERT_EQ(501, wait_ms);
+  ASSERT_EQ(0, b.get_debt_wait_ms(wait_ms));
+}
+
+TEST(bandwidth_limiter, global_limit_is_shared_by_peers)
+{
+  bandwidth_limiter l;
+  l.set_limits(20000, 0, 0, 0, 0);
+  token_bucket peer1, peer2;
+  uint64_t wait_ms = 0;
+  ASSERT_TRUE(l.is_upload_limited());
+  ASSERT_EQ(16384, l.grant_upload(peer1, 16384, 1024, send_priority_high, 0, wait_ms));
+  // 3616 left in the global bucket
+  ASSERT_EQ(3616, l.grant_upload(peer2, 16384, 1024, send_priority_high, 0, wait_ms));
+  ASSERT_EQ(0, l.grant_upload(peer2, 16384, 1024, send_priority_high, 0, wait_ms));
+  ASSERT_EQ(52, wait_ms);
+  ASSERT_EQ(1040, l.grant_upload(peer2, 16384, 1024, send_priority_high, 52, wait_ms));
+
+  ASSERT_EQ(0, l.account_download(peer1, 100000, 52));
+}
@@ -13,9 +13,6 @@
 #include "string_tools.h"
 #include "net/abstract_tcp_server2.h"
 
-#pragma message(__FILE__ "(" STRINGIFY_EXPAND(__LINE__) "): TODO: these tests should be fixed!")
-#if 0
-
 namespace
 {
   const uint32_t test_server_port = 5626;
@@ -27,6 +24,9 @@ namespace
 
   struct test_protocol_handler_config
   {
+    void on_send_stop_signal()
+    {
+    }
   };
 
   struct test_protocol_handler
@@ -60,6 +60,9 @@ namespace
   typedef epee::net_utils::boosted_tcp_server<test_protocol_handler> test_tcp_server;
 }
 
+#pragma message(__FILE__ "(" STRINGIFY_EXPAND(__LINE__) "): TODO: these tests should be fixed!")
+#if 0
+
 TEST(boosted_tcp_server, worker_threads_are_exception_resistant)
 {
   test_tcp_server srv;
@@ -112,3 +115,47 @@ TEST(boosted_tcp_server, worker_threads_are_exception_resistant)
 }
 
 #endif
+
+TEST(boosted_tcp_server, sync_connect_from_idle_handler_in_io_service_per_thread_mode)
+{
+  test_tcp_server listener;
+  ASSERT_TRUE(listener.init_server(0, test_server_host));
+  ASSERT_TRUE(listener.run_server(2, false));
+
+  test_tcp_server srv;
+  srv.set_io_service_per_thread(3);
+  ASSERT_TRUE(srv.init_server(0, test_server_host));
+  ASSERT_TRUE(srv.run_server(3, false));
+
+  //idle handlers and async_call() run on the main io_service's thread, like p2p connections_maker does
+  std::mutex mtx;
+  std::condition_variable cond;
+  size_t connected = 0;
+  bool done = false;
+  std::string port = std::to_string(listener.get_binded_port());
+  srv.async_call([&]()
+  {
+    size_t local_connected = 0;
+    for (size_t i = 0; i != 4; ++i)
+    {
+      test_connection_context context;
+      if (srv.connect(test_server_host, port, 2000, context))
+        ++local_connected;
+    }
+    std::unique_lock<std::mutex> lock(mtx);
+    connected = local_connected;
+    done = true;
+    cond.notify_one();
+  });
+
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    ASSERT_TRUE(cond.wait_for(lock, std::chrono::seconds(20), [&done]() { return done; }));
+    ASSERT_EQ(4, connected);
+  }
+
+  srv.send_stop_signal();
+  ASSERT_TRUE(srv.timed_wait_server_stop(5 * 1000));
+  listener.send_stop_signal();
+  ASSERT_TRUE(listener.timed_wait_server_stop(5 * 1000));
+}
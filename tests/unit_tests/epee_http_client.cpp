@@ -0,0 +1,302 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <boost/asio.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "include_base_utils.h"
+#include "net/http_client_pool.h"
+
+using namespace epee;
+using namespace epee::net_utils::http;
+using boost::asio::ip::tcp;
+
+namespace
+{
+  //plain blocking server, every accepted connection is handled by the test's script in its own thread
+  class test_http_server
+  {
+  public:
+    typedef std::function<void(tcp::socket&)> connection_handler;
+
+    test_http_server():m_acceptor(m_io_service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0)), m_connections(0)
+    {}
+
+    ~test_http_server()
+    {
+      m_thread.join();
+      m_connection_threads.join_all();
+    }
+
+    std::string get_port()
+    {
+      return std::to_string(m_acceptor.local_endpoint().port());
+    }
+
+    void run(size_t connections_count, connection_handler handler)
+    {
+      m_thread = boost::thread([this, connections_count, handler]()
+      {
+        for (size_t i = 0; i != connections_count; ++i)
+        {
+          std::shared_ptr<tcp::socket> socket(new tcp::socket(m_io_service));
+          m_acceptor.accept(*socket);
+          ++m_connections;
+          m_connection_threads.create_thread([socket, handler]() { handler(*socket); });
+        }
+      });
+    }
+
+    size_t get_connections_count()
+    {
+      return m_connections;
+    }
+
+    //returns uri of the request, empty if connection was closed
+    static std::string read_request(tcp::socket& socket, std::string& buff, std::string& body)
+    {
+      size_t header_end = 0;
+      while ((header_end = buff.find("\r\n\r\n")) == std::string::npos)
+      {
+        if (!read_some(socket, buff))
+          return std::string();
+      }
+      std::string header = buff.substr(0, header_end + 4);
+      size_t len_pos = header.find("Content-Length: ");
+      size_t body_size = len_pos == std::string::npos ? 0 : std::stoul(header.substr(len_pos + 16));
+      while (buff.size() < header.size() + body_size)
+      {
+        if (!read_some(socket, buff))
+          return std::string();
+      }
+      body = buff.substr(header.size(), body_size);
+      buff.erase(0, header.size() + body_size);
+      size_t uri_begin = header.find(' ') + 1;
+      return header.substr(uri_begin, header.find(' ', uri_begin) - uri_begin);
+    }
+
+    static std::string make_response(const std::string& body)
+    {
+      return "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    }
+
+    static void write(tcp::socket& socket, const std::string& data)
+    {
+      boost::asio::write(socket, boost::asio::buffer(data));
+    }
+
+  private:
+    static bool read_some(tcp::socket& socket, std::string& buff)
+    {
+      char local_buff[4096];
+      boost::system::error_code ec;
+      size_t read = socket.read_some(boost::asio::buffer(local_buff), ec);
+      if (ec)
+        return false;
+      buff.append(local_buff, read);
+      return true;
+    }
+
+    boost::asio::io_service m_io_service;
+    tcp::acceptor m_acceptor;
+    std::atomic<size_t> m_connections;
+    boost::thread m_thread;
+    boost::thread_group m_connection_threads;
+  };
+}
+
+TEST(http_client, keep_alive_and_large_body)
+{
+  test_http_server server;
+  std::string large_body(2 * HTTP_CLIENT_BODY_READ_STEP + 17, 'x');
+  for (size_t i = 0; i < large_body.size(); i += 4099)
+    large_body[i] = static_cast<char>(i);
+  server.run(1, [&large_body](tcp::socket& socket)
+  {
+    std::string buff, body;
+    while (true)
+    {
+      std::string uri = test_http_server::read_request(socket, buff, body);
+      if (uri.empty())
+        return;
+      test_http_server::write(socket, test_http_server::make_response(uri == "/large" ? large_body : uri + ":" + body));
+    }
+  });
+
+  http_simple_client client;
+  client.set_server("127.0.0.1", server.get_port(), 5000);
+  const http_response_info* pri = nullptr;
+  ASSERT_TRUE(client.invoke("/a", "POST", "request a", &pri));
+  ASSERT_EQ(200, pri->m_response_code);
+  ASSERT_EQ("/a:request a", pri->m_body);
+  ASSERT_TRUE(client.invoke("/large", "GET", "", &pri));
+  ASSERT_EQ(large_body, pri->m_body);
+  ASSERT_TRUE(client.invoke("/b", "POST", std::string(100000, 'b'), &pri));
+  ASSERT_EQ("/b:" + std::string(100000, 'b'), pri->m_body);
+  client.disconnect();
+  ASSERT_EQ(1, server.get_connections_count());
+}
+
+TEST(http_client, bytes_after_response_drop_connection)
+{
+  test_http_server server;
+  //first connection sends an unasked response after the answer
+  server.run(2, [&server](tcp::socket& socket)
+  {
+    std::string buff, body;
+    while (true)
+    {
+      std::string uri = test_http_server::read_request(socket, buff, body);
+      if (uri.empty())
+        return;
+      std::string response = test_http_server::make_response(uri);
+      if (server.get_connections_count() == 1)
+        response += test_http_server::make_response("/unasked");
+      test_http_server::write(socket, response);
+    }
+  });
+
+  http_simple_client client;
+  client.set_server("127.0.0.1", server.get_port(), 5000);
+  const http_response_info* pri = nullptr;
+  ASSERT_TRUE(client.invoke("/a", "GET", "", &pri));
+  ASSERT_EQ("/a", pri->m_body);
+  ASSERT_FALSE(client.is_connected());
+  ASSERT_TRUE(client.invoke("/b", "POST", "", &pri));
+  ASSERT_EQ("/b", pri->m_body);
+  client.disconnect();
+  ASSERT_EQ(2, server.get_connections_count());
+}
+
+TEST(http_client, stale_keep_alive_connection_is_retried)
+{
+  test_http_server server;
+  //server drops connection silently after every response, as on idle timeout
+  server.run(2, [](tcp::socket& socket)
+  {
+    std::string buff, body;
+    std::string uri = test_http_server::read_request(socket, buff, body);
+    test_http_server::write(socket, test_http_server::make_response(uri));
+    socket.close();
+  });
+
+  http_simple_client client;
+  client.set_server("127.0.0.1", server.get_port(), 5000);
+  const http_response_info* pri = nullptr;
+  ASSERT_TRUE(client.invoke("/a", "GET", "", &pri));
+  ASSERT_EQ("/a", pri->m_body);
+  boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+  ASSERT_TRUE(client.invoke("/b", "GET", "", &pri));
+  ASSERT_EQ("/b", pri->m_body);
+  client.disconnect();
+  ASSERT_EQ(2, server.get_connections_count());
+}
+
+TEST(http_client, pool_reuses_connections)
+{
+  test_http_server server;
+  server.run(2, [](tcp::socket& socket)
+  {
+    std::string buff, body;
+    while (true)
+    {
+      std::string uri = test_http_server::read_request(socket, buff, body);
+      if (uri.empty())
+        return;
+      test_http_server::write(socket, test_http_server::make_response(uri));
+    }
+  });
+
+  http_client_pool<> pool(1);
+  pool.set_server("127.0.0.1", server.get_port(), 5000);
+  const http_response_info* pri = nullptr;
+  {
+    auto first = pool.acquire();
+    auto second = pool.acquire();
+    ASSERT_NE(&*first, &*second);
+    ASSERT_TRUE(first->invoke("/1", "GET", "", &pri));
+    ASSERT_TRUE(second->invoke("/2", "GET", "", &pri));
+    ASSERT_EQ("/2", pri->m_body);
+  }
+  //only one is kept idle
+  ASSERT_EQ(1, pool.get_idle_count());
+  for (size_t i = 0; i != 10; ++i)
+    ASSERT_TRUE(pool.acquire()->invoke("/3", "GET", "", &pri));
+  ASSERT_EQ(1, pool.get_idle_count());
+
+  pool.set_server("127.0.0.1", server.get_port(), 5000);
+  ASSERT_EQ(0, pool.get_idle_count());
+  ASSERT_EQ(2, server.get_connections_count());
+}
+
+TEST(http_client, pool_check_connection_probes_idle_clients)
+{
+  test_http_server server;
+  //first connection is closed by server after the answer, as on idle timeout
+  server.run(2, [&server](tcp::socket& socket)
+  {
+    std::string buff, body;
+    while (true)
+    {
+      std::string uri = test_http_server::read_request(socket, buff, body);
+      if (uri.empty())
+        return;
+      test_http_server::write(socket, test_http_server::make_response(uri));
+      if (server.get_connections_count() == 1)
+      {
+        socket.close();
+        return;
+      }
+    }
+  });
+
+  http_client_pool<> pool;
+  pool.set_server("127.0.0.1", server.get_port(), 5000);
+  const http_response_info* pri = nullptr;
+  ASSERT_TRUE(pool.acquire()->invoke("/1", "GET", "", &pri));
+  ASSERT_EQ(1, pool.get_idle_count());
+  boost::this_thread::sleep_for(boost::chrono::milliseconds(50));
+
+  //closed one is dropped and a new connection is made
+  ASSERT_TRUE(pool.check_connection());
+  ASSERT_EQ(2, server.get_connections_count());
+  ASSERT_EQ(1, pool.get_idle_count());
+  ASSERT_TRUE(pool.check_connection());
+  ASSERT_EQ(2, server.get_connections_count());
+  ASSERT_TRUE(pool.acquire()->invoke("/2", "GET", "", &pri));
+  ASSERT_EQ("/2", pri->m_body);
+
+  //nobody listens on the new server
+  std::string closed_port;
+  {
+    boost::asio::io_service io_service;
+    tcp::acceptor acceptor(io_service, tcp::endpoint(boost::asio::ip::address_v4::loopback(), 0));
+    closed_port = std::to_string(acceptor.local_endpoint().port());
+  }
+  pool.set_server("127.0.0.1", closed_port, 5000);
+  ASSERT_FALSE(pool.check_connection());
+  ASSERT_EQ(0, pool.get_idle_count());
+}
+
+TEST(http_client, oversized_content_length)
+{
+  test_http_server server;
+  server.run(1, [](tcp::socket& socket)
+  {
+    std::string buff, body;
+    test_http_server::read_request(socket, buff, body);
+    test_http_server::write(socket, "HTTP/1.1 200 OK\r\nContent-Length: 99999999999\r\n\r\nonly a few bytes");
+    socket.close();
+  });
+
+  http_simple_client client;
+  client.set_server("127.0.0.1", server.get_port(), 5000);
+  const http_response_info* pri = nullptr;
+  ASSERT_FALSE(client.invoke("/a", "GET", "", &pri));
+  ASSERT_GE(HTTP_CLIENT_BODY_READ_STEP, pri->m_body.capacity());
+  ASSERT_FALSE(client.is_connected());
+}
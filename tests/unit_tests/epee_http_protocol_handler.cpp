@@ -0,0 +1,384 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+
+#include "include_base_utils.h"
+#include "net/http_protocol_handler.h"
+#include "net/net_utils_base.h"
+
+namespace
+{
+  using namespace epee::net_utils;
+
+  struct test_http_handler : public http::i_http_server_handler<connection_context_base>
+  {
+    virtual bool handle_http_request(const http::http_request_info& query_info, http::http_response_info& response, connection_context_base& context)
+    {
+      m_requests.push_back(query_info);
+      if (query_info.m_uri_content.m_path == "/stream")
+      {
+        response.m_body_writer = [](const http::body_chunk_sink& sink) {
+          std::string chunk = "first,";
+          std::string empty;
+          std::string last = std::string(100, 'z');
+          return sink(chunk) && sink(empty) && sink(last);
+        };
+        return true;
+      }
+      if (query_info.m_uri_content.m_path == "/long_stream")
+      {
+        response.m_body_writer = [](const http::body_chunk_sink& sink) {
+          for (size_t i = 0; i != 100; ++i)
+          {
+            std::string chunk = std::to_string(i) + ",";
+            if (!sink(chunk))
+              return false;
+          }
+          return true;
+        };
+        return true;
+      }
+      response.m_body = query_info.m_uri_content.m_path + ":" + query_info.m_body;
+      return true;
+    }
+
+    virtual http::worker_pool* get_request_worker_pool(const http::http_request_info& query_info)
+    {
+      return query_info.m_uri_content.m_path == "/slow" ? &m_pool : nullptr;
+    }
+
+    std::vector<http::http_request_info> m_requests;
+    http::worker_pool m_pool;
+  };
+
+  class test_http_connection : public i_service_endpoint
+  {
+  public:
+    test_http_connection()
+      : m_context(boost::uuids::uuid(), 0, 0, false)
+      , m_handler(this, m_config, m_context)
+      , m_callbacks(0)
+      , m_refs(0)
+      , m_closed(false)
+      , m_que_size(0)
+      , m_max_que_size(0)
+      , m_que_stuck(false)
+    {
+      m_config.m_phandler = &m_http_handler;
+    }
+
+    bool recv(const std::string& data)
+    {
+      return m_handler.handle_recv(data.data(), data.size());
+    }
+
+    virtual bool do_send(const void* ptr, size_t cb) { m_sent.append(static_cast<const char*>(ptr), cb); return true; }
+    // every shared send is one queue entry, taken by the "client" one per io run
+    virtual bool do_send_shared(const void* head_ptr, size_t head_cb, const shared_send_buffer& body, send_priority priority)
+    {
+      m_sent.append(static_cast<const char*>(head_ptr), head_cb);
+      if (body)
+        m_sent += *body;
+      m_max_que_size = std::max(m_max_que_size, ++m_que_size);
+      return true;
+    }
+    virtual size_t get_send_queue_size() { return m_que_size; }
+    virtual bool close() { m_closed = true; return true; }
+    virtual bool call_run_once_service_io()
+    {
+      if (m_que_stuck)
+        return false;
+      if (m_que_size)
+        --m_que_size;
+      return true;
+    }
+    virtual bool request_callback() { ++m_callbacks; return true; }
+    virtual boost::asio::io_service& get_io_service() { return m_io_service; }
+    virtual bool add_ref() { ++m_refs; return true; }
+    virtual bool release() { --m_refs; return true; }
+
+    // plays connection's strand: runs queued callback once worker has answered
+    bool run_callback()
+    {
+      for (size_t i = 0; i != 5000 && !m_callbacks; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      if (!m_callbacks)
+        return false;
+      --m_callbacks;
+      m_handler.handle_qued_callback();
+      return true;
+    }
+
+    size_t responses_count() const
+    {
+      size_t count = 0;
+      for (std::string::size_type pos = m_sent.find("HTTP/1.1 200"); std::string::npos != pos; pos = m_sent.find("HTTP/1.1 200", pos + 1))
+        ++count;
+      return count;
+    }
+
+    boost::asio::io_service m_io_service;
+    connection_context_base m_context;
+    http::custum_handler_config<connection_context_base> m_config;
+    test_http_handler m_http_handler;
+    http::http_custom_handler<connection_context_base> m_handler;
+    std::string m_sent;
+    std::atomic<size_t> m_callbacks;
+    std::atomic<int> m_refs;
+    bool m_closed;
+    size_t m_que_size;
+    size_t m_max_que_size;
+    bool m_que_stuck;
+  };
+
+  // keeps the only worker of the pool busy until released or destroyed
+  class worker_blocker
+  {
+  public:
+    worker_blocker(http::worker_pool& pool) : m_release(false)
+    {
+      m_posted = pool.post([this]() { while (!m_release) std::this_thread::sleep_for(std::chrono::milliseconds(1)); });
+      while (m_posted && !pool.get_busy_count())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    ~worker_blocker() { release(); }
+
+    bool is_posted() const { return m_posted; }
+    void release() { m_release = true; }
+
+  private:
+    std::atomic<bool> m_release;
+    bool m_posted;
+  };
+}
+
+TEST(epee_http_parser, request_line)
+{
+  http::http_request_info info;
+  std::string line = "POST /json_rpc?a=1&b=2#frag HTTP/1.1";
+  ASSERT_TRUE(parse_http_request_line(line.data(), line.data() + line.size(), info));
+  ASSERT_EQ(http::http_method_post, info.m_http_method);
+  ASSERT_EQ("POST", info.m_http_method_str);
+  ASSERT_EQ("/json_rpc?a=1&b=2#frag", info.m_URI);
+  ASSERT_EQ(1, info.m_http_ver_hi);
+  ASSERT_EQ(1, info.m_http_ver_lo);
+
+  ASSERT_TRUE(parse_uri(info.m_URI, info.m_uri_content));
+  ASSERT_EQ("/json_rpc", info.m_uri_content.m_path);
+  ASSERT_EQ("a=1&b=2", info.m_uri_content.m_query);
+  ASSERT_EQ("frag", info.m_uri_content.m_fragment);
+  ASSERT_EQ(2, info.m_uri_content.m_query_params.size());
+
+  line = "get /getheight http/1.0";
+  ASSERT_TRUE(parse_http_request_line(line.data(), line.data() + line.size(), info));
+  ASSERT_EQ(http::http_method_get, info.m_http_method);
+  ASSERT_EQ(0, info.m_http_ver_lo);
+
+  const char* bad_lines[] = {"", "GET", "GET /", "GET / HTTP", "GET / HTTP/1", "GET / HTTP/1.x", "FOO / HTTP/1.1", "GET / HTTP/1.1 x", "GET  HTTP/1.1"};
+  for (auto bad : bad_lines)
+    ASSERT_FALSE(parse_http_request_line(bad, bad + strlen(bad), info)) << bad;
+}
+
+TEST(epee_http_parser, header_fields)
+{
+  std::string head = "Host: 127.0.0.1\r\ncontent-length:  12 \r\nX-Custom: a\r\n  b\r\nConnection:close\r\nbroken line\r\n\r\n";
+  http::http_header_info info;
+  ASSERT_TRUE(parse_http_header_fields(head.data(), head.data() + head.size(), info));
+  ASSERT_EQ("127.0.0.1", info.m_host);
+  ASSERT_EQ("12", info.m_content_length);
+  ASSERT_EQ("close", info.m_connection);
+  ASSERT_EQ(1, info.m_etc_fields.size());
+  ASSERT_EQ("X-Custom", info.m_etc_fields.front().first);
+  ASSERT_EQ("a b", info.m_etc_fields.front().second);
+
+  size_t len = 0;
+  ASSERT_TRUE(parse_content_length(info.m_content_length, len));
+  ASSERT_EQ(12, len);
+  ASSERT_FALSE(parse_content_length("", len));
+  ASSERT_FALSE(parse_content_length("12a", len));
+  ASSERT_FALSE(parse_content_length("99999999999999999999999", len));
+
+  ASSERT_EQ(head.size(), match_end_of_http_header(head.data(), head.data() + head.size()));
+  ASSERT_EQ(0, match_end_of_http_header(head.data(), head.data() + head.size() - 1));
+  ASSERT_EQ(2, match_end_of_http_header("\r\nGET", "\r\nGET" + 5));
+}
+
+TEST(epee_http_protocol_handler, pipelined_requests_split_at_any_byte)
+{
+  std::string req1 = "GET /getheight HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  std::string req2 = "POST /json_rpc HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello";
+  std::string req3 = "GET /getinfo HTTP/1.1\r\n\r\n";
+  std::string stream = req1 + req2 + req3;
+
+  for (size_t chunk = 1; chunk <= stream.size(); ++chunk)
+  {
+    test_http_connection conn;
+    for (size_t pos = 0; pos < stream.size(); pos += chunk)
+      ASSERT_TRUE(conn.recv(stream.substr(pos, chunk)));
+
+    ASSERT_EQ(3, conn.m_http_handler.m_requests.size()) << "chunk " << chunk;
+    ASSERT_EQ("/getheight", conn.m_http_handler.m_requests[0].m_uri_content.m_path);
+    ASSERT_EQ("hello", conn.m_http_handler.m_requests[1].m_body);
+    ASSERT_EQ("/getinfo", conn.m_http_handler.m_requests[2].m_uri_content.m_path);
+    ASSERT_EQ(3, conn.responses_count());
+    ASSERT_NE(std::string::npos, conn.m_sent.find("/json_rpc:hello"));
+  }
+}
+
+TEST(epee_http_protocol_handler, connection_close_and_keep_alive)
+{
+  test_http_connection conn;
+  // nothing after close request is handled
+  ASSERT_FALSE(conn.recv("GET /a HTTP/1.1\r\nConnection: close\r\n\r\nGET /b HTTP/1.1\r\n\r\n"));
+  ASSERT_EQ(1, conn.m_http_handler.m_requests.size());
+  ASSERT_NE(std::string::npos, conn.m_sent.find("Connection: close"));
+
+  test_http_connection conn10;
+  ASSERT_FALSE(conn10.recv("GET /a HTTP/1.0\r\n\r\n"));
+
+  test_http_connection conn10_keep_alive;
+  ASSERT_TRUE(conn10_keep_alive.recv("GET /a HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\nGET /b HTTP/1.0\r\nConnection: keep-alive\r\n\r\n"));
+  ASSERT_EQ(2, conn10_keep_alive.m_http_handler.m_requests.size());
+  ASSERT_NE(std::string::npos, conn10_keep_alive.m_sent.find("Connection: keep-alive"));
+
+  test_http_connection conn_bad;
+  ASSERT_FALSE(conn_bad.recv("BREW /pot HTCPCP/1.0\r\n\r\n"));
+  ASSERT_TRUE(conn_bad.m_http_handler.m_requests.empty());
+}
+
+TEST(epee_http_protocol_handler, streamed_response_is_chunked)
+{
+  test_http_connection conn;
+  ASSERT_TRUE(conn.recv("GET /stream HTTP/1.1\r\n\r\nGET /after HTTP/1.1\r\n\r\n"));
+  ASSERT_EQ(2, conn.responses_count());
+  std::string::size_type head_end = conn.m_sent.find("\r\n\r\n");
+  ASSERT_NE(std::string::npos, head_end);
+  std::string head = conn.m_sent.substr(0, head_end);
+  ASSERT_NE(std::string::npos, head.find("Transfer-Encoding: chunked"));
+  ASSERT_EQ(std::string::npos, head.find("Content-Length"));
+  std::string body = "6\r\nfirst,\r\n64\r\n" + std::string(100, 'z') + "\r\n0\r\n\r\n";
+  ASSERT_EQ(body, conn.m_sent.substr(head_end + 4, body.size()));
+  // next response follows right after the last chunk
+  ASSERT_EQ(0, conn.m_sent.compare(head_end + 4 + body.size(), 12, "HTTP/1.1 200"));
+
+  // HTTP/1.0 client gets plain body
+  test_http_connection conn10;
+  conn10.recv("GET /stream HTTP/1.0\r\n\r\n");
+  ASSERT_NE(std::string::npos, conn10.m_sent.find("Content-Length: 106\r\n"));
+  ASSERT_EQ(std::string::npos, conn10.m_sent.find("chunked"));
+  ASSERT_NE(std::string::npos, conn10.m_sent.find("\r\n\r\nfirst," + std::string(100, 'z')));
+}
+
+TEST(epee_http_protocol_handler, streamed_response_waits_for_send_queue)
+{
+  test_http_connection conn;
+  ASSERT_TRUE(conn.recv("GET /long_stream HTTP/1.1\r\n\r\n"));
+  ASSERT_EQ(1, conn.responses_count());
+  ASSERT_GE(HTTP_STREAMED_RESPONSE_SEND_QUE_WATERMARK + 1, conn.m_max_que_size);
+  ASSERT_NE(std::string::npos, conn.m_sent.find("\r\n3\r\n99,\r\n0\r\n\r\n"));
+  ASSERT_FALSE(conn.m_closed);
+
+  // client doesn't take chunks and io is stopping: body is cut and connection closed
+  test_http_connection stuck;
+  stuck.m_que_stuck = true;
+  ASSERT_FALSE(stuck.recv("GET /long_stream HTTP/1.1\r\n\r\n"));
+  ASSERT_EQ(HTTP_STREAMED_RESPONSE_SEND_QUE_WATERMARK + 1, stuck.m_max_que_size);
+  ASSERT_EQ(std::string::npos, stuck.m_sent.find("\r\n0\r\n\r\n"));
+}
+
+TEST(epee_http_protocol_handler, async_response_keeps_pipeline_order)
+{
+  test_http_connection conn;
+  ASSERT_TRUE(conn.m_http_handler.m_pool.init(1, 10, "test"));
+  ASSERT_TRUE(conn.recv("GET /a HTTP/1.1\r\n\r\nGET /slow HTTP/1.1\r\n\r\nGET /b HTTP/1.1\r\n\r\nGET /c HTTP/1"));
+  // /b waits for /slow, only /a is answered in place
+  ASSERT_TRUE(conn.run_callback());
+  ASSERT_TRUE(conn.recv(".1\r\n\r\n"));
+  ASSERT_EQ(4, conn.responses_count());
+  size_t a = conn.m_sent.find("/a:");
+  size_t slow = conn.m_sent.find("/slow:");
+  size_t b = conn.m_sent.find("/b:");
+  size_t c = conn.m_sent.find("/c:");
+  ASSERT_TRUE(a < slow && slow < b && b < c) << conn.m_sent;
+  ASSERT_EQ(0, conn.m_refs);
+  ASSERT_FALSE(conn.m_closed);
+
+  // data coming while request is in the pool is kept till response is sent
+  ASSERT_TRUE(conn.recv("GET /slow HTTP/1.1\r\nConnection: close\r\n\r\n"));
+  ASSERT_TRUE(conn.recv("GET /d HTTP/1.1\r\n\r\n"));
+  ASSERT_TRUE(conn.run_callback());
+  ASSERT_EQ(5, conn.responses_count());
+  ASSERT_EQ(std::string::npos, conn.m_sent.find("/d:"));
+  ASSERT_TRUE(conn.m_closed);
+  ASSERT_EQ(0, conn.m_refs);
+}
+
+TEST(epee_http_protocol_handler, full_worker_queue_answers_busy)
+{
+  test_http_connection conn;
+  ASSERT_TRUE(conn.m_http_handler.m_pool.init(1, 0, "test"));
+  ASSERT_TRUE(conn.recv("GET /slow HTTP/1.1\r\n\r\nGET /a HTTP/1.1\r\n\r\n"));
+  ASSERT_TRUE(conn.run_callback());
+  ASSERT_EQ(0, conn.m_sent.find("HTTP/1.1 503"));
+  ASSERT_NE(std::string::npos, conn.m_sent.find("/a:"));
+  ASSERT_TRUE(conn.m_http_handler.m_requests.size() == 1);
+  ASSERT_EQ(0, conn.m_refs);
+}
+
+TEST(epee_http_protocol_handler, busy_workers_and_full_queue_answer_busy)
+{
+  test_http_connection conn;
+  ASSERT_TRUE(conn.m_http_handler.m_pool.init(1, 1, "test"));
+  // worker is held by one job and another one waits in the queue
+  worker_blocker blocker(conn.m_http_handler.m_pool);
+  ASSERT_TRUE(blocker.is_posted());
+  ASSERT_TRUE(conn.m_http_handler.m_pool.post([]() {}));
+
+  ASSERT_TRUE(conn.recv("GET /slow HTTP/1.1\r\n\r\nGET /a HTTP/1.1\r\n\r\n"));
+  ASSERT_TRUE(conn.run_callback());
+  ASSERT_EQ(0, conn.m_sent.find("HTTP/1.1 503 Service Unavailable"));
+  ASSERT_NE(std::string::npos, conn.m_sent.find("Server is busy"));
+  ASSERT_NE(std::string::npos, conn.m_sent.find("/a:"));
+  ASSERT_EQ(1, conn.m_http_handler.m_requests.size());
+  ASSERT_FALSE(conn.m_closed);
+  ASSERT_EQ(0, conn.m_refs);
+
+  // once the queue drains the same connection is served by the pool again
+  blocker.release();
+  while (conn.m_http_handler.m_pool.get_queue_size() || conn.m_http_handler.m_pool.get_busy_count())
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  conn.m_sent.clear();
+  ASSERT_TRUE(conn.recv("GET /slow HTTP/1.1\r\n\r\n"));
+  ASSERT_TRUE(conn.run_callback());
+  ASSERT_EQ(0, conn.m_sent.find("HTTP/1.1 200"));
+  ASSERT_NE(std::string::npos, conn.m_sent.find("/slow:"));
+  ASSERT_EQ(0, conn.m_refs);
+}
+
+TEST(epee_http_protocol_handler, data_sent_ahead_of_async_response_is_limited)
+{
+  test_http_connection conn;
+  ASSERT_TRUE(conn.m_http_handler.m_pool.init(1, 10, "test"));
+  worker_blocker blocker(conn.m_http_handler.m_pool);
+  ASSERT_TRUE(blocker.is_posted());
+
+  ASSERT_TRUE(conn.recv("GET /slow HTTP/1.1\r\n\r\n"));
+  // one more request with a body is fine
+  std::string body(HTTP_MAX_PREALLOCATED_BODY_LEN, 'x');
+  ASSERT_TRUE(conn.recv("POST /a HTTP/1.1\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n"));
+  ASSERT_TRUE(conn.recv(body));
+  // but not endless pipelining
+  ASSERT_FALSE(conn.recv(std::string(HTTP_MAX_HEADER_LEN, 'y')));
+
+  blocker.release();
+  ASSERT_TRUE(conn.run_callback());
+  ASSERT_TRUE(conn.m_closed);
+  ASSERT_EQ(1, conn.responses_count());
+  ASSERT_EQ(std::string::npos, conn.m_sent.find("/a:"));
+  ASSERT_EQ(0, conn.m_refs);
+}
@@ -0,0 +1,207 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <boost/thread/thread.hpp>
+
+#include "include_base_utils.h"
+#include "net/http_server_handlers_map2.h"
+#include "net/net_utils_base.h"
+
+using namespace epee;
+using namespace epee::net_utils::http;
+
+namespace
+{
+  struct COMMAND_TEST_VALUE
+  {
+    struct request
+    {
+      uint64_t value;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(value)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      uint64_t value;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(value)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  class test_stats_server
+  {
+  public:
+    typedef net_utils::connection_context_base connection_context;
+
+    bool process(const std::string& uri, const std::string& body)
+    {
+      http_request_info query;
+      query.m_URI = uri;
+      query.m_body = body;
+      http_response_info response;
+      response.m_response_code = 200;
+      connection_context context(boost::uuids::uuid(), 0, 0, false);
+      return handle_http_request_map(query, response, context);
+    }
+
+    bool on_value(const COMMAND_TEST_VALUE::request& req, COMMAND_TEST_VALUE::response& res, connection_context& cntx)
+    {
+      res.value = req.value;
+      return req.value != 13;
+    }
+
+    bool on_rpc_value(const COMMAND_TEST_VALUE::request& req, COMMAND_TEST_VALUE::response& res, json_rpc::error& error_resp, connection_context& cntx)
+    {
+      res.value = req.value;
+      return req.value != 13;
+    }
+
+    BEGIN_URI_MAP2()
+      MAP_URI_AUTO_JON2("/value", on_value, COMMAND_TEST_VALUE)
+      BEGIN_JSON_RPC_MAP_WITH_BATCH("/json_rpc", json_rpc::batch_config())
+        MAP_JON_RPC_WE("value", on_rpc_value, COMMAND_TEST_VALUE)
+      END_JSON_RPC_MAP()
+    END_URI_MAP2()
+  };
+
+  const route_stat* find_route(const std::list<route_stat>& stats, const std::string& name)
+  {
+    for (const auto& rs : stats)
+    {
+      if (rs.name == name)
+        return &rs;
+    }
+    return nullptr;
+  }
+}
+
+TEST(http_route_stats, histogram_buckets)
+{
+  for (uint64_t v = 0; v != 100000; ++v)
+  {
+    size_t i = latency_histogram::get_bucket_index(v);
+    ASSERT_LE(v, latency_histogram::get_bucket_upper_bound(i));
+    if (i)
+      ASSERT_GT(v, latency_histogram::get_bucket_upper_bound(i - 1));
+    //bucket width is at most 1/16 of its values
+    ASSERT_LE(latency_histogram::get_bucket_upper_bound(i) - v, v / 16);
+  }
+  ASSERT_EQ(latency_histogram::buckets_count - 1, latency_histogram::get_bucket_index(std::numeric_limits<uint64_t>::max()));
+}
+
+TEST(http_route_stats, histogram_percentiles)
+{
+  latency_histogram h;
+  ASSERT_EQ(0, h.get_percentile(99, 0));
+  for (uint64_t v = 1; v <= 10000; ++v)
+    h.record(v);
+  uint64_t p50 = h.get_percentile(50, 10000);
+  uint64_t p99 = h.get_percentile(99, 10000);
+  uint64_t p999 = h.get_percentile(99.9, 10000);
+  ASSERT_LE(5000, p50);
+  ASSERT_GE(5000 + 5000 / 16, p50);
+  ASSERT_LE(9900, p99);
+  ASSERT_GE(9900 + 9900 / 16, p99);
+  ASSERT_LE(9990, p999);
+  ASSERT_GE(9990 + 9990 / 16, p999);
+}
+
+TEST(http_route_stats, routes_are_counted_separately)
+{
+  route_stats stats;
+  boost::thread_group threads;
+  for (size_t t = 0; t != 4; ++t)
+  {
+    threads.create_thread([&stats]()
+    {
+      for (uint64_t i = 0; i != 1000; ++i)
+      {
+        stats.on_call("/a", 10, true);
+        stats.on_call("b", i, i % 10 != 0);
+      }
+    });
+  }
+  threads.join_all();
+  //same name from other literal goes to the same route
+  std::string name = "/a";
+  stats.on_call(name.c_str(), 1000, true);
+
+  std::list<route_stat> list;
+  stats.get_stats(list);
+  ASSERT_EQ(2, list.size());
+  const route_stat* a = find_route(list, "/a");
+  ASSERT_TRUE(a != nullptr);
+  ASSERT_EQ(4001, a->calls);
+  ASSERT_EQ(0, a->errors);
+  ASSERT_EQ(41000, a->total_time_us);
+  ASSERT_EQ(1000, a->max_time_us);
+  ASSERT_EQ(10, a->p50_us);
+  ASSERT_EQ(10, a->p999_us);
+  const route_stat* b = find_route(list, "b");
+  ASSERT_TRUE(b != nullptr);
+  ASSERT_EQ(4000, b->calls);
+  ASSERT_EQ(400, b->errors);
+  ASSERT_EQ(999, b->max_time_us);
+}
+
+TEST(http_route_stats, table_overflow_goes_to_other)
+{
+  route_stats stats;
+  std::vector<std::string> names;
+  for (size_t i = 0; i != route_stats::slots_count + 10; ++i)
+    names.push_back("/route" + std::to_string(i));
+  for (const auto& n : names)
+    stats.on_call(n.c_str(), 1, true);
+
+  std::list<route_stat> list;
+  stats.get_stats(list);
+  ASSERT_EQ(route_stats::slots_count + 1, list.size());
+  const route_stat* other = find_route(list, "other");
+  ASSERT_TRUE(other != nullptr);
+  ASSERT_EQ(10, other->calls);
+}
+
+TEST(http_route_stats, uri_map_records_calls)
+{
+  test_stats_server server;
+  ASSERT_TRUE(server.process("/value", "{\"value\": 1}"));
+  ASSERT_TRUE(server.process("/value", "{\"value\": 13}"));
+  ASSERT_TRUE(server.process("/json_rpc", "{\"jsonrpc\": \"2.0\", \"id\": 1, \"method\": \"value\", \"params\": {\"value\": 13}}"));
+  ASSERT_TRUE(server.process("/json_rpc", "[{\"jsonrpc\": \"2.0\", \"id\": 1, \"method\": \"value\", \"params\": {\"value\": 2}}]"));
+  ASSERT_FALSE(server.process("/nope", ""));
+
+  std::list<route_stat> list;
+  test_stats_server::get_http_route_stats().get_stats(list);
+  ASSERT_EQ(3, list.size());
+  const route_stat* uri = find_route(list, "/value");
+  ASSERT_TRUE(uri != nullptr);
+  ASSERT_EQ(2, uri->calls);
+  ASSERT_EQ(1, uri->errors);
+  const route_stat* method = find_route(list, "value");
+  ASSERT_TRUE(method != nullptr);
+  ASSERT_EQ(2, method->calls);
+  ASSERT_EQ(1, method->errors);
+  const route_stat* batch = find_route(list, "/json_rpc[batch]");
+  ASSERT_TRUE(batch != nullptr);
+  ASSERT_EQ(1, batch->calls);
+  ASSERT_EQ(0, batch->errors);
+}
+
+TEST(http_route_stats, slow_call_params_are_hidden_by_default)
+{
+  route_stats stats;
+  ASSERT_FALSE(stats.is_params_logged("value"));
+  stats.set_log_slow_call_params(true);
+  stats.hide_params("scan_with_view_keys");
+  ASSERT_TRUE(stats.is_params_logged("value"));
+  std::string name = "scan_with_view_keys";
+  ASSERT_FALSE(stats.is_params_logged(name.c_str()));
+}
@@ -0,0 +1,307 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "net/http_server_handlers_map2.h"
+#include "net/net_utils_base.h"
+
+using namespace epee;
+
+namespace
+{
+  struct COMMAND_TEST_ECHO
+  {
+    struct request
+    {
+      uint64_t value;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(value)
+      END_KV_SERIALIZE_MAP()
+    };
+
+    struct response
+    {
+      uint64_t value;
+      uint64_t counter;
+
+      BEGIN_KV_SERIALIZE_MAP()
+        KV_SERIALIZE(value)
+        KV_SERIALIZE(counter)
+      END_KV_SERIALIZE_MAP()
+    };
+  };
+
+  class test_json_rpc_server
+  {
+  public:
+    typedef net_utils::connection_context_base connection_context;
+
+    test_json_rpc_server() : m_counter(0), m_context_recv_cnt(0)
+    {
+      m_batch_config.max_size = 5;
+      m_batch_config.threads = 3;
+      m_batch_config.is_read_only = [](const std::string& method) { return method == "echo"; };
+    }
+
+    bool process(const std::string& body, std::string& response_body)
+    {
+      net_utils::http::http_request_info query;
+      query.m_URI = "/json_rpc";
+      query.m_body = body;
+      net_utils::http::http_response_info response;
+      connection_context context(boost::uuids::uuid(), 0, 0, false);
+      bool r = handle_http_request_map(query, response, context);
+      response_body = response.m_body;
+      m_response_code = response.m_response_code;
+      m_context_recv_cnt = context.m_recv_cnt;
+      return r;
+    }
+
+    bool on_echo(const COMMAND_TEST_ECHO::request& req, COMMAND_TEST_ECHO::response& res, json_rpc::error& error_resp, connection_context& cntx)
+    {
+      if (req.value == 13)
+      {
+        error_resp.code = -1;
+        error_resp.message = "unlucky";
+        return false;
+      }
+      res.value = req.value;
+      return true;
+    }
+
+    bool on_count(const COMMAND_TEST_ECHO::request& req, COMMAND_TEST_ECHO::response& res, json_rpc::error& error_resp, connection_context& cntx)
+    {
+      res.value = req.value;
+      res.counter = ++m_counter;
+      return true;
+    }
+
+    bool on_touch_context(const COMMAND_TEST_ECHO::request& req, COMMAND_TEST_ECHO::response& res, json_rpc::error& error_resp, connection_context& cntx)
+    {
+      res.value = req.value;
+      res.counter = ++cntx.m_recv_cnt;
+      return true;
+    }
+
+    BEGIN_URI_MAP2()
+      BEGIN_JSON_RPC_MAP_WITH_BATCH("/json_rpc", m_batch_config)
+        MAP_JON_RPC_WE("echo",  on_echo,  COMMAND_TEST_ECHO)
+        MAP_JON_RPC_WE("count", on_count, COMMAND_TEST_ECHO)
+        MAP_JON_RPC_WE("touch", on_touch_context, COMMAND_TEST_ECHO)
+      END_JSON_RPC_MAP()
+    END_URI_MAP2()
+
+    json_rpc::batch_config m_batch_config;
+    uint64_t m_counter;
+    int m_response_code;
+    uint64_t m_context_recv_cnt;
+  };
+
+  std::string make_call(const std::string& method, uint64_t id, uint64_t value)
+  {
+    return "{\"jsonrpc\": \"2.0\", \"id\": " + std::to_string(id) + ", \"method\": \"" + method + "\", \"params\": {\"value\": " + std::to_string(value) + "}}";
+  }
+
+  std::string make_notification(const std::string& method, uint64_t value)
+  {
+    return "{\"jsonrpc\": \"2.0\", \"method\": \"" + method + "\", \"params\": {\"value\": " + std::to_string(value) + "}}";
+  }
+
+  //loads every element of json array through portable_storage
+  bool load_batch_response(const std::string& body, std::vector<serialization::portable_storage>& items)
+  {
+    std::vector<std::string> texts;
+    if (!json_rpc::split_json_array(body, texts))
+      return false;
+    items.resize(texts.size());
+    for (size_t i = 0; i != texts.size(); ++i)
+    {
+      if (!items[i].load_from_json(texts[i]))
+        return false;
+    }
+    return true;
+  }
+
+  uint64_t get_result_value(serialization::portable_storage& ps, const std::string& name)
+  {
+    uint64_t v = 0;
+    serialization::portable_storage::hsection result = ps.open_section("result", nullptr);
+    if (result)
+      ps.get_value(name, v, result);
+    return v;
+  }
+
+  int64_t get_error_code(serialization::portable_storage& ps)
+  {
+    int64_t code = 0;
+    serialization::portable_storage::hsection error = ps.open_section("error", nullptr);
+    if (error)
+      ps.get_value("code", code, error);
+    return code;
+  }
+}
+
+TEST(json_rpc_batch, split_json_array)
+{
+  std::vector<std::string> items;
+  ASSERT_TRUE(json_rpc::split_json_array(" [ {\"a\": \"x,]}\\\"\"} , [1, {}],2,\"s\" ] ", items));
+  ASSERT_EQ(4, items.size());
+  ASSERT_EQ("{\"a\": \"x,]}\\\"\"}", items[0]);
+  ASSERT_EQ("[1, {}]", items[1]);
+  ASSERT_EQ("2", items[2]);
+  ASSERT_EQ("\"s\"", items[3]);
+
+  ASSERT_TRUE(json_rpc::split_json_array("[]", items));
+  ASSERT_TRUE(items.empty());
+
+  ASSERT_FALSE(json_rpc::split_json_array("[{}", items));
+  ASSERT_FALSE(json_rpc::split_json_array("[{},]", items));
+  ASSERT_FALSE(json_rpc::split_json_array("[,{}]", items));
+  ASSERT_FALSE(json_rpc::split_json_array("[{}}]", items));
+  ASSERT_FALSE(json_rpc::split_json_array("[\"unterminated]", items));
+}
+
+TEST(json_rpc_batch, responses_follow_calls_order)
+{
+  test_json_rpc_server server;
+  std::string single;
+  ASSERT_TRUE(server.process(make_call("echo", 1, 10), single));
+
+  std::string body;
+  ASSERT_TRUE(server.process("[" + make_call("echo", 1, 10) + "," + make_call("echo", 2, 13) + ",\n" +
+    "{\"jsonrpc\": \"2.0\", \"id\": 3, \"method\": \"nope\"}," + make_call("echo", 4, 40) + "]", body));
+  std::vector<serialization::portable_storage> items;
+  ASSERT_TRUE(load_batch_response(body, items)) << body;
+  ASSERT_EQ(4, items.size());
+
+  //same text as for single call
+  std::vector<std::string> texts;
+  ASSERT_TRUE(json_rpc::split_json_array(body, texts));
+  ASSERT_EQ(single, texts[0]);
+
+  ASSERT_EQ(10, get_result_value(items[0], "value"));
+  ASSERT_EQ(-1, get_error_code(items[1]));
+  ASSERT_EQ(-32601, get_error_code(items[2]));
+  ASSERT_EQ(40, get_result_value(items[3], "value"));
+  for (uint64_t i = 0; i != items.size(); ++i)
+  {
+    uint64_t id = 0;
+    ASSERT_TRUE(items[i].get_value("id", id, nullptr));
+    ASSERT_EQ(i + 1, id);
+  }
+}
+
+TEST(json_rpc_batch, calls_with_side_effects_run_in_order)
+{
+  test_json_rpc_server server;
+  std::string body;
+  ASSERT_TRUE(server.process("[" + make_call("echo", 1, 1) + "," + make_call("count", 2, 2) + "," + make_call("count", 3, 3) + "," +
+    make_call("echo", 4, 4) + "," + make_call("count", 5, 5) + "]", body));
+  std::vector<serialization::portable_storage> items;
+  ASSERT_TRUE(load_batch_response(body, items)) << body;
+  ASSERT_EQ(5, items.size());
+  ASSERT_EQ(1, get_result_value(items[1], "counter"));
+  ASSERT_EQ(2, get_result_value(items[2], "counter"));
+  ASSERT_EQ(3, get_result_value(items[4], "counter"));
+}
+
+TEST(json_rpc_batch, read_only_calls_in_parallel)
+{
+  test_json_rpc_server server;
+  server.m_batch_config.max_size = 1000;
+  std::string batch = "[";
+  for (uint64_t i = 0; i != 1000; ++i)
+    batch += (i ? "," : "") + make_call("echo", i, i * 3);
+  batch += "]";
+
+  std::string body;
+  ASSERT_TRUE(server.process(batch, body));
+  std::vector<serialization::portable_storage> items;
+  ASSERT_TRUE(load_batch_response(body, items));
+  ASSERT_EQ(1000, items.size());
+  for (uint64_t i = 0; i != items.size(); ++i)
+    ASSERT_EQ(i * 3, get_result_value(items[i], "value"));
+}
+
+TEST(json_rpc_batch, invalid_batches)
+{
+  test_json_rpc_server server;
+  std::string body;
+  serialization::portable_storage ps;
+
+  ASSERT_TRUE(server.process("[]", body));
+  ASSERT_TRUE(ps.load_from_json(body));
+  ASSERT_EQ(-32600, get_error_code(ps));
+
+  ASSERT_TRUE(server.process("[{\"id\": 1", body));
+  ASSERT_TRUE(ps.load_from_json(body));
+  ASSERT_EQ(-32700, get_error_code(ps));
+
+  std::string batch = "[";
+  for (uint64_t i = 0; i != 6; ++i)
+    batch += (i ? "," : "") + make_call("echo", i, i);
+  batch += "]";
+  ASSERT_TRUE(server.process(batch, body));
+  ASSERT_TRUE(ps.load_from_json(body));
+  ASSERT_EQ(-32600, get_error_code(ps));
+  ASSERT_EQ(0, server.m_counter);
+
+  //bad elements get own errors, the rest is still processed
+  ASSERT_TRUE(server.process("[1, [], {\"id\": 2, \"params\": {}}, " + make_call("count", 3, 3) + "]", body));
+  std::vector<serialization::portable_storage> items;
+  ASSERT_TRUE(load_batch_response(body, items)) << body;
+  ASSERT_EQ(4, items.size());
+  ASSERT_EQ(-32600, get_error_code(items[0]));
+  ASSERT_EQ(-32600, get_error_code(items[1]));
+  ASSERT_EQ(-32600, get_error_code(items[2]));
+  ASSERT_EQ(1, get_result_value(items[3], "counter"));
+
+  server.m_batch_config.max_size = 0;
+  ASSERT_TRUE(server.process("[" + make_call("echo", 1, 1) + "]", body));
+  ASSERT_TRUE(ps.load_from_json(body));
+  ASSERT_EQ(-32600, get_error_code(ps));
+}
+
+TEST(json_rpc_batch, notifications_are_run_without_response)
+{
+  test_json_rpc_server server;
+  std::string body;
+  ASSERT_TRUE(server.process("[" + make_notification("count", 1) + "," + make_call("count", 2, 2) + "," + make_notification("count", 3) + "]", body));
+  std::vector<serialization::portable_storage> items;
+  ASSERT_TRUE(load_batch_response(body, items)) << body;
+  ASSERT_EQ(1, items.size());
+  uint64_t id = 0;
+  ASSERT_TRUE(items[0].get_value("id", id, nullptr));
+  ASSERT_EQ(2, id);
+  ASSERT_EQ(2, get_result_value(items[0], "counter"));
+  ASSERT_EQ(3, server.m_counter);
+
+  //nothing to answer at all
+  ASSERT_TRUE(server.process("[" + make_notification("count", 4) + "," + make_notification("echo", 5) + "]", body));
+  ASSERT_TRUE(body.empty()) << body;
+  ASSERT_EQ(204, server.m_response_code);
+  ASSERT_EQ(4, server.m_counter);
+}
+
+TEST(json_rpc_batch, calls_get_own_connection_context)
+{
+  test_json_rpc_server server;
+  server.m_batch_config.is_read_only = [](const std::string& method) { return method == "touch"; };
+  std::string batch = "[";
+  for (uint64_t i = 0; i != 5; ++i)
+    batch += (i ? "," : "") + make_call("touch", i, i);
+  batch += "]";
+
+  std::string body;
+  ASSERT_TRUE(server.process(batch, body));
+  std::vector<serialization::portable_storage> items;
+  ASSERT_TRUE(load_batch_response(body, items)) << body;
+  ASSERT_EQ(5, items.size());
+  for (auto& item : items)
+    ASSERT_EQ(1, get_result_value(item, "counter"));
+  ASSERT_EQ(0, server.m_context_recv_cnt);
+}
@@ -352,6 +352,88 @@ TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_process
   ASSERT_TRUE(0 != (resp_head.m_flags | LEVIN_PACKET_RESPONSE));
 }
 
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_counts_traffic)
+{
+  const int expected_command = 2634982;
+  test_connection_ptr conn = create_connection();
+  m_commands_handler.invoke_out_buf(std::string(128, 'w'));
+
+  std::string in_data(256, 'q');
+  epee::levin::bucket_head2 req_head;
+  req_head.m_signature = LEVIN_SIGNATURE;
+  req_head.m_cb = in_data.size();
+  req_head.m_have_to_return_data = true;
+  req_head.m_command = expected_command;
+  req_head.m_flags = LEVIN_PACKET_REQUEST;
+  req_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+  std::string buf(reinterpret_cast<const char*>(&req_head), sizeof(req_head));
+  buf += in_data;
+
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+
+  const test_levin_connection_context& context = conn->m_protocol_handler.get_context_ref();
+  ASSERT_EQ(2, context.m_recv_msgs.load());
+  ASSERT_EQ(2, context.m_send_msgs.load());
+  test_levin_connection_context context_copy(context);
+  ASSERT_EQ(2, context_copy.m_recv_msgs.load());
+  ASSERT_EQ(context.m_handler_time_us.load(), context_copy.m_handler_time_us.load());
+
+  std::list<epee::levin::command_traffic_stat> stats;
+  m_handler_config.m_traffic_stats.get_stats(stats);
+  ASSERT_EQ(1, stats.size());
+  ASSERT_EQ(expected_command, stats.front().command);
+  ASSERT_EQ(2, stats.front().messages_in);
+  ASSERT_EQ(2, stats.front().messages_out);
+  ASSERT_EQ(2 * buf.size(), stats.front().bytes_in);
+  ASSERT_EQ(2 * (sizeof(req_head) + 128), stats.front().bytes_out);
+}
+
+TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_counts_unknown_commands_as_other)
+{
+  test_connection_ptr conn = create_connection();
+  m_commands_handler.return_code(LEVIN_ERROR_CONNECTION_HANDLER_NOT_DEFINED);
+
+  std::string in_data(16, 'u');
+  epee::levin::bucket_head2 req_head;
+  req_head.m_signature = LEVIN_SIGNATURE;
+  req_head.m_cb = in_data.size();
+  req_head.m_flags = LEVIN_PACKET_REQUEST;
+  req_head.m_protocol_version = LEVIN_PROTOCOL_VER_1;
+
+  // more distinct ids than the table has slots, as invokes and notifies
+  const int commands_count = 2 * epee::levin::traffic_stats::slots_count;
+  for (int i = 1; i <= commands_count; ++i)
+  {
+    req_head.m_command = 1000 + i;
+    req_head.m_have_to_return_data = i % 2 == 0;
+    std::string buf(reinterpret_cast<const char*>(&req_head), sizeof(req_head));
+    buf += in_data;
+    ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+  }
+
+  std::list<epee::levin::command_traffic_stat> stats;
+  m_handler_config.m_traffic_stats.get_stats(stats);
+  ASSERT_EQ(1, stats.size());
+  ASSERT_EQ(epee::levin::traffic_stats::other_command, stats.front().command);
+  ASSERT_EQ(commands_count, stats.front().messages_in);
+  ASSERT_EQ(commands_count / 2, stats.front().messages_out);
+  ASSERT_EQ(commands_count * (sizeof(req_head) + in_data.size()), stats.front().bytes_in);
+
+  // known commands still get their own slot
+  m_commands_handler.return_code(LEVIN_OK);
+  req_head.m_command = 77;
+  req_head.m_have_to_return_data = false;
+  std::string buf(reinterpret_cast<const char*>(&req_head), sizeof(req_head));
+  buf += in_data;
+  ASSERT_TRUE(conn->m_protocol_handler.handle_recv(buf.data(), buf.size()));
+  stats.clear();
+  m_handler_config.m_traffic_stats.get_stats(stats);
+  ASSERT_EQ(2, stats.size());
+  ASSERT_EQ(77, stats.front().command);
+  ASSERT_EQ(1, stats.front().messages_in);
+}
+
 TEST_F(positive_test_connection_to_levin_protocol_handler_calls, handler_processes_handle_read_as_notify)
 {
   // Setup
@@ -0,0 +1,134 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "serialization/keyvalue_serialization.h"
+#include "storages/portable_storage_template_helper.h"
+
+using epee::serialization::portable_storage;
+
+namespace
+{
+  struct test_destination
+  {
+    uint64_t amount;
+    std::string address;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(amount)
+      KV_SERIALIZE(address)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct test_request
+  {
+    std::list<test_destination> destinations;
+    int64_t delta;
+    double ratio;
+    bool flag;
+    std::list<uint64_t> heights;
+    std::list<std::string> names;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(destinations)
+      KV_SERIALIZE(delta)
+      KV_SERIALIZE(ratio)
+      KV_SERIALIZE(flag)
+      KV_SERIALIZE(heights)
+      KV_SERIALIZE(names)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  bool parse(const std::string& json)
+  {
+    portable_storage ps;
+    return ps.load_from_json(json);
+  }
+}
+
+TEST(portable_storage_from_json, values)
+{
+  portable_storage ps;
+  ASSERT_TRUE(ps.load_from_json(" \r\n{\"u\": 18446744073709551615, \"i\": -9223372036854775808, \"d\": -1.5e2,"
+                                "\"t\": TRUE, \"f\": false, \"n\": null, \"s\": \"a\\\"b\\\\c\\/d\\n\\te\", \"e\": \"\","
+                                "\"sec\": {\"x\": 1, \"empty\": {}}, \"arr\": []}"));
+  uint64_t u = 0;
+  ASSERT_TRUE(ps.get_value("u", u, nullptr));
+  ASSERT_EQ(18446744073709551615ULL, u);
+  int64_t i = 0;
+  ASSERT_TRUE(ps.get_value("i", i, nullptr));
+  ASSERT_EQ(std::numeric_limits<int64_t>::min(), i);
+  double d = 0;
+  ASSERT_TRUE(ps.get_value("d", d, nullptr));
+  ASSERT_EQ(-150.0, d);
+  bool b = false;
+  ASSERT_TRUE(ps.get_value("t", b, nullptr));
+  ASSERT_TRUE(b);
+  ASSERT_TRUE(ps.get_value("f", b, nullptr));
+  ASSERT_FALSE(b);
+  std::string s;
+  ASSERT_FALSE(ps.get_value("n", s, nullptr));
+  ASSERT_TRUE(ps.get_value("s", s, nullptr));
+  ASSERT_EQ("a\"b\\c/d\n\te", s);
+  ASSERT_TRUE(ps.get_value("e", s, nullptr));
+  ASSERT_EQ("", s);
+
+  portable_storage::hsection sec = ps.open_section("sec", nullptr);
+  ASSERT_TRUE(sec != nullptr);
+  ASSERT_TRUE(ps.get_value("x", u, sec));
+  ASSERT_EQ(1, u);
+  ASSERT_TRUE(ps.open_section("empty", sec) != nullptr);
+}
+
+TEST(portable_storage_from_json, into_struct)
+{
+  test_request req = AUTO_VAL_INIT(req);
+  ASSERT_TRUE(epee::serialization::load_t_from_json(req,
+    "{\"destinations\": [{\"amount\": 10, \"address\": \"addr1\"}, {\"address\": \"addr2\", \"amount\": 20}],"
+    " \"delta\": -7, \"ratio\": 0.25, \"flag\": true, \"heights\": [1, 2, 3], \"names\": [\"x\", \"y\"],}"));
+  ASSERT_EQ(2, req.destinations.size());
+  ASSERT_EQ(10, req.destinations.front().amount);
+  ASSERT_EQ("addr2", req.destinations.back().address);
+  ASSERT_EQ(20, req.destinations.back().amount);
+  ASSERT_EQ(-7, req.delta);
+  ASSERT_EQ(0.25, req.ratio);
+  ASSERT_TRUE(req.flag);
+  ASSERT_EQ(std::list<uint64_t>({1, 2, 3}), req.heights);
+  ASSERT_EQ(std::list<std::string>({"x", "y"}), req.names);
+
+  //round trip through own output
+  test_request loaded = AUTO_VAL_INIT(loaded);
+  ASSERT_TRUE(epee::serialization::load_t_from_json(loaded, epee::serialization::store_t_to_json(req)));
+  ASSERT_EQ(epee::serialization::store_t_to_json(req), epee::serialization::store_t_to_json(loaded));
+}
+
+TEST(portable_storage_from_json, empty_document)
+{
+  ASSERT_TRUE(parse(""));
+  ASSERT_TRUE(parse(" \n "));
+  ASSERT_TRUE(parse("{}"));
+}
+
+TEST(portable_storage_from_json, malformed)
+{
+  ASSERT_FALSE(parse("x{}"));
+  ASSERT_FALSE(parse("{\"a\": 1"));
+  ASSERT_FALSE(parse("{\"a\": \"unterminated}"));
+  ASSERT_FALSE(parse("{\"a\" 1}"));
+  ASSERT_FALSE(parse("{\"a\": 1 \"b\": 2}"));
+  ASSERT_FALSE(parse("{\"a\": }"));
+  ASSERT_FALSE(parse("{\"a\": nope}"));
+  ASSERT_FALSE(parse("{\"a\": -}"));
+  ASSERT_FALSE(parse("{\"a\": 1e}"));
+  ASSERT_FALSE(parse("{\"a\": 18446744073709551616}"));
+  ASSERT_FALSE(parse("{\"a\": -9223372036854775809}"));
+  ASSERT_FALSE(parse("{\"a\": [1, 2}"));
+  ASSERT_FALSE(parse("{\"a\": [[1]]}"));
+  ASSERT_FALSE(parse("{\"a\": [null]}"));
+  ASSERT_FALSE(parse("{\"a\": [1, \"2\"]}"));
+  ASSERT_FALSE(parse("{\"a\": [true, 1]}"));
+  ASSERT_FALSE(parse("{\"a\": [{}, 1]}"));
+}
@@ -0,0 +1,217 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "serialization/keyvalue_serialization.h"
+#include "storages/portable_storage_template_helper.h"
+
+namespace
+{
+  struct test_item
+  {
+    std::string name;
+    uint32_t value;
+    std::list<std::string> tags;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(name)
+      KV_SERIALIZE(value)
+      KV_SERIALIZE(tags)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct test_inner
+  {
+    int64_t i64;
+    std::vector<test_item> items;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(i64)
+      KV_SERIALIZE(items)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  struct test_object
+  {
+    uint64_t u64;
+    uint32_t u32;
+    uint16_t u16;
+    uint8_t u8;
+    int32_t i32;
+    int16_t i16;
+    int8_t i8;
+    double d;
+    bool b;
+    std::string str;
+    std::string escaped;
+    std::list<uint64_t> numbers;
+    std::vector<std::string> strings;
+    std::list<bool> flags;
+    std::list<test_item> empty_items;
+    std::list<test_item> items;
+    test_inner inner;
+    std::vector<uint32_t> pod_blob;
+    epee::serialization::storage_entry meta;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(u64)
+      KV_SERIALIZE(u32)
+      KV_SERIALIZE(u16)
+      KV_SERIALIZE(u8)
+      KV_SERIALIZE(i32)
+      KV_SERIALIZE(i16)
+      KV_SERIALIZE(i8)
+      KV_SERIALIZE(d)
+      KV_SERIALIZE(b)
+      KV_SERIALIZE(str)
+      KV_SERIALIZE(escaped)
+      KV_SERIALIZE(numbers)
+      KV_SERIALIZE(strings)
+      KV_SERIALIZE(flags)
+      KV_SERIALIZE(empty_items)
+      KV_SERIALIZE(items)
+      KV_SERIALIZE(inner)
+      KV_SERIALIZE_CONTAINER_POD_AS_BLOB(pod_blob)
+      KV_SERIALIZE(meta)
+    END_KV_SERIALIZE_MAP()
+  };
+
+  test_item make_item(const std::string& name, uint32_t value, size_t tags_count)
+  {
+    test_item it = AUTO_VAL_INIT(it);
+    it.name = name;
+    it.value = value;
+    for (size_t i = 0; i != tags_count; ++i)
+      it.tags.push_back(name + "_tag" + std::to_string(i));
+    return it;
+  }
+
+  test_object make_test_object()
+  {
+    test_object obj = AUTO_VAL_INIT(obj);
+    obj.u64 = 18446744073709551615ULL;
+    obj.u32 = 4000000000U;
+    obj.u16 = 65000;
+    obj.u8 = 200;
+    obj.i32 = -2000000000;
+    obj.i16 = -30000;
+    obj.i8 = -100;
+    obj.d = 3.25;
+    obj.b = true;
+    obj.str = "plain";
+    obj.escaped = "quote\" slash/ backslash\\ \r\n\t";
+    for (uint64_t i = 0; i != 100; ++i)
+      obj.numbers.push_back(i * 1000000007ULL);
+    obj.strings.push_back("one");
+    obj.strings.push_back("");
+    obj.strings.push_back(std::string(300, 'x'));
+    obj.flags.push_back(true);
+    obj.flags.push_back(false);
+    for (uint32_t i = 0; i != 50; ++i)
+      obj.items.push_back(make_item("item" + std::to_string(i), i, i % 4));
+    obj.inner.i64 = -5;
+    obj.inner.items.push_back(make_item("inner", 1, 2));
+    obj.pod_blob.push_back(1);
+    obj.pod_blob.push_back(0xdeadbeef);
+    obj.meta = epee::serialization::storage_entry(std::string("meta value"));
+    return obj;
+  }
+
+  struct chunk_collector
+  {
+    std::string data;
+    size_t chunks;
+    size_t max_chunk;
+
+    chunk_collector() : chunks(0), max_chunk(0) {}
+
+    epee::serialization::stream_sink sink()
+    {
+      return [this](std::string& chunk) {
+        ++chunks;
+        max_chunk = (std::max)(max_chunk, chunk.size());
+        data += chunk;
+        return true;
+      };
+    }
+  };
+}
+
+TEST(portable_storage_stream, json_same_as_portable_storage)
+{
+  test_object obj = make_test_object();
+  std::string expected = epee::serialization::store_t_to_json(obj);
+
+  for (size_t chunk_size : {size_t(1), size_t(7), size_t(1000), size_t(PORTABLE_STORAGE_STREAM_CHUNK_SIZE)})
+  {
+    chunk_collector col;
+    ASSERT_TRUE(epee::serialization::store_t_to_json_stream(obj, col.sink(), chunk_size));
+    ASSERT_LT(0, col.chunks);
+    // a chunk is flushed as soon as it's full, only one value may stick out
+    ASSERT_GE(chunk_size + 400, col.max_chunk);
+
+    // streamed text keeps declaration order, compare normalized dumps
+    epee::serialization::portable_storage ps;
+    ASSERT_TRUE(ps.load_from_json(col.data)) << col.data;
+    std::string streamed;
+    ps.dump_as_json(streamed);
+    ASSERT_EQ(expected, streamed);
+
+    test_object loaded = AUTO_VAL_INIT(loaded);
+    ASSERT_TRUE(epee::serialization::load_t_from_json(loaded, col.data));
+    ASSERT_EQ(obj.escaped, loaded.escaped);
+    ASSERT_EQ(obj.items.size(), loaded.items.size());
+    ASSERT_EQ(obj.pod_blob, loaded.pod_blob);
+  }
+}
+
+TEST(portable_storage_stream, binary_same_as_portable_storage)
+{
+  test_object obj = make_test_object();
+  std::string expected_bin = epee::serialization::store_t_to_binary(obj);
+  std::string expected_json = epee::serialization::store_t_to_json(obj);
+
+  for (size_t chunk_size : {size_t(1), size_t(13), size_t(PORTABLE_STORAGE_STREAM_CHUNK_SIZE)})
+  {
+    chunk_collector col;
+    ASSERT_TRUE(epee::serialization::store_t_to_binary_stream(obj, col.sink(), chunk_size));
+    ASSERT_EQ(expected_bin.size(), col.data.size());
+
+    epee::serialization::portable_storage ps;
+    ASSERT_TRUE(ps.load_from_binary(col.data));
+    std::string streamed;
+    ps.dump_as_json(streamed);
+    ASSERT_EQ(expected_json, streamed);
+
+    test_object loaded = AUTO_VAL_INIT(loaded);
+    ASSERT_TRUE(epee::serialization::load_t_from_binary(loaded, col.data));
+    ASSERT_EQ(expected_bin, epee::serialization::store_t_to_binary(loaded));
+  }
+}
+
+TEST(portable_storage_stream, empty_object)
+{
+  test_inner obj = AUTO_VAL_INIT(obj);
+  chunk_collector json_col;
+  ASSERT_TRUE(epee::serialization::store_t_to_json_stream(obj, json_col.sink()));
+  ASSERT_EQ("{\"i64\": 0}", json_col.data);
+
+  chunk_collector bin_col;
+  ASSERT_TRUE(epee::serialization::store_t_to_binary_stream(obj, bin_col.sink()));
+  ASSERT_EQ(epee::serialization::store_t_to_binary(obj), bin_col.data);
+}
+
+TEST(portable_storage_stream, sink_failure_stops_output)
+{
+  test_object obj = make_test_object();
+  size_t calls = 0;
+  auto failing_sink = [&calls](std::string& chunk) { ++calls; return false; };
+  ASSERT_FALSE(epee::serialization::store_t_to_json_stream(obj, failing_sink, 16));
+  ASSERT_EQ(1, calls);
+  calls = 0;
+  ASSERT_FALSE(epee::serialization::store_t_to_binary_stream(obj, failing_sink, 16));
+  ASSERT_EQ(1, calls);
+}
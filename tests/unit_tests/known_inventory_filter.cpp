@@ -0,0 +1,77 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "currency_protocol/known_inventory_filter.h"
+
+using currency::known_inventory_filter;
+
+namespace
+{
+  crypto::hash make_id(uint64_t n)
+  {
+    crypto::hash h = crypto::hash();
+    *reinterpret_cast<uint64_t*>(&h) = n + 1;
+    return h;
+  }
+}
+
+TEST(known_inventory_filter, insert_reports_only_new_ids)
+{
+  known_inventory_filter filter(10);
+  ASSERT_FALSE(filter.contains(make_id(1)));
+  ASSERT_TRUE(filter.insert(make_id(1)));
+  ASSERT_TRUE(filter.insert(make_id(2)));
+  ASSERT_FALSE(filter.insert(make_id(1)));
+  ASSERT_TRUE(filter.contains(make_id(1)));
+  ASSERT_TRUE(filter.contains(make_id(2)));
+  ASSERT_EQ(2, filter.size());
+}
+
+TEST(known_inventory_filter, oldest_ids_are_forgotten_first)
+{
+  known_inventory_filter filter(3);
+  for (uint64_t i = 0; i != 5; ++i)
+    ASSERT_TRUE(filter.insert(make_id(i)));
+  ASSERT_EQ(3, filter.size());
+  ASSERT_FALSE(filter.contains(make_id(0)));
+  ASSERT_FALSE(filter.contains(make_id(1)));
+  for (uint64_t i = 2; i != 5; ++i)
+    ASSERT_TRUE(filter.contains(make_id(i)));
+
+  //forgotten id is new again and pushes out the next oldest one
+  ASSERT_TRUE(filter.insert(make_id(0)));
+  ASSERT_FALSE(filter.contains(make_id(2)));
+  ASSERT_TRUE(filter.contains(make_id(0)));
+  ASSERT_EQ(3, filter.size());
+}
+
+TEST(known_inventory_filter, repeated_insert_doesnt_refresh_id)
+{
+  known_inventory_filter filter(2);
+  ASSERT_TRUE(filter.insert(make_id(1)));
+  ASSERT_TRUE(filter.insert(make_id(2)));
+  ASSERT_FALSE(filter.insert(make_id(1)));
+  //id 1 is still the oldest one
+  ASSERT_TRUE(filter.insert(make_id(3)));
+  ASSERT_FALSE(filter.contains(make_id(1)));
+  ASSERT_TRUE(filter.contains(make_id(2)));
+  ASSERT_TRUE(filter.contains(make_id(3)));
+}
+
+TEST(known_inventory_filter, size_stays_bounded)
+{
+  known_inventory_filter filter(100);
+  for (uint64_t i = 0; i != 1000; ++i)
+  {
+    filter.insert(make_id(i));
+    ASSERT_GE(100, filter.size());
+  }
+  ASSERT_EQ(100, filter.size());
+  ASSERT_TRUE(filter.contains(make_id(999)));
+  ASSERT_FALSE(filter.contains(make_id(899)));
+  ASSERT_TRUE(filter.contains(make_id(900)));
+}
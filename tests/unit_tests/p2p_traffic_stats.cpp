@@ -0,0 +1,93 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "currency_protocol/currency_protocol_defs.h"
+#include "rpc/p2p_traffic_stats.h"
+
+TEST(p2p_traffic_stats, table_counts_per_command)
+{
+  const int command = currency::NOTIFY_NEW_BLOCK::ID;
+  const int colliding_command = command + epee::levin::traffic_stats::slots_count;
+  epee::levin::traffic_stats ts;
+  ts.on_recv(command, 100);
+  ts.on_recv(command, 50);
+  ts.on_send(command, 10);
+  ts.on_handled(command, 7);
+  // collides with NOTIFY_NEW_BLOCK in the table
+  ts.on_send(colliding_command, 5);
+
+  std::list<epee::levin::command_traffic_stat> stats;
+  ts.get_stats(stats);
+  ASSERT_EQ(2, stats.size());
+  const epee::levin::command_traffic_stat& st = stats.front();
+  ASSERT_EQ(command, st.command);
+  ASSERT_EQ(150, st.bytes_in);
+  ASSERT_EQ(2, st.messages_in);
+  ASSERT_EQ(10, st.bytes_out);
+  ASSERT_EQ(1, st.messages_out);
+  ASSERT_EQ(7, st.handler_time_us);
+  ASSERT_EQ(colliding_command, stats.back().command);
+  ASSERT_EQ(5, stats.back().bytes_out);
+}
+
+TEST(p2p_traffic_stats, table_overflow_goes_to_other)
+{
+  epee::levin::traffic_stats ts;
+  for (int i = 1; i <= epee::levin::traffic_stats::slots_count + 2; ++i)
+    ts.on_recv(i, 1);
+
+  std::list<epee::levin::command_traffic_stat> stats;
+  ts.get_stats(stats);
+  ASSERT_EQ(epee::levin::traffic_stats::slots_count + 1, stats.size());
+  ASSERT_EQ(epee::levin::traffic_stats::other_command, stats.back().command);
+  ASSERT_EQ(2, stats.back().messages_in);
+}
+
+TEST(p2p_traffic_stats, rpc_response)
+{
+  epee::levin::traffic_stats ts;
+  ts.on_recv(nodetool::COMMAND_HANDSHAKE_T<currency::CORE_SYNC_DATA>::ID, 300);
+  ts.on_recv(nodetool::COMMAND_REQUEST_STAT_INFO_T<currency::core_stat_info>::ID, 20);
+  ts.on_recv(424242, 1);
+
+  boost::uuids::uuid id = boost::uuids::uuid();
+  id.data[0] = 1;
+  epee::net_utils::connection_context_base cntxt(id, MAKE_IP(10, 0, 0, 1), 10101, true, 0, 0, 1000, 2000);
+  cntxt.m_recv_msgs = 3;
+  cntxt.m_send_msgs = 4;
+  cntxt.m_handler_time_us = 55;
+  std::list<epee::net_utils::connection_context_base> connections;
+  connections.push_back(cntxt);
+
+  currency::COMMAND_RPC_GET_P2P_TRAFFIC_STATS::response res = AUTO_VAL_INIT(res);
+  currency::fill_p2p_traffic_stats(ts, connections, cntxt.m_started + 60, res);
+  ASSERT_EQ(3, res.commands.size());
+  std::set<std::string> names;
+  for (const auto& ce : res.commands)
+    names.insert(ce.name);
+  ASSERT_EQ(1, names.count("COMMAND_HANDSHAKE"));
+  ASSERT_EQ(1, names.count("COMMAND_REQUEST_STAT_INFO"));
+  ASSERT_EQ(1, names.count("COMMAND_424242"));
+
+  ASSERT_EQ(1, res.peers.size());
+  const auto& pe = res.peers.front();
+  ASSERT_EQ("10.0.0.1", pe.ip);
+  ASSERT_EQ(10101, pe.port);
+  ASSERT_TRUE(pe.is_income);
+  ASSERT_EQ(60, pe.live_time);
+  ASSERT_EQ(1000, pe.bytes_in);
+  ASSERT_EQ(2000, pe.bytes_out);
+  ASSERT_EQ(3, pe.messages_in);
+  ASSERT_EQ(4, pe.messages_out);
+  ASSERT_EQ(55, pe.handler_time_us);
+
+  // restricted mode passes no connections
+  currency::COMMAND_RPC_GET_P2P_TRAFFIC_STATS::response restricted = AUTO_VAL_INIT(restricted);
+  currency::fill_p2p_traffic_stats(ts, std::list<epee::net_utils::connection_context_base>(), 0, restricted);
+  ASSERT_EQ(3, restricted.commands.size());
+  ASSERT_TRUE(restricted.peers.empty());
+}
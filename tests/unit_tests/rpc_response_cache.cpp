@@ -0,0 +1,152 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "include_base_utils.h"
+#include "net/http_server_handlers_map2.h"
+#include "rpc/rpc_response_cache.h"
+
+using currency::rpc_response_cache;
+
+namespace
+{
+  const size_t entry_body_size = 1000;
+
+  std::string make_body(char c)
+  {
+    return std::string(entry_body_size, c);
+  }
+
+  struct test_result
+  {
+    std::string hash;
+    uint64_t depth;
+    std::list<uint64_t> sizes;
+
+    BEGIN_KV_SERIALIZE_MAP()
+      KV_SERIALIZE(hash)
+      KV_SERIALIZE(depth)
+      KV_SERIALIZE(sizes)
+    END_KV_SERIALIZE_MAP()
+  };
+}
+
+TEST(rpc_response_cache, evicts_least_recently_used_within_budget)
+{
+  rpc_response_cache cache(10 * entry_body_size);
+  uint64_t epoch = 0;
+  std::string body;
+  for (char c = 'a'; c != 'k'; ++c)
+  {
+    ASSERT_FALSE(cache.get(std::string(1, c), 100, body, epoch));
+    ASSERT_TRUE(cache.put(std::string(1, c), make_body(c), 10, std::string::npos, epoch));
+  }
+
+  rpc_response_cache::stats st = AUTO_VAL_INIT(st);
+  cache.get_stats(st);
+  ASSERT_LE(st.size, st.max_size);
+  ASSERT_LT(0, st.evictions);
+  ASSERT_EQ(10, st.entries + st.evictions);
+
+  // touch the oldest surviving entry, then push more and check it survives
+  std::string oldest(1, static_cast<char>('a' + st.evictions));
+  ASSERT_TRUE(cache.get(oldest, 100, body, epoch));
+  ASSERT_EQ(make_body(oldest[0]), body);
+  ASSERT_TRUE(cache.put("x", make_body('x'), 10, std::string::npos, epoch));
+  ASSERT_TRUE(cache.get(oldest, 100, body, epoch));
+  ASSERT_FALSE(cache.get(std::string(1, static_cast<char>(oldest[0] + 1)), 100, body, epoch));
+
+  // too big to be kept
+  ASSERT_FALSE(cache.put("big", std::string(5 * entry_body_size, 'b'), 10, std::string::npos, epoch));
+
+  cache.set_max_size(0);
+  ASSERT_FALSE(cache.is_enabled());
+  cache.get_stats(st);
+  ASSERT_EQ(0, st.entries);
+  ASSERT_EQ(0, st.size);
+}
+
+TEST(rpc_response_cache, invalidated_by_popped_blocks)
+{
+  rpc_response_cache cache;
+  uint64_t epoch = 0;
+  std::string body;
+  ASSERT_FALSE(cache.get("h10", 100, body, epoch));
+  ASSERT_TRUE(cache.put("h10", "10", 10, std::string::npos, epoch));
+  ASSERT_TRUE(cache.put("h20", "20", 20, std::string::npos, epoch));
+  ASSERT_TRUE(cache.put("h30", "30", 30, std::string::npos, epoch));
+
+  cache.on_block_popped(20);
+  ASSERT_TRUE(cache.get("h10", 100, body, epoch));
+  ASSERT_FALSE(cache.get("h20", 100, body, epoch));
+  ASSERT_FALSE(cache.get("h30", 100, body, epoch));
+
+  rpc_response_cache::stats st = AUTO_VAL_INIT(st);
+  cache.get_stats(st);
+  ASSERT_EQ(2, st.invalidations);
+  ASSERT_EQ(1, st.entries);
+  ASSERT_EQ(1, st.hits);
+  ASSERT_EQ(3, st.misses);
+}
+
+TEST(rpc_response_cache, response_built_before_pop_is_not_stored)
+{
+  rpc_response_cache cache;
+  uint64_t epoch = 0;
+  std::string body;
+  ASSERT_FALSE(cache.get("k", 100, body, epoch));
+  // chain reorganized while response was being built
+  cache.on_block_popped(99);
+  ASSERT_FALSE(cache.put("k", "stale", 10, std::string::npos, epoch));
+  ASSERT_FALSE(cache.get("k", 100, body, epoch));
+  ASSERT_TRUE(cache.put("k", "fresh", 10, std::string::npos, epoch));
+  ASSERT_TRUE(cache.get("k", 100, body, epoch));
+  ASSERT_EQ("fresh", body);
+}
+
+TEST(rpc_response_cache, depth_filled_on_hit)
+{
+  test_result res = AUTO_VAL_INIT(res);
+  res.hash = "abcd";
+  res.depth = RPC_RESPONSE_CACHE_DEPTH_PLACEHOLDER;
+  res.sizes.push_back(1);
+  res.sizes.push_back(2);
+  std::string cached = epee::serialization::store_t_to_json(res, 1);
+  size_t depth_pos = cached.find(RPC_RESPONSE_CACHE_DEPTH_PLACEHOLDER_STR);
+  ASSERT_NE(std::string::npos, depth_pos);
+
+  rpc_response_cache cache;
+  uint64_t epoch = 0;
+  std::string body;
+  ASSERT_FALSE(cache.get("k", 100, body, epoch));
+  ASSERT_TRUE(cache.put("k", cached, 50, depth_pos, epoch));
+
+  for (uint64_t height = 100; height != 103; ++height)
+  {
+    res.depth = height - 50 - 1;
+    ASSERT_TRUE(cache.get("k", height, body, epoch));
+    ASSERT_EQ(epee::serialization::store_t_to_json(res, 1), body);
+  }
+}
+
+TEST(rpc_response_cache, json_rpc_response_from_cached_result)
+{
+  epee::json_rpc::response<test_result, epee::json_rpc::dummy_error> resp = AUTO_VAL_INIT(resp);
+  resp.jsonrpc = "2.0";
+  resp.result.hash = "abcd";
+  resp.result.depth = 7;
+  resp.result.sizes.push_back(3);
+
+  epee::serialization::storage_entry ids[] = {epee::serialization::storage_entry(std::string("0")),
+                                              epee::serialization::storage_entry(uint64_t(42)),
+                                              epee::serialization::storage_entry(std::string("a \"quoted\" id"))};
+  for (const auto& id : ids)
+  {
+    resp.id = id;
+    std::string body;
+    epee::json_rpc::make_response_json(id, epee::serialization::store_t_to_json(resp.result, 1), body);
+    ASSERT_EQ(epee::serialization::store_t_to_json(resp), body);
+  }
+}
@@ -6,6 +6,7 @@
 
 #include "common/util.h"
 #include "p2p/net_peerlist.h"
+#include "common/boost_serialization_helper.h"
 #include "net/net_utils_base.h"
 
 TEST(peer_list, peer_list_general)
@@ -56,3 +57,199 @@ TEST(peer_list, merge_peer_lists)
 
 
 }
+
+namespace
+{
+  nodetool::peerlist_entry make_peer(uint32_t n, time_t last_seen)
+  {
+    nodetool::peerlist_entry ple = AUTO_VAL_INIT(ple);
+    ple.adr.ip = MAKE_IP(100, ((n >> 16) & 0xff), ((n >> 8) & 0xff), (n & 0xff));
+    ple.adr.port = 8080;
+    ple.id = n;
+    ple.last_seen = last_seen;
+    return ple;
+  }
+}
+
+TEST(peer_list, hashed_list_keeps_time_order)
+{
+  nodetool::peers_hashed_list pl;
+  pl.upsert(make_peer(1, 100));
+  pl.upsert(make_peer(2, 300));
+  pl.upsert(make_peer(3, 200));
+  pl.upsert(make_peer(4, 300));
+  ASSERT_EQ(4, pl.size());
+  ASSERT_EQ(1, pl.oldest().id);
+
+  nodetool::peerlist_entry pe = AUTO_VAL_INIT(pe);
+  ASSERT_TRUE(pl.get_by_index_from_newest(0, pe));
+  ASSERT_EQ(4, pe.id);
+  ASSERT_TRUE(pl.get_by_index_from_newest(2, pe));
+  ASSERT_EQ(3, pe.id);
+  ASSERT_FALSE(pl.get_by_index_from_newest(4, pe));
+
+  // update moves the entry, size stays the same
+  ASSERT_FALSE(pl.upsert(make_peer(1, 400)));
+  ASSERT_EQ(4, pl.size());
+  ASSERT_EQ(3, pl.oldest().id);
+  ASSERT_TRUE(pl.get_by_index_from_newest(0, pe));
+  ASSERT_EQ(1, pe.id);
+
+  ASSERT_TRUE(pl.erase(make_peer(3, 0).adr));
+  ASSERT_FALSE(pl.erase(make_peer(3, 0).adr));
+  ASSERT_EQ(2, pl.oldest().id);
+  ASSERT_EQ(nullptr, pl.find(make_peer(3, 0).adr));
+  ASSERT_NE(nullptr, pl.find(make_peer(4, 0).adr));
+}
+
+TEST(peer_list, gray_list_is_trimmed_by_age)
+{
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  std::list<nodetool::peerlist_entry> outer_bs;
+  for (uint32_t i = 0; i != P2P_LOCAL_GRAY_PEERLIST_LIMIT + 10; ++i)
+    outer_bs.push_back(make_peer(i, 1000 + i));
+  plm.merge_peerlist(outer_bs);
+  ASSERT_EQ(P2P_LOCAL_GRAY_PEERLIST_LIMIT, plm.get_gray_peers_count());
+  ASSERT_EQ(0, plm.get_white_peers_count());
+
+  nodetool::peerlist_entry pe = AUTO_VAL_INIT(pe);
+  ASSERT_TRUE(plm.get_gray_peer_by_index(pe, P2P_LOCAL_GRAY_PEERLIST_LIMIT - 1));
+  ASSERT_EQ(10, pe.id);
+}
+
+TEST(peer_list, journal_replay_restores_changes)
+{
+  std::string journal_path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  plm.append_with_peer_gray(make_peer(1, 100));
+  plm.append_with_peer_gray(make_peer(2, 200));
+  ASSERT_TRUE(plm.flush_journal(journal_path));
+  plm.append_with_peer_white(make_peer(1, 300));
+  plm.append_with_peer_gray(make_peer(3, 400));
+  ASSERT_TRUE(plm.flush_journal(journal_path));
+  ASSERT_EQ(5, plm.get_journal_file_records());
+
+  nodetool::peerlist_manager restored;
+  restored.init(false);
+  ASSERT_TRUE(restored.replay_journal(journal_path));
+  ASSERT_EQ(1, restored.get_white_peers_count());
+  ASSERT_EQ(2, restored.get_gray_peers_count());
+
+  std::list<nodetool::peerlist_entry> gray, white;
+  restored.get_peerlist_full(gray, white);
+  ASSERT_EQ(1, white.front().id);
+  ASSERT_EQ(3, gray.front().id);
+  ASSERT_EQ(2, gray.back().id);
+
+  // torn tail is ignored
+  {
+    std::ofstream f(journal_path, std::ios_base::binary | std::ios_base::app);
+    f.write("\x00\x01\x02", 3);
+  }
+  nodetool::peerlist_manager restored_torn;
+  ASSERT_TRUE(restored_torn.replay_journal(journal_path));
+  ASSERT_EQ(5, restored_torn.get_journal_file_records());
+
+  // journal is dropped only for a serialized snapshot
+  ASSERT_FALSE(plm.on_snapshot_stored(journal_path));
+  ASSERT_TRUE(boost::filesystem::exists(journal_path));
+  std::string state_path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+  ASSERT_TRUE(tools::serialize_obj_to_file(plm, state_path));
+  ASSERT_TRUE(plm.on_snapshot_stored(journal_path));
+  ASSERT_EQ(0, plm.get_journal_file_records());
+  ASSERT_FALSE(boost::filesystem::exists(journal_path));
+  boost::filesystem::remove(state_path);
+}
+
+TEST(peer_list, journal_of_another_snapshot_is_ignored)
+{
+  std::string state_path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+  std::string journal_path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  plm.append_with_peer_gray(make_peer(1, 100));
+  ASSERT_TRUE(plm.flush_journal(journal_path));
+  plm.append_with_peer_gray(make_peer(2, 200));
+  ASSERT_TRUE(tools::serialize_obj_to_file(plm, state_path));
+  // changed after the snapshot was taken, has to stay in the journal
+  plm.append_with_peer_gray(make_peer(3, 300));
+  // the journal file belongs to the old snapshot until the new one is in place
+  ASSERT_FALSE(plm.flush_journal(journal_path));
+
+  // crash before the old journal is removed: it doesn't match the new snapshot
+  {
+    nodetool::peerlist_manager restored;
+    ASSERT_TRUE(tools::unserialize_obj_from_file(restored, state_path));
+    ASSERT_TRUE(restored.replay_journal(journal_path));
+    ASSERT_EQ(0, restored.get_journal_file_records());
+    ASSERT_EQ(2, restored.get_gray_peers_count());
+    ASSERT_FALSE(boost::filesystem::exists(journal_path));
+  }
+
+  ASSERT_TRUE(plm.on_snapshot_stored(journal_path));
+  ASSERT_FALSE(boost::filesystem::exists(journal_path));
+  ASSERT_TRUE(plm.flush_journal(journal_path));
+  ASSERT_EQ(1, plm.get_journal_file_records());
+
+  nodetool::peerlist_manager restored;
+  ASSERT_TRUE(tools::unserialize_obj_from_file(restored, state_path));
+  ASSERT_TRUE(restored.replay_journal(journal_path));
+  ASSERT_EQ(1, restored.get_journal_file_records());
+  ASSERT_EQ(3, restored.get_gray_peers_count());
+  boost::filesystem::remove(state_path);
+  boost::filesystem::remove(journal_path);
+}
+
+TEST(peer_list, discarded_snapshot_keeps_journal)
+{
+  std::string state_path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+  std::string journal_path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path()).string();
+
+  nodetool::peerlist_manager plm;
+  plm.init(false);
+  plm.append_with_peer_gray(make_peer(1, 100));
+  ASSERT_TRUE(plm.flush_journal(journal_path));
+  plm.append_with_peer_gray(make_peer(2, 200));
+  ASSERT_TRUE(tools::serialize_obj_to_file(plm, state_path));
+  ASSERT_FALSE(plm.flush_journal(journal_path));
+
+  // snapshot couldn't be put into place, changes go on to the old journal
+  plm.on_snapshot_discarded();
+  ASSERT_FALSE(plm.on_snapshot_stored(journal_path));
+  ASSERT_TRUE(plm.flush_journal(journal_path));
+  ASSERT_EQ(2, plm.get_journal_file_records());
+
+  nodetool::peerlist_manager restored;
+  restored.init(false);
+  ASSERT_TRUE(restored.replay_journal(journal_path));
+  ASSERT_EQ(2, restored.get_gray_peers_count());
+  boost::filesystem::remove(state_path);
+  boost::filesystem::remove(journal_path);
+}
+
+TEST(peer_list, hashed_list_places_older_entries)
+{
+  nodetool::peers_hashed_list pl;
+  time_t times[] = {500, 100, 300, 100, 700, 0, 300};
+  for (uint32_t i = 0; i != sizeof(times) / sizeof(times[0]); ++i)
+    pl.upsert(make_peer(i, times[i]));
+
+  // oldest first, same last_seen in the order of upserts
+  uint32_t expected_order[] = {5, 1, 3, 2, 6, 0, 4};
+  std::vector<uint32_t> order;
+  pl.for_each_oldest_first([&](const nodetool::peerlist_entry& pe) { order.push_back(static_cast<uint32_t>(pe.id)); return true; });
+  ASSERT_EQ(std::vector<uint32_t>(expected_order, expected_order + 7), order);
+
+  // moved back in time
+  ASSERT_FALSE(pl.upsert(make_peer(4, 200)));
+  nodetool::peerlist_entry pe = AUTO_VAL_INIT(pe);
+  ASSERT_TRUE(pl.get_by_index_from_newest(0, pe));
+  ASSERT_EQ(0, pe.id);
+  ASSERT_TRUE(pl.get_by_index_from_newest(3, pe));
+  ASSERT_EQ(4, pe.id);
+  ASSERT_EQ(5, pl.oldest().id);
+}
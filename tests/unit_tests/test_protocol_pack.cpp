@@ -6,7 +6,10 @@
 
 #include "include_base_utils.h"
 #include "currency_protocol/currency_protocol_defs.h"
+#include "currency_protocol/currency_protocol_packed.h"
+#include "crypto/hash.h"
 #include "storages/portable_storage_template_helper.h"
+#include <random>
 
 TEST(protocol_pack, protocol_pack_command) 
 {
@@ -27,3 +30,237 @@ TEST(protocol_pack, protocol_pack_command)
     ASSERT_TRUE(r.total_height == 3);
   }
 }
+
+namespace
+{
+  std::string make_blob(size_t size, char fill)
+  {
+    return std::string(size, fill);
+  }
+
+  crypto::hash make_hash(uint64_t n)
+  {
+    crypto::hash h = currency::null_hash;
+    *reinterpret_cast<uint64_t*>(&h) = n;
+    return h;
+  }
+
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request make_get_objects_response(size_t blocks_count, size_t txs_per_block)
+  {
+    currency::NOTIFY_RESPONSE_GET_OBJECTS::request r = AUTO_VAL_INIT(r);
+    r.txs.push_back(make_blob(300, 't'));
+    for (size_t i = 0; i != blocks_count; ++i)
+    {
+      currency::block_complete_entry e;
+      e.block = make_blob(200 + i, static_cast<char>(i));
+      for (size_t j = 0; j != txs_per_block; ++j)
+        e.txs.push_back(make_blob(1000 + j, static_cast<char>(j)));
+      r.blocks.push_back(e);
+    }
+    r.missed_ids.push_back(make_hash(7));
+    r.missed_ids.push_back(make_hash(8));
+    r.current_blockchain_height = 123456;
+    return r;
+  }
+}
+
+namespace currency
+{
+  bool operator==(const block_complete_entry& a, const block_complete_entry& b)
+  {
+    return a.block == b.block && a.txs == b.txs;
+  }
+}
+
+TEST(protocol_pack, packed_new_block_round_trip)
+{
+  currency::NOTIFY_NEW_BLOCK::request r = AUTO_VAL_INIT(r);
+  r.b.block = make_blob(250, 'b');
+  r.b.txs.push_back(make_blob(500, 'x'));
+  r.b.txs.push_back(std::string());
+  r.current_blockchain_height = 300000;
+  r.hop = 3;
+
+  std::string buff;
+  ASSERT_TRUE(currency::store_protocol_payload(r, buff, CURRENCY_PROTOCOL_FLAG_PACKED_BULK));
+  ASSERT_TRUE(currency::is_packed_payload(buff));
+
+  currency::NOTIFY_NEW_BLOCK::request r2 = AUTO_VAL_INIT(r2);
+  ASSERT_TRUE(currency::load_protocol_payload(buff, r2));
+  ASSERT_TRUE(r.b == r2.b);
+  ASSERT_EQ(r.current_blockchain_height, r2.current_blockchain_height);
+  ASSERT_EQ(r.hop, r2.hop);
+}
+
+TEST(protocol_pack, packed_get_objects_round_trip)
+{
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request r = make_get_objects_response(20, 3);
+  std::string buff;
+  ASSERT_TRUE(currency::pack_payload(r, buff));
+
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request r2 = AUTO_VAL_INIT(r2);
+  ASSERT_TRUE(currency::load_protocol_payload(buff, r2));
+  ASSERT_EQ(r.txs, r2.txs);
+  ASSERT_TRUE(r.blocks == r2.blocks);
+  ASSERT_EQ(r.missed_ids, r2.missed_ids);
+  ASSERT_EQ(r.current_blockchain_height, r2.current_blockchain_height);
+}
+
+TEST(protocol_pack, packed_chain_entry_round_trip)
+{
+  currency::NOTIFY_RESPONSE_CHAIN_ENTRY::request r = AUTO_VAL_INIT(r);
+  r.start_height = 1000;
+  r.total_height = 250000;
+  for (uint64_t i = 0; i != 1000; ++i)
+    r.m_block_ids.push_back(make_hash(i));
+
+  std::string buff;
+  ASSERT_TRUE(currency::pack_payload(r, buff));
+  // header + two varints + count + raw hashes, no per-item overhead
+  ASSERT_GT(buff.size(), r.m_block_ids.size() * sizeof(crypto::hash));
+  ASSERT_LT(buff.size(), r.m_block_ids.size() * sizeof(crypto::hash) + 20);
+
+  currency::NOTIFY_RESPONSE_CHAIN_ENTRY::request r2 = AUTO_VAL_INIT(r2);
+  ASSERT_TRUE(currency::load_protocol_payload(buff, r2));
+  ASSERT_EQ(r.start_height, r2.start_height);
+  ASSERT_EQ(r.total_height, r2.total_height);
+  ASSERT_EQ(r.m_block_ids, r2.m_block_ids);
+}
+
+TEST(protocol_pack, legacy_payload_is_still_accepted)
+{
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request r = make_get_objects_response(3, 2);
+  std::string buff;
+  ASSERT_TRUE(currency::store_protocol_payload(r, buff, 0));
+  ASSERT_FALSE(currency::is_packed_payload(buff));
+
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request r2 = AUTO_VAL_INIT(r2);
+  ASSERT_TRUE(currency::load_protocol_payload(buff, r2));
+  ASSERT_TRUE(r.blocks == r2.blocks);
+  ASSERT_EQ(r.missed_ids, r2.missed_ids);
+}
+
+TEST(protocol_pack, malformed_packed_payload_is_rejected)
+{
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request r = make_get_objects_response(5, 2);
+  std::string buff;
+  ASSERT_TRUE(currency::pack_payload(r, buff));
+
+  // every truncation must fail
+  for (size_t len = 0; len < buff.size(); len += 7)
+  {
+    currency::NOTIFY_RESPONSE_GET_OBJECTS::request r2 = AUTO_VAL_INIT(r2);
+    ASSERT_FALSE(currency::unpack_payload(buff.substr(0, len), r2));
+  }
+
+  // trailing garbage
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request r3 = AUTO_VAL_INIT(r3);
+  ASSERT_FALSE(currency::unpack_payload(buff + "x", r3));
+
+  // payload of another command
+  currency::NOTIFY_NEW_BLOCK::request nb = AUTO_VAL_INIT(nb);
+  ASSERT_FALSE(currency::unpack_payload(buff, nb));
+
+  // forged huge count must not be trusted
+  std::string forged;
+  currency::packed_writer w(forged);
+  currency::write_packed_header(w, forged, currency::NOTIFY_RESPONSE_CHAIN_ENTRY::ID);
+  w.write_varint(1);
+  w.write_varint(2);
+  w.write_varint(std::numeric_limits<uint64_t>::max() / 2);
+  currency::NOTIFY_RESPONSE_CHAIN_ENTRY::request ce = AUTO_VAL_INIT(ce);
+  ASSERT_FALSE(currency::unpack_payload(forged, ce));
+  ASSERT_TRUE(ce.m_block_ids.empty());
+}
+
+TEST(protocol_pack, compressed_round_trip)
+{
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request r = make_get_objects_response(20, 3);
+  const uint32_t flags[] = {CURRENCY_PROTOCOL_FLAG_COMPRESSED, CURRENCY_PROTOCOL_FLAG_COMPRESSED | CURRENCY_PROTOCOL_FLAG_PACKED_BULK};
+  for (uint32_t f : flags)
+  {
+    std::string buff;
+    ASSERT_TRUE(currency::store_protocol_payload(r, buff, f));
+    ASSERT_TRUE(currency::is_compressed_payload(buff));
+
+    currency::NOTIFY_RESPONSE_GET_OBJECTS::request r2 = AUTO_VAL_INIT(r2);
+    ASSERT_TRUE(currency::load_protocol_payload(buff, r2));
+    ASSERT_EQ(r.txs, r2.txs);
+    ASSERT_TRUE(r.blocks == r2.blocks);
+    ASSERT_EQ(r.missed_ids, r2.missed_ids);
+    ASSERT_EQ(r.current_blockchain_height, r2.current_blockchain_height);
+  }
+}
+
+TEST(protocol_pack, only_worthy_payload_is_compressed)
+{
+  const uint32_t flags = CURRENCY_PROTOCOL_FLAG_COMPRESSED | CURRENCY_PROTOCOL_FLAG_PACKED_BULK;
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request r = make_get_objects_response(0, 0);
+  std::string buff;
+  ASSERT_TRUE(currency::store_protocol_payload(r, buff, flags));
+  ASSERT_LT(buff.size(), CURRENCY_PROTOCOL_COMPRESSION_THRESHOLD);
+  ASSERT_FALSE(currency::is_compressed_payload(buff));
+  ASSERT_TRUE(currency::is_packed_payload(buff));
+
+  // incompressible payload above threshold goes as is
+  std::mt19937 rng(2);
+  r.missed_ids.clear();
+  r.txs.front().resize(CURRENCY_PROTOCOL_COMPRESSION_THRESHOLD * 2);
+  for (auto& c : r.txs.front())
+    c = static_cast<char>(rng());
+  ASSERT_TRUE(currency::store_protocol_payload(r, buff, flags));
+  ASSERT_FALSE(currency::is_compressed_payload(buff));
+
+  // block ids are never compressed
+  currency::NOTIFY_RESPONSE_CHAIN_ENTRY::request ce = AUTO_VAL_INIT(ce);
+  ce.m_block_ids.resize(1000, make_hash(1));
+  ASSERT_TRUE(currency::store_protocol_payload(ce, buff, flags));
+  ASSERT_FALSE(currency::is_compressed_payload(buff));
+}
+
+TEST(protocol_pack, malformed_compressed_payload_is_rejected)
+{
+  std::string packed;
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request r = make_get_objects_response(5, 2);
+  ASSERT_TRUE(currency::pack_payload(r, packed));
+  std::string buff, out;
+  ASSERT_TRUE(currency::compress_payload(packed, buff));
+  ASSERT_TRUE(currency::decompress_payload(buff, out));
+  ASSERT_EQ(packed, out);
+
+  for (size_t len = 0; len < buff.size(); len += 11)
+    ASSERT_FALSE(currency::decompress_payload(buff.substr(0, len), out));
+  ASSERT_FALSE(currency::decompress_payload(buff + "x", out));
+
+  // stream that unpacks to more or less than claimed
+  std::string lie = buff;
+  const size_t size_pos = CURRENCY_PROTOCOL_COMPRESSED_SIGNATURE_SIZE + 1;
+  uint64_t claimed = 0;
+  const char* p = lie.data() + size_pos;
+  const char* end = lie.data() + lie.size();
+  ASSERT_LT(0, tools::read_varint<64>(p, end, claimed));
+  size_t varint_size = p - (lie.data() + size_pos);
+  std::string smaller = tools::get_varint_data(claimed - 1), bigger = tools::get_varint_data(claimed + 1);
+  ASSERT_EQ(varint_size, smaller.size());
+  ASSERT_EQ(varint_size, bigger.size());
+  ASSERT_FALSE(currency::decompress_payload(lie.replace(size_pos, varint_size, smaller), out));
+  ASSERT_FALSE(currency::decompress_payload(lie.replace(size_pos, varint_size, bigger), out));
+
+  // claimed size above packet limit is refused
+  std::string bomb(CURRENCY_PROTOCOL_COMPRESSED_SIGNATURE, CURRENCY_PROTOCOL_COMPRESSED_SIGNATURE_SIZE);
+  bomb.push_back(CURRENCY_PROTOCOL_COMPRESSED_VERSION);
+  std::string stream = buff.substr(size_pos + varint_size);
+  ASSERT_FALSE(currency::decompress_payload(bomb + tools::get_varint_data(static_cast<uint64_t>(P2P_DEFAULT_PACKET_MAX_SIZE) + 1) + stream, out));
+
+  // claimed size within the limit doesn't make it allocated up front
+  std::string out_limited;
+  ASSERT_FALSE(currency::decompress_payload(bomb + tools::get_varint_data(static_cast<uint64_t>(P2P_DEFAULT_PACKET_MAX_SIZE)) + stream, out_limited));
+  ASSERT_GE(4 * packed.size() + 2 * CURRENCY_PROTOCOL_DECOMPRESSION_STEP, out_limited.capacity());
+
+  // nested compression is not accepted
+  std::string nested;
+  std::string twice = buff + std::string(10000, 'a');
+  ASSERT_TRUE(currency::compress_payload(twice, nested));
+  currency::NOTIFY_RESPONSE_GET_OBJECTS::request r2 = AUTO_VAL_INIT(r2);
+  ASSERT_FALSE(currency::load_protocol_payload(nested, r2));
+}
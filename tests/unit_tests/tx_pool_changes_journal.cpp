@@ -0,0 +1,147 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <unordered_set>
+#include "include_base_utils.h"
+#include "currency_core/tx_pool_changes_journal.h"
+
+using currency::tx_pool_changes_journal;
+
+namespace
+{
+  const uint64_t start_version = 1000;
+
+  crypto::hash make_id(uint64_t n)
+  {
+    crypto::hash h = crypto::hash();
+    *reinterpret_cast<uint64_t*>(&h) = n + 1;
+    return h;
+  }
+
+  //mirrors pool membership the way tx_memory_pool does
+  struct test_pool
+  {
+    test_pool(size_t journal_size) : journal(start_version, journal_size)
+    {}
+
+    void add(uint64_t n)
+    {
+      ids.insert(make_id(n));
+      journal.on_change(make_id(n), true);
+    }
+
+    void remove(uint64_t n)
+    {
+      ids.erase(make_id(n));
+      journal.on_change(make_id(n), false);
+    }
+
+    bool get_changes(uint64_t since_version, std::list<crypto::hash>& added, std::list<crypto::hash>& removed)
+    {
+      added.clear();
+      removed.clear();
+      return journal.get_changes(since_version, [this](const crypto::hash& id) { return ids.count(id) != 0; }, added, removed);
+    }
+
+    std::unordered_set<crypto::hash> ids;
+    tx_pool_changes_journal journal;
+  };
+}
+
+TEST(tx_pool_changes_journal, reports_changes_since_version)
+{
+  test_pool pool(100);
+  ASSERT_EQ(start_version, pool.journal.get_version());
+  pool.add(1);
+  pool.add(2);
+  uint64_t seen = pool.journal.get_version();
+  ASSERT_EQ(start_version + 2, seen);
+  pool.add(3);
+  pool.remove(1);
+
+  std::list<crypto::hash> added, removed;
+  ASSERT_TRUE(pool.get_changes(seen, added, removed));
+  ASSERT_EQ(std::list<crypto::hash>(1, make_id(3)), added);
+  ASSERT_EQ(std::list<crypto::hash>(1, make_id(1)), removed);
+
+  ASSERT_TRUE(pool.get_changes(start_version, added, removed));
+  ASSERT_EQ(2, added.size());
+  ASSERT_TRUE(removed.empty());
+
+  ASSERT_TRUE(pool.get_changes(pool.journal.get_version(), added, removed));
+  ASSERT_TRUE(added.empty());
+  ASSERT_TRUE(removed.empty());
+}
+
+TEST(tx_pool_changes_journal, add_and_remove_inside_window_net_out)
+{
+  test_pool pool(100);
+  pool.add(1);
+  uint64_t seen = pool.journal.get_version();
+  //appeared and left while client wasn't looking
+  pool.add(2);
+  pool.remove(2);
+  //left and came back
+  pool.remove(1);
+  pool.add(1);
+
+  std::list<crypto::hash> added, removed;
+  ASSERT_TRUE(pool.get_changes(seen, added, removed));
+  ASSERT_TRUE(added.empty());
+  ASSERT_TRUE(removed.empty());
+
+  //but removal of tx known at since_version is still reported
+  pool.remove(1);
+  ASSERT_TRUE(pool.get_changes(seen, added, removed));
+  ASSERT_TRUE(added.empty());
+  ASSERT_EQ(std::list<crypto::hash>(1, make_id(1)), removed);
+}
+
+TEST(tx_pool_changes_journal, overflow_makes_old_versions_full_sync)
+{
+  test_pool pool(3);
+  for (uint64_t i = 0; i != 5; ++i)
+    pool.add(i);
+  //only changes 3..5 are kept, version right before them is still answerable
+  std::list<crypto::hash> added, removed;
+  ASSERT_FALSE(pool.get_changes(start_version, added, removed));
+  ASSERT_FALSE(pool.get_changes(start_version + 1, added, removed));
+  ASSERT_TRUE(pool.get_changes(start_version + 2, added, removed));
+  ASSERT_EQ(3, added.size());
+  ASSERT_EQ(make_id(2), added.front());
+  ASSERT_TRUE(removed.empty());
+}
+
+TEST(tx_pool_changes_journal, future_version_is_full_sync)
+{
+  test_pool pool(100);
+  pool.add(1);
+  std::list<crypto::hash> added, removed;
+  //e.g. version from daemon run that started later than this one
+  ASSERT_FALSE(pool.get_changes(pool.journal.get_version() + 1, added, removed));
+  ASSERT_TRUE(added.empty());
+  ASSERT_TRUE(removed.empty());
+}
+
+TEST(tx_pool_changes_journal, reset_makes_known_versions_full_sync)
+{
+  test_pool pool(100);
+  pool.add(1);
+  pool.add(2);
+  uint64_t seen = pool.journal.get_version();
+  pool.ids.clear();
+  pool.journal.reset();
+  ASSERT_LT(seen, pool.journal.get_version());
+
+  std::list<crypto::hash> added, removed;
+  ASSERT_FALSE(pool.get_changes(seen, added, removed));
+  ASSERT_FALSE(pool.get_changes(start_version, added, removed));
+  //version right after reset works again
+  seen = pool.journal.get_version();
+  pool.add(3);
+  ASSERT_TRUE(pool.get_changes(seen, added, removed));
+  ASSERT_EQ(std::list<crypto::hash>(1, make_id(3)), added);
+}
@@ -0,0 +1,239 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <boost/filesystem.hpp>
+
+#include "wallet/wallet2.h"
+#include "wallet_test_core_proxy.h"
+
+namespace
+{
+  //cached balances and get_transfers height index are checked against the plain walk over transfers and history
+  class wallet_balance_cache_test: public ::testing::Test
+  {
+  protected:
+    virtual void SetUp()
+    {
+      m_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+      boost::filesystem::create_directories(m_dir);
+      m_stranger.generate();
+      m_height = 1;
+      m_proxy.reset(new unit_test::test_core_proxy());
+      m_wallet.reset(new tools::wallet2());
+      m_wallet->generate((m_dir / "wallet").string(), "");
+      std::shared_ptr<tools::i_core_proxy> proxy = m_proxy;
+      m_wallet->set_core_proxy(proxy);
+    }
+
+    virtual void TearDown()
+    {
+      boost::system::error_code ec;
+      boost::filesystem::remove_all(m_dir, ec);
+    }
+
+    const currency::account_public_address& address() const
+    {
+      return m_wallet->get_account().get_keys().m_account_address;
+    }
+
+    currency::transaction make_payment(const std::vector<uint64_t>& amounts, uint64_t unlock_time = 0)
+    {
+      currency::transaction tx = unit_test::test_core_proxy::make_tx(m_height, std::vector<currency::account_public_address>(amounts.size(), address()), amounts);
+      tx.unlock_time = unlock_time;
+      return tx;
+    }
+
+    //spends given unspent transfers of the wallet, change goes back to it
+    currency::transaction make_spend(const std::vector<size_t>& transfer_indices, uint64_t change)
+    {
+      tools::wallet2::transfer_container transfers;
+      m_wallet->get_transfers(transfers);
+      currency::transaction tx = unit_test::test_core_proxy::make_tx(m_height, {m_stranger.get_keys().m_account_address, address()}, {1, change});
+      tx.vin.clear();
+      for (size_t i : transfer_indices)
+      {
+        currency::txin_to_key in = AUTO_VAL_INIT(in);
+        in.amount = transfers[i].amount();
+        in.k_image = transfers[i].m_key_image;
+        tx.vin.push_back(in);
+      }
+      return tx;
+    }
+
+    void add_block(const std::vector<currency::transaction>& txs = std::vector<currency::transaction>())
+    {
+      m_proxy->add_block(unit_test::test_core_proxy::make_tx(m_height, {m_stranger.get_keys().m_account_address}, {1}), txs);
+      ++m_height;
+    }
+
+    void add_blocks(size_t count)
+    {
+      for (size_t i = 0; i != count; ++i)
+        add_block();
+    }
+
+    //blocks from height on are replaced by empty ones, as after reorganization
+    void replace_blocks(uint64_t height, size_t new_count)
+    {
+      m_proxy->pop_blocks(static_cast<size_t>(m_height - height));
+      m_height = height;
+      add_blocks(new_count);
+    }
+
+    void expect_balances_recomputed()
+    {
+      tools::wallet2::transfer_container transfers;
+      m_wallet->get_transfers(transfers);
+      uint64_t chain_size = m_wallet->get_blockchain_current_height();
+      uint64_t unspent = 0;
+      uint64_t unlocked = 0;
+      for (const auto& td : transfers)
+      {
+        if (td.m_spent)
+          continue;
+        unspent += td.amount();
+        uint64_t unlock_time = td.m_tx.unlock_time;
+        bool spendtime_unlocked = unlock_time < CURRENCY_MAX_BLOCK_NUMBER ? unlock_time <= chain_size - 1 + CURRENCY_LOCKED_TX_ALLOWED_DELTA_BLOCKS :
+          unlock_time <= static_cast<uint64_t>(time(nullptr)) + CURRENCY_LOCKED_TX_ALLOWED_DELTA_SECONDS;
+        if (spendtime_unlocked && td.m_block_height + DEFAULT_TX_SPENDABLE_AGE <= chain_size)
+          unlocked += td.amount();
+      }
+      EXPECT_EQ(unspent, m_wallet->balance());
+      EXPECT_EQ(unlocked, m_wallet->unlocked_balance());
+    }
+
+    static void expect_same(const std::list<tools::wallet_rpc::wallet_transfer_info>& expected, const std::list<tools::wallet_rpc::wallet_transfer_info>& actual)
+    {
+      ASSERT_EQ(expected.size(), actual.size());
+      auto a = actual.begin();
+      for (const auto& e : expected)
+      {
+        ASSERT_EQ(e.tx_hash, a->tx_hash);
+        ASSERT_EQ(e.height, a->height);
+        ASSERT_EQ(e.amount, a->amount);
+        ++a;
+      }
+    }
+
+    //height filter gives the same entries in the same order as filtering the whole history
+    void expect_height_filter_recomputed(uint64_t min_height, uint64_t max_height)
+    {
+      tools::wallet_rpc::COMMAND_RPC_GET_TRANSFERS::request req = AUTO_VAL_INIT(req);
+      req.in = true;
+      req.out = true;
+      tools::wallet_rpc::COMMAND_RPC_GET_TRANSFERS::response all = AUTO_VAL_INIT(all);
+      ASSERT_TRUE(m_wallet->get_transfers(req, all));
+
+      auto in_range = [&](const tools::wallet_rpc::wallet_transfer_info& wti) { return wti.height && min_height <= wti.height && wti.height <= max_height; };
+      tools::wallet_rpc::COMMAND_RPC_GET_TRANSFERS::response expected = AUTO_VAL_INIT(expected);
+      std::copy_if(all.in.begin(), all.in.end(), std::back_inserter(expected.in), in_range);
+      std::copy_if(all.out.begin(), all.out.end(), std::back_inserter(expected.out), in_range);
+
+      req.filter_by_height = true;
+      req.min_height = min_height;
+      req.max_height = max_height;
+      tools::wallet_rpc::COMMAND_RPC_GET_TRANSFERS::response filtered = AUTO_VAL_INIT(filtered);
+      ASSERT_TRUE(m_wallet->get_transfers(req, filtered));
+      expect_same(expected.in, filtered.in);
+      expect_same(expected.out, filtered.out);
+    }
+
+    void expect_height_filters_recomputed()
+    {
+      for (uint64_t min_height = 0; min_height <= m_height; min_height += 3)
+      {
+        for (uint64_t max_height = min_height; max_height <= m_height + 1; max_height += 4)
+          expect_height_filter_recomputed(min_height, max_height);
+      }
+      expect_height_filter_recomputed(5, 4);
+    }
+
+    boost::filesystem::path m_dir;
+    currency::account_base m_stranger;
+    std::shared_ptr<unit_test::test_core_proxy> m_proxy;
+    std::shared_ptr<tools::wallet2> m_wallet;
+    uint64_t m_height;
+  };
+}
+
+TEST_F(wallet_balance_cache_test, balances_follow_locks_spends_and_detach)
+{
+  //unlocked after spendable age, locked by height, locked by time far in the future
+  add_block({make_payment({100, 200})});
+  add_block({make_payment({1000}, 30), make_payment({5000}, time(nullptr) + 365 * 24 * 60 * 60)});
+  m_wallet->refresh();
+  expect_balances_recomputed();
+  ASSERT_EQ(6300, m_wallet->balance());
+  ASSERT_EQ(0, m_wallet->unlocked_balance());
+
+  //transfers unlock one by one as blocks come
+  for (size_t i = 0; i != 30; ++i)
+  {
+    add_block();
+    m_wallet->refresh();
+    expect_balances_recomputed();
+  }
+  ASSERT_EQ(1300, m_wallet->unlocked_balance());
+
+  //spend of 100 and 200 with change 50
+  add_block({make_spend({0, 1}, 50)});
+  m_wallet->refresh();
+  expect_balances_recomputed();
+  ASSERT_EQ(6050, m_wallet->balance());
+  ASSERT_EQ(1000, m_wallet->unlocked_balance());
+  add_blocks(DEFAULT_TX_SPENDABLE_AGE);
+  m_wallet->refresh();
+  expect_balances_recomputed();
+  ASSERT_EQ(1050, m_wallet->unlocked_balance());
+
+  //spend with its change is detached
+  replace_blocks(m_height - DEFAULT_TX_SPENDABLE_AGE - 1, 2);
+  m_wallet->refresh();
+  expect_balances_recomputed();
+  ASSERT_GT(6050, m_wallet->balance());
+
+  //deeper detach makes height locked transfer locked again
+  replace_blocks(20, 1);
+  m_wallet->refresh();
+  expect_balances_recomputed();
+  ASSERT_GT(1000, m_wallet->unlocked_balance());
+
+  //payments themselves are detached
+  replace_blocks(1, 3);
+  m_wallet->refresh();
+  expect_balances_recomputed();
+  ASSERT_EQ(0, m_wallet->balance());
+  ASSERT_EQ(0, m_wallet->unlocked_balance());
+}
+
+TEST_F(wallet_balance_cache_test, height_filter_follows_transfers_spends_and_detach)
+{
+  for (size_t i = 0; i != 6; ++i)
+  {
+    add_block({make_payment({10 + i}), make_payment({20 + i})});
+    add_blocks(2);
+  }
+  add_blocks(DEFAULT_TX_SPENDABLE_AGE);
+  m_wallet->refresh();
+  add_block({make_spend({0, 1}, 5)});
+  add_block();
+  add_block({make_spend({2}, 3), make_payment({40})});
+  add_blocks(2);
+  m_wallet->refresh();
+  expect_height_filters_recomputed();
+
+  //history of the replaced blocks is gone from the index too
+  replace_blocks(m_height - 4, 3);
+  add_block({make_payment({50})});
+  m_wallet->refresh();
+  expect_height_filters_recomputed();
+  expect_balances_recomputed();
+
+  replace_blocks(8, 2);
+  m_wallet->refresh();
+  expect_height_filters_recomputed();
+  expect_balances_recomputed();
+}
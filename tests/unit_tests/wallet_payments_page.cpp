@@ -0,0 +1,241 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <boost/filesystem.hpp>
+
+#include "wallet/wallet2.h"
+#include "wallet_test_core_proxy.h"
+
+namespace
+{
+  typedef std::pair<currency::payment_id_t, tools::wallet2::payment_details> payment_entry;
+
+  //walks payments the way get_bulk_payments_paged is polled: cursor is the one returned with the previous page
+  class wallet_payments_page_test: public ::testing::Test
+  {
+  protected:
+    virtual void SetUp()
+    {
+      m_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+      boost::filesystem::create_directories(m_dir);
+      m_stranger.generate();
+      m_height = 1;
+      m_proxy.reset(new unit_test::test_core_proxy());
+      m_wallet.reset(new tools::wallet2());
+      m_wallet->generate((m_dir / "wallet").string(), "");
+      std::shared_ptr<tools::i_core_proxy> proxy = m_proxy;
+      m_wallet->set_core_proxy(proxy);
+    }
+
+    virtual void TearDown()
+    {
+      boost::system::error_code ec;
+      boost::filesystem::remove_all(m_dir, ec);
+    }
+
+    //one block with a tx per payment id, all of them pay to the wallet
+    void add_block(const std::vector<currency::payment_id_t>& payment_ids)
+    {
+      uint64_t height = m_height++;
+      std::vector<currency::transaction> txs;
+      for (const auto& pid : payment_ids)
+      {
+        currency::transaction tx = unit_test::test_core_proxy::make_tx(height, {m_wallet->get_account().get_keys().m_account_address}, {100 + txs.size()});
+        //payment id goes before tx key, as construct_tx puts it
+        std::vector<uint8_t> extra;
+        ASSERT_TRUE(currency::set_payment_id_to_tx_extra(extra, pid));
+        tx.extra.insert(tx.extra.begin(), extra.begin(), extra.end());
+        txs.push_back(tx);
+
+        tools::wallet2::payment_details pd = AUTO_VAL_INIT(pd);
+        pd.m_tx_hash = currency::get_transaction_hash(tx);
+        pd.m_block_height = height;
+        m_expected.push_back(std::make_pair(pid, pd));
+      }
+      m_proxy->add_block(unit_test::test_core_proxy::make_tx(height, {m_stranger.get_keys().m_account_address}, {1}), txs);
+    }
+
+    static tools::wallet2::payment_order_key key_of(const payment_entry& p)
+    {
+      tools::wallet2::payment_order_key key = AUTO_VAL_INIT(key);
+      key.height = p.second.m_block_height;
+      key.tx_hash = p.second.m_tx_hash;
+      return key;
+    }
+
+    //expected payments of given ids above min_height, in page order
+    std::list<payment_entry> expected(const std::vector<currency::payment_id_t>& payment_ids, uint64_t min_height) const
+    {
+      std::list<payment_entry> res;
+      for (const auto& p : m_expected)
+      {
+        if (min_height < p.second.m_block_height && std::find(payment_ids.begin(), payment_ids.end(), p.first) != payment_ids.end())
+          res.push_back(p);
+      }
+      res.sort([](const payment_entry& a, const payment_entry& b) { return key_of(a) < key_of(b); });
+      return res;
+    }
+
+    //fetches pages of count payments starting after cursor until has_more is false, moves cursor after the last one
+    std::list<payment_entry> get_all_pages(const std::vector<currency::payment_id_t>& payment_ids, uint64_t min_height, size_t count, std::shared_ptr<tools::wallet2::payments_page_cursor>& cursor, size_t& pages)
+    {
+      std::list<payment_entry> res;
+      pages = 0;
+      bool has_more = true;
+      while (has_more)
+      {
+        std::list<payment_entry> page;
+        tools::wallet2::payments_page_cursor next = AUTO_VAL_INIT(next);
+        has_more = m_wallet->get_payments_page(payment_ids, min_height, cursor.get(), count, page, next);
+        ++pages;
+        EXPECT_GE(count, page.size());
+        if (has_more)
+          EXPECT_EQ(count, page.size());
+        if (page.empty())
+          break;
+        EXPECT_FALSE(key_of(page.back()) < next.key || next.key < key_of(page.back()));
+        cursor.reset(new tools::wallet2::payments_page_cursor(next));
+        res.splice(res.end(), page);
+      }
+      return res;
+    }
+
+    static void expect_same(const std::list<payment_entry>& expected, const std::list<payment_entry>& actual)
+    {
+      ASSERT_EQ(expected.size(), actual.size());
+      auto a = actual.begin();
+      for (const auto& e : expected)
+      {
+        ASSERT_EQ(e.first, a->first);
+        ASSERT_EQ(e.second.m_tx_hash, a->second.m_tx_hash);
+        ASSERT_EQ(e.second.m_block_height, a->second.m_block_height);
+        ++a;
+      }
+    }
+
+    boost::filesystem::path m_dir;
+    currency::account_base m_stranger;
+    std::shared_ptr<unit_test::test_core_proxy> m_proxy;
+    std::shared_ptr<tools::wallet2> m_wallet;
+    std::list<payment_entry> m_expected;
+    uint64_t m_height;
+  };
+}
+
+TEST_F(wallet_payments_page_test, pages_resume_from_cursor)
+{
+  std::vector<currency::payment_id_t> ids = {"id-a", "id-b"};
+  for (size_t i = 0; i != 6; ++i)
+    add_block({ids[i % 2], "id-other", ids[(i + 1) % 2]});
+  m_wallet->refresh();
+
+  std::shared_ptr<tools::wallet2::payments_page_cursor> cursor;
+  size_t pages = 0;
+  std::list<payment_entry> all = get_all_pages(ids, 0, 5, cursor, pages);
+  expect_same(expected(ids, 0), all);
+  ASSERT_EQ(12, all.size());
+  ASSERT_EQ(3, pages);
+
+  //min_height still applies on top of the cursor
+  cursor.reset();
+  all = get_all_pages(ids, 3, 4, cursor, pages);
+  expect_same(expected(ids, 3), all);
+  ASSERT_EQ(6, all.size());
+
+  //duplicated and unknown ids change nothing
+  cursor.reset();
+  all = get_all_pages({"id-a", "id-unknown", "id-a"}, 0, 2, cursor, pages);
+  expect_same(expected({"id-a"}, 0), all);
+}
+
+TEST_F(wallet_payments_page_test, ties_at_same_height_split_across_pages)
+{
+  std::vector<currency::payment_id_t> ids = {"id-a", "id-b"};
+  add_block({"id-a"});
+  add_block({"id-a", "id-b", "id-a", "id-b", "id-b"});
+  add_block({"id-b"});
+  m_wallet->refresh();
+
+  //every page boundary falls between payments of the same block
+  for (size_t count = 1; count != 5; ++count)
+  {
+    std::shared_ptr<tools::wallet2::payments_page_cursor> cursor;
+    size_t pages = 0;
+    std::list<payment_entry> all = get_all_pages(ids, 0, count, cursor, pages);
+    expect_same(expected(ids, 0), all);
+  }
+}
+
+TEST_F(wallet_payments_page_test, last_page_and_polling)
+{
+  std::vector<currency::payment_id_t> ids = {"id-a"};
+  add_block({"id-a", "id-a"});
+  add_block({"id-a", "id-a"});
+  m_wallet->refresh();
+
+  //exactly full last page doesn't report more
+  std::list<payment_entry> page;
+  tools::wallet2::payments_page_cursor next = AUTO_VAL_INIT(next);
+  ASSERT_FALSE(m_wallet->get_payments_page(ids, 0, nullptr, 4, page, next));
+  ASSERT_EQ(4, page.size());
+  page.clear();
+  ASSERT_TRUE(m_wallet->get_payments_page(ids, 0, nullptr, 3, page, next));
+  ASSERT_EQ(3, page.size());
+
+  //past the last payment: empty page
+  std::shared_ptr<tools::wallet2::payments_page_cursor> cursor;
+  size_t pages = 0;
+  ASSERT_EQ(4, get_all_pages(ids, 0, 2, cursor, pages).size());
+  ASSERT_EQ(2, pages);
+  page.clear();
+  ASSERT_FALSE(m_wallet->get_payments_page(ids, 0, cursor.get(), 2, page, next));
+  ASSERT_TRUE(page.empty());
+  ASSERT_EQ(cursor->key.height, next.key.height);
+  ASSERT_EQ(cursor->block_hash, next.block_hash);
+
+  //new payments show up after the kept cursor
+  add_block({"id-a"});
+  m_wallet->refresh();
+  std::list<payment_entry> tail = get_all_pages(ids, 0, 2, cursor, pages);
+  ASSERT_EQ(1, tail.size());
+  ASSERT_EQ(expected(ids, 0).back().second.m_tx_hash, tail.front().second.m_tx_hash);
+}
+
+TEST_F(wallet_payments_page_test, cursor_of_detached_block_is_stale)
+{
+  std::vector<currency::payment_id_t> ids = {"id-a"};
+  for (size_t i = 0; i != 4; ++i)
+    add_block({"id-a"});
+  m_wallet->refresh();
+
+  //cursors after blocks 1 and 2
+  std::list<payment_entry> page;
+  tools::wallet2::payments_page_cursor below_fork = AUTO_VAL_INIT(below_fork);
+  tools::wallet2::payments_page_cursor at_fork = AUTO_VAL_INIT(at_fork);
+  ASSERT_TRUE(m_wallet->get_payments_page(ids, 0, nullptr, 1, page, below_fork));
+  page.clear();
+  ASSERT_TRUE(m_wallet->get_payments_page(ids, 0, &below_fork, 1, page, at_fork));
+  ASSERT_EQ(2, at_fork.key.height);
+
+  //blocks 2-4 are replaced, new block 2 has two payments that sort anywhere around the old one
+  m_proxy->pop_blocks(3);
+  m_expected.resize(1);
+  m_height = 2;
+  add_block({"id-a", "id-a"});
+  add_block({"id-a"});
+  m_wallet->refresh();
+
+  ASSERT_TRUE(m_wallet->is_payments_cursor_valid(below_fork));
+  ASSERT_FALSE(m_wallet->is_payments_cursor_valid(at_fork));
+  page.clear();
+  tools::wallet2::payments_page_cursor next = AUTO_VAL_INIT(next);
+  ASSERT_THROW(m_wallet->get_payments_page(ids, 0, &at_fork, 10, page, next), tools::error::wallet_common_error);
+
+  //cursor below the fork goes on with the new blocks
+  std::shared_ptr<tools::wallet2::payments_page_cursor> cursor(new tools::wallet2::payments_page_cursor(below_fork));
+  size_t pages = 0;
+  expect_same(expected(ids, 1), get_all_pages(ids, 0, 2, cursor, pages));
+}
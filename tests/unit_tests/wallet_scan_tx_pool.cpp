@@ -0,0 +1,209 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <boost/filesystem.hpp>
+
+#include "currency_core/tx_pool_changes_journal.h"
+#include "wallet/wallet2.h"
+#include "wallet_test_core_proxy.h"
+
+namespace
+{
+  //daemon with pool, answers get_tx_pool_changes like tx_memory_pool does, unless it is "too old" to have it
+  class pool_core_proxy: public unit_test::test_core_proxy
+  {
+  public:
+    pool_core_proxy(bool has_pool_changes):m_has_pool_changes(has_pool_changes), m_journal(100, 10), m_pool_changes_calls(0), m_pool_calls(0), m_last_since_version(0)
+    {}
+
+    crypto::hash add_to_pool(const currency::transaction& tx)
+    {
+      crypto::hash id = currency::get_transaction_hash(tx);
+      m_pool[id] = tx;
+      m_journal.on_change(id, true);
+      return id;
+    }
+
+    void remove_from_pool(const crypto::hash& id)
+    {
+      m_pool.erase(id);
+      m_journal.on_change(id, false);
+    }
+
+    //as after purge or daemon restart
+    void clear_pool()
+    {
+      m_pool.clear();
+      m_journal.reset();
+    }
+
+    size_t pool_changes_calls() const { return m_pool_changes_calls; }
+    size_t pool_calls() const { return m_pool_calls; }
+    uint64_t last_since_version() const { return m_last_since_version; }
+    uint64_t version() const { return m_journal.get_version(); }
+
+    virtual bool call_COMMAND_RPC_GET_TX_POOL(const currency::COMMAND_RPC_GET_TX_POOL::request& rqt, currency::COMMAND_RPC_GET_TX_POOL::response& rsp)
+    {
+      ++m_pool_calls;
+      for (auto& tx : m_pool)
+        rsp.txs.push_back(currency::tx_to_blob(tx.second));
+      rsp.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+    virtual bool call_COMMAND_RPC_GET_TX_POOL_CHANGES(const currency::COMMAND_RPC_GET_TX_POOL_CHANGES::request& rqt, currency::COMMAND_RPC_GET_TX_POOL_CHANGES::response& rsp)
+    {
+      ++m_pool_changes_calls;
+      if (!m_has_pool_changes)
+        return false;
+      m_last_since_version = rqt.since_version;
+      rsp.version = m_journal.get_version();
+      rsp.full_sync = !m_journal.get_changes(rqt.since_version, [this](const crypto::hash& id) { return m_pool.count(id) != 0; }, rsp.added_ids, rsp.removed_ids);
+      if (rsp.full_sync)
+      {
+        for (auto& tx : m_pool)
+          rsp.added_ids.push_back(tx.first);
+      }
+      for (auto& id : rsp.added_ids)
+        rsp.added_txs.push_back(currency::tx_to_blob(m_pool[id]));
+      rsp.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+
+  private:
+    bool m_has_pool_changes;
+    std::unordered_map<crypto::hash, currency::transaction> m_pool;
+    currency::tx_pool_changes_journal m_journal;
+    size_t m_pool_changes_calls;
+    size_t m_pool_calls;
+    uint64_t m_last_since_version;
+  };
+
+  struct transfers_counter: public tools::i_wallet2_callback
+  {
+    transfers_counter():count(0)
+    {}
+    virtual void on_transfer2(const tools::wallet_rpc::wallet_transfer_info& wti) { ++count; }
+    size_t count;
+  };
+
+  class wallet_scan_tx_pool_test: public ::testing::Test
+  {
+  protected:
+    virtual void SetUp()
+    {
+      m_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+      boost::filesystem::create_directories(m_dir);
+      m_stranger.generate();
+    }
+
+    virtual void TearDown()
+    {
+      boost::system::error_code ec;
+      boost::filesystem::remove_all(m_dir, ec);
+    }
+
+    void make_wallet(bool has_pool_changes)
+    {
+      m_proxy.reset(new pool_core_proxy(has_pool_changes));
+      m_wallet.reset(new tools::wallet2());
+      m_wallet->generate((m_dir / "wallet").string(), "");
+      std::shared_ptr<tools::i_core_proxy> proxy = m_proxy;
+      m_wallet->set_core_proxy(proxy);
+      m_wallet->callback(&m_transfers);
+    }
+
+    currency::transaction make_tx(uint64_t amount)
+    {
+      return unit_test::test_core_proxy::make_tx(0, {m_wallet->get_account().get_keys().m_account_address}, {amount});
+    }
+
+    currency::transaction make_stranger_tx(uint64_t amount)
+    {
+      return unit_test::test_core_proxy::make_tx(0, {m_stranger.get_keys().m_account_address}, {amount});
+    }
+
+    boost::filesystem::path m_dir;
+    currency::account_base m_stranger;
+    std::shared_ptr<pool_core_proxy> m_proxy;
+    std::shared_ptr<tools::wallet2> m_wallet;
+    transfers_counter m_transfers;
+  };
+}
+
+TEST_F(wallet_scan_tx_pool_test, delta_scans_apply_additions_and_removals)
+{
+  make_wallet(true);
+  crypto::hash first = m_proxy->add_to_pool(make_tx(500));
+  m_proxy->add_to_pool(make_stranger_tx(1000));
+  m_wallet->scan_tx_pool();
+  ASSERT_EQ(0, m_proxy->last_since_version());
+  ASSERT_EQ(1, m_transfers.count);
+  ASSERT_EQ(500, m_wallet->unconfirmed_balance());
+
+  uint64_t seen = m_proxy->version();
+  m_proxy->add_to_pool(make_tx(300));
+  m_wallet->scan_tx_pool();
+  ASSERT_EQ(seen, m_proxy->last_since_version());
+  //only new tx is reported, earlier one still counts
+  ASSERT_EQ(2, m_transfers.count);
+  ASSERT_EQ(800, m_wallet->unconfirmed_balance());
+
+  m_proxy->remove_from_pool(first);
+  m_wallet->scan_tx_pool();
+  ASSERT_EQ(2, m_transfers.count);
+  ASSERT_EQ(300, m_wallet->unconfirmed_balance());
+
+  //nothing changed
+  m_wallet->scan_tx_pool();
+  ASSERT_EQ(m_proxy->version(), m_proxy->last_since_version());
+  ASSERT_EQ(2, m_transfers.count);
+  ASSERT_EQ(300, m_wallet->unconfirmed_balance());
+  ASSERT_EQ(4, m_proxy->pool_changes_calls());
+  ASSERT_EQ(0, m_proxy->pool_calls());
+}
+
+TEST_F(wallet_scan_tx_pool_test, full_sync_drops_transfers_gone_from_pool)
+{
+  make_wallet(true);
+  m_proxy->add_to_pool(make_tx(500));
+  m_wallet->scan_tx_pool();
+  ASSERT_EQ(500, m_wallet->unconfirmed_balance());
+
+  //wallet's version is from before clear, daemon answers with whole pool
+  m_proxy->clear_pool();
+  m_proxy->add_to_pool(make_tx(200));
+  m_wallet->scan_tx_pool();
+  ASSERT_EQ(2, m_transfers.count);
+  ASSERT_EQ(200, m_wallet->unconfirmed_balance());
+
+  //after delta scan same tx isn't reported again
+  m_wallet->scan_tx_pool();
+  ASSERT_EQ(2, m_transfers.count);
+  ASSERT_EQ(200, m_wallet->unconfirmed_balance());
+}
+
+TEST_F(wallet_scan_tx_pool_test, missing_pool_changes_is_remembered)
+{
+  make_wallet(false);
+  crypto::hash id = m_proxy->add_to_pool(make_tx(500));
+  m_wallet->scan_tx_pool();
+  ASSERT_EQ(1, m_transfers.count);
+  ASSERT_EQ(500, m_wallet->unconfirmed_balance());
+
+  m_proxy->remove_from_pool(id);
+  m_proxy->add_to_pool(make_tx(100));
+  m_wallet->scan_tx_pool();
+  ASSERT_EQ(2, m_transfers.count);
+  ASSERT_EQ(100, m_wallet->unconfirmed_balance());
+  ASSERT_EQ(1, m_proxy->pool_changes_calls());
+  ASSERT_EQ(2, m_proxy->pool_calls());
+
+  //another daemon may have it
+  std::shared_ptr<tools::i_core_proxy> proxy = m_proxy;
+  m_wallet->set_core_proxy(proxy);
+  m_wallet->scan_tx_pool();
+  ASSERT_EQ(2, m_proxy->pool_changes_calls());
+}
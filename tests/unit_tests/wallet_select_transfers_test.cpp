@@ -56,4 +56,41 @@ TEST(wallet_select_indices_validate, wallet_select_indices_validate)
   set_testcase_free_amounts(found_free_amounts);
   ASSERT_EQ(0, tools::wallet2::select_indices_for_transfer(selected_indexes, found_free_amounts, 0));
 
-}
\ No newline at end of file
+}
+namespace
+{
+  tools::wallet2::free_transfers_index free_index_from_amounts(const std::map<uint64_t, std::list<size_t> >& free_amounts)
+  {
+    tools::wallet2::free_transfers_index free_index;
+    for (const auto& a : free_amounts)
+      free_index[a.first].insert(a.second.begin(), a.second.end());
+    return free_index;
+  }
+
+  bool select_any(size_t) { return true; }
+}
+
+TEST(wallet_select_indices_validate, select_from_free_index_matches_select_indices_for_transfer)
+{
+  std::map<uint64_t, std::list<size_t> > found_free_amounts;
+  set_testcase_free_amounts(found_free_amounts);
+  const tools::wallet2::free_transfers_index free_index = free_index_from_amounts(found_free_amounts);
+
+  for (uint64_t needed_money = 0; needed_money != 60; ++needed_money)
+  {
+    std::list<size_t> expected_indexes, selected_indexes;
+    set_testcase_free_amounts(found_free_amounts);
+    uint64_t expected_money = tools::wallet2::select_indices_for_transfer(expected_indexes, found_free_amounts, needed_money);
+    uint64_t found_money = tools::wallet2::select_indices_from_free_index(selected_indexes, free_index, needed_money, select_any);
+    ASSERT_EQ(expected_money, found_money);
+    ASSERT_EQ(expected_indexes, selected_indexes);
+  }
+
+  // transfers not matching the predicate (e.g. by mix_attr) must be skipped
+  std::list<size_t> selected_indexes;
+  ASSERT_EQ(5, tools::wallet2::select_indices_from_free_index(selected_indexes, free_index, 4, [](size_t i) { return i != 103 && i != 52; }));
+  ASSERT_EQ(std::list<size_t>{ 51 }, selected_indexes);
+  selected_indexes.clear();
+  ASSERT_EQ(3, tools::wallet2::select_indices_from_free_index(selected_indexes, free_index, 100, [](size_t i) { return i < 20 && i != 11 && i != 12; }));
+  ASSERT_EQ((std::list<size_t>{ 15, 14, 13 }), selected_indexes);
+}
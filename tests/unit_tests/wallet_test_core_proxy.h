@@ -0,0 +1,137 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <atomic>
+#include <ctime>
+#include <unordered_map>
+#include <vector>
+
+#include "currency_core/currency_format_utils.h"
+#include "wallet/core_rpc_proxy.h"
+
+namespace unit_test
+{
+  //daemon of wallet tests: in-memory chain, starts with genesis, no network
+  class test_core_proxy: public tools::i_core_proxy
+  {
+  public:
+    test_core_proxy(size_t blocks_per_call = 1000):m_blocks_per_call(blocks_per_call), m_get_blocks_calls(0)
+    {
+      currency::block genesis = AUTO_VAL_INIT(genesis);
+      currency::generate_genesis_block(genesis);
+      add_block(genesis, std::vector<currency::transaction>());
+    }
+
+    //transaction without inputs that pays amounts[i] to addresses[i]
+    static currency::transaction make_tx(uint64_t height, const std::vector<currency::account_public_address>& addresses, const std::vector<uint64_t>& amounts)
+    {
+      currency::transaction tx = AUTO_VAL_INIT(tx);
+      tx.version = CURRENT_TRANSACTION_VERSION;
+      currency::txin_gen in;
+      in.height = height;
+      tx.vin.push_back(in);
+      currency::keypair txkey = currency::keypair::generate();
+      currency::add_tx_pub_key_to_extra(tx, txkey.pub);
+      for (size_t i = 0; i != addresses.size(); ++i)
+        currency::construct_tx_out(addresses[i], txkey.sec, i, amounts[i], tx);
+      return tx;
+    }
+
+    void add_block(const currency::transaction& miner_tx, const std::vector<currency::transaction>& txs)
+    {
+      currency::block b = AUTO_VAL_INIT(b);
+      b.major_version = CURRENT_BLOCK_MAJOR_VERSION;
+      b.timestamp = time(nullptr);
+      b.prev_id = get_block_hash(m_blocks.back());
+      b.miner_tx = miner_tx;
+      for (auto& tx : txs)
+        b.tx_hashes.push_back(currency::get_transaction_hash(tx));
+      add_block(b, txs);
+    }
+
+    //drops blocks from the top, blocks added after that make an alternative chain
+    void pop_blocks(size_t count)
+    {
+      for (size_t i = 0; i != count; ++i)
+      {
+        m_heights.erase(currency::get_block_hash(m_blocks.back()));
+        m_blocks.pop_back();
+        m_blobs.pop_back();
+      }
+    }
+
+    size_t get_blocks_calls() const { return m_get_blocks_calls; }
+
+    virtual bool set_connection_addr(const std::string& url) { return true; }
+    virtual bool call_COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES(const currency::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::request& rqt, currency::COMMAND_RPC_GET_TX_GLOBAL_OUTPUTS_INDEXES::response& rsp)
+    {
+      auto it = m_outs_count.find(rqt.txid);
+      if (it == m_outs_count.end())
+        return false;
+      for (size_t i = 0; i != it->second; ++i)
+        rsp.o_indexes.push_back(i);
+      rsp.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+    virtual bool call_COMMAND_RPC_GET_BLOCKS_FAST(const currency::COMMAND_RPC_GET_BLOCKS_FAST::request& rqt, currency::COMMAND_RPC_GET_BLOCKS_FAST::response& rsp)
+    {
+      ++m_get_blocks_calls;
+      //starts from the highest known block like the daemon does
+      rsp.start_height = 0;
+      for (auto& id : rqt.block_ids)
+      {
+        auto it = m_heights.find(id);
+        if (it != m_heights.end())
+        {
+          rsp.start_height = it->second;
+          break;
+        }
+      }
+      for (uint64_t h = rsp.start_height; h < m_blobs.size() && h < rsp.start_height + m_blocks_per_call; ++h)
+        rsp.blocks.push_back(m_blobs[h]);
+      rsp.current_height = m_blobs.size();
+      rsp.status = CORE_RPC_STATUS_OK;
+      return true;
+    }
+    virtual bool call_COMMAND_RPC_GET_INFO(const currency::COMMAND_RPC_GET_INFO::request& rqt, currency::COMMAND_RPC_GET_INFO::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_GET_TX_POOL(const currency::COMMAND_RPC_GET_TX_POOL::request& rqt, currency::COMMAND_RPC_GET_TX_POOL::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_GET_TX_POOL_CHANGES(const currency::COMMAND_RPC_GET_TX_POOL_CHANGES::request& rqt, currency::COMMAND_RPC_GET_TX_POOL_CHANGES::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_GET_ALIASES_BY_ADDRESS(const currency::COMMAND_RPC_GET_ALIASES_BY_ADDRESS::request& rqt, currency::COMMAND_RPC_GET_ALIASES_BY_ADDRESS::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS(const currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& rqt, currency::COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_SEND_RAW_TX(const currency::COMMAND_RPC_SEND_RAW_TX::request& rqt, currency::COMMAND_RPC_SEND_RAW_TX::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_GET_ALL_ALIASES(currency::COMMAND_RPC_GET_ALL_ALIASES::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_GET_ALIAS_DETAILS(const currency::COMMAND_RPC_GET_ALIAS_DETAILS::request& req, currency::COMMAND_RPC_GET_ALIAS_DETAILS::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_GET_TRANSACTIONS(const currency::COMMAND_RPC_GET_TRANSACTIONS::request& req, currency::COMMAND_RPC_GET_TRANSACTIONS::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_COMMAND_RPC_CHECK_KEYIMAGES(const currency::COMMAND_RPC_CHECK_KEYIMAGES::request& req, currency::COMMAND_RPC_CHECK_KEYIMAGES::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_VALIDATE_SIGNED_TEXT(const currency::COMMAND_RPC_VALIDATE_SIGNED_TEXT::request& req, currency::COMMAND_RPC_VALIDATE_SIGNED_TEXT::response& rsp) { return false; }
+    virtual bool call_COMMAND_RPC_RELAY_TXS(const currency::COMMAND_RPC_RELAY_TXS::request& req, currency::COMMAND_RPC_RELAY_TXS::response& rsp) { return false; }
+    virtual bool check_connection() { return true; }
+    virtual bool get_transfer_address(const std::string& adr_str, currency::account_public_address& addr, currency::payment_id_t& payment_id) { return false; }
+
+  private:
+    void add_block(const currency::block& b, const std::vector<currency::transaction>& txs)
+    {
+      currency::block_complete_entry e;
+      e.block = currency::block_to_blob(b);
+      m_outs_count[currency::get_transaction_hash(b.miner_tx)] = b.miner_tx.vout.size();
+      for (auto& tx : txs)
+      {
+        e.txs.push_back(currency::tx_to_blob(tx));
+        m_outs_count[currency::get_transaction_hash(tx)] = tx.vout.size();
+      }
+      m_heights[currency::get_block_hash(b)] = m_blocks.size();
+      m_blocks.push_back(b);
+      m_blobs.push_back(e);
+    }
+
+    size_t m_blocks_per_call;
+    std::atomic<size_t> m_get_blocks_calls;
+    std::vector<currency::block> m_blocks;
+    std::vector<currency::block_complete_entry> m_blobs;
+    std::unordered_map<crypto::hash, uint64_t> m_heights;
+    std::unordered_map<crypto::hash, size_t> m_outs_count;
+  };
+}
@@ -0,0 +1,151 @@
+// Copyright (c) 2012-2013 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <boost/filesystem.hpp>
+
+#include "wallet/wallets_host.h"
+#include "wallet_test_core_proxy.h"
+
+namespace
+{
+  class wallets_host_test: public ::testing::Test
+  {
+  protected:
+    virtual void SetUp()
+    {
+      m_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path();
+      boost::filesystem::create_directories(m_dir);
+    }
+
+    virtual void TearDown()
+    {
+      boost::system::error_code ec;
+      boost::filesystem::remove_all(m_dir, ec);
+    }
+
+    std::shared_ptr<tools::wallet2> make_wallet(const std::string& name)
+    {
+      std::shared_ptr<tools::wallet2> w(new tools::wallet2());
+      w->generate((m_dir / name).string(), "");
+      return w;
+    }
+
+    boost::filesystem::path m_dir;
+  };
+
+  currency::account_public_address address_of(const std::shared_ptr<tools::wallet2>& w)
+  {
+    return w->get_account().get_keys().m_account_address;
+  }
+}
+
+TEST_F(wallets_host_test, find_outs_tests_every_wallet)
+{
+  std::vector<std::shared_ptr<tools::wallet2> > wallets;
+  for (size_t i = 0; i != 3; ++i)
+    wallets.push_back(make_wallet("w" + std::to_string(i)));
+  currency::account_base stranger;
+  stranger.generate();
+
+  //block b: miner tx pays to wallet b % 3, one tx pays to wallets 0 and 2 and a stranger in between
+  std::vector<tools::parsed_block_entry> blocks(50);
+  for (size_t b = 0; b != blocks.size(); ++b)
+  {
+    blocks[b].bl.timestamp = time(nullptr);
+    blocks[b].bl.miner_tx = unit_test::test_core_proxy::make_tx(b, {address_of(wallets[b % 3])}, {100});
+    blocks[b].txs.push_back(unit_test::test_core_proxy::make_tx(b, {address_of(wallets[0]), stranger.get_keys().m_account_address, address_of(wallets[2])}, {1, 2, 3}));
+  }
+
+  for (size_t threads : {1, 4})
+  {
+    std::vector<std::vector<tools::block_found_outs> > found_outs;
+    tools::wallets_host::find_outs(blocks, wallets, found_outs, threads);
+    ASSERT_EQ(wallets.size(), found_outs.size());
+    for (size_t w = 0; w != wallets.size(); ++w)
+    {
+      ASSERT_EQ(blocks.size(), found_outs[w].size());
+      for (size_t b = 0; b != blocks.size(); ++b)
+      {
+        ASSERT_EQ(2, found_outs[w][b].size());
+        ASSERT_EQ(b % 3 == w ? std::vector<size_t>({0}) : std::vector<size_t>(), found_outs[w][b][0]);
+        std::vector<size_t> expected_tx_outs;
+        if (w != 1)
+          expected_tx_outs.push_back(w);
+        ASSERT_EQ(expected_tx_outs, found_outs[w][b][1]);
+      }
+    }
+  }
+}
+
+TEST_F(wallets_host_test, find_outs_leaves_unsupported_tx_to_wallet)
+{
+  std::vector<std::shared_ptr<tools::wallet2> > wallets;
+  wallets.push_back(make_wallet("w0"));
+  wallets.push_back(make_wallet("w1"));
+  std::vector<tools::parsed_block_entry> blocks(1);
+  blocks[0].bl.timestamp = time(nullptr);
+  blocks[0].bl.miner_tx = unit_test::test_core_proxy::make_tx(0, {address_of(wallets[0])}, {100});
+  //an output lookup_acc_outs refuses, the wallet has to meet it itself to report the error
+  currency::transaction tx = unit_test::test_core_proxy::make_tx(0, {address_of(wallets[1])}, {5});
+  tx.vout.push_back(currency::tx_out());
+  tx.vout.back().target = currency::txout_to_script();
+  blocks[0].txs.push_back(tx);
+
+  std::vector<std::vector<tools::block_found_outs> > found_outs;
+  tools::wallets_host::find_outs(blocks, wallets, found_outs, 1);
+  ASSERT_TRUE(found_outs[0].empty());
+  ASSERT_TRUE(found_outs[1].empty());
+}
+
+TEST_F(wallets_host_test, refresh_shares_batches)
+{
+  std::shared_ptr<unit_test::test_core_proxy> proxy(new unit_test::test_core_proxy(4));
+  tools::wallets_host host(proxy);
+  std::shared_ptr<tools::wallet2> a = make_wallet("a");
+  std::shared_ptr<tools::wallet2> b = make_wallet("b");
+  ASSERT_TRUE(host.add_wallet("a", a));
+  ASSERT_TRUE(host.add_wallet("b", b));
+  ASSERT_FALSE(host.add_wallet("a", b));
+
+  currency::account_base stranger;
+  stranger.generate();
+  for (uint64_t h = 1; h != 11; ++h)
+  {
+    std::vector<currency::transaction> txs;
+    txs.push_back(unit_test::test_core_proxy::make_tx(h, {address_of(a), address_of(b)}, {h, 10 * h}));
+    proxy->add_block(unit_test::test_core_proxy::make_tx(h, {stranger.get_keys().m_account_address}, {1000}), txs);
+  }
+
+  size_t blocks_fetched = 0;
+  bool ok = false;
+  ASSERT_TRUE(host.refresh(blocks_fetched, ok));
+  //both wallets take the same batches: 11 blocks by 4 with one overlapping block per call, and the final empty call
+  ASSERT_EQ(5, proxy->get_blocks_calls());
+  ASSERT_EQ(2 * 10, blocks_fetched);
+  ASSERT_EQ(11, a->get_blockchain_current_height());
+  ASSERT_EQ(11, b->get_blockchain_current_height());
+  ASSERT_EQ(55, a->balance());
+  ASSERT_EQ(550, b->balance());
+}
+
+TEST_F(wallets_host_test, refresh_loop_stops_without_waiting_interval)
+{
+  std::shared_ptr<unit_test::test_core_proxy> proxy(new unit_test::test_core_proxy());
+  tools::wallets_host host(proxy);
+  ASSERT_TRUE(host.add_wallet("a", make_wallet("a")));
+
+  std::thread loop([&host](){ host.run_refresh_loop(60 * 60 * 1000); });
+  while (!proxy->get_blocks_calls())
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  {
+    //requests hold the wallet lock, refresh is not waiting for it
+    CRITICAL_REGION_LOCAL(host.get_wallet_lock("a"));
+  }
+  host.stop();
+  loop.join();
+  ASSERT_EQ(1, proxy->get_blocks_calls());
+}